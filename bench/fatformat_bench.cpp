@@ -0,0 +1,144 @@
+// Native formatter benchmark and check (src/FatFormat.*): formats sparse image files in-process,
+// times the same image with mkfs.vfat / mkfs.exfat when they are installed, and runs
+// fsck.vfat -n / fsck.exfat -n on every native result.
+//
+//   fatformat_bench                              # vfat and exfat, 64M,1G,32G,128G images in $TMPDIR
+//   fatformat_bench --fs exfat --sizes 256M,8G --dir /mnt/scratch
+//   fatformat_bench --fs vfat /dev/loop0         # format and check a loop device instead
+//
+// Exit status 2 if any fsck reported a problem, 1 if a format failed.
+
+#include "FatFormat.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+static quint64 parseSize(const QString& s) {
+  static const QString kUnits = QStringLiteral("KMGT");
+  const int unit = kUnits.indexOf(s.right(1).toUpper());
+  const quint64 n = (unit >= 0 ? s.chopped(1) : s).toULongLong();
+  return unit >= 0 ? n << (10 * (unit + 1)) : n;
+}
+
+static QString findTool(const QStringList& names) {
+  for (const QString& n : names) {
+    QString path = QStandardPaths::findExecutable(n);
+    if (path.isEmpty()) path = QStandardPaths::findExecutable(n, {"/usr/sbin", "/sbin"});
+    if (!path.isEmpty()) return path;
+  }
+  return {};
+}
+
+// Runs `tool args...`; returns the exit code (-1 if it didn't run) and the time in ms.
+static int runTool(const QString& tool, const QStringList& args, double* ms, QString* output = nullptr) {
+  QProcess proc;
+  proc.setProcessChannelMode(QProcess::MergedChannels);
+  QElapsedTimer t;
+  t.start();
+  proc.start(tool, args);
+  if (!proc.waitForFinished(-1) || proc.exitStatus() != QProcess::NormalExit) return -1;
+  *ms = t.nsecsElapsed() / 1e6;
+  if (output) *output = QString::fromLocal8Bit(proc.readAll()).trimmed();
+  return proc.exitCode();
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("fatformat_bench");
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Benchmark and fsck-check ffrog's in-process FAT32/exFAT formatter.");
+  p.addHelpOption();
+  p.addPositionalArgument("path", "Optional block device or file to format instead of image files.", "[path]");
+  p.addOptions({
+      {"fs", "vfat, exfat or both (default).", "fs", "both"},
+      {"sizes", "Comma-separated image sizes (K/M/G/T suffixes).", "list", "64M,1G,32G,128G"},
+      {"dir", "Directory for the sparse image files (default: a temporary directory).", "dir"},
+      {"label", "Volume label.", "label", "FFROG"},
+      {"no-mkfs", "Don't time mkfs for comparison."},
+  });
+  p.process(app);
+
+  QTextStream out(stdout);
+  QList<FatFormat::Type> types;
+  for (const QString& fs : p.value("fs") == "both" ? QStringList{"vfat", "exfat"} : QStringList{p.value("fs")}) {
+    FatFormat::Type t;
+    if (!FatFormat::typeFromName(fs, &t)) {
+      out << "Unknown --fs " << fs << Qt::endl;
+      return 2;
+    }
+    types << t;
+  }
+
+  QTemporaryDir tmp;
+  const QString dir = p.isSet("dir") ? p.value("dir") : tmp.path();
+  const QStringList targets = p.positionalArguments();
+  const bool images = targets.isEmpty();
+
+  int status = 0;
+  for (FatFormat::Type type : types) {
+    const bool fat32 = type == FatFormat::Type::Fat32;
+    const QString fsck = findTool(fat32 ? QStringList{"fsck.vfat", "fsck.fat", "dosfsck"} : QStringList{"fsck.exfat", "exfatfsck"});
+    const QString mkfs = p.isSet("no-mkfs") ? QString() : findTool(fat32 ? QStringList{"mkfs.vfat", "mkfs.fat"} : QStringList{"mkfs.exfat"});
+    const QStringList mkfsArgs = fat32 ? QStringList{"-F", "32", "-I", "-n", p.value("label")} : QStringList{"-L", p.value("label")};
+    if (fsck.isEmpty()) out << FatFormat::typeName(type) << ": no fsck tool found, results are not checked" << Qt::endl;
+
+    const QStringList sizes = p.value("sizes").split(',', Qt::SkipEmptyParts);
+    const qsizetype runs = images ? sizes.size() : targets.size();
+    for (qsizetype i = 0; i < runs; ++i) {
+      const QString path = images ? QString("%1/ffrog-%2-%3.img").arg(dir, FatFormat::typeName(type), sizes[i]) : targets[i];
+      if (images) {
+        QFile f(path);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || !f.resize(static_cast<qint64>(parseSize(sizes[i])))) {
+          out << "Can't create " << path << ": " << f.errorString() << Qt::endl;
+          return 1;
+        }
+      }
+
+      double mkfsMs = -1;
+      if (!mkfs.isEmpty() && runTool(mkfs, mkfsArgs + QStringList{path}, &mkfsMs) != 0) mkfsMs = -1;
+
+      FatFormat::Options opts;
+      opts.type = type;
+      opts.label = p.value("label");
+      FatFormat::Stats stats;
+      QString err;
+      QElapsedTimer t;
+      t.start();
+      if (!FatFormat::run(path, opts, {}, &stats, &err)) {
+        out << path << ": FAILED: " << err << Qt::endl;
+        status = qMax(status, 1);
+        continue;
+      }
+      const double nativeMs = t.nsecsElapsed() / 1e6;
+
+      QString verdict = QStringLiteral("unchecked");
+      if (!fsck.isEmpty()) {
+        double fsckMs = 0;
+        QString log;
+        const int rc = runTool(fsck, {"-n", path}, &fsckMs, &log);
+        verdict = rc == 0 ? QStringLiteral("fsck clean") : QString("fsck exit %1").arg(rc);
+        if (rc != 0) {
+          out << log << Qt::endl;
+          status = 2;
+        }
+      }
+
+      out << QString("%1 %2: native %3 ms, mkfs %4; %5 [%6]")
+                 .arg(FatFormat::typeName(type), -5)
+                 .arg(images ? sizes[i] : path, 6)
+                 .arg(nativeMs, 0, 'f', 1)
+                 .arg(mkfsMs < 0 ? QStringLiteral("-") : QString::number(mkfsMs, 'f', 1) + " ms")
+                 .arg(stats.summary(), verdict)
+          << Qt::endl;
+      if (images) QFile::remove(path);
+    }
+  }
+  return status;
+}
@@ -0,0 +1,401 @@
+// Stand-in UDisks2 service for the benchmarks: presents N synthetic USB sticks (drive, whole-disk
+// block, partitions) plus a few internal disks, answers the calls ffrog makes and simulates
+// Format jobs (Job object, Progress updates) with a configurable latency.
+//
+// Runs on the session bus or on a private bus given by address, never on the system bus:
+//   dbus-run-session -- sh -c 'udisks2_mock --devices 100 & sleep 1; FFROG_UDISKS_BUS=session ffrog-cli list'
+//
+// Control interface, org.ffrog.MockUDisks2 at /org/ffrog/MockUDisks2 (not counted as calls):
+//   SetDeviceCount(u n)     add or remove sticks until there are n
+//   AddDevices(u n)         hotplug n sticks in one burst of InterfacesAdded
+//   RemoveDevices(u n)      unplug the n newest sticks
+//   SetFormatLatency(u ms)
+//   CallCount() -> t        method calls received on the UDisks2 tree, Introspect included
+//   ResetCallCount()
+//   Quit()
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusVariant>
+#include <QDBusVirtualObject>
+#include <QDateTime>
+#include <QMap>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+#include <memory>
+
+using InterfaceMap = QMap<QString, QVariantMap>;
+using ManagedObjects = QMap<QDBusObjectPath, InterfaceMap>;
+
+static const QString kService = QStringLiteral("org.freedesktop.UDisks2");
+static const QString kRootPath = QStringLiteral("/org/freedesktop/UDisks2");
+static const QString kManagerPath = QStringLiteral("/org/freedesktop/UDisks2/Manager");
+static const QString kControlPath = QStringLiteral("/org/ffrog/MockUDisks2");
+static const QString kControlIface = QStringLiteral("org.ffrog.MockUDisks2");
+static const QString kPropsIface = QStringLiteral("org.freedesktop.DBus.Properties");
+static const QString kObjectManagerIface = QStringLiteral("org.freedesktop.DBus.ObjectManager");
+static const QString kManagerIface = QStringLiteral("org.freedesktop.UDisks2.Manager");
+static const QString kBlockIface = QStringLiteral("org.freedesktop.UDisks2.Block");
+static const QString kDriveIface = QStringLiteral("org.freedesktop.UDisks2.Drive");
+static const QString kPartitionIface = QStringLiteral("org.freedesktop.UDisks2.Partition");
+static const QString kPartitionTableIface = QStringLiteral("org.freedesktop.UDisks2.PartitionTable");
+static const QString kFilesystemIface = QStringLiteral("org.freedesktop.UDisks2.Filesystem");
+static const QString kJobIface = QStringLiteral("org.freedesktop.UDisks2.Job");
+
+static constexpr quint64 kStickBytes = 16'000'000'000ull;
+
+// sda..sdz, sdaa..sdzz, sdaaa...: enough names for thousands of sticks.
+static QString diskName(int index) {
+  QString letters;
+  for (int n = index + 1; n > 0; n = (n - 1) / 26) letters.prepend(QChar('a' + (n - 1) % 26));
+  return "sd" + letters;
+}
+
+static QByteArray nulTerminated(const QString& s) {
+  QByteArray b = s.toLocal8Bit();
+  b.append('\0');
+  return b;
+}
+
+class MockUDisks2 final : public QDBusVirtualObject {
+public:
+  struct Config {
+    int partitions = 1;
+    bool mounted = false;
+    int formatLatencyMs = 200;
+  };
+
+  MockUDisks2(const QDBusConnection& conn, const Config& cfg) : conn_(conn), cfg_(cfg) {
+    objects_[kManagerPath][kManagerIface] = QVariantMap{{"Version", QStringLiteral("2.10.0-mock")}};
+  }
+
+  int stickCount() const { return sticks_.size(); }
+
+  void addInternalDisk(int index) {
+    // NVMe disks with a non-USB ConnectionBus: exercises the filter, never listed.
+    const QString name = QString("nvme%1n1").arg(index);
+    const QString drive = QString("%1/drives/Mock_NVMe_%2").arg(kRootPath).arg(index);
+    objects_[drive][kDriveIface] = QVariantMap{{"Vendor", QString()},
+                                               {"Model", QStringLiteral("Mock NVMe")},
+                                               {"Serial", QString("NVME%1").arg(index)},
+                                               {"ConnectionBus", QString()},
+                                               {"Removable", false},
+                                               {"Size", quint64(512'000'000'000ull)}};
+    objects_[kRootPath + "/block_devices/" + name][kBlockIface] = blockProps(name, drive, 512'000'000'000ull);
+  }
+
+  void addSticks(int n, bool announce) {
+    for (int i = 0; i < n; ++i) addStick(nextStick_++, announce);
+  }
+
+  void removeSticks(int n, bool announce) {
+    for (int i = 0; i < n && !sticks_.isEmpty(); ++i) {
+      const int index = sticks_.takeLast();
+      const QString name = diskName(index);
+      for (int p = cfg_.partitions; p >= 1; --p) removeObject(QString("%1/block_devices/%2%3").arg(kRootPath, name).arg(p), announce);
+      removeObject(kRootPath + "/block_devices/" + name, announce);
+      removeObject(QString("%1/drives/Mock_Stick_%2").arg(kRootPath).arg(index), announce);
+    }
+  }
+
+  void setFormatLatency(int ms) { cfg_.formatLatencyMs = ms; }
+  quint64 callCount() const { return calls_; }
+  void resetCallCount() { calls_ = 0; }
+
+  QString introspect(const QString& path) const override {
+    ++calls_;
+    QString xml;
+    for (const QString& iface : objects_.value(path).keys()) xml += QString("<interface name=\"%1\"/>").arg(iface);
+    if (path == kRootPath) xml += QString("<interface name=\"%1\"/>").arg(kObjectManagerIface);
+    return xml;
+  }
+
+  bool handleMessage(const QDBusMessage& msg, const QDBusConnection& connection) override {
+    ++calls_;
+    const QString path = msg.path();
+    const QString iface = msg.interface();
+    const QString member = msg.member();
+    const QList<QVariant> args = msg.arguments();
+
+    if (path == kRootPath && member == "GetManagedObjects") {
+      ManagedObjects all;
+      for (auto it = objects_.cbegin(); it != objects_.cend(); ++it) all.insert(QDBusObjectPath(it.key()), it.value());
+      connection.send(msg.createReply(QVariant::fromValue(all)));
+      return true;
+    }
+
+    const auto objIt = objects_.constFind(path);
+    if (objIt == objects_.constEnd()) {
+      connection.send(msg.createErrorReply("org.freedesktop.DBus.Error.UnknownObject", "No such object: " + path));
+      return true;
+    }
+
+    if (iface == kPropsIface && member == "Get" && args.size() == 2) {
+      const QVariantMap props = objIt->value(args.at(0).toString());
+      const QString name = args.at(1).toString();
+      if (!props.contains(name)) {
+        connection.send(msg.createErrorReply("org.freedesktop.DBus.Error.InvalidArgs", "No such property: " + name));
+      } else {
+        connection.send(msg.createReply(QVariant::fromValue(QDBusVariant(props.value(name)))));
+      }
+      return true;
+    }
+    if (iface == kPropsIface && member == "GetAll" && args.size() == 1) {
+      connection.send(msg.createReply(QVariant::fromValue(objIt->value(args.at(0).toString()))));
+      return true;
+    }
+    if (path == kManagerPath && member == "GetBlockDevices") {
+      QList<QDBusObjectPath> blocks;
+      for (auto it = objects_.cbegin(); it != objects_.cend(); ++it) {
+        if (it->contains(kBlockIface)) blocks.push_back(QDBusObjectPath(it.key()));
+      }
+      connection.send(msg.createReply(QVariant::fromValue(blocks)));
+      return true;
+    }
+    if (iface == kFilesystemIface && member == "Unmount") {
+      if (qdbus_cast<QList<QByteArray>>(objIt->value(kFilesystemIface).value("MountPoints")).isEmpty()) {
+        connection.send(msg.createErrorReply("org.freedesktop.UDisks2.Error.NotMounted", "Device is not mounted"));
+      } else {
+        changeProperty(path, kFilesystemIface, "MountPoints", QVariant::fromValue(QList<QByteArray>{}));
+        connection.send(msg.createReply());
+      }
+      return true;
+    }
+    if (iface == kBlockIface && member == "Format") {
+      startFormat(msg);
+      return true;
+    }
+    if (iface == kBlockIface && member == "Rescan") {
+      connection.send(msg.createReply());
+      return true;
+    }
+
+    connection.send(msg.createErrorReply("org.freedesktop.DBus.Error.UnknownMethod",
+                                         QString("Mock doesn't implement %1.%2").arg(iface, member)));
+    return true;
+  }
+
+private:
+  QVariantMap blockProps(const QString& name, const QString& drive, quint64 size) const {
+    return QVariantMap{{"Device", nulTerminated("/dev/" + name)},
+                       {"PreferredDevice", nulTerminated("/dev/" + name)},
+                       {"Drive", QVariant::fromValue(QDBusObjectPath(drive))},
+                       {"Size", size},
+                       {"ReadOnly", false},
+                       {"HintSystem", false},
+                       {"HintIgnore", false},
+                       {"IdType", QString()},
+                       {"IdLabel", QString()}};
+  }
+
+  void addStick(int index, bool announce) {
+    const QString name = diskName(index);
+    const QString serial = QString("MOCK%1").arg(index, 6, 10, QChar('0'));
+    const QString drive = QString("%1/drives/Mock_Stick_%2").arg(kRootPath).arg(index);
+    const QString disk = kRootPath + "/block_devices/" + name;
+
+    addObject(drive,
+              {{kDriveIface, QVariantMap{{"Vendor", QStringLiteral("Mock")},
+                                         {"Model", QStringLiteral("Stick 16GB")},
+                                         {"Serial", serial},
+                                         {"ConnectionBus", QStringLiteral("usb")},
+                                         {"Removable", true},
+                                         {"MediaRemovable", true},
+                                         {"Size", kStickBytes}}}},
+              announce);
+
+    QList<QDBusObjectPath> parts;
+    for (int p = 1; p <= cfg_.partitions; ++p) parts.push_back(QDBusObjectPath(QString("%1%2").arg(disk).arg(p)));
+    addObject(disk,
+              {{kBlockIface, blockProps(name, drive, kStickBytes)},
+               {kPartitionTableIface, QVariantMap{{"Type", QStringLiteral("dos")}, {"Partitions", QVariant::fromValue(parts)}}}},
+              announce);
+
+    const quint64 partSize = kStickBytes / std::max(1, cfg_.partitions);
+    for (int p = 1; p <= cfg_.partitions; ++p) {
+      const QString partName = QString("%1%2").arg(name).arg(p);
+      QVariantMap blk = blockProps(partName, drive, partSize);
+      blk.insert("IdType", QStringLiteral("vfat"));
+      QList<QByteArray> mounts;
+      if (cfg_.mounted) mounts.push_back(nulTerminated(QString("/run/media/mock/%1").arg(partName.toUpper())));
+      addObject(QString("%1%2").arg(disk).arg(p),
+                {{kBlockIface, blk},
+                 {kPartitionIface, QVariantMap{{"Table", QVariant::fromValue(QDBusObjectPath(disk))},
+                                               {"Number", quint32(p)},
+                                               {"Offset", quint64(1 << 20) + (p - 1) * partSize},
+                                               {"Size", partSize}}},
+                 {kFilesystemIface, QVariantMap{{"MountPoints", QVariant::fromValue(mounts)}}}},
+                announce);
+    }
+    sticks_.push_back(index);
+  }
+
+  void addObject(const QString& path, const InterfaceMap& ifaces, bool announce) {
+    objects_[path] = ifaces;
+    if (announce) emitSignal(kRootPath, kObjectManagerIface, "InterfacesAdded", {QVariant::fromValue(QDBusObjectPath(path)), QVariant::fromValue(ifaces)});
+  }
+
+  void removeObject(const QString& path, bool announce) {
+    const auto it = objects_.find(path);
+    if (it == objects_.end()) return;
+    const QStringList ifaces = it->keys();
+    objects_.erase(it);
+    if (announce) emitSignal(kRootPath, kObjectManagerIface, "InterfacesRemoved", {QVariant::fromValue(QDBusObjectPath(path)), ifaces});
+  }
+
+  void changeProperty(const QString& path, const QString& iface, const QString& name, const QVariant& value) {
+    objects_[path][iface].insert(name, value);
+    emitSignal(path, kPropsIface, "PropertiesChanged", {iface, QVariantMap{{name, value}}, QStringList()});
+  }
+
+  void emitSignal(const QString& path, const QString& iface, const QString& name, const QList<QVariant>& args) {
+    QDBusMessage sig = QDBusMessage::createSignal(path, iface, name);
+    sig.setArguments(args);
+    conn_.send(sig);
+  }
+
+  // Replies after formatLatencyMs, publishing a Job with ten Progress steps meanwhile, like
+  // udisksd's format-erase/format-mkfs jobs. "empty" removes the partitions.
+  void startFormat(const QDBusMessage& call) {
+    const QString block = call.path();
+    const QString fsType = call.arguments().value(0).toString();
+    const QVariantMap opts = qdbus_cast<QVariantMap>(call.arguments().value(1));
+    const quint64 size = objects_.value(block).value(kBlockIface).value("Size").toULongLong();
+    const int latency = cfg_.formatLatencyMs;
+    const QString job = QString("%1/jobs/%2").arg(kRootPath).arg(++jobSeq_);
+    const quint64 endUsec = static_cast<quint64>(QDateTime::currentMSecsSinceEpoch() + latency) * 1000;
+
+    addObject(job,
+              {{kJobIface, QVariantMap{{"Operation", opts.contains("erase") ? QStringLiteral("format-erase") : QStringLiteral("format-mkfs")},
+                                       {"Progress", 0.0},
+                                       {"ProgressValid", true},
+                                       {"Rate", quint64(latency > 0 ? size * 1000 / latency : 0)},
+                                       {"BytesTotal", size},
+                                       {"ExpectedEndTime", endUsec},
+                                       {"Objects", QVariant::fromValue(QList<QDBusObjectPath>{QDBusObjectPath(block)})}}}},
+              /*announce*/ true);
+
+    constexpr int kSteps = 10;
+    auto step = std::make_shared<int>(0);
+    auto* timer = new QTimer();
+    timer->setInterval(latency / kSteps);
+    QObject::connect(timer, &QTimer::timeout, timer, [=, this]() {
+      if (++*step < kSteps) {
+        changeProperty(job, kJobIface, "Progress", double(*step) / kSteps);
+        return;
+      }
+      timer->deleteLater();
+      removeObject(job, /*announce*/ true);
+      if (fsType == "empty") {
+        for (int p = 1; objects_.contains(QString("%1%2").arg(block).arg(p)); ++p) {
+          removeObject(QString("%1%2").arg(block).arg(p), /*announce*/ true);
+        }
+      } else {
+        changeProperty(block, kBlockIface, "IdType", fsType);
+      }
+      conn_.send(call.createReply());
+    });
+    timer->start();
+  }
+
+  QDBusConnection conn_;
+  Config cfg_;
+  QMap<QString, InterfaceMap> objects_;
+  QList<int> sticks_;
+  int nextStick_ = 0;
+  int jobSeq_ = 0;
+  mutable quint64 calls_ = 0;
+};
+
+class MockControl final : public QDBusVirtualObject {
+public:
+  explicit MockControl(MockUDisks2* mock) : mock_(mock) {}
+
+  QString introspect(const QString&) const override {
+    return QString("<interface name=\"%1\"/>").arg(kControlIface);
+  }
+
+  bool handleMessage(const QDBusMessage& msg, const QDBusConnection& connection) override {
+    const QString member = msg.member();
+    const int n = msg.arguments().value(0).toInt();
+    QDBusMessage reply = msg.createReply();
+    if (member == "SetDeviceCount") {
+      if (n > mock_->stickCount()) mock_->addSticks(n - mock_->stickCount(), true);
+      else mock_->removeSticks(mock_->stickCount() - n, true);
+    } else if (member == "AddDevices") {
+      mock_->addSticks(n, true);
+    } else if (member == "RemoveDevices") {
+      mock_->removeSticks(n, true);
+    } else if (member == "SetFormatLatency") {
+      mock_->setFormatLatency(n);
+    } else if (member == "CallCount") {
+      reply = msg.createReply(QVariant::fromValue(mock_->callCount()));
+    } else if (member == "ResetCallCount") {
+      mock_->resetCallCount();
+    } else if (member == "Quit") {
+      QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+    } else {
+      reply = msg.createErrorReply("org.freedesktop.DBus.Error.UnknownMethod", "Unknown control method " + member);
+    }
+    connection.send(reply);
+    return true;
+  }
+
+private:
+  MockUDisks2* mock_;
+};
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("udisks2_mock");
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Synthetic UDisks2 service for ffrog's benchmarks (session or private bus only).");
+  p.addHelpOption();
+  p.addOptions({
+      {"bus", "\"session\" or a D-Bus address (default: session).", "bus", "session"},
+      {"devices", "USB sticks present at startup.", "n", "0"},
+      {"internal", "Internal (non-USB) disks, never listed by ffrog.", "n", "2"},
+      {"partitions", "Partitions per stick.", "n", "1"},
+      {"mounted", "Partitions start out mounted."},
+      {"format-latency", "Duration of a simulated Format job in ms.", "ms", "200"},
+  });
+  p.process(app);
+
+  qDBusRegisterMetaType<QList<QByteArray>>();
+  qDBusRegisterMetaType<InterfaceMap>();
+  qDBusRegisterMetaType<ManagedObjects>();
+
+  const QString busArg = p.value("bus");
+  QDBusConnection conn = busArg == "session" ? QDBusConnection::sessionBus()
+                                             : QDBusConnection::connectToBus(busArg, QStringLiteral("udisks2-mock"));
+  QTextStream err(stderr);
+  if (!conn.isConnected()) {
+    err << "udisks2_mock: can't connect to the " << busArg << " bus: " << conn.lastError().message() << Qt::endl;
+    return 1;
+  }
+
+  MockUDisks2::Config cfg;
+  cfg.partitions = std::max(0, p.value("partitions").toInt());
+  cfg.mounted = p.isSet("mounted");
+  cfg.formatLatencyMs = std::max(0, p.value("format-latency").toInt());
+
+  MockUDisks2 mock(conn, cfg);
+  MockControl control(&mock);
+  for (int i = 0; i < p.value("internal").toInt(); ++i) mock.addInternalDisk(i);
+  mock.addSticks(p.value("devices").toInt(), /*announce*/ false);
+
+  if (!conn.registerVirtualObject(kRootPath, &mock, QDBusConnection::SubPath) ||
+      !conn.registerVirtualObject(kControlPath, &control) || !conn.registerService(kService)) {
+    err << "udisks2_mock: can't register " << kService << ": " << conn.lastError().message() << Qt::endl;
+    return 1;
+  }
+  return app.exec();
+}
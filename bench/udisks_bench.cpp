@@ -0,0 +1,191 @@
+// Enumeration and hotplug benchmark for the UDisks2 client, against the mock service
+// (bench/mock_udisks2.cpp), which it starts itself on the session bus:
+//
+//   dbus-run-session -- udisks_bench
+//   dbus-run-session -- udisks_bench --counts 1,10,100,1000 --reps 20 --burst 50
+//
+// For each device count it reports:
+//   list      latency (median / p95) and bus calls of one blocking listUsbRemovable()
+//   unmount   latency and bus calls of the blocking unmountAllOnSameDrive() helper on one stick
+//   hotplug   time from a burst of `--burst` sticks (InterfacesAdded) to a device cache that
+//             lists all of them, and how many devicesChanged() signals the burst produced
+// Bus calls are counted by the mock, Introspect included. The sysfs backend's scan of the real
+// machine is timed once up front for comparison.
+
+#include "SysfsBackend.h"
+#include "UDisks2.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <vector>
+
+static const QString kService = QStringLiteral("org.freedesktop.UDisks2");
+
+static QDBusMessage control(const QString& member, const QList<QVariant>& args = {}) {
+  QDBusMessage call = QDBusMessage::createMethodCall(kService, "/org/ffrog/MockUDisks2", "org.ffrog.MockUDisks2", member);
+  call.setArguments(args);
+  return UDisks2::bus().call(call);
+}
+
+static quint64 callCount() {
+  return control("CallCount").arguments().value(0).toULongLong();
+}
+
+static double percentile(std::vector<double> v, double q) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[static_cast<std::size_t>(q * static_cast<double>(v.size() - 1) + 0.5)];
+}
+
+int main(int argc, char** argv) {
+  // Before UDisks2::bus() is first used: talk to the mock, never to the real udisksd.
+  if (qEnvironmentVariableIsEmpty("FFROG_UDISKS_BUS")) qputenv("FFROG_UDISKS_BUS", "session");
+
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("udisks_bench");
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Benchmark ffrog's UDisks2 enumeration and hotplug paths against a mock udisksd.");
+  p.addHelpOption();
+  p.addOptions({
+      {"counts", "Comma-separated device counts.", "list", "1,10,100,1000"},
+      {"reps", "Repetitions per measurement.", "n", "10"},
+      {"burst", "Sticks hotplugged at once.", "n", "20"},
+      {"mock", "Path of udisks2_mock (default: next to this binary).", "path"},
+  });
+  p.process(app);
+
+  QTextStream out(stdout);
+  const QByteArray bus = qgetenv("FFROG_UDISKS_BUS");
+  if (bus == "system") {
+    out << "Refusing to benchmark against the system bus; use session or a private bus address." << Qt::endl;
+    return 2;
+  }
+
+  QProcess mock;
+  mock.setProcessChannelMode(QProcess::ForwardedChannels);
+  const QString mockPath = p.isSet("mock") ? p.value("mock") : QCoreApplication::applicationDirPath() + "/udisks2_mock";
+  mock.start(mockPath, {"--bus", QString::fromLocal8Bit(bus), "--devices", "0"});
+  if (!mock.waitForStarted()) {
+    out << "Can't start " << mockPath << ": " << mock.errorString() << Qt::endl;
+    return 1;
+  }
+  QElapsedTimer wait;
+  wait.start();
+  while (!UDisks2::bus().interface()->isServiceRegistered(kService) && wait.elapsed() < 5000) QThread::msleep(20);
+  if (!UDisks2::bus().interface()->isServiceRegistered(kService)) {
+    out << "The mock didn't show up on the bus (is there a session bus? try dbus-run-session)." << Qt::endl;
+    mock.kill();
+    return 1;
+  }
+
+  const int reps = std::max(1, p.value("reps").toInt());
+  const int burst = std::max(1, p.value("burst").toInt());
+
+  {
+    // Reference point: the sysfs backend's full scan of this machine (no D-Bus at all).
+    std::vector<double> us;
+    qsizetype found = 0;
+    for (int r = 0; r < reps; ++r) {
+      QElapsedTimer t;
+      t.start();
+      found = SysfsBackend::scan(QStringLiteral("/sys"), QStringLiteral("/run/udev/data")).size();
+      us.push_back(t.nsecsElapsed() / 1e3);
+    }
+    out << QString("sysfs scan of this host: %1 us (p50), %2 USB disk(s)").arg(percentile(us, 0.5), 0, 'f', 1).arg(found)
+        << Qt::endl;
+  }
+
+  out << QString("%1 %2 %3 %4 %5 %6 %7 %8")
+             .arg("devices", 8)
+             .arg("list p50", 10)
+             .arg("list p95", 10)
+             .arg("calls", 7)
+             .arg("unmount", 10)
+             .arg("calls", 7)
+             .arg(QString("hotplug+%1").arg(burst), 12)
+             .arg("signals", 8)
+      << Qt::endl;
+
+  for (const QString& c : p.value("counts").split(',', Qt::SkipEmptyParts)) {
+    const int n = c.toInt();
+    control("SetDeviceCount", {quint32(n)});
+
+    UDisks2 udisks;
+    std::vector<double> listMs;
+    quint64 listCalls = 0;
+    QString firstBlock;
+    for (int r = 0; r < reps; ++r) {
+      control("ResetCallCount");
+      QElapsedTimer t;
+      t.start();
+      QString err;
+      const QVector<UDisks2::UsbDevice> devs = udisks.listUsbRemovable(&err);
+      listMs.push_back(t.nsecsElapsed() / 1e6);
+      listCalls = callCount();
+      if (devs.size() != n) out << "  warning: listed " << devs.size() << " of " << n << " devices " << err << Qt::endl;
+      if (!devs.isEmpty()) firstBlock = devs.first().blockObject;
+    }
+
+    double unmountMs = 0;
+    quint64 unmountCalls = 0;
+    if (!firstBlock.isEmpty()) {
+      control("ResetCallCount");
+      QElapsedTimer t;
+      t.start();
+      udisks.unmountAllOnSameDrive(firstBlock);
+      unmountMs = t.nsecsElapsed() / 1e6;
+      unmountCalls = callCount();
+    }
+
+    // Hotplug: a watching cache, a burst of sticks, and the time until all of them are listed.
+    double hotplugMs = -1;
+    int changeSignals = 0;
+    {
+      UDisks2 watcher;
+      watcher.startWatching();
+      QEventLoop loop;
+      QElapsedTimer t;
+      QObject::connect(&watcher, &UDisks2::devicesChanged, &loop, [&]() {
+        ++changeSignals;
+        if (watcher.cachedUsbRemovable().size() == n + burst) {
+          hotplugMs = t.nsecsElapsed() / 1e6;
+          loop.quit();
+        }
+      });
+      QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+      QDBusMessage call = QDBusMessage::createMethodCall(kService, "/org/ffrog/MockUDisks2", "org.ffrog.MockUDisks2", "AddDevices");
+      call << quint32(burst);
+      t.start();
+      UDisks2::bus().asyncCall(call);
+      loop.exec();
+    }
+    control("SetDeviceCount", {quint32(n)});
+
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8")
+               .arg(n, 8)
+               .arg(QString::number(percentile(listMs, 0.5), 'f', 2) + "ms", 10)
+               .arg(QString::number(percentile(listMs, 0.95), 'f', 2) + "ms", 10)
+               .arg(listCalls, 7)
+               .arg(QString::number(unmountMs, 'f', 2) + "ms", 10)
+               .arg(unmountCalls, 7)
+               .arg(hotplugMs < 0 ? QStringLiteral("timeout") : QString::number(hotplugMs, 'f', 2) + "ms", 12)
+               .arg(changeSignals, 8)
+        << Qt::endl;
+  }
+
+  control("Quit");
+  mock.waitForFinished(2000);
+  return 0;
+}
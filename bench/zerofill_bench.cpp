@@ -0,0 +1,85 @@
+// Zero-fill throughput benchmark for the in-process engine (src/ZeroFill.*).
+//
+//   zerofill_bench /dev/loop0                     # one run with the defaults
+//   zerofill_bench --size 2048 /tmp/zf.img        # regular file, created/extended to 2048 MiB
+//   zerofill_bench --sweep /dev/loop0             # chunk size x queue depth matrix
+//   zerofill_bench --random /dev/loop0            # a random pass (RandomFill) instead of zeros
+//
+// Compare against the UDisks path with e.g.
+//   time udisksctl ... / gdbus call ... Block.Format empty "{'erase': <'zero'>}"
+// on the same loop device.
+
+#include "RandomFill.h"
+#include "ZeroFill.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+
+#include <cstdio>
+
+static bool runOnce(const QString& path, const ZeroFill::Options& opts) {
+  ZeroFill::Stats stats;
+  QString err;
+  const bool ok = ZeroFill::run(path, opts, {}, &stats, &err);
+  QTextStream out(stdout);
+  if (ok) {
+    out << stats.summary(opts) << Qt::endl;
+  } else {
+    out << "FAILED: " << err << Qt::endl;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("zerofill_bench");
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Benchmark ffrog's in-process zero-fill engine on a block device or file.");
+  p.addHelpOption();
+  p.addPositionalArgument("path", "Block device, loop device or regular file to overwrite.");
+  QCommandLineOption chunkOpt("chunk", "Write size in MiB (default 4).", "MiB", "4");
+  QCommandLineOption qdOpt("qd", "Writes in flight (default 8).", "n", "8");
+  QCommandLineOption sizeOpt("size", "For regular files: extend to this many MiB first.", "MiB");
+  QCommandLineOption noDirectOpt("no-direct", "Buffered I/O instead of O_DIRECT.");
+  QCommandLineOption noUringOpt("no-uring", "Force the pwrite thread pool.");
+  QCommandLineOption sweepOpt("sweep", "Run chunk {1,4,16} MiB x depth {1,4,8,16}.");
+  QCommandLineOption randomOpt("random", "Write seeded random data (always on the pwrite workers).");
+  p.addOptions({chunkOpt, qdOpt, sizeOpt, noDirectOpt, noUringOpt, sweepOpt, randomOpt});
+  p.process(app);
+
+  if (p.positionalArguments().size() != 1) p.showHelp(2);
+  const QString path = p.positionalArguments().first();
+
+  if (p.isSet(sizeOpt)) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadWrite) || !f.resize(p.value(sizeOpt).toLongLong() << 20)) {
+      std::fprintf(stderr, "can't create/resize %s\n", qPrintable(path));
+      return 1;
+    }
+  }
+
+  ZeroFill::Options opts;
+  opts.direct = !p.isSet(noDirectOpt);
+  opts.useIoUring = !p.isSet(noUringOpt);
+  opts.random = p.isSet(randomOpt);
+  opts.seed = RandomFill::newSeed();
+
+  if (!p.isSet(sweepOpt)) {
+    opts.chunkBytes = p.value(chunkOpt).toULongLong() << 20;
+    opts.queueDepth = p.value(qdOpt).toInt();
+    return runOnce(path, opts) ? 0 : 1;
+  }
+
+  bool ok = true;
+  for (const quint64 mib : {1ull, 4ull, 16ull}) {
+    for (const int qd : {1, 4, 8, 16}) {
+      opts.chunkBytes = mib << 20;
+      opts.queueDepth = qd;
+      ok = runOnce(path, opts) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,361 @@
+#include "AutoProvision.h"
+#include "FormatProfile.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+#include <algorithm>
+
+namespace {
+
+const QStringList kFsTypes{"vfat", "exfat", "ntfs", "ext4"};
+const QStringList kRuleKeys{"name", "vendor", "model", "serial", "minSize", "maxSize", "wipe", "verify",
+                            "fs", "profile", "label", "counterStart", "rateLimit", "dryRun"};
+
+// Case-insensitive wildcard match against any of `patterns`; an empty list matches everything.
+bool matchesAny(const QString& value, const QStringList& patterns) {
+  if (patterns.isEmpty()) return true;
+  for (const QString& pat : patterns) {
+    const QRegularExpression re(QRegularExpression::wildcardToRegularExpression(pat),
+                                QRegularExpression::CaseInsensitiveOption);
+    if (re.match(value).hasMatch()) return true;
+  }
+  return false;
+}
+
+// A pattern or a list of them.
+bool patternList(const QJsonValue& v, QStringList* out) {
+  if (v.isUndefined()) return true;
+  if (v.isString()) {
+    *out = QStringList{v.toString()};
+    return true;
+  }
+  if (!v.isArray()) return false;
+  for (const QJsonValue& item : v.toArray()) {
+    if (!item.isString()) return false;
+    *out << item.toString();
+  }
+  return true;
+}
+
+bool sizeValue(const QJsonValue& v, quint64* out) {
+  if (v.isUndefined()) return true;
+  if (v.isDouble() && v.toDouble() >= 0) {
+    *out = static_cast<quint64>(v.toDouble());
+    return true;
+  }
+  return v.isString() && AutoProvision::parseSize(v.toString(), out);
+}
+
+// "20/min": count and window in seconds.
+bool rateValue(const QString& text, int* count, int* windowSec) {
+  static const QRegularExpression kRate("^\\s*(\\d+)\\s*/\\s*(s|sec|min|h|hour)\\s*$", QRegularExpression::CaseInsensitiveOption);
+  const QRegularExpressionMatch m = kRate.match(text);
+  if (!m.hasMatch()) return false;
+  const QString unit = m.captured(2).toLower();
+  *count = m.captured(1).toInt();
+  *windowSec = unit.startsWith('s') ? 1 : unit == "min" ? 60 : 3600;
+  return *count > 0;
+}
+
+bool parseRule(const QJsonObject& o, AutoProvision::Rule* r, QString* why) {
+  for (const QString& key : o.keys()) {
+    if (!kRuleKeys.contains(key)) {
+      *why = QString("unknown key '%1'").arg(key);
+      return false;
+    }
+  }
+  r->name = o.value("name").toString().trimmed();
+  if (r->name.isEmpty()) {
+    *why = "no name";
+    return false;
+  }
+  if (!patternList(o.value("vendor"), &r->vendor) || !patternList(o.value("model"), &r->model) ||
+      !patternList(o.value("serial"), &r->serial)) {
+    *why = "vendor/model/serial must be a pattern or a list of patterns";
+    return false;
+  }
+  if (!sizeValue(o.value("minSize"), &r->minBytes) || !sizeValue(o.value("maxSize"), &r->maxBytes)) {
+    *why = "bad minSize/maxSize (e.g. 8GB, 7.5GiB or bytes)";
+    return false;
+  }
+  if (r->maxBytes && r->maxBytes < r->minBytes) {
+    *why = "maxSize is below minSize";
+    return false;
+  }
+  // A rule that would take any stick plugged in is almost certainly a mistake.
+  if (r->vendor.isEmpty() && r->model.isEmpty() && r->serial.isEmpty() && !r->minBytes && !r->maxBytes) {
+    *why = "matches every device (set vendor, model, serial or a size range)";
+    return false;
+  }
+
+  if (!AutoProvision::wipeFromName(o.value("wipe").toString("none"), &r->wipe)) {
+    *why = QString("unknown wipe mode '%1' (none, quick, full, native, instant)").arg(o.value("wipe").toString());
+    return false;
+  }
+  r->verify = o.value("verify").toBool();
+  if (r->verify && r->wipe != AutoProvision::Wipe::Full && r->wipe != AutoProvision::Wipe::Native &&
+      r->wipe != AutoProvision::Wipe::Instant) {
+    *why = "verify needs a full, native or instant wipe";
+    return false;
+  }
+  r->fsType = o.value("fs").toString();
+  if (!r->fsType.isEmpty() && !kFsTypes.contains(r->fsType)) {
+    *why = QString("unknown filesystem '%1' (%2)").arg(r->fsType, kFsTypes.join(", "));
+    return false;
+  }
+  r->profile = o.value("profile").toString();
+  if (!r->profile.isEmpty() && !FormatProfile::find(r->profile)) {
+    *why = QString("unknown format profile '%1'").arg(r->profile);
+    return false;
+  }
+  r->label = o.value("label").toString();
+  if (r->fsType.isEmpty() && (!r->label.isEmpty() || !r->profile.isEmpty())) {
+    *why = "label and profile need a filesystem (fs)";
+    return false;
+  }
+  if (r->fsType.isEmpty() && r->wipe == AutoProvision::Wipe::None) {
+    *why = "nothing to do (set wipe and/or fs)";
+    return false;
+  }
+  r->counterStart = o.value("counterStart").toInt(1);
+  if (r->counterStart < 0) {
+    *why = "counterStart must not be negative";
+    return false;
+  }
+  if (o.contains("rateLimit") && !rateValue(o.value("rateLimit").toString(), &r->rateCount, &r->rateWindowSec)) {
+    *why = "bad rateLimit (e.g. 20/min, 5/s, 300/h)";
+    return false;
+  }
+  r->dryRun = o.value("dryRun").toBool();
+  return true;
+}
+
+} // namespace
+
+bool AutoProvision::Rule::matches(const UsbDevice& d) const {
+  // No medium (card reader): nothing to provision yet.
+  if (d.sizeBytes == 0) return false;
+  if (d.sizeBytes < minBytes || (maxBytes && d.sizeBytes > maxBytes)) return false;
+  return matchesAny(d.vendor, vendor) && matchesAny(d.model, model) && matchesAny(d.serial, serial);
+}
+
+QString AutoProvision::Rule::describe() const {
+  QStringList parts;
+  if (wipe != Wipe::None) parts << "wipe " + wipeName(wipe) + (verify ? " + verify" : "");
+  if (!fsType.isEmpty()) parts << QString("format %1 (%2)").arg(fsType, profile.isEmpty() ? QStringLiteral("default") : profile);
+  if (!label.isEmpty()) parts << "label " + label;
+  if (rateCount > 0) parts << QString("at most %1/%2s").arg(rateCount).arg(rateWindowSec);
+  if (dryRun) parts << "dry run";
+  return parts.join(", ");
+}
+
+QString AutoProvision::defaultRulesPath() {
+  const QString env = qEnvironmentVariable("FFROG_PROVISION_RULES");
+  if (!env.isEmpty()) return env;
+  QString config = qEnvironmentVariable("XDG_CONFIG_HOME");
+  if (config.isEmpty()) config = QDir::homePath() + "/.config";
+  return config + "/ffrog/provision-rules.json";
+}
+
+QString AutoProvision::defaultStateDir() {
+  const QString env = qEnvironmentVariable("FFROG_PROVISION_STATE");
+  if (!env.isEmpty()) return env;
+  QString state = qEnvironmentVariable("XDG_STATE_HOME");
+  if (state.isEmpty()) state = QDir::homePath() + "/.local/state";
+  return state + "/ffrog";
+}
+
+bool AutoProvision::wipeFromName(const QString& name, Wipe* out) {
+  static const QHash<QString, Wipe> kNames{{"none", Wipe::None}, {"quick", Wipe::Quick}, {"full", Wipe::Full},
+                                           {"native", Wipe::Native}, {"instant", Wipe::Instant}};
+  const auto it = kNames.constFind(name.toLower());
+  if (it == kNames.constEnd()) return false;
+  *out = *it;
+  return true;
+}
+
+QString AutoProvision::actionName(Action action) {
+  switch (action) {
+    case Action::Queue: return QStringLiteral("queued");
+    case Action::DryRun: return QStringLiteral("dry-run");
+    case Action::RateLimited: return QStringLiteral("rate-limited");
+    case Action::Skipped: return QStringLiteral("skipped");
+  }
+  return {};
+}
+
+QString AutoProvision::wipeName(Wipe wipe) {
+  switch (wipe) {
+    case Wipe::None: return QStringLiteral("none");
+    case Wipe::Quick: return QStringLiteral("quick");
+    case Wipe::Full: return QStringLiteral("full");
+    case Wipe::Native: return QStringLiteral("native");
+    case Wipe::Instant: return QStringLiteral("instant");
+  }
+  return {};
+}
+
+bool AutoProvision::parseSize(const QString& text, quint64* out) {
+  static const QRegularExpression kSize("^\\s*(\\d+(?:\\.\\d+)?)\\s*(?:([KMGT])(i?)B)?\\s*$", QRegularExpression::CaseInsensitiveOption);
+  const QRegularExpressionMatch m = kSize.match(text);
+  if (!m.hasMatch()) return false;
+  double v = m.captured(1).toDouble();
+  const QString unit = m.captured(2).toUpper();
+  const double base = m.captured(3).isEmpty() ? 1000.0 : 1024.0;
+  for (int i = unit.isEmpty() ? 0 : static_cast<int>(QString("KMGT").indexOf(unit)) + 1; i > 0; --i) v *= base;
+  *out = static_cast<quint64>(v);
+  return true;
+}
+
+QString AutoProvision::expandLabel(const QString& tmpl, int counter, const UsbDevice& d) {
+  static const QRegularExpression kField("\\{(n|serial)(?::(\\d+))?\\}");
+  QString out;
+  qsizetype pos = 0;
+  for (auto it = kField.globalMatch(tmpl); it.hasNext();) {
+    const QRegularExpressionMatch m = it.next();
+    out += tmpl.mid(pos, m.capturedStart() - pos);
+    const int width = m.captured(2).toInt();
+    if (m.captured(1) == "n") {
+      out += QString("%1").arg(counter, width, 10, QChar('0'));
+    } else {
+      out += width > 0 ? d.serial.right(width) : d.serial;
+    }
+    pos = m.capturedEnd();
+  }
+  return out + tmpl.mid(pos);
+}
+
+AutoProvision::AutoProvision(const QString& stateDir) : stateDir_(stateDir) {
+  QFile f(countersPath());
+  if (!f.open(QIODevice::ReadOnly)) return;
+  const QJsonObject root = QJsonDocument::fromJson(f.readAll()).object();
+  for (auto it = root.constBegin(); it != root.constEnd(); ++it) counters_.insert(it.key(), it.value().toInt());
+}
+
+bool AutoProvision::load(const QString& path, QString* error) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) {
+    if (error) *error = QString("Cannot read %1: %2").arg(path, f.errorString());
+    return false;
+  }
+  QString why;
+  if (!parse(f.readAll(), &why)) {
+    if (error) *error = QString("%1: %2").arg(path, why);
+    return false;
+  }
+  return true;
+}
+
+bool AutoProvision::parse(const QByteArray& json, QString* error) {
+  QJsonParseError parseError;
+  const QJsonDocument doc = QJsonDocument::fromJson(json, &parseError);
+  if (doc.isNull()) {
+    if (error) *error = parseError.errorString();
+    return false;
+  }
+  const QJsonValue list = doc.object().value("rules");
+  if (!list.isArray() || list.toArray().isEmpty()) {
+    if (error) *error = "expected {\"rules\": [...]} with at least one rule";
+    return false;
+  }
+
+  QVector<Rule> rules;
+  for (const QJsonValue& v : list.toArray()) {
+    Rule r;
+    QString why = "not an object";
+    if (!v.isObject() || !parseRule(v.toObject(), &r, &why)) {
+      if (error) *error = QString("rule %1%2: %3").arg(rules.size() + 1).arg(r.name.isEmpty() ? QString() : " (" + r.name + ")", why);
+      return false;
+    }
+    if (std::any_of(rules.cbegin(), rules.cend(), [&r](const Rule& o) { return o.name == r.name; })) {
+      if (error) *error = QString("rule name '%1' is used twice").arg(r.name);
+      return false;
+    }
+    rules << r;
+  }
+  rules_ = rules;
+  return true;
+}
+
+int AutoProvision::nextCounter(const Rule& rule) const {
+  return std::max(rule.counterStart, counters_.value(rule.name, rule.counterStart));
+}
+
+void AutoProvision::storeCounters() {
+  // Best effort: the audit log records every label handed out anyway.
+  QJsonObject root;
+  for (auto it = counters_.constBegin(); it != counters_.constEnd(); ++it) root.insert(it.key(), it.value());
+  QDir().mkpath(stateDir_);
+  QSaveFile f(countersPath());
+  if (!f.open(QIODevice::WriteOnly)) return;
+  f.write(QJsonDocument(root).toJson());
+  f.commit();
+}
+
+bool AutoProvision::decide(const UsbDevice& d, bool dryRun, Decision* out) {
+  const auto rule = std::find_if(rules_.cbegin(), rules_.cend(), [&d](const Rule& r) { return r.matches(d); });
+  if (rule == rules_.cend()) return false;
+
+  Decision dec;
+  dec.rule = *rule;
+  if (d.readOnly) {
+    dec.action = Action::Skipped;
+    dec.reason = "device is read-only";
+  } else if (dryRun || rule->dryRun) {
+    dec.action = Action::DryRun;
+    dec.label = expandLabel(rule->label, nextCounter(*rule), d);
+  } else {
+    // Sliding window: a hub reset that re-adds a whole tray of sticks stops at the limit.
+    QQueue<qint64>& recent = recent_[rule->name];
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!recent.isEmpty() && now - recent.head() >= rule->rateWindowSec * 1000ll) recent.dequeue();
+    if (rule->rateCount > 0 && recent.size() >= rule->rateCount) {
+      dec.action = Action::RateLimited;
+      dec.reason = QString("rate limit of %1 per %2 s reached").arg(rule->rateCount).arg(rule->rateWindowSec);
+    } else {
+      recent.enqueue(now);
+      dec.action = Action::Queue;
+      const int n = nextCounter(*rule);
+      dec.label = expandLabel(rule->label, n, d);
+      if (rule->label.contains("{n")) {
+        counters_.insert(rule->name, n + 1);
+        storeCounters();
+      }
+    }
+  }
+  *out = dec;
+  return true;
+}
+
+bool AutoProvision::audit(const UsbDevice& d, const QString& event, const QString& rule, const QString& label,
+                          const QString& detail, QString* error) {
+  QJsonObject o{{"time", QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs)},
+                {"event", event},
+                {"rule", rule},
+                {"device", d.deviceNode},
+                {"vendor", d.vendor},
+                {"model", d.model},
+                {"serial", d.serial},
+                {"sizeBytes", static_cast<qint64>(d.sizeBytes)}};
+  if (!label.isEmpty()) o.insert("label", label);
+  if (!detail.isEmpty()) o.insert("detail", detail);
+
+  if (!QDir().mkpath(stateDir_)) {
+    if (error) *error = QString("Cannot create %1.").arg(stateDir_);
+    return false;
+  }
+  QFile f(auditPath());
+  if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    if (error) *error = QString("Cannot write %1: %2").arg(auditPath(), f.errorString());
+    return false;
+  }
+  f.write(QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n');
+  return true;
+}
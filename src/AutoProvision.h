@@ -0,0 +1,100 @@
+#pragma once
+
+#include "UsbDevice.h"
+
+#include <QHash>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Rules for provisioning sticks as they are plugged in, without selecting and confirming each
+// one: a rule matches vendor/model/serial patterns and a size range, and names what to do with
+// a matching stick (wipe, then format with a label from a template with a counter). Rules come
+// from a JSON file:
+//
+//   {"rules": [{"name": "kiosk", "vendor": "SanDisk", "model": ["Ultra*", "Cruzer*"],
+//               "minSize": "7GB", "maxSize": "70GB", "wipe": "instant", "fs": "vfat",
+//               "profile": "default", "label": "KIOSK{n:3}", "rateLimit": "20/min"}]}
+//
+// Every decision and every job result goes to an append-only audit log (JSON lines); label
+// counters survive restarts in a small state file next to it.
+class AutoProvision final {
+public:
+  enum class Wipe { None, Quick, Full, Native, Instant };
+
+  struct Rule {
+    QString name;
+    QStringList vendor;   // wildcards, case insensitive; empty matches any
+    QStringList model;
+    QStringList serial;
+    quint64 minBytes = 0;
+    quint64 maxBytes = 0; // 0: no upper bound
+    Wipe wipe = Wipe::None;
+    bool verify = false;  // read-back check after a full/native/instant wipe
+    QString fsType;       // vfat, exfat, ntfs, ext4; empty: wipe only
+    QString profile;      // FormatProfile name; empty: default
+    QString label;        // template, see expandLabel()
+    int counterStart = 1;
+    int rateCount = 0;    // at most rateCount devices per rateWindowSec; 0: no limit
+    int rateWindowSec = 60;
+    bool dryRun = false;  // log and audit what would be done, queue nothing
+
+    bool matches(const UsbDevice& d) const;
+    // e.g. "wipe instant, format vfat (default), label KIOSK{n:3}, at most 20/60s"
+    QString describe() const;
+  };
+
+  enum class Action { Queue, DryRun, RateLimited, Skipped };
+
+  struct Decision {
+    Action action = Action::Skipped;
+    Rule rule;
+    QString label;  // expanded template
+    QString reason; // why it was not queued
+  };
+
+  // $FFROG_PROVISION_RULES, else $XDG_CONFIG_HOME/ffrog/provision-rules.json (~/.config/...).
+  static QString defaultRulesPath();
+  // $FFROG_PROVISION_STATE, else $XDG_STATE_HOME/ffrog: provision-audit.jsonl and
+  // provision-counters.json.
+  static QString defaultStateDir();
+
+  static bool wipeFromName(const QString& name, Wipe* out);
+  static QString wipeName(Wipe wipe);
+  // The decision's audit event: "queued", "dry-run", "rate-limited", "skipped".
+  static QString actionName(Action action);
+  // "8GB", "7.5GiB", "512MB" (sizes as printed on sticks are decimal), or plain bytes.
+  static bool parseSize(const QString& text, quint64* out);
+  // {n} -> 7, {n:3} -> 007, {serial} -> the drive's serial, {serial:4} -> its last 4 characters.
+  static QString expandLabel(const QString& tmpl, int counter, const UsbDevice& d);
+
+  explicit AutoProvision(const QString& stateDir = defaultStateDir());
+
+  // Replaces the rules; on error the current ones are kept.
+  bool load(const QString& path, QString* error = nullptr);
+  bool parse(const QByteArray& json, QString* error = nullptr);
+  const QVector<Rule>& rules() const { return rules_; }
+  QString auditPath() const { return stateDir_ + "/provision-audit.jsonl"; }
+
+  // The first rule that matches `d` decides; false if none does. A Queue decision takes the
+  // rule's next label counter and a slot of its rate limit. `dryRun` turns every Queue into a
+  // DryRun (the counter is not used up).
+  bool decide(const UsbDevice& d, bool dryRun, Decision* out);
+
+  // Appends one audit record (a JSON line): time, event (actionName(), "ok", "failed"...), rule,
+  // device, vendor, model, serial, size, label and detail.
+  bool audit(const UsbDevice& d, const QString& event, const QString& rule, const QString& label,
+             const QString& detail = {}, QString* error = nullptr);
+
+private:
+  QString countersPath() const { return stateDir_ + "/provision-counters.json"; }
+  int nextCounter(const Rule& rule) const;
+  void storeCounters();
+
+  QString stateDir_;
+  QVector<Rule> rules_;
+  // By rule name: queue times (ms since epoch) inside the rate window, next label counter.
+  QHash<QString, QQueue<qint64>> recent_;
+  QHash<QString, int> counters_;
+};
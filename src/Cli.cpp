@@ -0,0 +1,521 @@
+#include "Cli.h"
+#include "JobQueue.h"
+#include "RandomFill.h"
+#include "UsbTopology.h"
+
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTextStream>
+
+#include <cstdio>
+
+// Progress lines go to stderr at most this often per device (--progress).
+static constexpr qint64 kProgressIntervalMs = 2000;
+
+// Case-insensitive wildcard match against any of `patterns`; an empty list matches everything.
+static bool matchesAny(const QString& value, const QStringList& patterns) {
+  if (patterns.isEmpty()) return true;
+  for (const QString& pat : patterns) {
+    const QRegularExpression re(QRegularExpression::wildcardToRegularExpression(pat),
+                                QRegularExpression::CaseInsensitiveOption);
+    if (re.match(value).hasMatch()) return true;
+  }
+  return false;
+}
+
+// Repeated and comma/space-separated values ("--confirm /dev/sdb,/dev/sdc") as one list.
+static QStringList splitValues(const QStringList& values) {
+  static const QRegularExpression kSep("[\\s,]+");
+  QStringList out;
+  for (const QString& v : values) out += v.split(kSep, Qt::SkipEmptyParts);
+  return out;
+}
+
+Cli::Cli(QObject* parent) : QObject(parent), udisks_(new UDisks2(this)), jobs_(new JobQueue(this)) {
+  connect(jobs_, &JobQueue::jobStarted, this, &Cli::onJobStarted);
+  connect(jobs_, &JobQueue::jobFinished, this, &Cli::onJobFinished);
+  connect(jobs_, &JobQueue::linkLimitChanged, this, [this](const QString& link, int limit, const QString& detail) {
+    if (!json_) printError(QString("%1: up to %2 parallel jobs (%3)").arg(link).arg(limit).arg(detail));
+  });
+  connect(udisks_, &UDisks2::jobProgress, this, &Cli::onProgress);
+}
+
+Cli::~Cli() {
+  cancel_ = true;
+  jobs_->threadPool()->waitForDone();
+}
+
+int Cli::run(const QStringList& args) {
+  QElapsedTimer total;
+  total.start();
+
+  QCommandLineParser p;
+  p.setApplicationDescription(
+      "Headless ffrog: list, format, wipe and flash USB removable drives through UDisks2.\n\n"
+      "Commands:\n"
+      "  list                        list USB removable drives\n"
+      "  format --fs FS              format (vfat, exfat, ntfs, ext4); --engine native writes\n"
+      "                              vfat/exfat in-process (whole disk, no partition table);\n"
+      "                              --table dos|gpt first creates a new erase-block aligned table\n"
+      "  wipe --mode MODE            quick (signatures), full (UDisks erase=zero),\n"
+      "                              native (in-process zero-fill, checkpointed: see --resume;\n"
+      "                              --passes random,zero adds a seeded random pass),\n"
+      "                              instant (discard/zeroout)\n"
+      "  write --image FILE          flash a disk image (.img/.iso, optionally .gz) to the whole disk;\n"
+      "                              several devices share one reader and all run at once\n"
+      "                              (unless -j is given; see --lag); --delta rewrites only the\n"
+      "                              chunks that changed\n\n"
+      "Destructive commands need --confirm with exactly the device nodes the filters select.\n"
+      "Exit codes: 0 ok, 1 an operation failed, 2 bad arguments, 3 refused (nothing selected,\n"
+      "--confirm mismatch, read-only device), 4 device enumeration failed.");
+  const QCommandLineOption help = p.addHelpOption();
+  p.addPositionalArgument("command", "list | format | wipe | write");
+  p.addOptions({
+      {"json", "Machine-readable JSON on stdout."},
+      {"progress", "Progress lines on stderr (JSON lines with --json)."},
+      {{"d", "device"}, "Select this device node (repeatable).", "node"},
+      {"serial", "Select by serial number (wildcards, repeatable).", "pattern"},
+      {"vendor", "Select by vendor (wildcards, repeatable).", "pattern"},
+      {"model", "Select by model (wildcards, repeatable).", "pattern"},
+      {"confirm", "The exact device node(s) the command may touch (comma separated or repeated).", "nodes"},
+      {"fs", "Filesystem for format.", "fs"},
+      {"label", "Filesystem label for format.", "label"},
+      {"erase", "UDisks erase mode for format (e.g. zero).", "mode"},
+      {"engine", "Format engine: udisks (mkfs through UDisks, default) or native (vfat/exfat only).", "engine", "udisks"},
+      {"cluster", "Cluster size in bytes for --engine native (default: by device size).", "bytes"},
+      {"profile", "format: mkfs tuning for a workload: default, large-files, small-files or quick "
+                  "(cluster size, ext4 journal/lazy init, discard).", "name", "default"},
+      {"table", "format: create a new partition table (dos or gpt) with one partition aligned to the erase "
+                "block (sysfs hints, else 4 MiB) instead of formatting the existing layout.", "type"},
+      {"mode", "Wipe mode: quick, full, native or instant.", "mode"},
+      {"image", "Disk image for write (.img/.iso, or gzip-compressed).", "file"},
+      {"delta", "write: read each 1 MiB chunk of the device first and write only the chunks that differ."},
+      {"assume-zeroed", "write: the devices are known to be all zeros (e.g. after wipe --mode instant); "
+                        "zero chunks of the image are not written."},
+      {"lag", "write to several devices: MiB the fastest may run ahead of the slowest before the slowest "
+              "is cut loose onto its own reader (default 256).", "MiB", "256"},
+      {"backend", "Device discovery: udisks, sysfs or mock:<file.json> (read-only; default: $FFROG_DEVICE_BACKEND, else udisks).",
+       "backend", qEnvironmentVariable("FFROG_DEVICE_BACKEND", QStringLiteral("udisks"))},
+      {"verify", "Read the device back after a full/native/instant wipe and check it is all zeros, or after "
+                 "write and check it matches the image (chunk hashes, in parallel)."},
+      {"sha256", "write --verify: also hash the image and each device with SHA-256 for the record."},
+      {"passes", "wipe --mode native: overwrite passes, comma separated: random, zero, verify (checks the pass "
+                 "before it), e.g. random,verify,zero (default zero).", "list", "zero"},
+      {"seed", "wipe --passes with random: the random stream's seed (default: a fresh one per device, printed).", "seed"},
+      {"resume", "wipe --mode native: continue an interrupted zero-fill from its checkpoint (kept per drive serial "
+                 "and size in $XDG_STATE_HOME/ffrog) after re-checking the overlap before it."},
+      {"no-tear-down", "Don't ask UDisks to tear down stacked devices (LUKS, LVM...)."},
+      {{"j", "parallel"}, "Devices processed at the same time (default 4).", "n", "4"},
+  });
+
+  if (!p.parse(args)) return fail(ExitUsage, p.errorText());
+  json_ = p.isSet("json");
+  progress_ = p.isSet("progress");
+  if (p.isSet(help)) {
+    printText(p.helpText());
+    return ExitOk;
+  }
+
+  const QStringList positional = p.positionalArguments();
+  command_ = positional.value(0);
+  if (positional.size() != 1 || !QStringList{"list", "format", "wipe", "write"}.contains(command_)) {
+    return fail(ExitUsage, "Expected exactly one command: list, format, wipe or write (see --help).");
+  }
+
+  // Validate the command's own options before touching the bus.
+  const QString mode = p.value("mode");
+  const bool verify = p.isSet("verify");
+  if (command_ == "format" && p.value("fs").isEmpty()) return fail(ExitUsage, "format needs --fs.");
+  const QString engine = p.value("engine");
+  const FormatProfile* profile = FormatProfile::find(p.value("profile"));
+  if (!profile) return fail(ExitUsage, "--profile must be default, large-files, small-files or quick.");
+  if (p.isSet("profile") && command_ != "format") return fail(ExitUsage, "--profile only applies to format.");
+  FatFormat::Options nativeFormat;
+  if (engine != "udisks" && engine != "native") return fail(ExitUsage, "--engine must be udisks or native.");
+  if (engine == "native") {
+    if (command_ != "format") return fail(ExitUsage, "--engine only applies to format.");
+    if (!FatFormat::typeFromName(p.value("fs"), &nativeFormat.type)) {
+      return fail(ExitUsage, "--engine native supports --fs vfat and exfat only.");
+    }
+    if (p.isSet("erase")) return fail(ExitUsage, "--erase needs --engine udisks (or wipe --mode native first).");
+    nativeFormat.label = p.value("label");
+    nativeFormat.cancel = &cancel_;
+    bool clusterOk = true;
+    if (p.isSet("cluster")) nativeFormat.clusterBytes = p.value("cluster").toUInt(&clusterOk);
+    if (!clusterOk) return fail(ExitUsage, "--cluster needs a size in bytes.");
+    if (!p.isSet("cluster")) nativeFormat.clusterBytes = profile->clusterBytes(p.value("fs"));
+  } else if (p.isSet("cluster")) {
+    return fail(ExitUsage, "--cluster needs --engine native.");
+  }
+  PartitionLayout::Table table = PartitionLayout::Table::Mbr;
+  const bool newTable = p.isSet("table");
+  if (newTable) {
+    if (command_ != "format") return fail(ExitUsage, "--table only applies to format.");
+    if (engine == "native") return fail(ExitUsage, "--table needs --engine udisks (native formats the whole disk).");
+    if (!PartitionLayout::tableFromName(p.value("table"), &table)) return fail(ExitUsage, "--table must be dos or gpt.");
+  }
+  if (command_ == "wipe" && !QStringList{"quick", "full", "native", "instant"}.contains(mode)) {
+    return fail(ExitUsage, "wipe needs --mode quick, full, native or instant.");
+  }
+  if (verify && command_ != "write" && (command_ != "wipe" || mode == "quick")) {
+    return fail(ExitUsage, "--verify only applies to write and to wipe --mode full, native or instant.");
+  }
+  if (p.isSet("resume") && !(command_ == "wipe" && mode == "native")) {
+    return fail(ExitUsage, "--resume only applies to wipe --mode native.");
+  }
+  WipePasses passes;
+  QString passesError;
+  if (!WipePasses::parse(p.value("passes"), &passes, &passesError)) return fail(ExitUsage, passesError);
+  if (p.isSet("passes") && !(command_ == "wipe" && mode == "native")) return fail(ExitUsage, "--passes only applies to wipe --mode native.");
+  if (p.isSet("resume") && !passes.isSingleZero()) return fail(ExitUsage, "--resume only applies to a single zero pass.");
+  quint64 fixedSeed = 0;
+  if (p.isSet("seed") && (!passes.hasRandom() || !RandomFill::parseSeed(p.value("seed"), &fixedSeed))) {
+    return fail(ExitUsage, "--seed needs a number (decimal or 0x hex) and a random pass.");
+  }
+  if (p.isSet("sha256") && !(command_ == "write" && verify)) {
+    return fail(ExitUsage, "--sha256 only applies to write --verify.");
+  }
+  const QString image = p.value("image");
+  if (command_ == "write") {
+    const QFileInfo fi(image);
+    if (image.isEmpty()) return fail(ExitUsage, "write needs --image.");
+    if (!fi.isFile() || !fi.isReadable()) return fail(ExitUsage, "Can't read the image " + image + ".");
+  }
+  bool lagOk = false;
+  const quint64 lagMiB = p.value("lag").toULongLong(&lagOk);
+  if (!lagOk || lagMiB == 0) return fail(ExitUsage, "--lag needs a positive number of MiB.");
+  if (p.isSet("lag") && command_ != "write") return fail(ExitUsage, "--lag only applies to write.");
+  const bool delta = p.isSet("delta");
+  const bool assumeZeroed = p.isSet("assume-zeroed");
+  if ((delta || assumeZeroed) && command_ != "write") return fail(ExitUsage, "--delta and --assume-zeroed only apply to write.");
+  bool parallelOk = false;
+  const int parallel = p.value("parallel").toInt(&parallelOk);
+  if (!parallelOk || parallel < 1) return fail(ExitUsage, "--parallel needs a positive number.");
+
+  QString err;
+  DeviceBackend* backend = DeviceBackend::create(p.value("backend"), udisks_, this, &err);
+  if (!backend) return fail(ExitUsage, err);
+
+  // Enumerate once. --progress follows UDisks Job objects, which needs the watching cache.
+  QElapsedTimer enumTimer;
+  enumTimer.start();
+  if (progress_ && !udisks_->startWatching(&err)) return fail(ExitNoUDisks, err);
+  if (!(progress_ && backend == udisks_) && !backend->resync(&err)) return fail(ExitNoUDisks, err);
+  const QVector<UsbDevice> all = backend->devices(&err);
+  steps_.append(OpStep{QStringLiteral("enumerate"), enumTimer.elapsed()});
+
+  const QStringList nodes = splitValues(p.values("device"));
+  QVector<UDisks2::UsbDevice> selected;
+  for (const UDisks2::UsbDevice& d : all) {
+    if (!nodes.isEmpty() && !nodes.contains(d.deviceNode)) continue;
+    if (!matchesAny(d.serial, p.values("serial"))) continue;
+    if (!matchesAny(d.vendor, p.values("vendor"))) continue;
+    if (!matchesAny(d.model, p.values("model"))) continue;
+    selected.push_back(d);
+  }
+
+  if (command_ == "list") {
+    QJsonArray devices;
+    for (const UDisks2::UsbDevice& d : selected) {
+      devices.append(deviceJson(d));
+      printText(QString("%1  %2  %3 %4  serial=%5%6")
+                    .arg(d.deviceNode, humanBytes(d.sizeBytes), d.vendor, d.model, d.serial)
+                    .arg(d.readOnly ? QStringLiteral("  [read-only]") : QString()));
+    }
+    if (selected.isEmpty() && !err.isEmpty()) printError(err);
+    printJson(QJsonObject{{"command", command_},
+                          {"ok", true},
+                          {"exitCode", ExitOk},
+                          {"ms", total.elapsed()},
+                          {"steps", stepsJson(steps_)},
+                          {"devices", devices}});
+    return ExitOk;
+  }
+
+  // Destructive commands: the confirmation must name exactly the selected nodes.
+  if (backend->isReadOnly()) return fail(ExitRefused, QString("The %1 device backend is read-only: only list works with it.").arg(backend->name()));
+  QStringList selectedNodes;
+  for (const UDisks2::UsbDevice& d : selected) {
+    if (d.readOnly) return fail(ExitRefused, d.deviceNode + " is read-only.");
+    selectedNodes << d.deviceNode;
+  }
+  if (selected.isEmpty()) return fail(ExitRefused, "No USB removable device matches the filters.");
+  const QStringList confirmed = splitValues(p.values("confirm"));
+  if (QSet<QString>(confirmed.cbegin(), confirmed.cend()) != QSet<QString>(selectedNodes.cbegin(), selectedNodes.cend())) {
+    return fail(ExitRefused, QString("--confirm must list exactly the selected device(s): %1").arg(selectedNodes.join(",")));
+  }
+
+  jobs_->setMaxConcurrent(parallel);
+  const bool tearDown = !p.isSet("no-tear-down");
+  ZeroVerify::Options verifyOpts;
+  verifyOpts.cancel = &cancel_;
+  // Chains the read-back check after a wipe when --verify is set.
+  auto withVerify = [this, verify, verifyOpts](const QString& block, QFuture<OpResult> wipe) {
+    if (!verify) return wipe;
+    return udisks_->verifyAfter(block, wipe, verifyOpts, jobs_->threadPool(),
+                                progressReporter(block, QStringLiteral("verify")));
+  };
+
+  // Image writes: the image is hashed once for the whole batch, by the first verify.
+  ImageVerify::Options imageVerifyOpts;
+  imageVerifyOpts.sha256 = p.isSet("sha256");
+  imageVerifyOpts.cancel = &cancel_;
+  const auto imageSource = std::make_shared<ImageVerify::Source>(image, imageVerifyOpts);
+  auto withImageVerify = [=, this](const QString& block, QFuture<OpResult> write) {
+    if (!verify) return write;
+    return udisks_->verifyImageAfter(block, write, imageSource, jobs_->threadPool(),
+                                     progressReporter(block, QStringLiteral("verify")));
+  };
+
+  int code = ExitOk;
+  if (command_ == "write" && selected.size() > 1) {
+    // One reader for the whole batch; each device is one writer of the shared ring.
+    ImageFanOut::Options opts;
+    opts.lagBytes = lagMiB << 20;
+    opts.delta = delta;
+    opts.targetZeroed = assumeZeroed;
+    opts.cancel = &cancel_;
+    // Writers queued behind -j would only be cut loose onto their own reader.
+    if (!p.isSet("parallel")) jobs_->setMaxConcurrent(static_cast<int>(selected.size()));
+    QHash<QString, int> writerIndex;
+    for (const UDisks2::UsbDevice& d : selected) {
+      if (!writerIndex.contains(d.blockObject)) writerIndex.insert(d.blockObject, static_cast<int>(writerIndex.size()));
+    }
+    auto fanOut = std::make_shared<ImageFanOut>(image, static_cast<int>(writerIndex.size()), opts);
+    code = runBatch(QString("write image (%1, fan-out)").arg(QFileInfo(image).fileName()), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return withImageVerify(d.blockObject, udisks_->writeImageFanOutBlockAsync(d.blockObject, fanOut, writerIndex.value(d.blockObject),
+                                                                                jobs_->threadPool(), progressReporter(d.blockObject)));
+    }, false);
+  } else if (command_ == "write") {
+    ImageWriter::Options opts;
+    opts.delta = delta;
+    opts.targetZeroed = assumeZeroed;
+    opts.cancel = &cancel_;
+    code = runBatch(QString("write image (%1)").arg(QFileInfo(image).fileName()), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return withImageVerify(d.blockObject,
+                             udisks_->writeImageBlockAsync(d.blockObject, image, opts, jobs_->threadPool(), progressReporter(d.blockObject)));
+    });
+  } else if (command_ == "format" && engine == "native") {
+    code = runBatch(QString("format (%1, native, %2)").arg(p.value("fs"), profile->name), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return udisks_->nativeFormatBlockAsync(d.blockObject, nativeFormat, jobs_->threadPool(),
+                                             progressReporter(d.blockObject, QStringLiteral("format")));
+    });
+  } else if (command_ == "format") {
+    const QString fs = p.value("fs");
+    const QString label = p.value("label");
+    const QString erase = p.value("erase");
+    const FormatProfile prof = *profile;
+    const bool mkfsArgs = udisks_->supportsMkfsArgs();
+    if (!mkfsArgs && prof.hasMkfsArgs(fs)) {
+      printError(QString("udisks %1 ignores mkfs-args (2.10 or newer needed): profile %2 formats with mkfs defaults.")
+                     .arg(udisks_->version(), prof.name));
+    }
+    if (newTable) {
+      code = runBatch(QString("format (%1, new %2 table, %3)").arg(fs, PartitionLayout::tableName(table), prof.describe(fs, mkfsArgs)), selected,
+                      [=, this](const UDisks2::UsbDevice& d) {
+        return udisks_->partitionAndFormatBlockAsync(d.blockObject, table, fs, label, erase, tearDown, prof);
+      });
+    } else {
+      code = runBatch(QString("format (%1, %2)").arg(fs, prof.describe(fs, mkfsArgs)), selected, [=, this](const UDisks2::UsbDevice& d) {
+        return udisks_->formatBlockAsync(d.blockObject, fs, label, erase, tearDown, prof);
+      });
+    }
+  } else if (mode == "quick") {
+    code = runBatch(QStringLiteral("quick wipe"), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return udisks_->wipeBlockAsync(d.blockObject, /*eraseMode*/ QString(), tearDown);
+    });
+  } else if (mode == "full") {
+    code = runBatch(QStringLiteral("full wipe (erase=zero)"), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return withVerify(d.blockObject, udisks_->wipeBlockAsync(d.blockObject, QStringLiteral("zero"), tearDown));
+    });
+  } else if (mode == "native" && !passes.isSingleZero()) {
+    ZeroFill::Options fill;
+    fill.cancel = &cancel_;
+    QHash<QString, WipePasses> plans;
+    for (const UDisks2::UsbDevice& d : selected) {
+      WipePasses plan = passes;
+      plan.seed = p.isSet("seed") ? fixedSeed : RandomFill::newSeed();
+      if (plan.hasRandom() && !json_) printError(QString("%1: random pass seed %2").arg(d.deviceNode, RandomFill::seedName(plan.seed)));
+      plans.insert(d.blockObject, plan);
+    }
+    // --verify checks the last write pass as a pass of its own, with the seed if it was random.
+    WipePasses shown = passes;
+    if (verify) {
+      shown.addFinalVerify();
+      for (WipePasses& plan : plans) plan.addFinalVerify();
+    }
+    code = runBatch(QString("full wipe (native, %1)").arg(shown.spec()), selected, [=, this](const UDisks2::UsbDevice& d) {
+      auto progressFor = [this, d](const QString& label) { return progressReporter(d.blockObject, label); };
+      return udisks_->multiPassWipeBlockAsync(d.blockObject, plans.value(d.blockObject), fill, verifyOpts, jobs_->threadPool(), progressFor);
+    });
+  } else if (mode == "native") {
+    ZeroFill::Options opts;
+    opts.cancel = &cancel_;
+    const bool resume = p.isSet("resume");
+    auto checkpoints = std::make_shared<WipeCheckpoint>();
+    for (const UDisks2::UsbDevice& d : selected) {
+      WipeCheckpoint::Entry entry;
+      if (resume || json_ || !checkpoints->find(d.serial, d.sizeBytes, &entry)) continue;
+      printError(QString("%1: an interrupted zero-fill reached %2; --resume continues from there.").arg(d.deviceNode, entry.describe()));
+    }
+    code = runBatch(QStringLiteral("full wipe (native zero-fill)"), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return withVerify(d.blockObject, udisks_->zeroFillBlockAsync(d.blockObject, opts, jobs_->threadPool(), progressReporter(d.blockObject),
+                                                                   checkpoints, WipeCheckpoint::Drive{d.serial, d.sizeBytes, resume}));
+    });
+  } else {
+    FastWipe::Options opts;
+    opts.cancel = &cancel_;
+    code = runBatch(QStringLiteral("instant wipe"), selected, [=, this](const UDisks2::UsbDevice& d) {
+      return withVerify(d.blockObject, udisks_->instantWipeBlockAsync(d.blockObject, opts, jobs_->threadPool(),
+                                                                      progressReporter(d.blockObject)));
+    });
+  }
+
+  printText(QString("%1 OK, %2 failed in %3 s.")
+                .arg(results_.size() - failed_)
+                .arg(failed_)
+                .arg(total.elapsed() / 1000.0, 0, 'f', 1));
+  printJson(QJsonObject{{"command", command_},
+                        {"operation", operation_},
+                        {"ok", code == ExitOk},
+                        {"exitCode", code},
+                        {"ms", total.elapsed()},
+                        {"steps", stepsJson(steps_)},
+                        {"results", results_}});
+  return code;
+}
+
+int Cli::runBatch(const QString& opName, const QVector<UDisks2::UsbDevice>& targets, const TaskFactory& makeTask, bool linkLimits) {
+  operation_ = opName;
+  for (const UDisks2::UsbDevice& d : targets) {
+    const int id = jobs_->enqueue(d.blockObject, [makeTask, d]() { return makeTask(d); },
+                                  linkLimits ? UsbTopology::probe(d.deviceNode).links : QVector<UsbTopology::Link>{});
+    if (id == 0) continue; // the same drive selected twice
+    DeviceJob job;
+    job.device = d;
+    job.queued.start();
+    jobsById_.insert(id, job);
+  }
+
+  QEventLoop loop;
+  connect(jobs_, &JobQueue::idle, &loop, &QEventLoop::quit);
+  loop.exec();
+  return failed_ > 0 ? ExitFailed : ExitOk;
+}
+
+void Cli::onJobStarted(int id, const QString& key) {
+  const auto it = jobsById_.find(id);
+  if (it == jobsById_.end()) return;
+  it->waitMs = it->queued.elapsed();
+  it->started.start();
+  runningJobByKey_.insert(key, id);
+  if (!json_) printError(QString("%1: %2 started").arg(it->device.deviceNode, operation_));
+}
+
+void Cli::onJobFinished(int id, const QString& key, const OpResult& result) {
+  runningJobByKey_.remove(key);
+  const auto it = jobsById_.find(id);
+  if (it == jobsById_.end()) return;
+  if (!result.ok) ++failed_;
+
+  QJsonObject o = deviceJson(it->device);
+  o.insert("ok", result.ok);
+  o.insert("error", result.error);
+  o.insert("detail", result.detail);
+  o.insert("waitMs", it->waitMs);
+  o.insert("ms", it->started.elapsed());
+  o.insert("steps", stepsJson(result.steps));
+  results_.append(o);
+
+  QStringList steps;
+  for (const OpStep& s : result.steps) steps << QString("%1 %2 ms").arg(s.name).arg(s.ms);
+  printText(QString("%1  %2  %3 (%4 s: %5)")
+                .arg(result.ok ? QStringLiteral("OK    ") : QStringLiteral("FAILED"), it->device.deviceNode,
+                     result.ok ? operation_ : result.error)
+                .arg(it->started.elapsed() / 1000.0, 0, 'f', 1)
+                .arg(steps.join(", ")));
+  if (!result.detail.isEmpty()) printText("        " + result.detail);
+  jobsById_.erase(it);
+}
+
+IoProgressFn Cli::progressReporter(const QString& key, const QString& operation) {
+  // Installed without --progress too: JobQueue's per-link limits are tuned from it.
+  return [this, key, operation](const IoProgress& p) {
+    QMetaObject::invokeMethod(this, [this, key, p, operation]() { onProgress(key, p, operation); }, Qt::QueuedConnection);
+  };
+}
+
+void Cli::onProgress(const QString& key, const IoProgress& p, const QString& operation) {
+  jobs_->reportProgress(key, p.bytesDone);
+  if (!progress_) return;
+  const auto idIt = runningJobByKey_.constFind(key);
+  if (idIt == runningJobByKey_.constEnd()) return;
+  const auto it = jobsById_.find(*idIt);
+  if (it == jobsById_.end()) return;
+  const qint64 now = it->started.elapsed();
+  if (it->lastProgressMs >= 0 && now - it->lastProgressMs < kProgressIntervalMs) return;
+  it->lastProgressMs = now;
+
+  if (json_) {
+    const QJsonObject o{{"event", "progress"},
+                        {"device", it->device.deviceNode},
+                        {"operation", operation.isEmpty() ? operation_ : operation},
+                        {"bytesDone", static_cast<qint64>(p.bytesDone)},
+                        {"bytesTotal", static_cast<qint64>(p.bytesTotal)},
+                        {"bytesPerSec", p.bytesPerSec},
+                        {"etaSeconds", p.eta()}};
+    printError(QString::fromUtf8(QJsonDocument(o).toJson(QJsonDocument::Compact)));
+    return;
+  }
+  const QString pct = p.bytesTotal ? QString::number(100.0 * p.bytesDone / p.bytesTotal, 'f', 1) + "%" : QStringLiteral("-");
+  printError(QString("%1: %2%3 @ %4/s, ETA %5")
+                 .arg(it->device.deviceNode, pct, operation.isEmpty() ? QString() : " (" + operation + ")",
+                      humanBytes(static_cast<quint64>(p.bytesPerSec)), formatDuration(p.eta())));
+}
+
+int Cli::fail(int code, const QString& message) {
+  if (json_) {
+    printJson(QJsonObject{{"command", command_},
+                          {"ok", false},
+                          {"exitCode", code},
+                          {"error", message},
+                          {"steps", stepsJson(steps_)}});
+  } else {
+    printError("ffrog-cli: " + message);
+  }
+  return code;
+}
+
+QJsonObject Cli::deviceJson(const UDisks2::UsbDevice& d) {
+  return QJsonObject{{"device", d.deviceNode},
+                     {"blockObject", d.blockObject},
+                     {"vendor", d.vendor},
+                     {"model", d.model},
+                     {"serial", d.serial},
+                     {"sizeBytes", static_cast<qint64>(d.sizeBytes)},
+                     {"readOnly", d.readOnly}};
+}
+
+QJsonArray Cli::stepsJson(const QVector<OpStep>& steps) {
+  QJsonArray out;
+  for (const OpStep& s : steps) out.append(QJsonObject{{"name", s.name}, {"ms", s.ms}});
+  return out;
+}
+
+void Cli::printJson(const QJsonObject& o) const {
+  if (!json_) return;
+  QTextStream(stdout) << QJsonDocument(o).toJson(QJsonDocument::Indented);
+}
+
+void Cli::printText(const QString& line) const {
+  if (json_) return;
+  QTextStream(stdout) << line << Qt::endl;
+}
+
+void Cli::printError(const QString& line) const {
+  QTextStream(stderr) << line << Qt::endl;
+}
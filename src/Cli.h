@@ -0,0 +1,88 @@
+#pragma once
+
+#include "OpResult.h"
+#include "UDisks2.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+
+class JobQueue;
+
+// Headless front end (ffrog-cli): the same UDisks2 / JobQueue / engine stack as the GUI, driven
+// by command-line arguments, with text or JSON output for scripts and provisioning rigs.
+//
+//   ffrog-cli list [--json] [filters]
+//   ffrog-cli format --fs vfat [--label L] [--erase zero] [filters] --confirm /dev/sdb
+//   ffrog-cli wipe --mode quick|full|native|instant [--verify] [filters] --confirm /dev/sdb,/dev/sdc
+//
+// Filters: --device NODE, --serial S, --vendor PATTERN, --model PATTERN (wildcards, case
+// insensitive; repeatable). Destructive commands never prompt: --confirm must name exactly the
+// device nodes the filters selected, like the GUI's confirmation field.
+class Cli final : public QObject {
+  Q_OBJECT
+public:
+  // Process exit codes.
+  enum ExitCode {
+    ExitOk = 0,
+    ExitFailed = 1,       // at least one device operation failed
+    ExitUsage = 2,        // bad arguments
+    ExitRefused = 3,      // nothing selected, --confirm mismatch, or a read-only device selected
+    ExitNoUDisks = 4,     // enumeration failed (udisksd not reachable...)
+  };
+
+  explicit Cli(QObject* parent = nullptr);
+  ~Cli() override;
+
+  // Parses `args` (including argv[0]), runs the command on the current event loop and returns
+  // the exit code.
+  int run(const QStringList& args);
+
+private:
+  struct DeviceJob {
+    UDisks2::UsbDevice device;
+    QElapsedTimer queued;
+    qint64 waitMs = 0; // queued -> started
+    QElapsedTimer started;
+    qint64 lastProgressMs = -1;
+  };
+
+  using TaskFactory = std::function<QFuture<OpResult>(const UDisks2::UsbDevice&)>;
+
+  // `linkLimits`: queue each job behind its USB hub/bus/controller (see JobQueue); off for jobs
+  // that must all run at once.
+  int runBatch(const QString& opName, const QVector<UDisks2::UsbDevice>& targets, const TaskFactory& makeTask, bool linkLimits = true);
+  void onJobStarted(int id, const QString& key);
+  void onJobFinished(int id, const QString& key, const OpResult& result);
+  IoProgressFn progressReporter(const QString& key, const QString& operation = {});
+  void onProgress(const QString& key, const IoProgress& p, const QString& operation);
+
+  static QJsonObject deviceJson(const UDisks2::UsbDevice& d);
+  static QJsonArray stepsJson(const QVector<OpStep>& steps);
+  int fail(int code, const QString& message);
+  void printJson(const QJsonObject& o) const;
+  void printText(const QString& line) const;
+  void printError(const QString& line) const;
+
+  UDisks2* udisks_;
+  JobQueue* jobs_;
+  bool json_ = false;
+  bool progress_ = false;
+  std::atomic_bool cancel_{false};
+
+  QString command_;
+  QString operation_;
+  QVector<OpStep> steps_; // command-level steps (enumerate)
+  QHash<int, DeviceJob> jobsById_;
+  QHash<QString, int> runningJobByKey_;
+  QJsonArray results_;
+  int failed_ = 0;
+};
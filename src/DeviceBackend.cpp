@@ -0,0 +1,16 @@
+#include "DeviceBackend.h"
+#include "MockBackend.h"
+#include "SysfsBackend.h"
+#include "UDisks2.h"
+
+DeviceBackend* DeviceBackend::create(const QString& spec, UDisks2* udisks, QObject* parent, QString* error) {
+  if (spec.isEmpty() || spec == "udisks") return udisks;
+  if (spec == "sysfs") return new SysfsBackend(parent);
+  if (spec.startsWith("mock:")) {
+    auto* mock = new MockBackend(parent);
+    mock->setSource(spec.mid(5));
+    return mock;
+  }
+  if (error) *error = QString("Unknown device backend '%1' (expected udisks, sysfs or mock:<file.json>).").arg(spec);
+  return nullptr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "OpResult.h"
+#include "UsbDevice.h"
+
+#include <QFuture>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class UDisks2;
+
+// Where the device list comes from: USB whole-disk discovery and hotplug, with the same safety
+// filters as UDisks2::listUsbRemovable(). Operations (format, wipe...) always go through
+// UDisks2, whichever backend found the device.
+class DeviceBackend : public QObject {
+  Q_OBJECT
+public:
+  using QObject::QObject;
+
+  virtual QString name() const = 0;
+
+  // A read-only backend lists devices but must never have jobs run on them: its list is not
+  // checked by UDisks' safety filters (a mock file can name any disk).
+  virtual bool isReadOnly() const { return false; }
+
+  // Starts hotplug monitoring and takes the first inventory. devicesChanged() follows every
+  // change from then on.
+  virtual bool startWatching(QString* error = nullptr) = 0;
+
+  // Takes a fresh inventory (manual refresh, consistency check); emits devicesChanged().
+  virtual bool resync(QString* error = nullptr) = 0;
+  virtual QFuture<OpResult> resyncAsync() = 0;
+
+  // The current inventory, sorted by device node. No I/O.
+  virtual QVector<UsbDevice> devices(QString* error = nullptr) const = 0;
+
+  // "udisks" (returns `udisks` itself), "sysfs", or "mock:<file.json>" (a read-only device list
+  // in the shape of `ffrog-cli list --json`). Returns nullptr and sets `error` for anything else.
+  static DeviceBackend* create(const QString& spec, UDisks2* udisks, QObject* parent, QString* error = nullptr);
+
+Q_SIGNALS:
+  void devicesChanged();
+};
@@ -0,0 +1,131 @@
+#include "DeviceModel.h"
+#include "IoProgress.h"
+
+#include <QSet>
+
+DeviceModel::DeviceModel(QObject* parent) : QAbstractTableModel(parent) {}
+
+void DeviceModel::setDevices(const QList<UsbDevice>& devices) {
+  QHash<QString, int> incoming;
+  incoming.reserve(devices.size());
+  for (int i = 0; i < devices.size(); ++i) incoming.insert(devices[i].blockObject, i);
+
+  // Removals, bottom-up in contiguous runs so the rows above keep their indices.
+  for (int row = rows_.size() - 1; row >= 0;) {
+    if (incoming.contains(rows_[row].blockObject)) {
+      --row;
+      continue;
+    }
+    int first = row;
+    while (first > 0 && !incoming.contains(rows_[first - 1].blockObject)) --first;
+    beginRemoveRows({}, first, row);
+    rows_.erase(rows_.begin() + first, rows_.begin() + row + 1);
+    endRemoveRows();
+    row = first - 1;
+  }
+  reindex();
+
+  // Changes in place: one dataChanged per changed row, over the device columns only.
+  for (int row = 0; row < rows_.size(); ++row) {
+    const UsbDevice& d = devices[incoming.value(rows_[row].blockObject)];
+    if (d == rows_[row]) continue;
+    rows_[row] = d;
+    Q_EMIT dataChanged(index(row, ColDevice), index(row, ColReadOnly));
+  }
+
+  // Additions.
+  QList<UsbDevice> added;
+  QSet<QString> seen;
+  for (const UsbDevice& d : devices) {
+    if (index_.contains(d.blockObject) || seen.contains(d.blockObject)) continue;
+    seen.insert(d.blockObject);
+    added.push_back(d);
+  }
+  if (!added.isEmpty()) {
+    beginInsertRows({}, rows_.size(), rows_.size() + added.size() - 1);
+    rows_.append(added);
+    reindex();
+    endInsertRows();
+  }
+}
+
+void DeviceModel::setJobState(const QString& blockObject, const QString& state) {
+  if (state.isEmpty()) {
+    if (jobs_.remove(blockObject) == 0) return;
+    cellChanged(blockObject, ColJob);
+    cellChanged(blockObject, ColProgress);
+    return;
+  }
+  Job& job = jobs_[blockObject];
+  if (job.state == state) return;
+  job.state = state;
+  cellChanged(blockObject, ColJob);
+}
+
+void DeviceModel::setJobProgress(const QString& blockObject, const QString& progress) {
+  const auto it = jobs_.find(blockObject);
+  if (it == jobs_.end() || it->progress == progress) return;
+  it->progress = progress;
+  cellChanged(blockObject, ColProgress);
+}
+
+void DeviceModel::reindex() {
+  index_.clear();
+  index_.reserve(rows_.size());
+  for (int row = 0; row < rows_.size(); ++row) index_.insert(rows_[row].blockObject, row);
+}
+
+void DeviceModel::cellChanged(const QString& blockObject, int column) {
+  const int row = rowOf(blockObject);
+  if (row < 0) return;
+  const QModelIndex cell = index(row, column);
+  Q_EMIT dataChanged(cell, cell, {Qt::DisplayRole});
+}
+
+int DeviceModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : rows_.size();
+}
+
+int DeviceModel::columnCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : ColCount;
+}
+
+QVariant DeviceModel::data(const QModelIndex& index, int role) const {
+  if (!index.isValid() || index.row() >= rows_.size()) return {};
+  const UsbDevice& d = rows_[index.row()];
+  switch (role) {
+    case Qt::DisplayRole:
+      switch (index.column()) {
+        case ColDevice: return d.deviceNode;
+        case ColName: return QString("%1 %2").arg(d.vendor.trimmed(), d.model.trimmed()).trimmed();
+        case ColSize: return humanBytes(d.sizeBytes);
+        case ColReadOnly: return d.readOnly ? QStringLiteral("READONLY") : QString();
+        case ColJob: return jobs_.value(d.blockObject).state;
+        case ColProgress: return jobs_.value(d.blockObject).progress;
+      }
+      return {};
+    case Qt::ToolTipRole:
+      return QString("Block: " + d.blockObject + "\nDrive: " + d.driveObject +
+                     (d.serial.isEmpty() ? "" : ("\nSerial: " + d.serial)));
+    case Qt::TextAlignmentRole:
+      if (index.column() == ColSize) return int(Qt::AlignRight | Qt::AlignVCenter);
+      return {};
+    case BlockObjectRole: return d.blockObject;
+    case DeviceNodeRole: return d.deviceNode;
+    case ReadOnlyRole: return d.readOnly;
+  }
+  return {};
+}
+
+QVariant DeviceModel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+  switch (section) {
+    case ColDevice: return QStringLiteral("Device");
+    case ColName: return QStringLiteral("Vendor / model");
+    case ColSize: return QStringLiteral("Size");
+    case ColReadOnly: return QStringLiteral("Read-only");
+    case ColJob: return QStringLiteral("Job");
+    case ColProgress: return QStringLiteral("Progress");
+  }
+  return {};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "UsbDevice.h"
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// The device list, keyed by block object. setDevices() applies a new snapshot as a minimal diff
+// (rows removed, changed cells, rows appended), so a refresh that changes nothing emits nothing
+// and the view keeps its selection and scroll position. Job state and progress are per-row cells
+// of their own, updated without touching the rest of the row.
+class DeviceModel final : public QAbstractTableModel {
+  Q_OBJECT
+public:
+  enum Column { ColDevice, ColName, ColSize, ColReadOnly, ColJob, ColProgress, ColCount };
+  enum Role { BlockObjectRole = Qt::UserRole, DeviceNodeRole, ReadOnlyRole };
+
+  explicit DeviceModel(QObject* parent = nullptr);
+
+  // Rows keep their order; new devices are appended in snapshot order.
+  void setDevices(const QList<UsbDevice>& devices);
+
+  // Empty `state` clears the job (and its progress). Kept for devices not currently listed.
+  void setJobState(const QString& blockObject, const QString& state);
+  void setJobProgress(const QString& blockObject, const QString& progress);
+  bool hasJob(const QString& blockObject) const { return jobs_.contains(blockObject); }
+
+  const UsbDevice& device(int row) const { return rows_[row]; }
+  int rowOf(const QString& blockObject) const { return index_.value(blockObject, -1); }
+
+  int rowCount(const QModelIndex& parent = {}) const override;
+  int columnCount(const QModelIndex& parent = {}) const override;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+  struct Job {
+    QString state;
+    QString progress;
+  };
+
+  void reindex();
+  void cellChanged(const QString& blockObject, int column);
+
+  QList<UsbDevice> rows_;
+  QHash<QString, int> index_; // block object -> row
+  QHash<QString, Job> jobs_;  // block object -> job shown in its row
+};
@@ -0,0 +1,222 @@
+#include "FastWipe.h"
+#include "RawDevice.h"
+#include "ZeroCheck.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+quint64 readSysfsU64(const QString& path) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return 0;
+  return f.readAll().trimmed().toULongLong();
+}
+
+bool cancelled(const std::atomic_bool* cancel, QString* error) {
+  if (!cancel || !cancel->load(std::memory_order_relaxed)) return false;
+  if (error) *error = QStringLiteral("Wipe cancelled.");
+  return true;
+}
+
+// BLKZEROOUT/BLKDISCARD over [start, end), `step` bytes per ioctl.
+bool rangeIoctl(int fd, unsigned long req, const char* name, quint64 start, quint64 end, quint64 step,
+                const std::atomic_bool* cancel, IoProgressMeter& meter, QString* error) {
+  for (quint64 off = start; off < end; off += step) {
+    if (cancelled(cancel, error)) return false;
+    std::uint64_t range[2] = {off, std::min(step, end - off)};
+    if (::ioctl(fd, req, range) != 0) {
+      if (error) *error = RawDevice::errnoMessage(QString("%1 at offset %2").arg(name).arg(off));
+      return false;
+    }
+    meter.update(off + range[1]);
+  }
+  return true;
+}
+
+bool writeZeros(int fd, const AlignedBuffer& zeros, quint64 off, quint64 len, QString* error) {
+  while (len > 0) {
+    const std::size_t n = static_cast<std::size_t>(std::min<quint64>(len, zeros.size()));
+    const ssize_t w = ::pwrite(fd, zeros.data(), n, static_cast<off_t>(off));
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) {
+      if (error) *error = RawDevice::errnoMessage(QString("pwrite at offset %1").arg(off));
+      return false;
+    }
+    off += static_cast<quint64>(w);
+    len -= static_cast<quint64>(w);
+  }
+  return true;
+}
+
+} // namespace
+
+FastWipe::Caps FastWipe::Caps::probe(const QString& devicePath) {
+  // /dev/sdb (or a /dev/disk/by-* symlink) -> /sys/class/block/sdb/queue. Partitions have no
+  // queue/ of their own; it lives on the parent disk.
+  const QString name = QFileInfo(QFileInfo(devicePath).canonicalFilePath()).fileName();
+  QString queue = "/sys/class/block/" + name + "/queue/";
+  if (!QDir(queue).exists()) queue = "/sys/class/block/" + name + "/../queue/";
+
+  Caps c;
+  c.discardGranularity = readSysfsU64(queue + "discard_granularity");
+  c.discardMaxBytes = readSysfsU64(queue + "discard_max_bytes");
+  c.discardZeroesData = readSysfsU64(queue + "discard_zeroes_data") != 0;
+  c.writeZeroesMaxBytes = readSysfsU64(queue + "write_zeroes_max_bytes");
+  return c;
+}
+
+QString FastWipe::Caps::describe() const {
+  return QString("discard_max_bytes=%1 discard_granularity=%2 discard_zeroes_data=%3 write_zeroes_max_bytes=%4")
+      .arg(discardMaxBytes)
+      .arg(discardGranularity)
+      .arg(discardZeroesData ? 1 : 0)
+      .arg(writeZeroesMaxBytes);
+}
+
+FastWipe::Method FastWipe::choose(const Caps& caps) {
+  if (caps.writeZeroesMaxBytes > 0) return Method::ZeroOut;
+  if (caps.discardMaxBytes > 0) return caps.discardZeroesData ? Method::DiscardZeroes : Method::DiscardAndCheck;
+  // BLKZEROOUT would still work here, but the kernel then writes zero pages one bio at a time;
+  // our own engine is faster.
+  return Method::ZeroFill;
+}
+
+QString FastWipe::methodName(Method m) {
+  switch (m) {
+    case Method::ZeroOut: return QStringLiteral("zeroout (WRITE ZEROES offload)");
+    case Method::DiscardZeroes: return QStringLiteral("discard (device zeroes data) + written edges");
+    case Method::DiscardAndCheck: return QStringLiteral("discard + read-check, rewrite non-zero chunks");
+    case Method::ZeroFill: return QStringLiteral("zero-fill (no discard/zeroout offload)");
+    case Method::FileZeroRange: return QStringLiteral("fallocate ZERO_RANGE (regular file)");
+  }
+  return {};
+}
+
+QString FastWipe::Stats::summary() const {
+  return QString("method=%1 [%2], rewritten %3 bytes, %4 s")
+      .arg(methodName(method))
+      .arg(caps.describe())
+      .arg(rewrittenBytes)
+      .arg(seconds, 0, 'f', 1)
+      + (discardError.isEmpty() ? QString() : QString(" (discard failed, everything read-checked: %1)").arg(discardError));
+}
+
+bool FastWipe::run(const QString& path,
+                   const Options& opts,
+                   const IoProgressFn& progress,
+                   Stats* stats,
+                   QString* error) {
+  Stats st;
+  bool ok = true;
+
+  {
+    RawDevice dev;
+    if (!dev.open(path, RawDevice::Mode::ReadWrite, /*direct*/ true, error)) return false;
+    const quint64 size = dev.size();
+    const quint64 align = dev.alignment();
+    const quint64 step = alignDown(std::max(opts.stepBytes, align), align);
+    IoProgressMeter meter(size, progress);
+
+    if (dev.isBlockDevice()) {
+      st.caps = Caps::probe(path);
+      st.method = choose(st.caps);
+    } else {
+      st.method = Method::FileZeroRange;
+    }
+
+    switch (st.method) {
+      case Method::FileZeroRange:
+        if (::fallocate(dev.fd(), FALLOC_FL_ZERO_RANGE, 0, static_cast<off_t>(size)) != 0) {
+          // e.g. tmpfs: fall back to written zeros.
+          st.method = Method::ZeroFill;
+        }
+        meter.update(size, /*force*/ true);
+        break;
+
+      case Method::ZeroOut:
+        ok = rangeIoctl(dev.fd(), BLKZEROOUT, "BLKZEROOUT", 0, size, step, opts.cancel, meter, error);
+        break;
+
+      case Method::DiscardZeroes: {
+        // Only whole discard granules are guaranteed to read back as zeros; write the rest.
+        const quint64 g = std::max(st.caps.discardGranularity, align);
+        const quint64 bodyEnd = alignDown(size, g);
+        ok = rangeIoctl(dev.fd(), BLKDISCARD, "BLKDISCARD", 0, bodyEnd, alignDown(std::max(step, g), g),
+                        opts.cancel, meter, error);
+        if (ok && bodyEnd < size) {
+          dev.setDirect(false);
+          const AlignedBuffer zeros(size - bodyEnd);
+          ok = writeZeros(dev.fd(), zeros, bodyEnd, size - bodyEnd, error);
+          st.rewrittenBytes += size - bodyEnd;
+        }
+        break;
+      }
+
+      case Method::DiscardAndCheck: {
+        // The device may return old data, zeros or 0xFF after a discard: read everything back
+        // and write zeros over any chunk that isn't zero yet.
+        IoProgressMeter silent(size, {});
+        // Bridges that advertise discard may still reject it (EOPNOTSUPP, EIO). The check below
+        // rewrites whatever isn't zero, so the wipe goes on without the discard.
+        rangeIoctl(dev.fd(), BLKDISCARD, "BLKDISCARD", 0, size, step, opts.cancel, silent, &st.discardError);
+        const quint64 chunk = alignUp(std::max(opts.checkChunkBytes, align), align);
+        AlignedBuffer buf(chunk);
+        const AlignedBuffer zeros(chunk);
+        for (quint64 off = 0; ok && off < size; off += chunk) {
+          if (cancelled(opts.cancel, error)) {
+            ok = false;
+            break;
+          }
+          const std::size_t len = static_cast<std::size_t>(std::min(chunk, size - off));
+          ssize_t r = 0;
+          do {
+            r = ::pread(dev.fd(), buf.data(), len, static_cast<off_t>(off));
+          } while (r < 0 && errno == EINTR);
+          if (r != static_cast<ssize_t>(len)) {
+            if (error) *error = RawDevice::errnoMessage(QString("read-check at offset %1").arg(off));
+            ok = false;
+            break;
+          }
+          if (ZeroCheck::scan(buf.data(), len, 4096).nonZeroSectors != 0) {
+            ok = writeZeros(dev.fd(), zeros, off, len, error);
+            st.rewrittenBytes += len;
+          }
+          meter.update(off + len);
+        }
+        break;
+      }
+
+      case Method::ZeroFill:
+        break;
+    }
+
+    if (ok && st.method != Method::ZeroFill && !dev.sync(error)) ok = false;
+    if (ok) meter.update(size, /*force*/ true);
+    st.seconds = meter.elapsedSeconds();
+  } // ZeroFill opens the device itself, exclusively: ours must be closed first.
+
+  if (ok && st.method == Method::ZeroFill) {
+    ZeroFill::Options fill = opts.fill;
+    if (!fill.cancel) fill.cancel = opts.cancel;
+    ZeroFill::Stats fs;
+    ok = ZeroFill::run(path, fill, progress, &fs, error);
+    st.rewrittenBytes = fs.bytesWritten;
+    st.seconds += fs.seconds;
+  }
+
+  if (stats) *stats = st;
+  return ok;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "IoProgress.h"
+#include "ZeroFill.h"
+
+#include <QString>
+
+#include <atomic>
+
+// "Instant" wipe: clears a device with BLKZEROOUT (hardware WRITE ZEROES offload) or BLKDISCARD
+// instead of writing every byte, falling back to written zeros (ZeroFill) wherever the result
+// isn't guaranteed to read back as zeros. Regular files use fallocate(FALLOC_FL_ZERO_RANGE).
+// Blocking: run it on a worker thread.
+class FastWipe final {
+public:
+  // What the kernel reports for the device under /sys/class/block/<name>/queue.
+  struct Caps {
+    quint64 discardGranularity = 0;
+    quint64 discardMaxBytes = 0;     // 0 = no discard support
+    bool discardZeroesData = false;  // legacy flag; always 0 on kernels >= 4.12
+    quint64 writeZeroesMaxBytes = 0; // 0 = no WRITE ZEROES/WRITE SAME offload
+
+    static Caps probe(const QString& devicePath);
+    QString describe() const;
+  };
+
+  enum class Method {
+    ZeroOut,          // BLKZEROOUT, offloaded to the device
+    DiscardZeroes,    // BLKDISCARD on a device that guarantees zeros, written zeros at unaligned edges
+    DiscardAndCheck,  // BLKDISCARD, then read back and rewrite whatever isn't zero
+    ZeroFill,         // no offload at all: plain written zeros
+    FileZeroRange,    // regular file: fallocate(FALLOC_FL_ZERO_RANGE)
+  };
+
+  struct Options {
+    quint64 stepBytes = 1ull << 30;  // per ioctl, so progress and cancel stay responsive
+    quint64 checkChunkBytes = 4ull << 20;
+    ZeroFill::Options fill;          // used for every written-zeros range
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  struct Stats {
+    Method method = Method::ZeroFill;
+    Caps caps;
+    quint64 rewrittenBytes = 0; // bytes written as zeros by us (edges, non-zero after discard...)
+    QString discardError;       // discard+read-check: BLKDISCARD was rejected, only the check ran
+    double seconds = 0;
+
+    // e.g. "method=discard+read-check (discard max 2 GiB, granularity 4 KiB, ...), rewritten 12 MiB, 9.1 s"
+    QString summary() const;
+  };
+
+  static Method choose(const Caps& caps);
+  static QString methodName(Method m);
+
+  static bool run(const QString& path,
+                  const Options& opts,
+                  const IoProgressFn& progress = {},
+                  Stats* stats = nullptr,
+                  QString* error = nullptr);
+};
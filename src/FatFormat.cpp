@@ -0,0 +1,606 @@
+#include "FatFormat.h"
+#include "RawDevice.h"
+
+#include <QByteArray>
+#include <QChar>
+#include <QVector>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+constexpr quint64 kFat32MinClusters = 65525;
+constexpr quint64 kFat32MaxClusters = 0x0FFFFFF5;
+constexpr quint64 kExFatMaxClusters = 0xFFFFFFF5; // 2^32 - 11
+constexpr quint32 kFat32ReservedSectors = 32;
+constexpr quint32 kExFatBootRegionSectors = 12; // main boot region; the backup follows it
+constexpr quint64 kTailWipeBytes = 1ull << 20;  // end of a whole device: backup GPT, RAID superblocks
+
+void put16(char* p, quint16 v) {
+  p[0] = static_cast<char>(v & 0xff);
+  p[1] = static_cast<char>(v >> 8);
+}
+
+void put32(char* p, quint32 v) {
+  put16(p, static_cast<quint16>(v & 0xffff));
+  put16(p + 2, static_cast<quint16>(v >> 16));
+}
+
+void put64(char* p, quint64 v) {
+  put32(p, static_cast<quint32>(v & 0xffffffffu));
+  put32(p + 4, static_cast<quint32>(v >> 32));
+}
+
+int log2Of(quint64 v) {
+  int n = 0;
+  while (v > 1) {
+    v >>= 1;
+    ++n;
+  }
+  return n;
+}
+
+bool isPowerOfTwo(quint64 v) { return v != 0 && (v & (v - 1)) == 0; }
+
+// The non-zero bytes of the metadata area, by offset from the volume start; everything else in
+// [0, Layout::metadataBytes) is written as zeros.
+struct Image {
+  struct Patch {
+    quint64 offset;
+    QByteArray bytes;
+  };
+  std::vector<Patch> patches;
+
+  void add(quint64 offset, QByteArray bytes) { patches.push_back({offset, std::move(bytes)}); }
+
+  // Copies the patches overlapping [from, from + len) into `dst` (which holds that range).
+  void overlay(char* dst, quint64 from, quint64 len) const {
+    for (const Patch& p : patches) {
+      const quint64 pEnd = p.offset + static_cast<quint64>(p.bytes.size());
+      const quint64 b = std::max(from, p.offset);
+      const quint64 e = std::min(from + len, pEnd);
+      if (b < e) std::memcpy(dst + (b - from), p.bytes.constData() + (b - p.offset), e - b);
+    }
+  }
+};
+
+// exFAT up-case table for the BMP from Qt's simple case mappings, compressed the usual way:
+// runs of identity mappings become 0xFFFF, <length>.
+const QVector<quint16>& upcaseTable() {
+  static const QVector<quint16> table = [] {
+    auto upper = [](quint32 c) -> quint32 {
+      const char32_t u = QChar::toUpper(static_cast<char32_t>(c));
+      return u > 0xFFFF ? c : static_cast<quint32>(u);
+    };
+    QVector<quint16> t;
+    quint32 c = 0;
+    while (c <= 0xFFFF) {
+      if (upper(c) != c) {
+        t.push_back(static_cast<quint16>(upper(c)));
+        ++c;
+        continue;
+      }
+      quint32 end = c;
+      while (end <= 0xFFFF && upper(end) == end && end - c < 0xFFFF) ++end;
+      if (end - c >= 2) {
+        t.push_back(0xFFFF);
+        t.push_back(static_cast<quint16>(end - c));
+      } else {
+        t.push_back(static_cast<quint16>(c));
+      }
+      c = end;
+    }
+    return t;
+  }();
+  return table;
+}
+
+QByteArray upcaseBytes() {
+  const QVector<quint16>& t = upcaseTable();
+  QByteArray b(t.size() * 2, '\0');
+  for (qsizetype i = 0; i < t.size(); ++i) put16(b.data() + 2 * i, t[i]);
+  return b;
+}
+
+// exFAT's rotate-and-add checksum (boot region, up-case table).
+quint32 exfatChecksum(const char* data, quint64 len, quint32 sum, bool bootSector = false) {
+  for (quint64 i = 0; i < len; ++i) {
+    if (bootSector && (i == 106 || i == 107 || i == 112)) continue; // VolumeFlags, PercentInUse
+    sum = ((sum & 1) ? 0x80000000u : 0u) + (sum >> 1) + static_cast<quint8>(data[i]);
+  }
+  return sum;
+}
+
+bool fat32Label(const QString& label, char out[11], QString* error) {
+  std::memcpy(out, "NO NAME    ", 11);
+  if (label.isEmpty()) return true;
+  if (label.size() > 11) {
+    if (error) *error = "FAT label is longer than 11 characters: " + label;
+    return false;
+  }
+  std::memset(out, ' ', 11);
+  for (qsizetype i = 0; i < label.size(); ++i) {
+    const char16_t u = label.at(i).unicode();
+    if (u < 0x20 || u > 0x7e || std::strchr("\"*+,./:;<=>?[\\]|", static_cast<char>(u))) {
+      if (error) *error = "FAT labels are limited to ASCII letters, digits, space and -_!#$%&'()@^`{}~: " + label;
+      return false;
+    }
+    out[i] = (u >= 'a' && u <= 'z') ? static_cast<char>(u - 'a' + 'A') : static_cast<char>(u);
+  }
+  return true;
+}
+
+bool exfatLabel(const QString& label, QVector<quint16>* out, QString* error) {
+  out->clear();
+  if (label.size() > 11) {
+    if (error) *error = "exFAT label is longer than 11 characters: " + label;
+    return false;
+  }
+  for (qsizetype i = 0; i < label.size(); ++i) {
+    const char16_t u = label.at(i).unicode();
+    if (u < 0x20 || (u < 0x80 && std::strchr("\"*/:<>?\\|", static_cast<char>(u)))) {
+      if (error) *error = "exFAT labels can't contain control characters or \"*/:<>?\\|: " + label;
+      return false;
+    }
+    out->push_back(u);
+  }
+  return true;
+}
+
+// Bytes to align the metadata/data boundary to (relative to the device, so partitions align too).
+quint64 boundaryFor(quint64 volumeBytes, quint32 clusterBytes) {
+  return std::max<quint64>(clusterBytes, volumeBytes >= (64ull << 20) ? (1ull << 20) : 4096);
+}
+
+bool planFat32(const FatFormat::Options& o, FatFormat::Layout* L, QString* error) {
+  const quint32 ss = L->sectorSize;
+  const quint64 totalSectors = L->volumeBytes / ss;
+  if (totalSectors > 0xFFFFFFFFull) {
+    if (error) *error = QString("Volume too large for FAT32 (%1 sectors of %2 bytes).").arg(totalSectors).arg(ss);
+    return false;
+  }
+
+  const bool autoSize = o.clusterBytes == 0;
+  quint32 cluster = std::max(autoSize ? FatFormat::defaultClusterBytes(FatFormat::Type::Fat32, L->volumeBytes) : o.clusterBytes, ss);
+  if (!isPowerOfTwo(cluster) || cluster > (64u << 10) || cluster / ss > 128) {
+    if (error) *error = QString("Invalid FAT32 cluster size %1 (power of two, %2 B to 64 KiB).").arg(cluster).arg(ss);
+    return false;
+  }
+
+  for (;;) {
+    const quint64 spc = cluster / ss;
+    quint64 reserved = kFat32ReservedSectors;
+    quint64 fat = 1;
+    if (totalSectors <= reserved + 2 + spc) {
+      if (error) *error = "Volume too small for FAT32.";
+      return false;
+    }
+    // Grow the FAT until it has an entry for every cluster left after it (converges in one or
+    // two rounds: a bigger FAT only leaves fewer clusters).
+    for (;;) {
+      const quint64 clusters = (totalSectors - reserved - 2 * fat) / spc;
+      const quint64 need = ((clusters + 2) * 4 + ss - 1) / ss;
+      if (need <= fat) break;
+      fat = need;
+      if (reserved + 2 * fat >= totalSectors) break;
+    }
+    // Pad the reserved area so the first cluster starts on a boundary of the device.
+    const quint64 dataAbs = o.offset + (reserved + 2 * fat) * ss;
+    reserved += (alignUp(dataAbs, boundaryFor(L->volumeBytes, cluster)) - dataAbs) / ss;
+    const quint64 clusters = reserved + 2 * fat < totalSectors ? (totalSectors - reserved - 2 * fat) / spc : 0;
+
+    if (clusters < kFat32MinClusters) {
+      if (autoSize && spc > 1) {
+        cluster /= 2;
+        continue;
+      }
+      if (error) *error = QString("Volume too small for FAT32 with %1 B clusters (%2 clusters, needs %3); use exFAT.")
+                              .arg(cluster)
+                              .arg(clusters)
+                              .arg(kFat32MinClusters);
+      return false;
+    }
+    if (clusters > kFat32MaxClusters) {
+      if (autoSize && cluster < (32u << 10)) {
+        cluster *= 2;
+        continue;
+      }
+      if (error) *error = "Volume too large for FAT32; use exFAT.";
+      return false;
+    }
+    if (reserved > 0xFFFF) {
+      if (error) *error = "FAT32 reserved area too large for this sector size.";
+      return false;
+    }
+
+    L->clusterBytes = cluster;
+    L->clusterCount = static_cast<quint32>(clusters);
+    L->fatCount = 2;
+    L->fatOffset = reserved * ss;
+    L->fatBytes = fat * ss;
+    L->dataOffset = (reserved + 2 * fat) * ss;
+    L->rootCluster = 2;
+    L->metadataBytes = L->dataOffset + cluster; // + the root directory
+    return true;
+  }
+}
+
+bool planExFat(const FatFormat::Options& o, FatFormat::Layout* L, QString* error) {
+  const quint32 ss = L->sectorSize;
+  if (ss < 512 || ss > 4096) {
+    if (error) *error = QString("exFAT needs 512 to 4096 byte sectors, not %1.").arg(ss);
+    return false;
+  }
+  if (L->volumeBytes < (1ull << 20)) {
+    if (error) *error = "Volume too small for exFAT (1 MiB minimum).";
+    return false;
+  }
+
+  const bool autoSize = o.clusterBytes == 0;
+  quint32 cluster = std::max(autoSize ? FatFormat::defaultClusterBytes(FatFormat::Type::ExFat, L->volumeBytes) : o.clusterBytes, ss);
+  if (!isPowerOfTwo(cluster) || cluster > (32u << 20)) {
+    if (error) *error = QString("Invalid exFAT cluster size %1 (power of two, %2 B to 32 MiB).").arg(cluster).arg(ss);
+    return false;
+  }
+
+  const quint64 upcaseLen = static_cast<quint64>(upcaseTable().size()) * 2;
+  for (;;) {
+    const quint64 boundary = boundaryFor(L->volumeBytes, cluster);
+    const quint64 fatOffset = alignUp(o.offset + kExFatBootRegionSectors * 2 * ss, boundary) - o.offset;
+    if (fatOffset >= L->volumeBytes) {
+      if (error) *error = "Volume too small for exFAT.";
+      return false;
+    }
+    // Sized for every cluster after the FAT offset: a few entries more than needed.
+    const quint64 estimate = (L->volumeBytes - fatOffset) / cluster;
+    const quint64 fatBytes = alignUp((estimate + 2) * 4, ss);
+    const quint64 heap = alignUp(o.offset + fatOffset + fatBytes, boundary) - o.offset;
+    const quint64 clusters = heap < L->volumeBytes ? (L->volumeBytes - heap) / cluster : 0;
+
+    if (clusters > kExFatMaxClusters) {
+      if (autoSize && cluster < (32u << 20)) {
+        cluster *= 2;
+        continue;
+      }
+      if (error) *error = "Volume too large for exFAT with this cluster size.";
+      return false;
+    }
+    const quint64 bitmapClusters = ((clusters + 7) / 8 + cluster - 1) / cluster;
+    const quint64 upcaseClusters = (upcaseLen + cluster - 1) / cluster;
+    if (clusters < bitmapClusters + upcaseClusters + 1) {
+      if (error) *error = "Volume too small for exFAT with this cluster size.";
+      return false;
+    }
+
+    L->clusterBytes = cluster;
+    L->clusterCount = static_cast<quint32>(clusters);
+    L->fatCount = 1;
+    L->fatOffset = fatOffset;
+    L->fatBytes = fatBytes;
+    L->dataOffset = heap;
+    L->rootCluster = static_cast<quint32>(2 + bitmapClusters + upcaseClusters);
+    L->metadataBytes = heap + (bitmapClusters + upcaseClusters + 1) * cluster;
+    return true;
+  }
+}
+
+void dosTimestamp(quint16* time, quint16* date) {
+  const std::time_t now = std::time(nullptr);
+  std::tm tm {};
+  localtime_r(&now, &tm);
+  *time = static_cast<quint16>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+  *date = static_cast<quint16>((std::max(tm.tm_year - 80, 0) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+Image buildFat32(const FatFormat::Options& o, const FatFormat::Layout& L, quint32 volumeId) {
+  const quint32 ss = L.sectorSize;
+  char label[11];
+  fat32Label(o.label, label, nullptr);
+
+  QByteArray bs(ss, '\0');
+  char* b = bs.data();
+  std::memcpy(b, "\xEB\x58\x90", 3); // jmp to the boot code at 0x5A
+  std::memcpy(b + 3, "MSWIN4.1", 8);
+  put16(b + 11, static_cast<quint16>(ss));
+  b[13] = static_cast<char>(L.clusterBytes / ss);
+  put16(b + 14, static_cast<quint16>(L.fatOffset / ss));
+  b[16] = 2;                                                // FATs
+  b[21] = char(0xF8);                                       // media: fixed disk
+  put16(b + 24, 63);                                        // sectors per track (legacy CHS)
+  put16(b + 26, 255);                                       // heads
+  put32(b + 28, static_cast<quint32>(o.offset / ss));       // hidden sectors
+  put32(b + 32, static_cast<quint32>(L.volumeBytes / ss));
+  put32(b + 36, static_cast<quint32>(L.fatBytes / ss));
+  put32(b + 44, L.rootCluster);
+  put16(b + 48, 1);                                         // FSInfo sector
+  put16(b + 50, 6);                                         // backup boot sector
+  b[64] = char(0x80);                                       // drive number
+  b[66] = 0x29;                                             // extended boot signature
+  put32(b + 67, volumeId);
+  std::memcpy(b + 71, label, 11);
+  std::memcpy(b + 82, "FAT32   ", 8);
+  std::memcpy(b + 90, "\xCD\x18\xEB\xFE", 4);              // not bootable: int 18h; jmp $
+  put16(b + 510, 0xAA55);
+
+  QByteArray fsinfo(ss, '\0');
+  put32(fsinfo.data() + 0, 0x41615252);
+  put32(fsinfo.data() + 484, 0x61417272);
+  put32(fsinfo.data() + 488, L.clusterCount - 1); // free: all but the root directory
+  put32(fsinfo.data() + 492, L.rootCluster + 1);  // next free hint
+  put32(fsinfo.data() + 508, 0xAA550000);
+
+  QByteArray fat(12, '\0');
+  put32(fat.data() + 0, 0x0FFFFFF8); // media
+  put32(fat.data() + 4, 0x0FFFFFFF); // clean, no I/O errors
+  put32(fat.data() + 8, 0x0FFFFFFF); // root directory: end of chain
+
+  Image img;
+  img.add(0, bs);
+  img.add(ss, fsinfo);
+  img.add(6ull * ss, bs);
+  img.add(7ull * ss, fsinfo);
+  for (int i = 0; i < L.fatCount; ++i) img.add(L.fatOffset + static_cast<quint64>(i) * L.fatBytes, fat);
+
+  if (!o.label.isEmpty()) {
+    QByteArray entry(32, '\0');
+    std::memcpy(entry.data(), label, 11);
+    entry[11] = 0x08; // ATTR_VOLUME_ID
+    quint16 time = 0, date = 0;
+    dosTimestamp(&time, &date);
+    put16(entry.data() + 22, time);
+    put16(entry.data() + 24, date);
+    img.add(L.dataOffset, entry);
+  }
+  return img;
+}
+
+Image buildExFat(const FatFormat::Options& o, const FatFormat::Layout& L, quint32 volumeId) {
+  const quint32 ss = L.sectorSize;
+  const quint64 cluster = L.clusterBytes;
+  const QByteArray upcase = upcaseBytes();
+  const quint64 bitmapLen = (static_cast<quint64>(L.clusterCount) + 7) / 8;
+  const quint32 bitmapClusters = static_cast<quint32>((bitmapLen + cluster - 1) / cluster);
+  const quint32 upcaseClusters = static_cast<quint32>((static_cast<quint64>(upcase.size()) + cluster - 1) / cluster);
+  const quint32 used = bitmapClusters + upcaseClusters + 1;
+
+  // Main boot region: boot sector, 8 extended boot sectors, OEM parameters, reserved, checksum.
+  QByteArray region(kExFatBootRegionSectors * ss, '\0');
+  char* b = region.data();
+  std::memcpy(b, "\xEB\x76\x90", 3);
+  std::memcpy(b + 3, "EXFAT   ", 8);
+  put64(b + 64, o.offset / ss);          // partition offset
+  put64(b + 72, L.volumeBytes / ss);     // volume length
+  put32(b + 80, static_cast<quint32>(L.fatOffset / ss));
+  put32(b + 84, static_cast<quint32>(L.fatBytes / ss));
+  put32(b + 88, static_cast<quint32>(L.dataOffset / ss));
+  put32(b + 92, L.clusterCount);
+  put32(b + 96, L.rootCluster);
+  put32(b + 100, volumeId);
+  put16(b + 104, 0x0100);                // revision 1.00
+  b[108] = static_cast<char>(log2Of(ss));
+  b[109] = static_cast<char>(log2Of(cluster / ss));
+  b[110] = 1;                            // FATs
+  b[111] = char(0x80);                   // drive select
+  b[112] = static_cast<char>(static_cast<quint64>(used) * 100 / L.clusterCount);
+  std::memset(b + 120, 0xF4, 390);       // boot code: hlt
+  put16(b + 510, 0xAA55);
+  for (quint32 s = 1; s <= 8; ++s) put32(b + (s + 1) * ss - 4, 0xAA550000);
+
+  quint32 sum = exfatChecksum(b, ss, 0, /*bootSector*/ true);
+  sum = exfatChecksum(b + ss, 10ull * ss, sum);
+  for (quint32 i = 0; i < ss / 4; ++i) put32(b + 11 * ss + 4 * i, sum);
+
+  // FAT: media and reserved entries, then one contiguous chain each for the bitmap, the up-case
+  // table and the root directory.
+  QByteArray fat((2 + used) * 4, '\0');
+  put32(fat.data() + 0, 0xFFFFFFF8);
+  put32(fat.data() + 4, 0xFFFFFFFF);
+  quint32 next = 2;
+  for (quint32 len : {bitmapClusters, upcaseClusters, 1u}) {
+    for (quint32 i = 0; i < len; ++i, ++next) put32(fat.data() + 4 * next, i + 1 < len ? next + 1 : 0xFFFFFFFF);
+  }
+
+  // Allocation bitmap: bit n = cluster n + 2.
+  QByteArray bitmap((used + 7) / 8, '\0');
+  for (quint32 i = 0; i < used; ++i) bitmap[i / 8] = static_cast<char>(bitmap[i / 8] | (1 << (i % 8)));
+
+  const quint64 bitmapAt = L.dataOffset;
+  const quint64 upcaseAt = bitmapAt + bitmapClusters * cluster;
+  const quint64 rootAt = upcaseAt + upcaseClusters * cluster;
+
+  QByteArray root;
+  QVector<quint16> label;
+  exfatLabel(o.label, &label, nullptr);
+  if (!label.isEmpty()) {
+    QByteArray e(32, '\0');
+    e[0] = char(0x83); // volume label
+    e[1] = static_cast<char>(label.size());
+    for (qsizetype i = 0; i < label.size(); ++i) put16(e.data() + 2 + 2 * i, label[i]);
+    root += e;
+  }
+  {
+    QByteArray e(32, '\0');
+    e[0] = char(0x81); // allocation bitmap
+    put32(e.data() + 20, 2);
+    put64(e.data() + 24, bitmapLen);
+    root += e;
+  }
+  {
+    QByteArray e(32, '\0');
+    e[0] = char(0x82); // up-case table
+    put32(e.data() + 4, exfatChecksum(upcase.constData(), static_cast<quint64>(upcase.size()), 0));
+    put32(e.data() + 20, 2 + bitmapClusters);
+    put64(e.data() + 24, static_cast<quint64>(upcase.size()));
+    root += e;
+  }
+
+  Image img;
+  img.add(0, region);
+  img.add(static_cast<quint64>(kExFatBootRegionSectors) * ss, region); // backup boot region
+  img.add(L.fatOffset, fat);
+  img.add(bitmapAt, bitmap);
+  img.add(upcaseAt, upcase);
+  img.add(rootAt, root);
+  return img;
+}
+
+bool cancelled(const std::atomic_bool* cancel, QString* error) {
+  if (!cancel || !cancel->load(std::memory_order_relaxed)) return false;
+  if (error) *error = QStringLiteral("Format cancelled.");
+  return true;
+}
+
+} // namespace
+
+bool FatFormat::typeFromName(const QString& fsType, Type* out) {
+  const QString t = fsType.toLower();
+  if (t == "vfat" || t == "fat32" || t == "fat") {
+    *out = Type::Fat32;
+    return true;
+  }
+  if (t == "exfat") {
+    *out = Type::ExFat;
+    return true;
+  }
+  return false;
+}
+
+QString FatFormat::typeName(Type t) {
+  return t == Type::Fat32 ? QStringLiteral("FAT32") : QStringLiteral("exFAT");
+}
+
+quint32 FatFormat::defaultClusterBytes(Type t, quint64 volumeBytes) {
+  constexpr quint64 MiB = 1ull << 20;
+  constexpr quint64 GiB = 1ull << 30;
+  if (t == Type::ExFat) {
+    if (volumeBytes <= 256 * MiB) return 4u << 10;
+    if (volumeBytes <= 32 * GiB) return 32u << 10;
+    return 128u << 10;
+  }
+  if (volumeBytes <= 260 * MiB) return 512;
+  if (volumeBytes <= 8 * GiB) return 4u << 10;
+  if (volumeBytes <= 16 * GiB) return 8u << 10;
+  if (volumeBytes <= 32 * GiB) return 16u << 10;
+  return 32u << 10;
+}
+
+QString FatFormat::Layout::describe() const {
+  return QString("%1, %2 clusters x %3, FAT %4 x %5, data at %6")
+      .arg(typeName(type), humanBytes(clusterBytes))
+      .arg(clusterCount)
+      .arg(fatCount)
+      .arg(humanBytes(fatBytes), humanBytes(dataOffset));
+}
+
+QString FatFormat::Stats::summary() const {
+  return QString("%1; %2 in %3 writes, %4 s")
+      .arg(layout.describe(), humanBytes(bytesWritten))
+      .arg(writes)
+      .arg(seconds, 0, 'f', 2);
+}
+
+bool FatFormat::plan(const Options& opts, quint64 volumeBytes, quint32 sectorSize, Layout* out, QString* error) {
+  if (!isPowerOfTwo(sectorSize) || sectorSize < 512) {
+    if (error) *error = QString("Unsupported sector size %1.").arg(sectorSize);
+    return false;
+  }
+  if (opts.offset % sectorSize != 0) {
+    if (error) *error = QString("Volume offset %1 is not a multiple of the %2 byte sector size.").arg(opts.offset).arg(sectorSize);
+    return false;
+  }
+  char fatLabel[11];
+  QVector<quint16> exLabel;
+  if (opts.type == Type::Fat32 ? !fat32Label(opts.label, fatLabel, error) : !exfatLabel(opts.label, &exLabel, error)) return false;
+
+  Layout L;
+  L.type = opts.type;
+  L.sectorSize = sectorSize;
+  L.volumeBytes = alignDown(volumeBytes, sectorSize);
+  if (!(opts.type == Type::Fat32 ? planFat32(opts, &L, error) : planExFat(opts, &L, error))) return false;
+  *out = L;
+  return true;
+}
+
+bool FatFormat::run(const QString& path,
+                    const Options& opts,
+                    const IoProgressFn& progress,
+                    Stats* stats,
+                    QString* error) {
+  const auto t0 = std::chrono::steady_clock::now();
+  RawDevice dev;
+  if (!dev.open(path, RawDevice::Mode::Write, /*direct*/ true, error)) return false;
+
+  if (opts.offset >= dev.size() || (opts.length > 0 && opts.offset + opts.length > dev.size())) {
+    if (error) *error = QString("Volume [%1, +%2) is outside %3 (%4 bytes).").arg(opts.offset).arg(opts.length).arg(path).arg(dev.size());
+    return false;
+  }
+  const quint64 volumeBytes = opts.length > 0 ? opts.length : dev.size() - opts.offset;
+
+  Stats st;
+  if (!plan(opts, volumeBytes, dev.sectorSize(), &st.layout, error)) return false;
+  const Layout& L = st.layout;
+
+  quint32 volumeId = opts.volumeId;
+  while (volumeId == 0) volumeId = std::random_device{}();
+  const Image img = L.type == Type::Fat32 ? buildFat32(opts, L, volumeId) : buildExFat(opts, L, volumeId);
+
+  // Ranges to write, relative to the volume: the metadata area, and on a whole device its last
+  // MiB too (a stale backup GPT there would make tools see the old partitions).
+  const quint64 align = dev.alignment();
+  const quint64 volumeEnd = L.volumeBytes;
+  const quint64 metaEnd = std::min(alignUp(L.metadataBytes, align), volumeEnd);
+  quint64 tailBegin = volumeEnd;
+  if (opts.offset == 0 && opts.length == 0 && volumeEnd > metaEnd + kTailWipeBytes) {
+    tailBegin = alignDown(volumeEnd - kTailWipeBytes, align);
+  }
+  if (opts.offset % align != 0 || metaEnd % align != 0 || tailBegin % align != 0 || volumeEnd % align != 0) {
+    dev.setDirect(false);
+  }
+
+  const quint64 chunk = std::max(alignUp(opts.chunkBytes, align), align);
+  AlignedBuffer buf(static_cast<std::size_t>(chunk));
+  if (buf.isNull()) {
+    if (error) *error = QString("Can't allocate a %1 byte write buffer.").arg(chunk);
+    return false;
+  }
+
+  const quint64 total = metaEnd + (volumeEnd - tailBegin);
+  IoProgressMeter meter(total, progress);
+  auto writeRange = [&](quint64 begin, quint64 end) {
+    for (quint64 w = begin; w < end; w += chunk) {
+      if (cancelled(opts.cancel, error)) return false;
+      const quint64 n = std::min(chunk, end - w);
+      std::memset(buf.data(), 0, static_cast<std::size_t>(n));
+      img.overlay(buf.data(), w, n);
+      if (!dev.writeAt(buf.data(), n, opts.offset + w, error)) return false;
+      st.bytesWritten += n;
+      ++st.writes;
+      meter.update(st.bytesWritten);
+    }
+    return true;
+  };
+
+  // Everything but the first chunk, flushed, then the first chunk with the boot sector: an
+  // interrupted format never leaves a valid boot sector over half-written metadata.
+  const quint64 firstEnd = std::min(chunk, metaEnd);
+  if (!writeRange(firstEnd, metaEnd) || !writeRange(tailBegin, volumeEnd)) return false;
+  if (!dev.sync(error)) return false;
+  if (!writeRange(0, firstEnd)) return false;
+  if (!dev.sync(error)) return false;
+  meter.update(st.bytesWritten, /*force*/ true);
+
+  // Drop the kernel's view of the old partitions; best effort, udev rescans on close anyway.
+  if (dev.isBlockDevice() && opts.offset == 0) ::ioctl(dev.fd(), BLKRRPART);
+
+  st.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if (stats) *stats = st;
+  return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "IoProgress.h"
+
+#include <QString>
+
+#include <atomic>
+
+// In-process FAT32 / exFAT formatter: builds the boot region, FAT(s), allocation bitmap, up-case
+// table and root directory in memory and writes the whole metadata area in a few large aligned
+// writes, instead of forking mkfs through UDisks. The volume is written as a "superfloppy"
+// (filesystem on the whole device, no partition table, like `mkfs.vfat -I /dev/sdX`) unless
+// `offset`/`length` place it inside a partition. Data clusters are not touched (quick format).
+// Blocking: run it on a worker thread.
+class FatFormat final {
+public:
+  enum class Type { Fat32, ExFat };
+
+  struct Options {
+    Type type = Type::Fat32;
+    QString label;             // FAT32: up to 11 ASCII chars (upper-cased); exFAT: up to 11 UTF-16 units
+    quint64 offset = 0;        // volume start on the device, in bytes (sector aligned)
+    quint64 length = 0;        // 0 = up to the end of the device/file
+    quint32 clusterBytes = 0;  // 0 = by volume size (Windows' defaults)
+    quint32 volumeId = 0;      // serial number; 0 = random
+    quint64 chunkBytes = 4ull << 20; // bytes per write
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  // Geometry of the volume, all offsets relative to its first byte.
+  struct Layout {
+    Type type = Type::Fat32;
+    quint32 sectorSize = 512;
+    quint64 volumeBytes = 0;
+    quint32 clusterBytes = 0;
+    quint32 clusterCount = 0;
+    quint64 fatOffset = 0;     // FAT32: = reserved sectors
+    quint64 fatBytes = 0;      // per FAT
+    int fatCount = 2;          // 2 for FAT32, 1 for exFAT
+    quint64 dataOffset = 0;    // first cluster (cluster #2)
+    quint32 rootCluster = 2;
+    quint64 metadataBytes = 0; // everything written from offset 0: boot region .. root directory
+
+    // e.g. "FAT32, 16 KiB clusters x 1953024, FAT 2 x 7.45 MiB, data at 15.00 MiB"
+    QString describe() const;
+  };
+
+  struct Stats {
+    Layout layout;
+    quint64 bytesWritten = 0;
+    int writes = 0;
+    double seconds = 0;
+
+    QString summary() const;
+  };
+
+  // "vfat"/"fat32" and "exfat"; false for anything else.
+  static bool typeFromName(const QString& fsType, Type* out);
+  static QString typeName(Type t);
+
+  // Windows' default cluster size for a volume of `volumeBytes`.
+  static quint32 defaultClusterBytes(Type t, quint64 volumeBytes);
+
+  // Computes the layout without touching any device. Fails on volumes too small or too large
+  // for the type, bad cluster sizes and invalid labels.
+  static bool plan(const Options& opts, quint64 volumeBytes, quint32 sectorSize, Layout* out, QString* error = nullptr);
+
+  static bool run(const QString& path,
+                  const Options& opts,
+                  const IoProgressFn& progress = {},
+                  Stats* stats = nullptr,
+                  QString* error = nullptr);
+};
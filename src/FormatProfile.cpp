@@ -0,0 +1,105 @@
+#include "FormatProfile.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+const QVector<FormatProfile>& FormatProfile::all() {
+  static const QVector<FormatProfile> profiles = [] {
+    QVector<FormatProfile> v;
+
+    FormatProfile def;
+    def.name = QStringLiteral("default");
+    def.title = QStringLiteral("mkfs defaults");
+    v.push_back(def);
+
+    // Big sequential files (video, images, backups): large clusters mean fewer FAT/bitmap updates
+    // per MB written; ext4 gets few inodes, no reserved blocks, no journal, and its inode tables
+    // initialised by mkfs instead of by ext4lazyinit during the first writes.
+    FormatProfile large;
+    large.name = QStringLiteral("large-files");
+    large.title = QStringLiteral("large media files");
+    large.fatClusterBytes = 32 << 10;
+    large.exfatClusterBytes = 256 << 10;
+    large.ntfsClusterBytes = 64 << 10;
+    large.ext4Args = {"-T", "largefile", "-m", "0", "-O", "^has_journal", "-E", "lazy_itable_init=0"};
+    v.push_back(large);
+
+    // Many small files (source trees, documents): small clusters waste less space per file;
+    // ext4 keeps its journal and gets the default inode ratio for small files.
+    FormatProfile small;
+    small.name = QStringLiteral("small-files");
+    small.title = QStringLiteral("many small files");
+    small.fatClusterBytes = 4 << 10;
+    small.exfatClusterBytes = 32 << 10;
+    small.ntfsClusterBytes = 4 << 10;
+    small.ext4Args = {"-T", "small", "-m", "0", "-E", "lazy_itable_init=0,lazy_journal_init=0"};
+    v.push_back(small);
+
+    // Shortest format: no discard pass, ext4 initialises lazily after mounting.
+    FormatProfile quick;
+    quick.name = QStringLiteral("quick");
+    quick.title = QStringLiteral("quick (no discard)");
+    quick.ext4Args = {"-E", "lazy_itable_init=1,lazy_journal_init=1"};
+    quick.noDiscard = true;
+    v.push_back(quick);
+
+    return v;
+  }();
+  return profiles;
+}
+
+const FormatProfile* FormatProfile::find(const QString& name) {
+  for (const FormatProfile& p : all()) {
+    if (p.name == name) return &p;
+  }
+  return nullptr;
+}
+
+quint32 FormatProfile::clusterBytes(const QString& fsType) const {
+  if (fsType == "vfat") return fatClusterBytes;
+  if (fsType == "exfat") return exfatClusterBytes;
+  if (fsType == "ntfs") return ntfsClusterBytes;
+  return 0;
+}
+
+QStringList FormatProfile::mkfsArgs(const QString& fsType, quint32 sectorBytes) const {
+  const quint32 cluster = clusterBytes(fsType);
+  // mkfs.fat takes sectors per cluster: 64 for 32 KiB on most sticks, 8 behind a 4K-sector bridge.
+  if (fsType == "vfat" && cluster) return {"-s", QString::number(std::max<quint32>(cluster / std::max<quint32>(sectorBytes, 512), 1))};
+  if (fsType == "exfat" && cluster) return {"-c", QString("%1K").arg(cluster >> 10)};
+  if (fsType == "ntfs" && cluster) return {"-c", QString::number(cluster)};
+  if (fsType == "ext4") return ext4Args;
+  return {};
+}
+
+void FormatProfile::addFormatOptions(const QString& fsType, quint32 sectorBytes, bool withMkfsArgs, QVariantMap* opts) const {
+  const QStringList args = mkfsArgs(fsType, sectorBytes);
+  if (withMkfsArgs && !args.isEmpty()) opts->insert("mkfs-args", args);
+  if (noDiscard) opts->insert("no-discard", true);
+}
+
+QString FormatProfile::describe(const QString& fsType, bool withMkfsArgs) const {
+  QStringList parts;
+  if (withMkfsArgs) {
+    // Clusters in bytes: mkfs.fat's -s depends on each device's sector size.
+    const quint32 cluster = clusterBytes(fsType);
+    if (cluster) parts << QString("%1 KiB clusters").arg(cluster >> 10);
+    else if (fsType == "ext4" && !ext4Args.isEmpty()) parts << "mkfs " + ext4Args.join(' ');
+  }
+  if (noDiscard) parts << QStringLiteral("no discard");
+  return parts.isEmpty() ? name : name + ": " + parts.join(", ");
+}
+
+quint32 FormatProfile::probeSectorBytes(const QString& devicePath) {
+  // /dev/sdb1 -> /sys/class/block/sdb1/../queue, as PartitionLayout::probeAlignment.
+  const QString name = QFileInfo(QFileInfo(devicePath).canonicalFilePath()).fileName();
+  QString queue = "/sys/class/block/" + name + "/queue/";
+  if (!QDir(queue).exists()) queue = "/sys/class/block/" + name + "/../queue/";
+  QFile f(queue + "logical_block_size");
+  if (name.isEmpty() || !f.open(QIODevice::ReadOnly)) return 512;
+  const quint32 v = f.readAll().trimmed().toUInt();
+  return v >= 512 ? v : 512;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVector>
+
+// A named set of mkfs tunings for a workload, applied to every device of a format batch: the
+// cluster (allocation unit) size per filesystem, ext4's inode ratio, journal and lazy init, and
+// whether mkfs discards the device first. The UDisks engine gets them as Format's `mkfs-args`
+// (udisks 2.10 or newer; older versions ignore it) and `no-discard` options; the native FAT
+// engine takes the cluster size.
+struct FormatProfile {
+  QString name;  // CLI/config name, e.g. "large-files"
+  QString title; // shown in the GUI, e.g. "large media files"
+  quint32 fatClusterBytes = 0;   // vfat; 0 = mkfs' default
+  quint32 exfatClusterBytes = 0;
+  quint32 ntfsClusterBytes = 0;
+  QStringList ext4Args;          // extra mkfs.ext4 arguments
+  bool noDiscard = false;        // skip mkfs' whole-device discard (slow on some cheap sticks)
+
+  // "default" (no tuning) first.
+  static const QVector<FormatProfile>& all();
+  // nullptr for an unknown name.
+  static const FormatProfile* find(const QString& name);
+
+  quint32 clusterBytes(const QString& fsType) const;
+  // `sectorBytes`: the device's logical sector size (mkfs.fat counts clusters in sectors).
+  QStringList mkfsArgs(const QString& fsType, quint32 sectorBytes = 512) const;
+  // Adds `mkfs-args` (unless `withMkfsArgs` is false) and `no-discard` to the options of a
+  // UDisks Format call for `fsType`.
+  void addFormatOptions(const QString& fsType, quint32 sectorBytes, bool withMkfsArgs, QVariantMap* opts) const;
+  bool hasMkfsArgs(const QString& fsType) const { return !mkfsArgs(fsType).isEmpty(); }
+
+  // e.g. "large-files: 32 KiB clusters" or "default"; without `withMkfsArgs`, only what
+  // applies without `mkfs-args` (no discard).
+  QString describe(const QString& fsType, bool withMkfsArgs = true) const;
+
+  // Logical sector size of a block device (/dev/sdb or a partition of it) from sysfs; 512 if
+  // it can't be read.
+  static quint32 probeSectorBytes(const QString& devicePath);
+};
@@ -0,0 +1,310 @@
+#include "ImageFanOut.h"
+#include "ImageSource.h"
+#include "RawDevice.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Image bytes projected for a gzip source from how much of the file produced `out` bytes.
+quint64 projectTotal(quint64 done, quint64 out, quint64 fileBytes, quint64 fileRead) {
+  return fileRead > 0 ? std::max(done, out * fileBytes / fileRead) : 0;
+}
+
+} // namespace
+
+struct ImageFanOut::Ring {
+  enum class State { Waiting, Running, Detached, Done };
+  struct Writer {
+    State state = State::Waiting;
+    quint64 next = 0;  // index of the next block it needs
+    bool busy = false; // writing block `next` from the ring right now (pins it, even once detached)
+  };
+
+  QString imagePath;
+  Options opts;
+  std::size_t slots = 2;
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::vector<Writer> writers;
+  std::deque<ImageSource::Block> blocks; // the ring: block indices [base, base + blocks.size())
+  quint64 base = 0;
+  quint64 produced = 0; // image bytes the source has delivered
+  bool started = false;
+  bool eof = false;
+  bool stop = false;
+  QString error;
+  ImageSource src;
+  std::thread pump;
+
+  bool cancelled() const { return opts.cancel && opts.cancel->load(std::memory_order_relaxed); }
+
+  static bool live(const Writer& w) { return w.state == State::Waiting || w.state == State::Running; }
+  bool anyLive() const { return std::any_of(writers.begin(), writers.end(), live); }
+
+  // A running writer has written everything in the ring and waits for the next block.
+  bool leaderBlocked() const {
+    const quint64 end = base + blocks.size();
+    return std::any_of(writers.begin(), writers.end(), [end](const Writer& w) { return w.state == State::Running && w.next >= end; });
+  }
+
+  // Hands the blocks every writer is past back to the source. Caller holds mu.
+  void trim() {
+    quint64 low = std::numeric_limits<quint64>::max();
+    for (const Writer& w : writers) {
+      if (live(w) || w.busy) low = std::min(low, w.next);
+    }
+    while (!blocks.empty() && base < low) {
+      src.release(blocks.front());
+      blocks.pop_front();
+      ++base;
+    }
+    cv.notify_all();
+  }
+
+  // Cuts loose the writers holding the oldest block (the slowest, or not started yet). They finish
+  // on their own reader. Caller holds mu.
+  void detachSlowest() {
+    for (Writer& w : writers) {
+      if (live(w) && w.next == base) w.state = State::Detached;
+    }
+    trim();
+  }
+
+  // Opens the image and starts the pump on the first write(). Caller holds mu.
+  void start() {
+    if (started) return;
+    started = true;
+    ImageSource::Options so;
+    so.blockBytes = opts.blockBytes;
+    so.depth = static_cast<int>(slots) + 2; // the ring plus two blocks being read ahead of it
+    so.cancel = opts.cancel;
+    if (!src.open(imagePath, so, &error)) {
+      eof = true;
+      return;
+    }
+    pump = std::thread([this] { run(); });
+  }
+
+  // Moves blocks from the source into the ring while there is room, i.e. while the slowest live
+  // writer is less than `slots` blocks behind.
+  void run() {
+    const auto grace = std::chrono::milliseconds(std::max(0, opts.graceMs));
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mu);
+        Clock::time_point blockedSince{};
+        while (!stop && !cancelled() && anyLive() && blocks.size() >= slots) {
+          if (!leaderBlocked()) {
+            blockedSince = {};
+          } else if (blockedSince == Clock::time_point{}) {
+            blockedSince = Clock::now();
+          } else if (Clock::now() - blockedSince >= grace) {
+            detachSlowest();
+            blockedSince = {};
+            continue;
+          }
+          cv.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (stop || cancelled() || !anyLive()) break;
+      }
+      ImageSource::Block b;
+      if (!src.next(&b)) break;
+      std::lock_guard<std::mutex> lock(mu);
+      if (stop) {
+        src.release(b);
+        break;
+      }
+      blocks.push_back(b);
+      produced += b.len;
+      cv.notify_all();
+    }
+    std::lock_guard<std::mutex> lock(mu);
+    eof = true;
+    if (src.failed()) error = src.error();
+    else if (cancelled()) error = QStringLiteral("Image write cancelled.");
+    cv.notify_all();
+  }
+};
+
+QString ImageFanOut::Stats::summary(const Options& opts) const {
+  ImageWriter::Options ring;
+  ring.blockBytes = opts.blockBytes;
+  ring.delta = opts.delta;
+  ring.targetZeroed = opts.targetZeroed;
+  ring.depth = static_cast<int>(std::max<quint64>(2, opts.lagBytes / std::max<quint64>(opts.blockBytes, 1)));
+  if (!detached) return write.summary(ring) + "; shared reader for all of it";
+  return write.summary(ring) + QString("; shared reader for %1 MB, then its own (fell behind)").arg(static_cast<double>(sharedBytes) / 1e6, 0, 'f', 1);
+}
+
+ImageFanOut::ImageFanOut(const QString& imagePath, int writers, const Options& opts) : r_(std::make_unique<Ring>()) {
+  r_->imagePath = imagePath;
+  r_->opts = opts;
+  r_->opts.blockBytes = alignUp(std::max<quint64>(opts.blockBytes, 4096), 4096);
+  r_->slots = static_cast<std::size_t>(std::max<quint64>(2, opts.lagBytes / r_->opts.blockBytes));
+  r_->writers.resize(static_cast<std::size_t>(std::max(0, writers)));
+}
+
+ImageFanOut::~ImageFanOut() {
+  {
+    // Free the ring so a pump waiting in ImageSource::next() gets a block and sees `stop`.
+    std::lock_guard<std::mutex> lock(r_->mu);
+    r_->stop = true;
+    while (!r_->blocks.empty()) {
+      r_->src.release(r_->blocks.front());
+      r_->blocks.pop_front();
+    }
+  }
+  r_->cv.notify_all();
+  if (r_->pump.joinable()) r_->pump.join();
+}
+
+const ImageFanOut::Options& ImageFanOut::options() const {
+  return r_->opts;
+}
+
+void ImageFanOut::withdraw(int index) {
+  std::lock_guard<std::mutex> lock(r_->mu);
+  if (index < 0 || index >= static_cast<int>(r_->writers.size())) return;
+  r_->writers[static_cast<std::size_t>(index)].state = Ring::State::Done;
+  r_->trim();
+}
+
+bool ImageFanOut::write(int index,
+                        const QString& devicePath,
+                        const IoProgressFn& progress,
+                        Stats* stats,
+                        QString* error) {
+  Ring& r = *r_;
+  if (index < 0 || index >= static_cast<int>(r.writers.size())) {
+    if (error) *error = QString("No fan-out writer %1.").arg(index);
+    return false;
+  }
+  const auto slot = static_cast<std::size_t>(index);
+
+  RawDevice dev;
+  const RawDevice::Mode mode = r.opts.delta ? RawDevice::Mode::ReadWrite : RawDevice::Mode::Write;
+  if (!dev.open(devicePath, mode, r.opts.direct, error)) {
+    withdraw(index);
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(r.mu);
+    r.start();
+    if (r.writers[slot].state == Ring::State::Waiting) r.writers[slot].state = Ring::State::Running;
+  }
+  // Plain images are checked up front; compressed ones when the writes get there.
+  if (dev.isBlockDevice() && r.src.sizeHint() > dev.size()) {
+    if (error) *error = QString("The image (%1 bytes) is larger than %2 (%3 bytes).").arg(r.src.sizeHint()).arg(devicePath).arg(dev.size());
+    withdraw(index);
+    return false;
+  }
+
+  const bool direct = dev.isDirect();
+  ImageWriter::Sink sink(dev, devicePath, r.opts.delta, r.opts.targetZeroed);
+  IoProgressMeter meter(r.src.sizeHint(), progress);
+  quint64 shared = 0;
+  bool ok = true;
+  bool detached = false;
+  for (;;) {
+    ImageSource::Block b;
+    {
+      std::unique_lock<std::mutex> lock(r.mu);
+      Ring::Writer& w = r.writers[slot];
+      r.cv.wait(lock, [&] { return w.state != Ring::State::Running || w.next < r.base + r.blocks.size() || r.eof; });
+      if (w.state != Ring::State::Running) {
+        detached = true;
+        break;
+      }
+      if (w.next >= r.base + r.blocks.size()) {
+        if (!r.error.isEmpty()) {
+          if (error) *error = r.error;
+          ok = false;
+        }
+        break;
+      }
+      b = r.blocks[w.next - r.base];
+      w.busy = true;
+    }
+
+    if (r.cancelled()) {
+      if (error) *error = QStringLiteral("Image write cancelled.");
+      ok = false;
+    } else {
+      ok = sink.write(b.data, b.offset, b.len, error);
+    }
+
+    quint64 projected = 0;
+    {
+      std::lock_guard<std::mutex> lock(r.mu);
+      Ring::Writer& w = r.writers[slot];
+      w.busy = false;
+      ++w.next;
+      if (!ok) w.state = Ring::State::Done;
+      r.trim();
+      if (r.src.isCompressed()) projected = projectTotal(sink.bytesDone(), r.produced, r.src.fileBytes(), r.src.fileBytesRead());
+    }
+    if (!ok) break;
+    shared += b.len;
+    if (projected > 0) meter.setTotal(projected);
+    meter.update(sink.bytesDone());
+  }
+
+  if (ok && detached) {
+    // Fell behind the lag window: the rest comes from a private reader, starting at the block the
+    // ring would have handed out next.
+    ImageSource own;
+    ImageSource::Options so;
+    so.blockBytes = r.src.blockBytes();
+    so.cancel = r.opts.cancel;
+    {
+      std::lock_guard<std::mutex> lock(r.mu);
+      so.startOffset = r.writers[slot].next * so.blockBytes;
+    }
+    ok = own.open(r.imagePath, so, error);
+    ImageSource::Block b;
+    while (ok && own.next(&b)) {
+      if (r.cancelled()) {
+        if (error) *error = QStringLiteral("Image write cancelled.");
+        ok = false;
+      } else {
+        ok = sink.write(b.data, b.offset, b.len, error);
+      }
+      own.release(b);
+      if (!ok) break;
+      if (own.isCompressed()) meter.setTotal(projectTotal(sink.bytesDone(), b.offset + b.len, own.fileBytes(), own.fileBytesRead()));
+      meter.update(sink.bytesDone());
+    }
+    if (ok && own.failed()) {
+      if (error) *error = own.error();
+      ok = false;
+    }
+  }
+  withdraw(index);
+
+  ok = sink.finish(ok, error);
+  meter.setTotal(sink.bytesDone());
+  meter.update(sink.bytesDone(), /*force*/ true);
+
+  if (stats) {
+    stats->write.compressed = r.src.isCompressed();
+    stats->write.direct = direct;
+    stats->write.fileBytes = r.src.fileBytes();
+    stats->write.bytesWritten = sink.bytesWritten();
+    stats->write.bytesSkipped = sink.bytesSkipped();
+    stats->write.seconds = meter.elapsedSeconds();
+    stats->sharedBytes = shared;
+    stats->detached = detached;
+  }
+  return ok;
+}
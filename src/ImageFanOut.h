@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ImageWriter.h"
+#include "IoProgress.h"
+
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+// Flashes one image onto many devices while reading (and inflating) it only once. A single
+// ImageSource feeds a shared ring of page-aligned blocks; one writer per device walks the ring at
+// its own pace, each on its own worker thread, and a block is recycled once every writer has
+// written it. A slow stick holds the ring back only up to `lagBytes`: when a faster writer has
+// waited at that edge for `graceMs`, the writers holding the oldest block are cut loose and finish
+// from their current offset on a private reader (ImageWriter's pipeline). A writer that fails, or
+// whose job never starts, just leaves the ring; the others carry on.
+class ImageFanOut final {
+public:
+  struct Options {
+    quint64 blockBytes = 8ull << 20; // ring block = bytes per write (rounded up to 4096)
+    quint64 lagBytes = 256ull << 20; // ring size: how far the fastest writer may run ahead
+    int graceMs = 2000;              // wait at the ring's edge before dropping the slowest
+    bool direct = true;              // O_DIRECT (silently buffered where unsupported)
+    bool delta = false;              // per device: write only the chunks that differ (see ImageWriter)
+    bool targetZeroed = false;       // devices known to be all zeros: skip the image's zero chunks
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  struct Stats {
+    ImageWriter::Stats write;  // totals for this device, as for a single ImageWriter::run()
+    quint64 sharedBytes = 0;   // written from the shared ring; the rest came from a private reader
+    bool detached = false;     // fell behind the lag window (or started late) and read on its own
+
+    // e.g. "gzip 1.2 GB -> 3.9 GB, O_DIRECT, 8 MiB x 32, 123.4 s (31.6 MB/s); shared reader for all of it"
+    QString summary(const Options& opts) const;
+  };
+
+  // `writers` devices will call write() with index 0..writers-1 (or withdraw()).
+  ImageFanOut(const QString& imagePath, int writers, const Options& opts);
+  ~ImageFanOut();
+  ImageFanOut(const ImageFanOut&) = delete;
+  ImageFanOut& operator=(const ImageFanOut&) = delete;
+
+  // Writes the image onto `devicePath` as writer `index`. Blocking: call it from the device's own
+  // worker thread; all writers run at the same time. The first call starts the shared reader.
+  bool write(int index,
+             const QString& devicePath,
+             const IoProgressFn& progress = {},
+             Stats* stats = nullptr,
+             QString* error = nullptr);
+
+  // Writer `index` won't write (its job failed before the write, or it is done): the ring stops
+  // waiting for it. Harmless if it already finished.
+  void withdraw(int index);
+
+  const Options& options() const;
+
+private:
+  struct Ring;
+
+  std::unique_ptr<Ring> r_;
+};
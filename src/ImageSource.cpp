@@ -0,0 +1,316 @@
+#include "ImageSource.h"
+#include "RawDevice.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+// Unbounded FIFO between two pipeline threads; the bound comes from the fixed number of buffers
+// circulating through it.
+template <typename T>
+class Channel {
+public:
+  void push(T v) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      q_.push_back(std::move(v));
+    }
+    cv_.notify_one();
+  }
+
+  // Waits for an item; false once the channel is closed and drained.
+  bool pop(T* out) {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this] { return !q_.empty() || closed_; });
+    if (q_.empty()) return false;
+    *out = std::move(q_.front());
+    q_.pop_front();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<T> q_;
+  bool closed_ = false;
+};
+
+// Reads up to `len` bytes, retrying short reads; returns the count (< len only at EOF), -1 on error.
+qint64 readFull(int fd, char* buf, quint64 len) {
+  quint64 got = 0;
+  while (got < len) {
+    const ssize_t n = ::read(fd, buf + got, static_cast<std::size_t>(len - got));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) break;
+    got += static_cast<quint64>(n);
+  }
+  return static_cast<qint64>(got);
+}
+
+} // namespace
+
+struct ImageSource::Pipeline {
+  struct Filled {
+    int slot = -1;
+    quint64 offset = 0;
+    quint64 len = 0;
+  };
+  struct Raw {
+    int buf = -1;
+    quint64 len = 0;
+  };
+
+  int fd = -1;
+  quint64 blockBytes = 0;
+  quint64 startOffset = 0;
+  const std::atomic_bool* cancel = nullptr;
+  std::vector<AlignedBuffer> blocks;
+  Channel<int> freeBlocks;
+  Channel<Filled> filled;
+
+  // gzip only: compressed reads on their way to the inflater.
+  std::vector<std::vector<char>> raw;
+  Channel<int> freeRaw;
+  Channel<Raw> rawFilled;
+
+  std::atomic<quint64> fileRead{0};
+  std::atomic_bool stop{false};
+  mutable std::mutex errorMu;
+  QString error;
+  std::vector<std::thread> threads;
+
+  bool stopped() const { return stop.load(std::memory_order_relaxed) || (cancel && cancel->load(std::memory_order_relaxed)); }
+
+  void fail(const QString& msg) {
+    {
+      std::lock_guard<std::mutex> lock(errorMu);
+      if (error.isEmpty()) error = msg;
+    }
+    shutdown();
+  }
+
+  // End of the image for the consumer; a cancel is reported as an error, not as a short image.
+  void finish() {
+    if (cancel && cancel->load(std::memory_order_relaxed)) return fail(QStringLiteral("Image read cancelled."));
+    filled.close();
+  }
+
+  void shutdown() {
+    stop = true;
+    freeBlocks.close();
+    filled.close();
+    freeRaw.close();
+    rawFilled.close();
+  }
+
+  // Plain image: read() straight into the aligned blocks.
+  void readPlain() {
+    quint64 offset = startOffset;
+    for (;;) {
+      int slot = -1;
+      if (!freeBlocks.pop(&slot) || stopped()) break;
+      const qint64 n = readFull(fd, blocks[slot].data(), blockBytes);
+      if (n < 0) return fail(RawDevice::errnoMessage(QString("read of the image at offset %1").arg(offset)));
+      fileRead.fetch_add(static_cast<quint64>(n), std::memory_order_relaxed);
+      if (n > 0) filled.push(Filled{slot, offset, static_cast<quint64>(n)});
+      offset += static_cast<quint64>(n);
+      if (static_cast<quint64>(n) < blockBytes) break;
+    }
+    finish();
+  }
+
+  // gzip: compressed chunks to the inflater.
+  void readCompressed() {
+    quint64 offset = 0;
+    for (;;) {
+      int buf = -1;
+      if (!freeRaw.pop(&buf) || stopped()) break;
+      const qint64 n = readFull(fd, raw[buf].data(), raw[buf].size());
+      if (n < 0) return fail(RawDevice::errnoMessage(QString("read of the image at offset %1").arg(offset)));
+      fileRead.fetch_add(static_cast<quint64>(n), std::memory_order_relaxed);
+      if (n > 0) rawFilled.push(Raw{buf, static_cast<quint64>(n)});
+      offset += static_cast<quint64>(n);
+      if (static_cast<quint64>(n) < raw[buf].size()) break;
+    }
+    rawFilled.close();
+  }
+
+  void inflateBlocks() {
+    z_stream zs{};
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) return fail(QStringLiteral("zlib: inflateInit2 failed"));
+
+    quint64 offset = 0;
+    int slot = -1;
+    bool streamEnd = false;
+    auto takeBlock = [&]() {
+      if (!freeBlocks.pop(&slot) || stopped()) return false;
+      zs.next_out = reinterpret_cast<Bytef*>(blocks[slot].data());
+      zs.avail_out = static_cast<uInt>(blockBytes);
+      return true;
+    };
+    auto pushBlock = [&]() {
+      const quint64 len = blockBytes - zs.avail_out;
+      // Blocks before startOffset are inflated only to get past them.
+      if (len > 0 && offset >= startOffset) filled.push(Filled{slot, offset, len});
+      else freeBlocks.push(slot);
+      offset += len;
+      slot = -1;
+    };
+
+    bool ok = takeBlock();
+    Raw in;
+    while (ok && rawFilled.pop(&in)) {
+      zs.next_in = reinterpret_cast<Bytef*>(raw[in.buf].data());
+      zs.avail_in = static_cast<uInt>(in.len);
+      while (ok && zs.avail_in > 0) {
+        if (streamEnd) {
+          // Concatenated gzip members (pigz, cat a.gz b.gz) continue the same image.
+          inflateReset(&zs);
+          streamEnd = false;
+        }
+        const int rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+          streamEnd = true;
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+          inflateEnd(&zs);
+          return fail(QString("gzip: %1 near image offset %2").arg(QString::fromLatin1(zs.msg ? zs.msg : "corrupt data")).arg(offset));
+        }
+        if (zs.avail_out == 0) {
+          pushBlock();
+          ok = takeBlock();
+        }
+      }
+      freeRaw.push(in.buf);
+    }
+    inflateEnd(&zs);
+    if (stopped()) return finish();
+    if (!streamEnd) return fail(QStringLiteral("gzip: unexpected end of the compressed image (truncated file?)"));
+    if (slot >= 0) pushBlock();
+    finish();
+  }
+};
+
+ImageSource::ImageSource() = default;
+
+ImageSource::~ImageSource() {
+  close();
+}
+
+bool ImageSource::open(const QString& path, const Options& opts, QString* error) {
+  close();
+  auto p = std::make_unique<Pipeline>();
+  p->fd = ::open(path.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+  if (p->fd < 0) {
+    if (error) *error = RawDevice::errnoMessage("open(" + path + ")");
+    return false;
+  }
+  struct stat st {};
+  if (::fstat(p->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    if (error) *error = path + " is not a regular file.";
+    ::close(p->fd);
+    return false;
+  }
+  // Large sequential reads: let the kernel read ahead aggressively.
+  ::posix_fadvise(p->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  unsigned char magic[2] = {0, 0};
+  compressed_ = ::pread(p->fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+  fileBytes_ = static_cast<quint64>(st.st_size);
+  blockBytes_ = alignUp(std::max<quint64>(opts.blockBytes, 4096), 4096);
+
+  p->blockBytes = blockBytes_;
+  p->startOffset = opts.startOffset / blockBytes_ * blockBytes_;
+  p->cancel = opts.cancel;
+  if (!compressed_ && p->startOffset > 0) {
+    if (::lseek(p->fd, static_cast<off_t>(p->startOffset), SEEK_SET) < 0) {
+      if (error) *error = RawDevice::errnoMessage("lseek(" + path + ")");
+      ::close(p->fd);
+      return false;
+    }
+    p->fileRead = p->startOffset;
+  }
+  const int depth = std::max(2, opts.depth);
+  for (int i = 0; i < depth; ++i) {
+    p->blocks.emplace_back(static_cast<std::size_t>(blockBytes_));
+    if (p->blocks.back().isNull()) {
+      if (error) *error = QString("Can't allocate %1 image buffers of %2 bytes.").arg(depth).arg(blockBytes_);
+      ::close(p->fd);
+      return false;
+    }
+    p->freeBlocks.push(i);
+  }
+
+  if (compressed_) {
+    for (int i = 0; i < 2; ++i) {
+      p->raw.emplace_back(static_cast<std::size_t>(std::max<quint64>(opts.readBytes, 64 << 10)));
+      p->freeRaw.push(i);
+    }
+    Pipeline* pl = p.get();
+    p->threads.emplace_back([pl] { pl->readCompressed(); });
+    p->threads.emplace_back([pl] { pl->inflateBlocks(); });
+  } else {
+    Pipeline* pl = p.get();
+    p->threads.emplace_back([pl] { pl->readPlain(); });
+  }
+  p_ = std::move(p);
+  return true;
+}
+
+void ImageSource::close() {
+  if (!p_) return;
+  p_->shutdown();
+  for (auto& t : p_->threads) t.join();
+  if (p_->fd >= 0) ::close(p_->fd);
+  p_.reset();
+}
+
+quint64 ImageSource::fileBytesRead() const {
+  return p_ ? p_->fileRead.load(std::memory_order_relaxed) : 0;
+}
+
+bool ImageSource::next(Block* out) {
+  if (!p_) return false;
+  Pipeline::Filled f;
+  if (!p_->filled.pop(&f)) return false;
+  out->data = p_->blocks[f.slot].data();
+  out->offset = f.offset;
+  out->len = f.len;
+  out->slot = f.slot;
+  return true;
+}
+
+void ImageSource::release(const Block& b) {
+  if (p_ && b.slot >= 0) p_->freeBlocks.push(b.slot);
+}
+
+bool ImageSource::failed() const {
+  if (!p_) return false;
+  std::lock_guard<std::mutex> lock(p_->errorMu);
+  return !p_->error.isEmpty();
+}
+
+QString ImageSource::error() const {
+  if (!p_) return {};
+  std::lock_guard<std::mutex> lock(p_->errorMu);
+  return p_->error;
+}
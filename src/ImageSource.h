@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+// Sequential reader of a disk image (.img/.iso, or gzip-compressed: detected by its magic, not
+// the file name). Background threads keep `depth` page-aligned blocks ready ahead of the
+// consumer: a reader doing large sequential read()s and, for gzip, an inflater between the
+// reader and the blocks. Blocks come out in order, all `blockBytes` long except the last one,
+// so a consumer can write them with O_DIRECT.
+class ImageSource final {
+public:
+  struct Options {
+    quint64 blockBytes = 8ull << 20;   // rounded up to 4096
+    int depth = 4;                     // blocks in flight (>= 2: reading overlaps writing)
+    quint64 readBytes = 4ull << 20;    // compressed input per read() (gzip only)
+    quint64 startOffset = 0;           // first image byte to deliver (a multiple of blockBytes);
+                                       // gzip is still inflated from the start
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  struct Block {
+    const char* data = nullptr;
+    quint64 offset = 0; // in the uncompressed image
+    quint64 len = 0;
+    int slot = -1;
+  };
+
+  ImageSource();
+  ~ImageSource();
+  ImageSource(const ImageSource&) = delete;
+  ImageSource& operator=(const ImageSource&) = delete;
+
+  // Opens the image and starts the background threads.
+  bool open(const QString& path, const Options& opts, QString* error = nullptr);
+  // Stops the threads; blocks handed out before become invalid.
+  void close();
+
+  bool isCompressed() const { return compressed_; }
+  quint64 blockBytes() const { return blockBytes_; }
+  // Size of the image file, and how much of it the reader has consumed so far (any thread).
+  quint64 fileBytes() const { return fileBytes_; }
+  quint64 fileBytesRead() const;
+  // Exact uncompressed size if known up front (plain images), else 0.
+  quint64 sizeHint() const { return compressed_ ? 0 : fileBytes_; }
+
+  // Waits for the next block. False at the end of the image, or on an error (see failed()).
+  bool next(Block* out);
+  // Hands a block's buffer back to the reader. Every block from next() must be released.
+  void release(const Block& b);
+
+  bool failed() const;
+  QString error() const;
+
+private:
+  struct Pipeline;
+
+  std::unique_ptr<Pipeline> p_;
+  bool compressed_ = false;
+  quint64 blockBytes_ = 0;
+  quint64 fileBytes_ = 0;
+};
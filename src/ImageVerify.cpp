@@ -0,0 +1,359 @@
+#include "ImageVerify.h"
+#include "ImageSource.h"
+#include "RawDevice.h"
+
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef FFROG_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+namespace {
+
+#ifndef FFROG_HAVE_XXHASH
+// XXH64 (https://github.com/Cyan4973/xxHash), seed 0: several GB/s per core, enough to keep up
+// with any USB stick without an extra dependency.
+constexpr quint64 kP1 = 0x9E3779B185EBCA87ull;
+constexpr quint64 kP2 = 0xC2B2AE3D27D4EB4Full;
+constexpr quint64 kP3 = 0x165667B19E3779F9ull;
+constexpr quint64 kP4 = 0x85EBCA77C2B2AE63ull;
+constexpr quint64 kP5 = 0x27D4EB2F165667C5ull;
+
+inline quint64 rotl(quint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline quint64 read64(const unsigned char* p) {
+  quint64 v;
+  std::memcpy(&v, p, 8);
+  return v; // x86/ARM little-endian, as XXH64 specifies
+}
+
+inline quint32 read32(const unsigned char* p) {
+  quint32 v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline quint64 round64(quint64 acc, quint64 input) {
+  acc += input * kP2;
+  return rotl(acc, 31) * kP1;
+}
+
+inline quint64 merge64(quint64 acc, quint64 v) {
+  acc ^= round64(0, v);
+  return acc * kP1 + kP4;
+}
+
+quint64 xxh64(const char* data, std::size_t len) {
+  const auto* p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* end = p + len;
+  quint64 h;
+  if (len >= 32) {
+    quint64 v1 = kP1 + kP2, v2 = kP2, v3 = 0, v4 = 0 - kP1;
+    const unsigned char* limit = end - 32;
+    do {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge64(merge64(merge64(merge64(h, v1), v2), v3), v4);
+  } else {
+    h = kP5;
+  }
+  h += len;
+  for (; p + 8 <= end; p += 8) h = rotl(h ^ round64(0, read64(p)), 27) * kP1 + kP4;
+  if (p + 4 <= end) {
+    h = rotl(h ^ (static_cast<quint64>(read32(p)) * kP1), 23) * kP2 + kP3;
+    p += 4;
+  }
+  for (; p < end; ++p) h = rotl(h ^ (*p * kP5), 11) * kP1;
+  h ^= h >> 33;
+  h *= kP2;
+  h ^= h >> 29;
+  h *= kP3;
+  h ^= h >> 32;
+  return h;
+}
+#endif
+
+quint64 chunkHash(const char* data, std::size_t len) {
+#ifdef FFROG_HAVE_XXHASH
+  return XXH3_64bits(data, len);
+#else
+  return xxh64(data, len);
+#endif
+}
+
+quint64 treeHash(const QVector<quint64>& chunks) {
+  return chunkHash(reinterpret_cast<const char*>(chunks.constData()), static_cast<std::size_t>(chunks.size()) * sizeof(quint64));
+}
+
+QString hex64(quint64 v) {
+  return QString("%1").arg(v, 16, 16, QChar('0'));
+}
+
+// Lets parallel workers feed an in-order consumer (SHA-256): chunk i goes in once 0..i-1 did.
+class InOrder {
+public:
+  // Waits for chunk `index`'s turn; false if abort() was called meanwhile.
+  bool wait(quint64 index) {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [&] { return next_ == index || aborted_; });
+    return !aborted_;
+  }
+  void done() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      ++next_;
+    }
+    cv_.notify_all();
+  }
+  void abort() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      aborted_ = true;
+    }
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  quint64 next_ = 0;
+  bool aborted_ = false;
+};
+
+} // namespace
+
+QString ImageVerify::algorithm() {
+#ifdef FFROG_HAVE_XXHASH
+  return QStringLiteral("xxh3");
+#else
+  return QStringLiteral("xxh64");
+#endif
+}
+
+QString ImageVerify::Digest::summary() const {
+  const double mb = static_cast<double>(imageBytes) / 1e6;
+  QString s = QString("image hashed: %1 MB in %2 s (%3 MB/s), %4/%5 MiB %6")
+                  .arg(mb, 0, 'f', 1)
+                  .arg(seconds, 0, 'f', 1)
+                  .arg(seconds > 0 ? mb / seconds : 0.0, 0, 'f', 1)
+                  .arg(algorithm)
+                  .arg(chunkBytes >> 20)
+                  .arg(hex64(tree));
+  if (!sha256.isEmpty()) s += ", sha256 " + QString::fromLatin1(sha256.toHex());
+  return s;
+}
+
+QString ImageVerify::Report::summary(const Digest& digest, const Options& opts) const {
+  const double mb = static_cast<double>(bytesChecked) / 1e6;
+  QString s = QString("image verify: %1 MB read back in %2 s (%3 MB/s, %4 threads), %5/%6 MiB %7")
+                  .arg(mb, 0, 'f', 1)
+                  .arg(seconds, 0, 'f', 1)
+                  .arg(seconds > 0 ? mb / seconds : 0.0, 0, 'f', 1)
+                  .arg(opts.threads)
+                  .arg(digest.algorithm)
+                  .arg(digest.chunkBytes >> 20)
+                  .arg(hex64(digest.tree));
+  if (!sha256.isEmpty()) s += ", sha256 " + QString::fromLatin1(sha256.toHex());
+  if (clean()) return s + ": match";
+  QStringList offsets;
+  for (quint64 off : badOffsets) offsets << QString::number(off);
+  if (badChunks > static_cast<quint64>(badOffsets.size())) offsets << "...";
+  s += QString(": %1 chunk(s) differ").arg(badChunks);
+  if (!offsets.isEmpty()) s += " at " + offsets.join(", ");
+  if (sha256Mismatch) s += ", SHA-256 differs";
+  return s;
+}
+
+ImageVerify::Source::Source(const QString& imagePath, const Options& opts) : imagePath_(imagePath), opts_(opts) {}
+
+const ImageVerify::Digest* ImageVerify::Source::digest(QString* error) {
+  std::call_once(once_, [this] { ok_ = hashImage(imagePath_, opts_, &digest_, &error_); });
+  if (!ok_ && error) *error = error_;
+  return ok_ ? &digest_ : nullptr;
+}
+
+bool ImageVerify::hashImage(const QString& imagePath, const Options& opts, Digest* out, QString* error) {
+  const int threads = std::max(1, opts.threads);
+  ImageSource::Options so;
+  so.blockBytes = opts.chunkBytes;
+  so.depth = threads + 2;
+  so.cancel = opts.cancel;
+  ImageSource src;
+  if (!src.open(imagePath, so, error)) return false;
+
+  std::mutex mu;
+  QVector<quint64> chunks;
+  quint64 imageBytes = 0;
+  QCryptographicHash sha(QCryptographicHash::Sha256);
+  InOrder order;
+  const auto start = std::chrono::steady_clock::now();
+
+  // The reader hands out chunks in order; the workers hash them in parallel.
+  auto worker = [&]() {
+    ImageSource::Block b;
+    while (src.next(&b)) {
+      const quint64 index = b.offset / src.blockBytes();
+      const quint64 h = chunkHash(b.data, static_cast<std::size_t>(b.len));
+      {
+        std::lock_guard<std::mutex> lock(mu);
+        if (index >= static_cast<quint64>(chunks.size())) chunks.resize(static_cast<qsizetype>(index + 1));
+        chunks[static_cast<qsizetype>(index)] = h;
+        imageBytes = std::max(imageBytes, b.offset + b.len);
+      }
+      if (opts.sha256) {
+        if (!order.wait(index)) {
+          src.release(b);
+          break;
+        }
+        sha.addData(QByteArrayView(b.data, static_cast<qsizetype>(b.len)));
+        order.done();
+      }
+      src.release(b);
+    }
+    // On a read error some chunk never comes: nobody may wait for it.
+    if (src.failed()) order.abort();
+  };
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+  for (auto& t : pool) t.join();
+
+  if (src.failed()) {
+    if (error) *error = src.error();
+    return false;
+  }
+  out->algorithm = algorithm();
+  out->imageBytes = imageBytes;
+  out->chunkBytes = src.blockBytes();
+  out->chunks = chunks;
+  out->tree = treeHash(chunks);
+  out->sha256 = opts.sha256 ? sha.result() : QByteArray();
+  out->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+bool ImageVerify::run(const QString& devicePath,
+                      const Digest& digest,
+                      const Options& opts,
+                      const IoProgressFn& progress,
+                      Report* report,
+                      QString* error) {
+  RawDevice dev;
+  if (!dev.open(devicePath, RawDevice::Mode::Read, /*direct*/ true, error)) return false;
+  if (dev.isBlockDevice() && digest.imageBytes > dev.size()) {
+    if (error) *error = QString("%1 (%2 bytes) is smaller than the image (%3 bytes).").arg(devicePath).arg(dev.size()).arg(digest.imageBytes);
+    return false;
+  }
+
+  const quint64 size = digest.imageBytes;
+  const quint64 chunk = digest.chunkBytes;
+  const quint64 chunkCount = static_cast<quint64>(digest.chunks.size());
+  const int threads = std::max(1, opts.threads);
+
+  std::atomic<quint64> next{0};
+  std::atomic<quint64> done{0};
+  std::atomic_bool failed{false};
+  std::mutex mu;
+  std::condition_variable cv;
+  int running = threads;
+  QVector<quint64> bad; // chunk indices
+  QString firstError;
+  QCryptographicHash sha(QCryptographicHash::Sha256);
+  InOrder order;
+
+  auto cancelled = [&opts]() { return opts.cancel && opts.cancel->load(std::memory_order_relaxed); };
+  auto fail = [&](const QString& msg) {
+    std::lock_guard<std::mutex> lock(mu);
+    if (!failed.exchange(true)) firstError = msg;
+  };
+
+  auto worker = [&]() {
+    AlignedBuffer buf(alignUp(chunk, dev.alignment()));
+    if (buf.isNull()) fail(QString("Can't allocate a %1-byte read buffer.").arg(chunk));
+    while (!failed.load(std::memory_order_relaxed) && !cancelled()) {
+      const quint64 index = next.fetch_add(1);
+      if (index >= chunkCount) break;
+      const quint64 off = index * chunk;
+      const std::size_t len = static_cast<std::size_t>(std::min(chunk, size - off));
+      // O_DIRECT only does whole aligned blocks: a short last chunk is read rounded up.
+      const std::size_t want = dev.isDirect() ? static_cast<std::size_t>(alignUp(len, dev.alignment())) : len;
+      std::size_t got = 0;
+      while (got < len) {
+        const ssize_t n = ::pread(dev.fd(), buf.data() + got, want - got, static_cast<off_t>(off + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += static_cast<std::size_t>(n);
+      }
+      if (got < len) {
+        fail(RawDevice::errnoMessage(QString("read at offset %1").arg(off)));
+        break;
+      }
+
+      if (chunkHash(buf.data(), len) != digest.chunks[static_cast<qsizetype>(index)]) {
+        std::lock_guard<std::mutex> lock(mu);
+        bad.append(index);
+      }
+      if (opts.sha256) {
+        if (!order.wait(index)) break;
+        sha.addData(QByteArrayView(buf.data(), static_cast<qsizetype>(len)));
+        order.done();
+      }
+      done.fetch_add(len, std::memory_order_relaxed);
+    }
+    // A worker that stops early leaves a gap in the SHA-256 order; release the others.
+    if (failed.load() || cancelled()) order.abort();
+    std::lock_guard<std::mutex> lock(mu);
+    --running;
+    cv.notify_all();
+  };
+
+  IoProgressMeter meter(size, progress);
+  std::vector<std::thread> pool;
+  pool.reserve(static_cast<std::size_t>(threads));
+  for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    while (running > 0) {
+      cv.wait_for(lock, std::chrono::milliseconds(200));
+      lock.unlock();
+      meter.update(done.load(std::memory_order_relaxed));
+      lock.lock();
+    }
+  }
+  for (auto& t : pool) t.join();
+  meter.update(done.load(), /*force*/ true);
+
+  if (report) {
+    std::sort(bad.begin(), bad.end());
+    report->bytesChecked = done.load();
+    report->badChunks = static_cast<quint64>(bad.size());
+    report->badOffsets.clear();
+    for (qsizetype i = 0; i < bad.size() && i < kMaxBadOffsets; ++i) report->badOffsets.append(bad[i] * chunk);
+    report->sha256 = opts.sha256 ? sha.result() : QByteArray();
+    report->sha256Mismatch = opts.sha256 && !digest.sha256.isEmpty() && report->sha256 != digest.sha256;
+    report->seconds = meter.elapsedSeconds();
+  }
+  if (failed) {
+    if (error) *error = firstError;
+    return false;
+  }
+  if (cancelled()) {
+    if (error) *error = QStringLiteral("Verify cancelled.");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "IoProgress.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <mutex>
+
+// Read-back verification after an image write. The source image (plain or gzip) is hashed once
+// per batch in fixed-size chunks; each device is then read back with large O_DIRECT reads on
+// `threads` threads that hash their chunks in parallel and compare them with the source's, so
+// mismatches are located to the chunk. Chunk hash: xxh3 when built with libxxhash, else the
+// built-in XXH64. With `sha256`, both sides are also hashed with SHA-256 end to end (in chunk
+// order) for the audit record.
+// Blocking: run it on a worker thread.
+class ImageVerify final {
+public:
+  struct Options {
+    quint64 chunkBytes = 4ull << 20; // hash granularity = read size (rounded up to 4096)
+    int threads = 4;                 // parallel reads/hashes per device (and for the image)
+    bool sha256 = false;
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  // The source image's hashes.
+  struct Digest {
+    QString algorithm;       // chunk hash: "xxh3" or "xxh64"
+    quint64 imageBytes = 0;  // uncompressed size
+    quint64 chunkBytes = 0;
+    QVector<quint64> chunks; // one hash per chunk, in order
+    quint64 tree = 0;        // hash of the chunk hashes: one value for the whole image
+    QByteArray sha256;       // of the whole image, with Options::sha256
+    double seconds = 0;
+
+    // e.g. "image hashed: 3900.0 MB in 5.1 s (764.7 MB/s), xxh3/4 MiB 1a2b3c4d5e6f7081"
+    QString summary() const;
+  };
+
+  struct Report {
+    quint64 bytesChecked = 0;
+    quint64 badChunks = 0;
+    QVector<quint64> badOffsets; // device offsets of the first kMaxBadOffsets mismatching chunks
+    QByteArray sha256;           // of the device's copy, with Options::sha256
+    bool sha256Mismatch = false;
+    double seconds = 0;
+
+    bool clean() const { return badChunks == 0 && !sha256Mismatch; }
+    // The per-device verification record, e.g. "image verify: 3900.0 MB read back in 12.3 s
+    // (317.1 MB/s, 4 threads), xxh3/4 MiB 1a2b3c4d5e6f7081, sha256 9f86...: match"
+    QString summary(const Digest& digest, const Options& opts) const;
+  };
+
+  static constexpr int kMaxBadOffsets = 16;
+
+  // The source side, shared by the devices of a batch: the first verify that needs the digest
+  // hashes the image, the others wait for it. Thread-safe.
+  class Source final {
+  public:
+    Source(const QString& imagePath, const Options& opts);
+    const Digest* digest(QString* error);
+    const Options& options() const { return opts_; }
+
+  private:
+    QString imagePath_;
+    Options opts_;
+    std::once_flag once_;
+    Digest digest_;
+    bool ok_ = false;
+    QString error_;
+  };
+
+  static QString algorithm();
+
+  static bool hashImage(const QString& imagePath, const Options& opts, Digest* out, QString* error = nullptr);
+
+  // Reads back the first digest.imageBytes of `devicePath`. Returns false on I/O errors or cancel;
+  // a completed check that found differences returns true with !report->clean().
+  static bool run(const QString& devicePath,
+                  const Digest& digest,
+                  const Options& opts,
+                  const IoProgressFn& progress = {},
+                  Report* report = nullptr,
+                  QString* error = nullptr);
+};
@@ -0,0 +1,162 @@
+#include "ImageWriter.h"
+#include "ImageSource.h"
+#include "RawDevice.h"
+#include "ZeroCheck.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+// Compare/skip granularity of delta writes: small enough that a changed file costs little more
+// than its own size, large enough that each read-back is still one efficient request.
+constexpr quint64 kDeltaChunkBytes = 1ull << 20;
+
+bool isZero(const char* data, quint64 len) {
+  return ZeroCheck::scan(data, static_cast<std::size_t>(len), 4096).nonZeroSectors == 0;
+}
+
+} // namespace
+
+QString ImageWriter::Stats::summary(const Options& opts) const {
+  const double mb = static_cast<double>(imageBytes()) / 1e6;
+  const QString source = compressed ? QString("gzip %1 MB -> %2 MB").arg(static_cast<double>(fileBytes) / 1e6, 0, 'f', 1).arg(mb, 0, 'f', 1)
+                                    : QString("%1 MB").arg(mb, 0, 'f', 1);
+  QString s = QString("%1, %2, %3 MiB x %4, %5 s (%6 MB/s)")
+                  .arg(source)
+                  .arg(direct ? QStringLiteral("O_DIRECT") : QStringLiteral("buffered"))
+                  .arg(static_cast<double>(opts.blockBytes) / (1 << 20), 0, 'f', 1)
+                  .arg(opts.depth)
+                  .arg(seconds, 0, 'f', 1)
+                  .arg(seconds > 0 ? mb / seconds : 0.0, 0, 'f', 1);
+  if (opts.delta || opts.targetZeroed) {
+    s += QString("; wrote %1 MB, skipped %2 MB (%3%)")
+             .arg(static_cast<double>(bytesWritten) / 1e6, 0, 'f', 1)
+             .arg(static_cast<double>(bytesSkipped) / 1e6, 0, 'f', 1)
+             .arg(imageBytes() ? 100.0 * static_cast<double>(bytesSkipped) / static_cast<double>(imageBytes()) : 0.0, 0, 'f', 0);
+  }
+  return s;
+}
+
+bool ImageWriter::run(const QString& imagePath,
+                      const QString& devicePath,
+                      const Options& opts,
+                      const IoProgressFn& progress,
+                      Stats* stats,
+                      QString* error) {
+  RawDevice dev;
+  const RawDevice::Mode mode = opts.delta ? RawDevice::Mode::ReadWrite : RawDevice::Mode::Write;
+  if (!dev.open(devicePath, mode, opts.direct, error)) return false;
+
+  ImageSource::Options srcOpts;
+  srcOpts.blockBytes = alignUp(std::max<quint64>(opts.blockBytes, dev.alignment()), dev.alignment());
+  srcOpts.depth = opts.depth;
+  srcOpts.cancel = opts.cancel;
+  ImageSource src;
+  if (!src.open(imagePath, srcOpts, error)) return false;
+
+  // Plain images are checked up front; compressed ones when the writes get there.
+  if (dev.isBlockDevice() && src.sizeHint() > dev.size()) {
+    if (error) *error = QString("The image (%1 bytes) is larger than %2 (%3 bytes).").arg(src.sizeHint()).arg(devicePath).arg(dev.size());
+    return false;
+  }
+
+  const bool direct = dev.isDirect();
+  Sink sink(dev, devicePath, opts.delta, opts.targetZeroed);
+  IoProgressMeter meter(src.sizeHint(), progress);
+  bool ok = true;
+  ImageSource::Block b;
+  while (ok && src.next(&b)) {
+    if (opts.cancel && opts.cancel->load(std::memory_order_relaxed)) {
+      if (error) *error = QStringLiteral("Image write cancelled.");
+      ok = false;
+    } else {
+      ok = sink.write(b.data, b.offset, b.len, error);
+    }
+    src.release(b);
+    if (!ok) break;
+    // gzip: project the total from how much of the file has been consumed.
+    if (src.isCompressed() && src.fileBytesRead() > 0) {
+      meter.setTotal(std::max(sink.bytesDone(), sink.bytesDone() * src.fileBytes() / src.fileBytesRead()));
+    }
+    meter.update(sink.bytesDone());
+  }
+  if (ok && src.failed()) {
+    if (error) *error = src.error();
+    ok = false;
+  }
+  src.close();
+
+  ok = sink.finish(ok, error);
+  meter.setTotal(sink.bytesDone());
+  meter.update(sink.bytesDone(), /*force*/ true);
+
+  if (stats) {
+    stats->compressed = src.isCompressed();
+    stats->direct = direct;
+    stats->fileBytes = src.fileBytes();
+    stats->bytesWritten = sink.bytesWritten();
+    stats->bytesSkipped = sink.bytesSkipped();
+    stats->seconds = meter.elapsedSeconds();
+  }
+  return ok;
+}
+
+ImageWriter::Sink::Sink(RawDevice& dev, const QString& devicePath, bool delta, bool targetZeroed)
+    : dev_(dev), devicePath_(devicePath), delta_(delta), zeroed_(targetZeroed) {
+  if (delta_) readBuf_ = AlignedBuffer(static_cast<std::size_t>(kDeltaChunkBytes));
+}
+
+bool ImageWriter::Sink::write(const char* data, quint64 offset, quint64 len, QString* error) {
+  if (dev_.isBlockDevice() && offset + len > dev_.size()) {
+    if (error) *error = QString("The image is larger than %1 (%2 bytes).").arg(devicePath_).arg(dev_.size());
+    return false;
+  }
+  if (!delta_ && !zeroed_) return writeRun(data, offset, len, error);
+
+  // Chunks that must be written are coalesced into one write per run.
+  quint64 run = 0;
+  quint64 runLen = 0;
+  for (quint64 pos = 0; pos < len;) {
+    const quint64 n = std::min(kDeltaChunkBytes, len - pos);
+    if (matches(data + pos, offset + pos, n)) {
+      if (runLen > 0 && !writeRun(data + run, offset + run, runLen, error)) return false;
+      runLen = 0;
+      skipped_ += n;
+    } else {
+      if (runLen == 0) run = pos;
+      runLen += n;
+    }
+    pos += n;
+  }
+  return runLen == 0 || writeRun(data + run, offset + run, runLen, error);
+}
+
+bool ImageWriter::Sink::matches(const char* data, quint64 offset, quint64 len) {
+  if (zeroed_ && isZero(data, len)) return true;
+  if (!delta_) return false;
+  // Only the last chunk can be short; O_DIRECT can't read an unaligned length.
+  if (dev_.isDirect() && len % dev_.alignment() != 0) dev_.setDirect(false);
+  // A chunk that can't be read back is simply written.
+  if (!dev_.readAt(readBuf_.data(), len, offset)) return false;
+  return std::memcmp(readBuf_.data(), data, static_cast<std::size_t>(len)) == 0;
+}
+
+bool ImageWriter::Sink::writeRun(const char* data, quint64 offset, quint64 len, QString* error) {
+  // Only the last block can be short; O_DIRECT can't write an unaligned length.
+  if (dev_.isDirect() && len % dev_.alignment() != 0) dev_.setDirect(false);
+  if (!dev_.writeAt(data, len, offset, error)) return false;
+  written_ += len;
+  return true;
+}
+
+bool ImageWriter::Sink::finish(bool ok, QString* error) {
+  // Flush even after a failure so the bytes counted as written really are on the device.
+  if (!dev_.sync(ok ? error : nullptr)) ok = false;
+  // The image usually carries its own partition table; best effort, udev rescans on close anyway.
+  if (ok && dev_.isBlockDevice()) ::ioctl(dev_.fd(), BLKRRPART);
+  return ok;
+}
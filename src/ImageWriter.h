@@ -0,0 +1,76 @@
+#pragma once
+
+#include "IoProgress.h"
+#include "RawDevice.h"
+
+#include <QString>
+
+#include <atomic>
+
+// Flashes a disk image (.img/.iso, optionally gzip-compressed) onto a whole device, like
+// `dd bs=8M oflag=direct conv=fsync` but double-buffered: ImageSource reads (and inflates) the
+// next blocks on its own threads while this thread writes the current one with O_DIRECT.
+// Blocking: run it on a worker thread.
+class ImageWriter final {
+public:
+  struct Options {
+    quint64 blockBytes = 8ull << 20; // bytes per write (rounded up to the device alignment)
+    int depth = 4;                   // blocks read ahead of the writer
+    bool direct = true;              // O_DIRECT (silently buffered where unsupported)
+    bool delta = false;              // read the device first, write only the chunks that differ
+    bool targetZeroed = false;       // device known to be all zeros: skip the image's zero chunks
+    const std::atomic_bool* cancel = nullptr;
+  };
+
+  struct Stats {
+    bool compressed = false;
+    bool direct = false;
+    quint64 fileBytes = 0;    // image file size (compressed size for .gz)
+    quint64 bytesWritten = 0; // uncompressed image bytes written to the device
+    quint64 bytesSkipped = 0; // image bytes not written: the device already had them (delta/zeroed)
+    double seconds = 0;
+
+    quint64 imageBytes() const { return bytesWritten + bytesSkipped; }
+
+    // e.g. "gzip 1.2 GB -> 3.9 GB, O_DIRECT, 8 MiB x 4, 123.4 s (31.6 MB/s)", plus
+    // "; wrote 0.2 GB, skipped 3.7 GB (95%)" when chunks were skipped
+    QString summary(const Options& opts) const;
+  };
+
+  static bool run(const QString& imagePath,
+                  const QString& devicePath,
+                  const Options& opts,
+                  const IoProgressFn& progress = {},
+                  Stats* stats = nullptr,
+                  QString* error = nullptr);
+
+  // The device end of a write, shared with ImageFanOut. write() takes image bytes
+  // [offset, offset+len) in order and refuses to go past the end of a block device; an unaligned
+  // (last) block turns O_DIRECT off. With `delta`, each 1 MiB chunk is read back first and only
+  // runs of chunks that differ are written; with `targetZeroed`, zero chunks of the image are
+  // skipped without reading. finish() flushes, also after a failure, and on success has the
+  // kernel re-read the partition table the image brought.
+  class Sink final {
+  public:
+    Sink(RawDevice& dev, const QString& devicePath, bool delta, bool targetZeroed);
+
+    bool write(const char* data, quint64 offset, quint64 len, QString* error);
+    bool finish(bool ok, QString* error);
+
+    quint64 bytesWritten() const { return written_; }
+    quint64 bytesSkipped() const { return skipped_; }
+    quint64 bytesDone() const { return written_ + skipped_; }
+
+  private:
+    bool writeRun(const char* data, quint64 offset, quint64 len, QString* error);
+    bool matches(const char* data, quint64 offset, quint64 len);
+
+    RawDevice& dev_;
+    QString devicePath_;
+    bool delta_;
+    bool zeroed_;
+    AlignedBuffer readBuf_;
+    quint64 written_ = 0;
+    quint64 skipped_ = 0;
+  };
+};
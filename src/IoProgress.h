@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+#include <chrono>
+#include <functional>
+
+// Progress of a long raw I/O operation (zero-fill, verify, image write...).
+struct IoProgress {
+  quint64 bytesDone = 0;
+  quint64 bytesTotal = 0;  // 0 = progress unknown (still running)
+  double bytesPerSec = 0;  // average since the start, or the current rate when the source has one
+  qint64 etaSeconds = -1;  // -1 = not reported; derive it from the rate
+
+  qint64 eta() const {
+    if (etaSeconds >= 0) return etaSeconds;
+    if (bytesPerSec <= 0 || bytesTotal <= bytesDone) return -1;
+    return static_cast<qint64>(static_cast<double>(bytesTotal - bytesDone) / bytesPerSec);
+  }
+};
+
+// "1.50 GiB" style sizes and "h:mm:ss" durations (-1 = "-") for progress displays.
+inline QString humanBytes(quint64 bytes) {
+  const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+  double b = static_cast<double>(bytes);
+  int u = 0;
+  while (b >= 1024.0 && u < 4) { b /= 1024.0; ++u; }
+  return QString::number(b, 'f', (u == 0 ? 0 : 2)) + " " + units[u];
+}
+
+inline QString formatDuration(qint64 secs) {
+  if (secs < 0) return QStringLiteral("-");
+  return QString("%1:%2:%3")
+      .arg(secs / 3600)
+      .arg((secs / 60) % 60, 2, 10, QChar('0'))
+      .arg(secs % 60, 2, 10, QChar('0'));
+}
+
+// Called from the worker thread that does the I/O; marshal to the GUI thread yourself.
+using IoProgressFn = std::function<void(const IoProgress&)>;
+
+// Rate-limits IoProgressFn calls and computes the average rate.
+class IoProgressMeter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  IoProgressMeter(quint64 bytesTotal, IoProgressFn fn, std::chrono::milliseconds interval = std::chrono::milliseconds(500))
+      : total_(bytesTotal), fn_(std::move(fn)), interval_(interval), start_(Clock::now()), last_(start_) {}
+
+  // Reports at most once per interval unless `force` is set.
+  void update(quint64 bytesDone, bool force = false) {
+    const auto now = Clock::now();
+    if (!force && now - last_ < interval_) return;
+    last_ = now;
+    if (!fn_) return;
+    IoProgress p;
+    p.bytesDone = bytesDone;
+    p.bytesTotal = total_;
+    const double secs = elapsedSeconds();
+    p.bytesPerSec = secs > 0 ? static_cast<double>(bytesDone) / secs : 0;
+    fn_(p);
+  }
+
+  // For sources whose size is only estimated as they go (compressed images).
+  void setTotal(quint64 bytesTotal) { total_ = bytesTotal; }
+
+  double elapsedSeconds() const { return std::chrono::duration<double>(Clock::now() - start_).count(); }
+
+private:
+  quint64 total_;
+  IoProgressFn fn_;
+  std::chrono::milliseconds interval_;
+  Clock::time_point start_;
+  Clock::time_point last_;
+};
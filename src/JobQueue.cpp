@@ -0,0 +1,190 @@
+#include "JobQueue.h"
+
+#include <QFutureWatcher>
+#include <algorithm>
+
+namespace {
+
+// Time for the link to settle after a job starts or finishes (the new job's mount/open, the
+// stick's write cache) before its throughput is measured, and the length of one measurement.
+constexpr qint64 kSettleMs = 3000;
+constexpr qint64 kWindowMs = 5000;
+// Weight of the newest measurement in the smoothed throughput.
+constexpr double kSmoothing = 0.5;
+// One more (or one fewer) job must be worth at least this much aggregate throughput.
+constexpr double kMinGain = 1.05;
+
+QString mbps(double bytesPerSec) {
+  return QString::number(bytesPerSec / 1e6, 'f', 1) + " MB/s";
+}
+
+} // namespace
+
+JobQueue::JobQueue(QObject* parent) : QObject(parent) {
+  pool_.setMaxThreadCount(maxConcurrent_);
+  clock_.start();
+}
+
+void JobQueue::setMaxConcurrent(int n) {
+  maxConcurrent_ = std::max(1, n);
+  pool_.setMaxThreadCount(maxConcurrent_);
+  pump();
+}
+
+int JobQueue::enqueue(const QString& key, Task task, const QVector<UsbTopology::Link>& links) {
+  if (activeKeys_.contains(key)) return 0;
+  activeKeys_.insert(key);
+
+  Job job;
+  job.id = nextId_++;
+  job.key = key;
+  job.task = std::move(task);
+  for (const UsbTopology::Link& l : links) {
+    if (!links_.contains(l.id)) links_[l.id].limit = initialLimit(l);
+    job.links << l.id;
+  }
+  const int id = job.id;
+  queue_.enqueue(std::move(job));
+  // Start from the event loop so callers can record the id before jobStarted() fires.
+  QMetaObject::invokeMethod(this, [this]() { pump(); }, Qt::QueuedConnection);
+  return id;
+}
+
+int JobQueue::initialLimit(const UsbTopology::Link& link) {
+  // The root hub (bus) of an xHCI controller gives each port its own bandwidth, so only an
+  // external hub's shared upstream port starts limited; retune() lowers the others if needed.
+  if (!link.hub) return 0;
+  // A USB 2 link carries ~40 MB/s of payload: two sticks writing 15-20 MB/s each fill it.
+  if (link.speedMbps > 0 && link.speedMbps <= 480) return 2;
+  if (link.speedMbps > 0 && link.speedMbps <= 5000) return 4;
+  return 0;
+}
+
+int JobQueue::effectiveLimit(const Link& link) const {
+  return link.limit > 0 ? std::min(link.limit, maxConcurrent_) : maxConcurrent_;
+}
+
+int JobQueue::linkLimit(const QString& link) const {
+  const auto it = links_.constFind(link);
+  return it == links_.constEnd() ? maxConcurrent_ : effectiveLimit(*it);
+}
+
+bool JobQueue::linksFree(const Job& job) const {
+  for (const QString& id : job.links) {
+    const Link& l = links_[id];
+    if (l.running >= effectiveLimit(l)) return false;
+  }
+  return true;
+}
+
+void JobQueue::pump() {
+  // In queue order, skipping jobs whose link is full. Index-based: jobStarted() handlers may
+  // enqueue more jobs.
+  for (int i = 0; running_ < maxConcurrent_ && i < queue_.size();) {
+    if (!linksFree(queue_[i])) {
+      ++i;
+      continue;
+    }
+    start(queue_.takeAt(i));
+  }
+}
+
+void JobQueue::start(const Job& job) {
+  ++running_;
+  for (const QString& id : job.links) {
+    Link& l = links_[id];
+    ++l.running;
+    restartWindow(l);
+  }
+  bytesDone_.insert(job.key, 0);
+  runningLinks_.insert(job.key, job.links);
+  Q_EMIT jobStarted(job.id, job.key);
+
+  auto* watcher = new QFutureWatcher<OpResult>(this);
+  connect(watcher, &QFutureWatcher<OpResult>::finished, this, [this, watcher, job]() {
+    watcher->deleteLater();
+    const QFuture<OpResult> f = watcher->future();
+    OpResult r;
+    if (f.isValid() && f.resultCount() > 0) {
+      r = f.result();
+    } else {
+      r.error = QStringLiteral("Operation was cancelled.");
+    }
+    finish(job, r);
+  });
+  watcher->setFuture(job.task());
+}
+
+void JobQueue::finish(const Job& job, const OpResult& r) {
+  --running_;
+  activeKeys_.remove(job.key);
+  bytesDone_.remove(job.key);
+  runningLinks_.remove(job.key);
+  for (const QString& id : job.links) {
+    Link& l = links_[id];
+    --l.running;
+    restartWindow(l);
+    // The next batch may be different sticks: measure afresh, from the limit learned so far.
+    if (l.running == 0) l.bytesPerSec.clear();
+  }
+  Q_EMIT jobFinished(job.id, job.key, r);
+  pump();
+  if (isIdle()) Q_EMIT idle();
+}
+
+void JobQueue::restartWindow(Link& link) {
+  link.windowStartMs = clock_.elapsed() + kSettleMs;
+  link.windowBytes = 0;
+}
+
+void JobQueue::reportProgress(const QString& key, quint64 bytesDone) {
+  const auto last = bytesDone_.find(key);
+  if (last == bytesDone_.end()) return;
+  const quint64 delta = bytesDone >= *last ? bytesDone - *last : bytesDone;
+  *last = bytesDone;
+
+  const qint64 now = clock_.elapsed();
+  bool raised = false;
+  for (const QString& id : runningLinks_.value(key)) {
+    Link& l = links_[id];
+    if (now < l.windowStartMs) continue;
+    l.windowBytes += delta;
+    const qint64 elapsed = now - l.windowStartMs;
+    if (elapsed < kWindowMs) continue;
+
+    const double sample = static_cast<double>(l.windowBytes) * 1000.0 / static_cast<double>(elapsed);
+    const auto prev = l.bytesPerSec.constFind(l.running);
+    l.bytesPerSec[l.running] = prev == l.bytesPerSec.constEnd() ? sample : kSmoothing * sample + (1 - kSmoothing) * *prev;
+    l.windowStartMs = now;
+    l.windowBytes = 0;
+    raised = retune(id, l) || raised;
+  }
+  if (raised) pump();
+}
+
+bool JobQueue::retune(const QString& id, Link& link) {
+  const int n = link.running;
+  const double here = link.bytesPerSec.value(n);
+  const double fewer = link.bytesPerSec.value(n - 1); // 0 = not measured
+  const double more = link.bytesPerSec.value(n + 1);
+
+  // The last job added cost throughput: step back.
+  if (n > 1 && fewer > here * kMinGain) {
+    if (link.limit == n - 1) return false; // already stepped back, waiting for a job to finish
+    link.limit = n - 1;
+    Q_EMIT linkLimitChanged(id, link.limit, QString("%1 at %2 jobs, %3 at %4").arg(mbps(fewer)).arg(n - 1).arg(mbps(here)).arg(n));
+    return false;
+  }
+
+  // Full, with jobs waiting for it: try one more unless that is known not to pay off.
+  if (n < effectiveLimit(link) || n >= maxConcurrent_) return false;
+  if (fewer > 0 && here < fewer * kMinGain) return false;
+  if (more > 0 && more < here * kMinGain) return false;
+  const bool waiting = std::any_of(queue_.cbegin(), queue_.cend(), [&id](const Job& j) { return j.links.contains(id); });
+  if (!waiting) return false;
+  link.limit = n + 1;
+  Q_EMIT linkLimitChanged(id, link.limit,
+                          fewer > 0 ? QString("%1 at %2 jobs, %3 at %4").arg(mbps(fewer)).arg(n - 1).arg(mbps(here)).arg(n)
+                                    : QString("%1 at %2 jobs").arg(mbps(here)).arg(n));
+  return true;
+}
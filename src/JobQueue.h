@@ -0,0 +1,99 @@
+#pragma once
+
+#include "OpResult.h"
+#include "UsbTopology.h"
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+// Runs device operations in parallel with a concurrency limit.
+// Each job is keyed by its device (block object); a key can only have one queued/running job,
+// and a failed job never affects the others.
+//
+// Jobs may also name the shared USB links their device sits behind (UsbTopology::links). Each
+// link has its own limit: external hubs start from their speed (2 jobs on 480 Mb/s, 4 on
+// 5 Gb/s), root hubs (buses) and controllers start unlimited; the aggregate throughput
+// measured at each job count (reportProgress()) then moves the limit one job at a time towards
+// the count with the most MB/s. Queued jobs behind a full link wait while later jobs on other
+// links start.
+class JobQueue final : public QObject {
+  Q_OBJECT
+public:
+  using Task = std::function<QFuture<OpResult>()>;
+
+  explicit JobQueue(QObject* parent = nullptr);
+
+  void setMaxConcurrent(int n);
+  int maxConcurrent() const { return maxConcurrent_; }
+
+  // Pool for tasks that still need a thread for blocking work. Sized to maxConcurrent().
+  QThreadPool* threadPool() { return &pool_; }
+
+  // Returns the job id, or 0 if `key` already has a job queued or running.
+  int enqueue(const QString& key, Task task, const QVector<UsbTopology::Link>& links = {});
+
+  // Progress of the running job `key`: bytes done in its current phase (a new phase may start
+  // over at 0). Feeds the per-link throughput measurement; unknown keys are ignored.
+  void reportProgress(const QString& key, quint64 bytesDone);
+
+  // The current job limit of a link (maxConcurrent() if it has none of its own).
+  int linkLimit(const QString& link) const;
+
+  bool isActive(const QString& key) const { return activeKeys_.contains(key); }
+  bool isIdle() const { return running_ == 0 && queue_.isEmpty(); }
+
+Q_SIGNALS:
+  void jobStarted(int id, const QString& key);
+  void jobFinished(int id, const QString& key, const OpResult& result);
+  void idle();
+  // A link's limit moved after a measurement; `detail` is e.g. "41.2 MB/s at 2 jobs, 38.0 MB/s at 3".
+  void linkLimitChanged(const QString& link, int limit, const QString& detail);
+
+private:
+  struct Job {
+    int id = 0;
+    QString key;
+    Task task;
+    QStringList links;
+  };
+
+  struct Link {
+    int limit = 0;   // 0 = none of its own (not a hub, or unknown speed)
+    int running = 0;
+    // Current measurement window; restarted (after a settle time) whenever `running` changes.
+    qint64 windowStartMs = 0;
+    quint64 windowBytes = 0;
+    QMap<int, double> bytesPerSec; // smoothed aggregate throughput by job count
+  };
+
+  void pump();
+  void start(const Job& job);
+  void finish(const Job& job, const OpResult& r);
+  bool linksFree(const Job& job) const;
+  int effectiveLimit(const Link& link) const;
+  void restartWindow(Link& link);
+  bool retune(const QString& id, Link& link);
+
+  static int initialLimit(const UsbTopology::Link& link);
+
+  QQueue<Job> queue_;
+  QSet<QString> activeKeys_;
+  QHash<QString, Link> links_;
+  QHash<QString, quint64> bytesDone_; // last reported progress of each running job
+  QHash<QString, QStringList> runningLinks_;
+  QElapsedTimer clock_;
+  QThreadPool pool_;
+  int maxConcurrent_ = 4;
+  int running_ = 0;
+  int nextId_ = 1;
+};
@@ -0,0 +1,157 @@
+#include "LogModel.h"
+
+#include <QBrush>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+QString LogEntry::levelName(Level level) {
+  switch (level) {
+    case Level::Debug: return QStringLiteral("DEBUG");
+    case Level::Info: return QStringLiteral("INFO");
+    case Level::Warning: return QStringLiteral("WARN");
+    case Level::Error: return QStringLiteral("ERROR");
+  }
+  return {};
+}
+
+QString LogEntry::toLine() const {
+  return QString("%1 %2 %3 %4")
+      .arg(QDateTime::fromMSecsSinceEpoch(msecs).toString("yyyy-MM-dd HH:mm:ss.zzz"))
+      .arg(levelName(level), -5)
+      .arg(device.isEmpty() ? QStringLiteral("-") : device)
+      .arg(message);
+}
+
+LogModel::LogModel(int capacity, QObject* parent) : QAbstractTableModel(parent), capacity_(std::max(1, capacity)) {}
+
+void LogModel::append(const LogEntry& entry) {
+  if (count_ == capacity_) {
+    beginRemoveRows({}, 0, 0);
+    head_ = (head_ + 1) % capacity_;
+    --count_;
+    endRemoveRows();
+  }
+  beginInsertRows({}, count_, count_);
+  const int slot = (head_ + count_) % capacity_;
+  if (slot == ring_.size()) ring_.push_back(entry);
+  else ring_[slot] = entry;
+  ++count_;
+  endInsertRows();
+
+  if (!entry.device.isEmpty() && !devices_.contains(entry.device)) {
+    devices_.insert(entry.device);
+    Q_EMIT deviceSeen(entry.device);
+  }
+}
+
+int LogModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : count_;
+}
+
+int LogModel::columnCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : ColCount;
+}
+
+QVariant LogModel::data(const QModelIndex& index, int role) const {
+  if (!index.isValid() || index.row() >= count_) return {};
+  const LogEntry& e = entry(index.row());
+  switch (role) {
+    case Qt::DisplayRole:
+      switch (index.column()) {
+        case ColTime: return QDateTime::fromMSecsSinceEpoch(e.msecs).toString("yyyy-MM-dd HH:mm:ss");
+        case ColLevel: return LogEntry::levelName(e.level);
+        case ColDevice: return e.device;
+        case ColMessage: return e.message;
+      }
+      return {};
+    case Qt::ToolTipRole:
+      return index.column() == ColMessage ? QVariant(e.message) : QVariant();
+    case Qt::ForegroundRole:
+      if (e.level == LogEntry::Level::Error) return QBrush(Qt::red);
+      if (e.level == LogEntry::Level::Warning) return QBrush(QColor(0xb3, 0x6b, 0x00));
+      if (e.level == LogEntry::Level::Debug) return QBrush(Qt::gray);
+      return {};
+    case LevelRole: return static_cast<int>(e.level);
+    case DeviceRole: return e.device;
+  }
+  return {};
+}
+
+QVariant LogModel::headerData(int section, Qt::Orientation orientation, int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+  switch (section) {
+    case ColTime: return QStringLiteral("Time");
+    case ColLevel: return QStringLiteral("Level");
+    case ColDevice: return QStringLiteral("Device");
+    case ColMessage: return QStringLiteral("Message");
+  }
+  return {};
+}
+
+LogFilter::LogFilter(QObject* parent) : QSortFilterProxyModel(parent) {}
+
+void LogFilter::setMinimumLevel(LogEntry::Level level) {
+  if (level == minLevel_) return;
+  minLevel_ = level;
+  invalidateRowsFilter();
+}
+
+void LogFilter::setDevice(const QString& device) {
+  if (device == device_) return;
+  device_ = device;
+  invalidateRowsFilter();
+}
+
+bool LogFilter::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const {
+  // Straight from the ring: no QVariant round trip per row while refiltering.
+  const auto* model = qobject_cast<const LogModel*>(sourceModel());
+  if (!model || sourceParent.isValid()) return true;
+  const LogEntry& e = model->entry(sourceRow);
+  return e.level >= minLevel_ && (device_.isEmpty() || e.device == device_);
+}
+
+QString RotatingLog::defaultPath() {
+  const QString env = qEnvironmentVariable("FFROG_LOG_FILE");
+  if (!env.isEmpty()) return env;
+  return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/ffrog.log";
+}
+
+bool RotatingLog::open(const Options& opts, QString* error) {
+  opts_ = opts;
+  file_.close();
+  if (!QDir().mkpath(QFileInfo(opts_.path).absolutePath())) {
+    if (error) *error = QString("Cannot create the directory of %1.").arg(opts_.path);
+    return false;
+  }
+  // History carries over from earlier runs.
+  file_.setFileName(opts_.path);
+  if (!file_.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+    if (error) *error = QString("Cannot open %1: %2").arg(opts_.path, file_.errorString());
+    return false;
+  }
+  return true;
+}
+
+void RotatingLog::write(const QString& line) {
+  if (!file_.isOpen()) return;
+  const QByteArray bytes = line.toUtf8() + '\n';
+  if (file_.size() > 0 && file_.size() + bytes.size() > opts_.maxBytes) rotate();
+  if (!file_.isOpen()) return;
+  file_.write(bytes);
+  file_.flush();
+}
+
+void RotatingLog::rotate() {
+  file_.close();
+  const int keep = std::max(0, opts_.keep);
+  QFile::remove(QString("%1.%2").arg(opts_.path).arg(keep));
+  for (int i = keep - 1; i >= 1; --i) {
+    QFile::rename(QString("%1.%2").arg(opts_.path).arg(i), QString("%1.%2").arg(opts_.path).arg(i + 1));
+  }
+  if (keep > 0) QFile::rename(opts_.path, opts_.path + ".1");
+  file_.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QFile>
+#include <QSet>
+#include <QSortFilterProxyModel>
+#include <QString>
+#include <QVector>
+
+// One line of the operation log.
+struct LogEntry {
+  enum class Level { Debug, Info, Warning, Error };
+
+  qint64 msecs = 0;         // wall clock, ms since the epoch
+  Level level = Level::Info;
+  QString device;           // e.g. "/dev/sdb"; empty for app-wide lines
+  QString message;
+
+  static QString levelName(Level level);
+  // The log file format: "2026-10-16 12:34:56.789 ERROR /dev/sdb Format on /dev/sdb: ..."
+  QString toLine() const;
+};
+
+// The most recent `capacity` log entries in a ring buffer: appending to a full log drops the
+// oldest entry, so memory and the cost of an append stay flat however long the station runs.
+// The full history is in the log file (RotatingLog).
+class LogModel final : public QAbstractTableModel {
+  Q_OBJECT
+public:
+  enum Column { ColTime, ColLevel, ColDevice, ColMessage, ColCount };
+  enum Role { LevelRole = Qt::UserRole, DeviceRole };
+
+  explicit LogModel(int capacity = 10000, QObject* parent = nullptr);
+
+  void append(const LogEntry& entry);
+  const LogEntry& entry(int row) const { return ring_[(head_ + row) % capacity_]; }
+  int capacity() const { return capacity_; }
+
+  int rowCount(const QModelIndex& parent = {}) const override;
+  int columnCount(const QModelIndex& parent = {}) const override;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+  QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+Q_SIGNALS:
+  // First entry for `device`: lets the view offer it as a filter.
+  void deviceSeen(const QString& device);
+
+private:
+  QVector<LogEntry> ring_; // grows to capacity_, then entries are overwritten in place
+  int capacity_;
+  int head_ = 0;           // slot of the oldest entry
+  int count_ = 0;
+  QSet<QString> devices_;
+};
+
+// Level/device filter over a LogModel.
+class LogFilter final : public QSortFilterProxyModel {
+  Q_OBJECT
+public:
+  explicit LogFilter(QObject* parent = nullptr);
+
+  void setMinimumLevel(LogEntry::Level level);
+  void setDevice(const QString& device); // empty: all devices
+
+protected:
+  bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+
+private:
+  LogEntry::Level minLevel_ = LogEntry::Level::Debug;
+  QString device_;
+};
+
+// Appends log lines to a file and rotates it by size: ffrog.log -> ffrog.log.1 -> ... ->
+// ffrog.log.<keep>, the oldest being deleted. Each line is flushed, so a crash loses nothing.
+class RotatingLog final {
+public:
+  struct Options {
+    QString path;                  // e.g. ~/.local/share/ffrog/ffrog.log
+    qint64 maxBytes = 8ll << 20;   // rotate once the file would grow past this
+    int keep = 5;                  // rotated files kept
+  };
+
+  // The default path: $FFROG_LOG_FILE, else ffrog.log in the app's data directory.
+  static QString defaultPath();
+
+  bool open(const Options& opts, QString* error = nullptr);
+  bool isOpen() const { return file_.isOpen(); }
+  QString path() const { return opts_.path; }
+
+  void write(const QString& line);
+
+private:
+  void rotate();
+
+  Options opts_;
+  QFile file_;
+};
@@ -1,33 +1,44 @@
 #include "MainWindow.h"
 #include "UDisks2.h"
+#include "RandomFill.h"
+#include "UsbTopology.h"
 
-#include <QListWidget>
+#include <QItemSelectionModel>
 #include <QComboBox>
 #include <QLineEdit>
 #include <QCheckBox>
 #include <QPushButton>
-#include <QTextEdit>
+#include <QTableView>
+#include <QScrollBar>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QMessageBox>
 #include <QDateTime>
+#include <QFileDialog>
+#include <QFileInfo>
 #include <QTimer>
-#include <QProgressDialog>
-#include <QFutureWatcher>
-#include <QtConcurrent/QtConcurrentRun>
-
-#include <QDBusConnection>
-
-static QString humanBytes(quint64 bytes) {
-  const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
-  double b = static_cast<double>(bytes);
-  int u = 0;
-  while (b >= 1024.0 && u < 4) { b /= 1024.0; ++u; }
-  return QString::number(b, 'f', (u == 0 ? 0 : 2)) + " " + units[u];
-}
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QRegularExpression>
+
+#include <QSignalBlocker>
+#include <QSet>
+
+#include <algorithm>
+
+// Job table columns.
+enum JobColumn { ColDevice, ColOperation, ColStatus, ColProgress, ColRate, ColEta, ColCount };
+
+// Rate samples go to the log this often per running job, to spot sticks that slow down.
+static constexpr qint64 kRateLogIntervalMs = 30000;
 
-MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), udisks_(new UDisks2(this)) {
+// Log entries kept in memory (and in the view); older ones are only in the log file.
+static constexpr int kLogCapacity = 10000;
+
+MainWindow::MainWindow(QWidget* parent)
+    : QMainWindow(parent), udisks_(new UDisks2(this)), jobs_(new JobQueue(this)) {
   setWindowTitle("ffrog v1.7 - The Frogmat utility");
   resize(900, 600);
 
@@ -38,12 +49,28 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), udisks_(new UDisk
   refreshBtn_ = new QPushButton("Refresh", this);
   topRow->addWidget(refreshBtn_);
   topRow->addStretch(1);
+  autoProvisionCombo_ = new QComboBox(this);
+  autoProvisionCombo_->addItem("Auto-provision: off", QString());
+  autoProvisionCombo_->addItem("Auto-provision: dry run", "dry-run");
+  autoProvisionCombo_->addItem("Auto-provision: on", "on");
+  autoProvisionCombo_->setToolTip(QString("Wipe/format sticks as they are plugged in, by the rules in %1 (dry run: "
+                                          "log what would be done). Every device is recorded in %2.")
+                                      .arg(AutoProvision::defaultRulesPath(), provision_.auditPath()));
+  topRow->addWidget(autoProvisionCombo_);
   root->addLayout(topRow);
 
-  list_ = new QListWidget(this);
-  list_->setSelectionMode(QAbstractItemView::SingleSelection);
-  root->addWidget(new QLabel("USB removable devices (whole-disk only, e.g. /dev/sdX):", this));
-  root->addWidget(list_, 1);
+  // Refreshes apply a diff to the model, so the view keeps its selection and scroll position.
+  deviceModel_ = new DeviceModel(this);
+  deviceView_ = new QTableView(this);
+  deviceView_->setModel(deviceModel_);
+  deviceView_->setSelectionMode(QAbstractItemView::ExtendedSelection);
+  deviceView_->setSelectionBehavior(QAbstractItemView::SelectRows);
+  deviceView_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  deviceView_->setWordWrap(false);
+  deviceView_->verticalHeader()->setVisible(false);
+  deviceView_->horizontalHeader()->setSectionResizeMode(DeviceModel::ColName, QHeaderView::Stretch);
+  root->addWidget(new QLabel("USB removable devices (whole-disk only, e.g. /dev/sdX; Ctrl/Shift-click for a batch):", this));
+  root->addWidget(deviceView_, 1);
 
   auto* cfgRow = new QHBoxLayout();
   cfgRow->addWidget(new QLabel("Format:", this));
@@ -53,6 +80,23 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), udisks_(new UDisk
   fsCombo_->addItem("NTFS (ntfs)", "ntfs");
   fsCombo_->addItem("ext4 (ext4)", "ext4");
   cfgRow->addWidget(fsCombo_);
+  profileCombo_ = new QComboBox(this);
+  for (const FormatProfile& prof : FormatProfile::all()) profileCombo_->addItem(prof.title, prof.name);
+  profileCombo_->setToolTip("Format profile, applied to the whole batch: cluster size, ext4 journal/lazy init "
+                            "and discard tuned for the workload");
+  cfgRow->addWidget(profileCombo_);
+  formatEngineCombo_ = new QComboBox(this);
+  formatEngineCombo_->addItem("via UDisks (mkfs)", "udisks");
+  formatEngineCombo_->addItem("native (FAT32/exFAT, whole disk)", "native");
+  formatEngineCombo_->setToolTip("Format engine: native writes FAT32/exFAT in-process, without a partition table");
+  cfgRow->addWidget(formatEngineCombo_);
+  tableCombo_ = new QComboBox(this);
+  tableCombo_->addItem("keep partitions", QString());
+  tableCombo_->addItem("new MBR, aligned", "dos");
+  tableCombo_->addItem("new GPT, aligned", "gpt");
+  tableCombo_->setToolTip("Format via UDisks: recreate the partition table with one partition aligned to the "
+                          "stick's erase block (from sysfs, else 4 MiB) instead of reusing the existing layout");
+  cfgRow->addWidget(tableCombo_);
 
   cfgRow->addSpacing(12);
   cfgRow->addWidget(new QLabel("Label:", this));
@@ -64,12 +108,29 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), udisks_(new UDisk
   tearDownCheck_->setChecked(true);
   cfgRow->addWidget(tearDownCheck_);
 
+  verifyCheck_ = new QCheckBox("verify after wipe/write", this);
+  verifyCheck_->setToolTip("Read the device back after a full or instant wipe and check every sector is zero, "
+                           "or after an image write and check it matches the image (hashed in parallel)");
+  cfgRow->addWidget(verifyCheck_);
+
+  deltaCheck_ = new QCheckBox("delta image write", this);
+  deltaCheck_->setToolTip("Read each 1 MiB of the stick first and write only the chunks that differ from the image "
+                          "(re-flashing a newer build of the same image)");
+  cfgRow->addWidget(deltaCheck_);
+
+  cfgRow->addSpacing(12);
+  cfgRow->addWidget(new QLabel("Parallel jobs:", this));
+  parallelSpin_ = new QSpinBox(this);
+  parallelSpin_->setRange(1, 32);
+  parallelSpin_->setValue(jobs_->maxConcurrent());
+  cfgRow->addWidget(parallelSpin_);
+
   root->addLayout(cfgRow);
 
   auto* confirmRow = new QHBoxLayout();
-  confirmRow->addWidget(new QLabel("Confirmation: type the exact device (e.g. /dev/sdb):", this));
+  confirmRow->addWidget(new QLabel("Confirmation: type the exact device(s) (e.g. /dev/sdb, or /dev/sdb /dev/sdc):", this));
   confirmEdit_ = new QLineEdit(this);
-  confirmEdit_->setPlaceholderText("/dev/sdX");
+  confirmEdit_->setPlaceholderText("/dev/sdX [/dev/sdY ...]");
   confirmRow->addWidget(confirmEdit_, 1);
   root->addLayout(confirmRow);
 
@@ -77,180 +138,354 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), udisks_(new UDisk
   formatBtn_ = new QPushButton("Format", this);
   wipeQuickBtn_ = new QPushButton("Wipe quick (signatures)", this);
   wipeFullBtn_ = new QPushButton("Wipe full (zero-fill)", this);
+  wipeEngineCombo_ = new QComboBox(this);
+  wipeEngineCombo_->addItem("via UDisks (erase=zero)", "udisks");
+  wipeEngineCombo_->addItem("native (O_DIRECT, io_uring)", "native");
+  wipeEngineCombo_->setToolTip("Zero-fill engine for 'Wipe full'");
+  wipePassesCombo_ = new QComboBox(this);
+  wipePassesCombo_->addItem("1 pass: zeros", "zero");
+  wipePassesCombo_->addItem("2 passes: random, zeros", "random,zero");
+  wipePassesCombo_->addItem("3 passes: random, verify, zeros", "random,verify,zero");
+  wipePassesCombo_->setToolTip("Overwrite passes of the native engine. Random data is seeded per device; the seed is "
+                               "logged so the pass can be verified by regenerating it.");
+  wipePassesCombo_->setEnabled(false);
   btnRow->addWidget(formatBtn_);
   btnRow->addWidget(wipeQuickBtn_);
   btnRow->addWidget(wipeFullBtn_);
+  btnRow->addWidget(wipeEngineCombo_);
+  btnRow->addWidget(wipePassesCombo_);
+  wipeInstantBtn_ = new QPushButton("Wipe instant (discard/zeroout)", this);
+  btnRow->addWidget(wipeInstantBtn_);
+  writeImageBtn_ = new QPushButton("Write image...", this);
+  writeImageBtn_->setToolTip("Flash a disk image (.img/.iso, optionally .gz) to the whole device");
+  btnRow->addWidget(writeImageBtn_);
   btnRow->addStretch(1);
   root->addLayout(btnRow);
 
-  log_ = new QTextEdit(this);
-  log_->setReadOnly(true);
-  root->addWidget(new QLabel("Log:", this));
-  root->addWidget(log_, 1);
+  jobTable_ = new QTableWidget(0, ColCount, this);
+  jobTable_->setHorizontalHeaderLabels({"Device", "Operation", "Status", "Progress", "Rate", "ETA"});
+  jobTable_->horizontalHeader()->setSectionResizeMode(ColStatus, QHeaderView::Stretch);
+  jobTable_->verticalHeader()->setVisible(false);
+  jobTable_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  jobTable_->setSelectionMode(QAbstractItemView::NoSelection);
+  root->addWidget(new QLabel("Jobs:", this));
+  root->addWidget(jobTable_, 1);
+
+  // The log keeps the last kLogCapacity entries; the view lays out only the visible rows (fixed row
+  // height, no per-row measuring) and the full history goes to the log file.
+  logModel_ = new LogModel(kLogCapacity, this);
+  logFilter_ = new LogFilter(this);
+  logFilter_->setSourceModel(logModel_);
+
+  auto* logRow = new QHBoxLayout();
+  logRow->addWidget(new QLabel("Log:", this));
+  logRow->addStretch(1);
+  logLevelCombo_ = new QComboBox(this);
+  logLevelCombo_->addItem("all (incl. rate samples)", static_cast<int>(LogEntry::Level::Debug));
+  logLevelCombo_->addItem("info and above", static_cast<int>(LogEntry::Level::Info));
+  logLevelCombo_->addItem("warnings and errors", static_cast<int>(LogEntry::Level::Warning));
+  logLevelCombo_->addItem("errors only", static_cast<int>(LogEntry::Level::Error));
+  logRow->addWidget(logLevelCombo_);
+  logDeviceCombo_ = new QComboBox(this);
+  logDeviceCombo_->addItem("all devices", QString());
+  logRow->addWidget(logDeviceCombo_);
+  root->addLayout(logRow);
+
+  logView_ = new QTableView(this);
+  logView_->setModel(logFilter_);
+  logView_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  logView_->setSelectionBehavior(QAbstractItemView::SelectRows);
+  logView_->setWordWrap(false);
+  logView_->setShowGrid(false);
+  logView_->verticalHeader()->setVisible(false);
+  logView_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+  logView_->verticalHeader()->setDefaultSectionSize(logView_->fontMetrics().height() + 4);
+  logView_->horizontalHeader()->setStretchLastSection(true);
+  logView_->setColumnWidth(LogModel::ColTime, logView_->fontMetrics().horizontalAdvance("0000-00-00 00:00:00  "));
+  logView_->setColumnWidth(LogModel::ColLevel, logView_->fontMetrics().horizontalAdvance("ERROR   "));
+  logView_->setColumnWidth(LogModel::ColDevice, logView_->fontMetrics().horizontalAdvance("/dev/nvme0n1  "));
+  root->addWidget(logView_, 1);
 
   setCentralWidget(central);
 
+  connect(logLevelCombo_, &QComboBox::currentIndexChanged, this, [this] {
+    logFilter_->setMinimumLevel(static_cast<LogEntry::Level>(logLevelCombo_->currentData().toInt()));
+  });
+  connect(logDeviceCombo_, &QComboBox::currentIndexChanged, this, [this] {
+    logFilter_->setDevice(logDeviceCombo_->currentData().toString());
+  });
+  connect(logModel_, &LogModel::deviceSeen, this, [this](const QString& device) {
+    logDeviceCombo_->addItem(device, device);
+  });
+
+  QString logError;
+  if (!logFile_.open(RotatingLog::Options{RotatingLog::defaultPath()}, &logError)) {
+    appendLog(LogEntry::Level::Warning, {}, "No log file: " + logError);
+  }
+
   connect(refreshBtn_, &QPushButton::clicked, this, &MainWindow::refreshDevices);
-  connect(list_, &QListWidget::itemSelectionChanged, this, &MainWindow::onSelectionChanged);
+  connect(deviceView_->selectionModel(), &QItemSelectionModel::selectionChanged, this, &MainWindow::onSelectionChanged);
   connect(confirmEdit_, &QLineEdit::textChanged, this, &MainWindow::onConfirmChanged);
   connect(formatBtn_, &QPushButton::clicked, this, &MainWindow::doFormat);
   connect(wipeQuickBtn_, &QPushButton::clicked, this, &MainWindow::doWipeQuick);
   connect(wipeFullBtn_, &QPushButton::clicked, this, &MainWindow::doWipeFull);
+  connect(wipeEngineCombo_, &QComboBox::currentIndexChanged, this,
+          [this]() { wipePassesCombo_->setEnabled(wipeEngineCombo_->currentData().toString() == "native"); });
+  connect(wipeInstantBtn_, &QPushButton::clicked, this, &MainWindow::doWipeInstant);
+  connect(writeImageBtn_, &QPushButton::clicked, this, &MainWindow::doWriteImage);
+  connect(autoProvisionCombo_, &QComboBox::currentIndexChanged, this, &MainWindow::onAutoProvisionModeChanged);
+  connect(parallelSpin_, &QSpinBox::valueChanged, jobs_, &JobQueue::setMaxConcurrent);
+  connect(jobs_, &JobQueue::jobStarted, this, &MainWindow::onJobStarted);
+  connect(jobs_, &JobQueue::jobFinished, this, &MainWindow::onJobFinished);
+  connect(jobs_, &JobQueue::idle, this, &MainWindow::onQueueIdle);
+  connect(jobs_, &JobQueue::linkLimitChanged, this, [this](const QString& link, int limit, const QString& detail) {
+    appendLog(QString("%1: up to %2 parallel jobs (%3).").arg(link).arg(limit).arg(detail));
+  });
+  // Progress of UDisks-side jobs (Format erase/mkfs); in-process engines use progressReporter().
+  connect(udisks_, &UDisks2::jobProgress, this, &MainWindow::onJobProgress);
+
+  // Device discovery: UDisks2 unless FFROG_DEVICE_BACKEND picks sysfs (or a mock list).
+  QString backendError;
+  devices_ = DeviceBackend::create(qEnvironmentVariable("FFROG_DEVICE_BACKEND"), udisks_, this, &backendError);
+  if (!devices_) devices_ = udisks_;
 
-  // Auto refresh (fallback): poll periodically without spamming the log.
+  // Hotplug/unplug: the backend keeps its device list current (UDisks2 from ObjectManager/
+  // PropertiesChanged signals, sysfs from uevents) and tells us when it changed, so a refresh
+  // costs no D-Bus round trips.
+  connect(devices_, &DeviceBackend::devicesChanged, this, &MainWindow::refreshDevicesSilent);
+
+  // Consistency check (missed signals, udisksd restart): a rare full resync, not a poll.
   pollTimer_ = new QTimer(this);
-  pollTimer_->setInterval(1500);
-  connect(pollTimer_, &QTimer::timeout, this, &MainWindow::refreshDevicesSilent);
+  pollTimer_->setInterval(60000);
+  connect(pollTimer_, &QTimer::timeout, this, &MainWindow::checkConsistency);
   pollTimer_->start();
 
-  // Debounce timer for udisks2 object-manager signals.
-  debounceTimer_ = new QTimer(this);
-  debounceTimer_->setSingleShot(true);
-  debounceTimer_->setInterval(250);
-  connect(debounceTimer_, &QTimer::timeout, this, &MainWindow::refreshDevicesSilent);
-
-  // Watch hotplug/unplug via UDisks2 ObjectManager signals (best UX).
-  // If this connection fails, the periodic poll above still keeps the UI updated.
-  QDBusConnection::systemBus().connect(
-      "org.freedesktop.UDisks2",
-      "/org/freedesktop/UDisks2",
-      "org.freedesktop.DBus.ObjectManager",
-      "InterfacesAdded",
-      this,
-      SLOT(onUDisksInterfacesAdded(QDBusObjectPath,QVariantMap)));
+  if (!backendError.isEmpty()) appendLog(LogEntry::Level::Error, {}, backendError + " Using udisks.");
+  if (devices_ != udisks_) appendLog("Device backend: " + devices_->name());
+  {
+    // Errors (udisksd not running...) are reported by the initial refresh below; only the
+    // other backends' hotplug setup needs its own line.
+    const QSignalBlocker block(devices_);
+    QString err;
+    if (!devices_->startWatching(&err) && devices_ != udisks_) appendLog(LogEntry::Level::Warning, {}, err);
+  }
+  refreshDevicesImpl(true);
+}
 
-  QDBusConnection::systemBus().connect(
-      "org.freedesktop.UDisks2",
-      "/org/freedesktop/UDisks2",
-      "org.freedesktop.DBus.ObjectManager",
-      "InterfacesRemoved",
-      this,
-      SLOT(onUDisksInterfacesRemoved(QDBusObjectPath,QStringList)));
+MainWindow::~MainWindow() {
+  // In-process engines run on the job pool and report back to us: stop them before we go.
+  cancelAll_ = true;
+  jobs_->threadPool()->waitForDone();
+}
 
-  refreshDevices();
+void MainWindow::appendLog(LogEntry::Level level, const QString& device, const QString& message) {
+  const LogEntry entry{QDateTime::currentMSecsSinceEpoch(), level, device, message};
+  logFile_.write(entry.toLine());
+
+  // Follow new lines only while the view is scrolled to the end.
+  QScrollBar* bar = logView_->verticalScrollBar();
+  const bool follow = bar->value() == bar->maximum();
+  logModel_->append(entry);
+  if (follow) logView_->scrollToBottom();
 }
 
+QList<int> MainWindow::runBatch(const QString& opName, const QList<Target>& targets, const TaskFactory& makeTask, bool linkLimits) {
+  // UDisks Job progress comes from the watching cache, which another backend doesn't start.
+  if (!udisks_->isWatching()) udisks_->startWatching();
+  QList<int> ids;
+  for (const Target& t : targets) {
+    UsbTopology topology;
+    if (linkLimits) topology = UsbTopology::probe(t.deviceNode);
+    const int id = jobs_->enqueue(t.blockObject, makeTask(t), topology.links);
+    if (id == 0) {
+      appendLog(LogEntry::Level::Warning, t.deviceNode, QString("Skipped: %1 already has a job queued or running.").arg(t.deviceNode));
+      continue;
+    }
+
+    const int row = jobTable_->rowCount();
+    jobTable_->insertRow(row);
+    jobTable_->setItem(row, ColDevice, new QTableWidgetItem(t.deviceNode));
+    jobTable_->setItem(row, ColOperation, new QTableWidgetItem(opName));
+    jobTable_->setItem(row, ColStatus, new QTableWidgetItem("queued"));
+    for (int col : {ColProgress, ColRate, ColEta}) jobTable_->setItem(row, col, new QTableWidgetItem());
+    jobRows_.insert(id, JobRow{row, t.deviceNode, opName});
+    ids << id;
+    deviceModel_->setJobState(t.blockObject, "queued: " + opName);
+    appendLog(LogEntry::Level::Info, t.deviceNode, QString("Queued %1 on %2.").arg(opName, t.deviceNode));
+    if (topology.isUsb()) appendLog(LogEntry::Level::Debug, t.deviceNode, "USB topology: " + topology.describe());
+  }
 
-void MainWindow::appendLog(const QString& line) {
-  const QString ts = QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss");
-  log_->append("[" + ts + "] " + line);
+  // Devices with a job can't be targeted again until it finishes.
+  updateActionEnablement();
+  return ids;
 }
 
-void MainWindow::setBusy(bool busy, const QString& statusLine) {
-  busy_ = busy;
+void MainWindow::onJobStarted(int id, const QString& key) {
+  const auto it = jobRows_.constFind(id);
+  if (it == jobRows_.constEnd()) return;
+  runningJobByKey_.insert(key, id);
+  jobTable_->item(it->row, ColStatus)->setText("running");
+  deviceModel_->setJobState(key, "running: " + it->opName);
+  appendLog(LogEntry::Level::Info, it->deviceNode, QString("Started %1 on %2...").arg(it->opName, it->deviceNode));
+}
 
-  // Stop background refresh while doing destructive operations.
-  if (pollTimer_) {
-    if (busy_) pollTimer_->stop();
-    else pollTimer_->start();
+void MainWindow::onJobFinished(int id, const QString& key, const OpResult& result) {
+  runningJobByKey_.remove(key);
+  deviceModel_->setJobState(key, {});
+  if (const auto autoIt = autoJobs_.constFind(id); autoIt != autoJobs_.constEnd()) {
+    ++batchAuto_;
+    auditProvision(autoIt->device, result.ok ? "ok" : "failed", autoIt->rule, autoIt->label, result.ok ? result.detail : result.error);
+    autoJobs_.erase(autoIt);
   }
-  if (debounceTimer_ && busy_) debounceTimer_->stop();
-
-  refreshBtn_->setEnabled(!busy_);
-  list_->setEnabled(!busy_);
-  fsCombo_->setEnabled(!busy_);
-  labelEdit_->setEnabled(!busy_);
-  tearDownCheck_->setEnabled(!busy_);
-  confirmEdit_->setEnabled(!busy_);
-
-  // Buttons: disable all while busy; re-evaluate afterwards.
-  formatBtn_->setEnabled(false);
-  wipeQuickBtn_->setEnabled(false);
-  wipeFullBtn_->setEnabled(false);
-
-  if (busy_) {
-    if (!progress_) {
-      progress_ = new QProgressDialog(this);
-      progress_->setWindowTitle("Working...");
-      progress_->setRange(0, 0); // indeterminate
-      progress_->setCancelButton(nullptr);
-      progress_->setWindowModality(Qt::ApplicationModal);
-      progress_->setMinimumDuration(0);
-    }
-    progress_->setLabelText(statusLine.isEmpty() ? QStringLiteral("Working...") : statusLine);
-    progress_->show();
+  const auto it = jobRows_.constFind(id);
+  if (it == jobRows_.constEnd()) return;
+
+  if (result.ok) {
+    ++batchOk_;
+    jobTable_->item(it->row, ColStatus)->setText("OK");
+    jobTable_->item(it->row, ColProgress)->setText("100%");
+    appendLog(LogEntry::Level::Info, it->deviceNode, QString("OK: %1 complete on %2.").arg(it->opName, it->deviceNode));
   } else {
-    if (progress_) {
-      progress_->hide();
-      progress_->deleteLater();
-      progress_ = nullptr;
-    }
-    updateActionEnablement();
+    ++batchFailed_;
+    jobTable_->item(it->row, ColStatus)->setText("FAILED: " + result.error);
+    appendLog(LogEntry::Level::Error, it->deviceNode, QString("%1 on %2: %3").arg(it->opName, it->deviceNode, result.error));
   }
+  jobTable_->item(it->row, ColEta)->setText({});
+  if (!result.detail.isEmpty()) appendLog(LogEntry::Level::Info, it->deviceNode, result.detail);
+  jobRows_.erase(it);
+
+  refreshDevicesImpl(false);
 }
 
-void MainWindow::runOp(const QString& startLine,
-                       const QString& okLine,
-                       const QString& failPrefix,
-                       std::function<OpResult()> fn) {
-  if (busy_) return;
+IoProgressFn MainWindow::progressReporter(const QString& key, const QString& operation) {
+  return [this, key, operation](const IoProgress& p) {
+    QMetaObject::invokeMethod(this, [this, key, p, operation]() { onJobProgress(key, p, operation); }, Qt::QueuedConnection);
+  };
+}
 
-  appendLog(startLine);
-  setBusy(true, startLine);
+QFuture<OpResult> MainWindow::withVerify(const QString& blockObject, QFuture<OpResult> wipe, bool verify) {
+  if (!verify) return wipe;
+  ZeroVerify::Options opts;
+  opts.cancel = &cancelAll_;
+  return udisks_->verifyAfter(blockObject, wipe, opts, jobs_->threadPool(),
+                              progressReporter(blockObject, QStringLiteral("verify")));
+}
 
-  auto* watcher = new QFutureWatcher<OpResult>(this);
-  connect(watcher, &QFutureWatcher<OpResult>::finished, this, [this, watcher, okLine, failPrefix]() {
-    const OpResult r = watcher->result();
-    watcher->deleteLater();
+QFuture<OpResult> MainWindow::withImageVerify(const QString& blockObject,
+                                              QFuture<OpResult> write,
+                                              std::shared_ptr<ImageVerify::Source> source) {
+  if (!source) return write;
+  return udisks_->verifyImageAfter(blockObject, write, source, jobs_->threadPool(),
+                                   progressReporter(blockObject, QStringLiteral("verify")));
+}
 
-    setBusy(false);
+void MainWindow::onJobProgress(const QString& key, const IoProgress& p, const QString& operation) {
+  const auto idIt = runningJobByKey_.constFind(key);
+  if (idIt == runningJobByKey_.constEnd()) return;
+  const auto it = jobRows_.find(*idIt);
+  if (it == jobRows_.end()) return;
+
+  jobs_->reportProgress(key, p.bytesDone);
+
+  const QString rate = p.bytesPerSec > 0 ? humanBytes(static_cast<quint64>(p.bytesPerSec)) + "/s" : QStringLiteral("-");
+  const QString pct = p.bytesTotal ? QString::number(100.0 * p.bytesDone / p.bytesTotal, 'f', 1) + "%" : QStringLiteral("-");
+
+  jobTable_->item(it->row, ColStatus)->setText(operation.isEmpty() ? QStringLiteral("running")
+                                                                   : QString("running (%1)").arg(operation));
+  jobTable_->item(it->row, ColProgress)->setText(
+      p.bytesTotal ? QString("%1  (%2 / %3)").arg(pct, humanBytes(p.bytesDone), humanBytes(p.bytesTotal)) : pct);
+  jobTable_->item(it->row, ColRate)->setText(rate);
+  deviceModel_->setJobState(key, (operation.isEmpty() ? "running: " : QString("running (%1): ").arg(operation)) + it->opName);
+  deviceModel_->setJobProgress(key, rate == QStringLiteral("-") ? pct : QString("%1 @ %2").arg(pct, rate));
+  jobTable_->item(it->row, ColEta)->setText(formatDuration(p.eta()));
+
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  if (p.bytesPerSec > 0 && now - it->lastRateLogMs >= kRateLogIntervalMs) {
+    it->lastRateLogMs = now;
+    appendLog(LogEntry::Level::Debug, it->deviceNode, QString("%1 @ %2, ETA %3").arg(pct, rate, formatDuration(p.eta())));
+  }
+}
 
-    if (r.ok) {
-      appendLog(okLine);
-      QMessageBox::information(this, "OK", okLine);
-    } else {
-      appendLog(failPrefix + r.error);
-      QMessageBox::critical(this, "Failed", r.error);
-    }
+void MainWindow::onQueueIdle() {
+  const QString summary = QString("All jobs finished: %1 OK, %2 failed.").arg(batchOk_).arg(batchFailed_);
+  const bool anyFailed = batchFailed_ > 0;
+  // Auto-provisioning runs all day: its batches end in the log, not in a dialog to click away.
+  const bool onlyAuto = batchAuto_ == batchOk_ + batchFailed_;
+  batchOk_ = 0;
+  batchFailed_ = 0;
+  batchAuto_ = 0;
 
-    refreshDevices();
-  });
+  appendLog(anyFailed ? LogEntry::Level::Warning : LogEntry::Level::Info, {}, summary);
+  refreshDevices();
+  if (onlyAuto) return;
 
-  watcher->setFuture(QtConcurrent::run([fn = std::move(fn)]() mutable { return fn(); }));
+  if (anyFailed) {
+    QMessageBox::critical(this, "Failed", summary + "\n\nSee the job list and log for details.");
+  } else {
+    QMessageBox::information(this, "OK", summary);
+  }
 }
 
-QString MainWindow::selectedBlockObject() const {
-  auto* item = list_->currentItem();
-  if (!item) return {};
-  return item->data(Qt::UserRole).toString();
+QList<MainWindow::Target> MainWindow::selectedTargets() const {
+  QModelIndexList rows = deviceView_->selectionModel()->selectedRows();
+  std::sort(rows.begin(), rows.end()); // list order, not click order
+  QList<Target> out;
+  for (const QModelIndex& index : rows) {
+    const UsbDevice& d = deviceModel_->device(index.row());
+    out.push_back(Target{d.blockObject, d.deviceNode, d.readOnly, d.serial, d.sizeBytes});
+  }
+  return out;
 }
 
-QString MainWindow::selectedDeviceNode() const {
-  auto* item = list_->currentItem();
-  if (!item) return {};
-  return item->data(Qt::UserRole + 1).toString();
+QStringList MainWindow::selectedDeviceNodes() const {
+  QStringList out;
+  for (const Target& t : selectedTargets()) out.push_back(t.deviceNode);
+  return out;
 }
 
-bool MainWindow::selectedReadOnly() const {
-  auto* item = list_->currentItem();
-  if (!item) return false;
-  return item->data(Qt::UserRole + 2).toBool();
+bool MainWindow::confirmationMatches() const {
+  // The typed text must name exactly the selected set (any order), e.g. "/dev/sdb /dev/sdc".
+  static const QRegularExpression kSeparators("[\\s,]+");
+  QStringList typed = confirmEdit_->text().split(kSeparators, Qt::SkipEmptyParts);
+  QStringList wanted = selectedDeviceNodes();
+  if (wanted.isEmpty()) return false;
+  typed.sort();
+  typed.removeDuplicates();
+  wanted.sort();
+  return typed == wanted;
 }
 
 void MainWindow::updateActionEnablement() {
-  const QString dev = selectedDeviceNode();
-  const bool hasSel = !dev.isEmpty();
-  const bool confirmOk = hasSel && (confirmEdit_->text().trimmed() == dev);
-  const bool ro = selectedReadOnly();
-
-  formatBtn_->setEnabled(hasSel && confirmOk && !ro);
-  wipeQuickBtn_->setEnabled(hasSel && confirmOk && !ro);
-  wipeFullBtn_->setEnabled(hasSel && confirmOk && !ro);
-
-  if (ro) {
-    formatBtn_->setToolTip("Device is read-only");
-    wipeQuickBtn_->setToolTip("Device is read-only");
-    wipeFullBtn_->setToolTip("Device is read-only");
-  } else {
-    formatBtn_->setToolTip({});
-    wipeQuickBtn_->setToolTip({});
-    wipeFullBtn_->setToolTip({});
+  const QList<Target> targets = selectedTargets();
+  const bool hasSel = !targets.isEmpty();
+  const bool confirmOk = hasSel && confirmationMatches();
+  bool ro = false;
+  bool active = false;
+  for (const Target& t : targets) {
+    ro = ro || t.readOnly;
+    active = active || jobs_->isActive(t.blockObject);
   }
+  const bool enable = hasSel && confirmOk && !ro && !active && !devices_->isReadOnly();
+
+  formatBtn_->setEnabled(enable);
+  wipeQuickBtn_->setEnabled(enable);
+  wipeFullBtn_->setEnabled(enable);
+  wipeInstantBtn_->setEnabled(enable);
+  writeImageBtn_->setEnabled(enable);
+
+  QString tip;
+  if (devices_->isReadOnly()) tip = QString("The %1 device backend is read-only").arg(devices_->name());
+  else if (ro) tip = "Device is read-only";
+  else if (active) tip = "A job is already queued or running on a selected device";
+  formatBtn_->setToolTip(tip);
+  wipeQuickBtn_->setToolTip(tip);
+  wipeFullBtn_->setToolTip(tip);
+  wipeInstantBtn_->setToolTip(tip);
+  writeImageBtn_->setToolTip(tip.isEmpty() ? QStringLiteral("Flash a disk image (.img/.iso, optionally .gz) to the whole device") : tip);
 }
 
 void MainWindow::onSelectionChanged() {
-  const QString dev = selectedDeviceNode();
-  confirmEdit_->setText(dev);
+  confirmEdit_->setText(selectedDeviceNodes().join(' '));
   updateActionEnablement();
 }
 
@@ -258,35 +493,36 @@ void MainWindow::onConfirmChanged(const QString&) {
   updateActionEnablement();
 }
 
-void MainWindow::onUDisksInterfacesAdded(const QDBusObjectPath&, const QVariantMap&) {
-  if (debounceTimer_) debounceTimer_->start();
-}
-
-void MainWindow::onUDisksInterfacesRemoved(const QDBusObjectPath&, const QStringList&) {
-  if (debounceTimer_) debounceTimer_->start();
+void MainWindow::checkConsistency() {
+  (void)devices_->resyncAsync(); // emits devicesChanged -> refreshDevicesSilent
 }
 
 void MainWindow::refreshDevices() {
-  refreshDevicesImpl(true);
+  // Manual refresh: resync the cache so the button is a real "look again". The verbose pass
+  // runs once the snapshot is in; the silent pass its devicesChanged() triggers is skipped.
+  manualRefreshPending_ = true;
+  devices_->resyncAsync().then(this, [this](OpResult) {
+    manualRefreshPending_ = false;
+    refreshDevicesImpl(true);
+  });
 }
 
 void MainWindow::refreshDevicesSilent() {
+  if (manualRefreshPending_) return;
   refreshDevicesImpl(false);
 }
 
 void MainWindow::refreshDevicesImpl(bool verbose) {
-  const QString prevDev = selectedDeviceNode();
-
-  list_->clear();
+  const QStringList prevDevs = selectedDeviceNodes();
   QString err;
-  const auto devices = udisks_->listUsbRemovable(&err);
+  const auto devices = devices_->devices(&err);
 
   // NOTE: listUsbRemovable() may provide a diagnostic string even when the service is reachable
   // but no matching USB whole-disk devices are currently connected. That's not an error.
   const bool noUsbInfo = err.startsWith("UDisks2 reachable, but filter returned 0 USB whole-disk devices");
   if (!err.isEmpty()) {
     if (verbose) {
-      appendLog(QString(noUsbInfo ? "INFO: " : "ERROR: ") + err);
+      appendLog(noUsbInfo ? LogEntry::Level::Info : LogEntry::Level::Error, {}, err);
     } else {
       // Silent refresh: never spam the log.
       // - Ignore the "no USB devices" informational message.
@@ -295,7 +531,7 @@ void MainWindow::refreshDevicesImpl(bool verbose) {
         if (!lastAutoError_.isEmpty()) lastAutoError_.clear();
       } else {
         if (err != lastAutoError_) {
-          appendLog("ERROR: " + err);
+          appendLog(LogEntry::Level::Error, {}, err);
           lastAutoError_ = err;
         }
       }
@@ -304,35 +540,11 @@ void MainWindow::refreshDevicesImpl(bool verbose) {
     if (!lastAutoError_.isEmpty()) lastAutoError_.clear();
   }
 
+  // Rows of unplugged devices go (and leave the selection), the rest stay selected as they were.
+  deviceModel_->setDevices(devices);
   QStringList curDevs;
-  for (const auto& d : devices) {
-    curDevs.push_back(d.deviceNode);
-
-    const QString title = QString("%1 %2 (%3)  [%4]")
-                            .arg(d.vendor.trimmed())
-                            .arg(d.model.trimmed())
-                            .arg(humanBytes(d.sizeBytes))
-                            .arg(d.deviceNode);
-
-    auto* item = new QListWidgetItem(title, list_);
-    item->setData(Qt::UserRole, d.blockObject);
-    item->setData(Qt::UserRole + 1, d.deviceNode);
-    item->setData(Qt::UserRole + 2, d.readOnly);
-    item->setToolTip("Block: " + d.blockObject + "\nDrive: " + d.driveObject +
-                     (d.serial.isEmpty() ? "" : ("\nSerial: " + d.serial)));
-    if (d.readOnly) item->setText(title + "  [READONLY]");
-  }
-
-  // Try to keep the previously selected device selected.
-  if (!prevDev.isEmpty()) {
-    for (int i = 0; i < list_->count(); ++i) {
-      auto* it = list_->item(i);
-      if (it && it->data(Qt::UserRole + 1).toString() == prevDev) {
-        list_->setCurrentItem(it);
-        break;
-      }
-    }
-  }
+  for (const auto& d : devices) curDevs.push_back(d.deviceNode);
+  if (selectedDeviceNodes() != prevDevs) onSelectionChanged();
 
   if (verbose) {
     appendLog(QString("Found %1 USB device(s).").arg(devices.size()));
@@ -343,93 +555,447 @@ void MainWindow::refreshDevicesImpl(bool verbose) {
     }
   }
 
+  // A failed listing (udisksd restarting...) says nothing about what is plugged in: the sticks
+  // it seems to drop must not look newly plugged once it works again.
+  if (err.isEmpty() || noUsbInfo) {
+    QHash<QString, quint64> seen;
+    for (const auto& d : devices) seen.insert(d.blockObject, d.sizeBytes);
+    std::swap(seen, autoSeen_);
+    if (!autoProvisionCombo_->currentData().toString().isEmpty()) {
+      for (const auto& d : devices) {
+        const auto it = seen.constFind(d.blockObject);
+        if (it == seen.constEnd() || (*it == 0 && d.sizeBytes > 0)) autoProvision(d);
+      }
+    }
+  }
+
   updateActionEnablement();
 }
 
+void MainWindow::onAutoProvisionModeChanged() {
+  const QString mode = autoProvisionCombo_->currentData().toString();
+  if (mode.isEmpty()) {
+    appendLog("Auto-provision off.");
+    return;
+  }
+  auto turnOff = [this]() {
+    const QSignalBlocker block(autoProvisionCombo_);
+    autoProvisionCombo_->setCurrentIndex(0);
+  };
+  if (mode == "on" && devices_->isReadOnly()) {
+    const QString msg = QString("The %1 device backend is read-only: only the dry run is available.").arg(devices_->name());
+    appendLog(LogEntry::Level::Error, {}, "Auto-provision: " + msg);
+    QMessageBox::warning(this, "Auto-provision", msg);
+    turnOff();
+    return;
+  }
+
+  // Rules are read again each time the mode is picked, so edits apply without a restart.
+  QString err;
+  if (!provision_.load(AutoProvision::defaultRulesPath(), &err)) {
+    appendLog(LogEntry::Level::Error, {}, "Auto-provision: " + err);
+    QMessageBox::warning(this, "Auto-provision", err);
+    turnOff();
+    return;
+  }
+  QStringList rules;
+  for (const AutoProvision::Rule& r : provision_.rules()) rules << QString("%1: %2").arg(r.name, r.describe());
+
+  if (mode == "on") {
+    const auto choice = QMessageBox::warning(
+        this,
+        "Confirm auto-provision",
+        QString("USB devices plugged in from now on that match one of these rules will be WIPED/FORMATTED "
+                "without further confirmation:\n%1\n\nDevices already listed are left alone. Every device "
+                "processed is recorded in %2.")
+            .arg(rules.join('\n'), provision_.auditPath()),
+        QMessageBox::Cancel | QMessageBox::Ok,
+        QMessageBox::Cancel);
+    if (choice != QMessageBox::Ok) {
+      turnOff();
+      return;
+    }
+  }
+
+  appendLog(QString("Auto-provision %1: %2 rule(s) from %3, audit log %4.")
+                .arg(mode == "on" ? QStringLiteral("on") : QStringLiteral("dry run"))
+                .arg(rules.size())
+                .arg(AutoProvision::defaultRulesPath(), provision_.auditPath()));
+  for (const QString& r : rules) appendLog(LogEntry::Level::Debug, {}, "Rule " + r);
+}
+
+void MainWindow::autoProvision(const UsbDevice& d) {
+  const QString what = QString("%1 (%2 %3, %4, serial %5)")
+                           .arg(d.deviceNode, d.vendor, d.model, humanBytes(d.sizeBytes), d.serial.isEmpty() ? QStringLiteral("-") : d.serial);
+  if (jobs_->isActive(d.blockObject)) {
+    appendLog(LogEntry::Level::Debug, d.deviceNode, QString("Auto-provision: %1 already has a job.").arg(what));
+    return;
+  }
+  AutoProvision::Decision dec;
+  const bool dryRun = autoProvisionCombo_->currentData().toString() == "dry-run" || devices_->isReadOnly();
+  if (!provision_.decide(d, dryRun, &dec)) {
+    appendLog(LogEntry::Level::Info, d.deviceNode, QString("Auto-provision: no rule matches %1.").arg(what));
+    return;
+  }
+  auditProvision(d, AutoProvision::actionName(dec.action), dec.rule.name, dec.label, dec.reason);
+  const QString label = dec.label.isEmpty() ? QString() : QString(", label %1").arg(dec.label);
+
+  switch (dec.action) {
+    case AutoProvision::Action::Skipped:
+    case AutoProvision::Action::RateLimited:
+      appendLog(LogEntry::Level::Warning, d.deviceNode, QString("Auto-provision: not queued %1, rule %2: %3.").arg(what, dec.rule.name, dec.reason));
+      return;
+    case AutoProvision::Action::DryRun:
+      appendLog(LogEntry::Level::Info, d.deviceNode,
+                QString("Auto-provision (dry run): rule %1 would run on %2: %3%4.").arg(dec.rule.name, what, dec.rule.describe(), label));
+      return;
+    case AutoProvision::Action::Queue:
+      break;
+  }
+
+  appendLog(LogEntry::Level::Info, d.deviceNode, QString("Auto-provision: rule %1 matches %2: %3%4.").arg(dec.rule.name, what, dec.rule.describe(), label));
+  const Target target{d.blockObject, d.deviceNode, d.readOnly, d.serial, d.sizeBytes};
+  const QList<int> ids = runBatch(QString("auto-provision (%1)").arg(dec.rule.name) + label, {target},
+                                  [this, &dec](const Target& t) { return provisionTask(dec.rule, dec.label, t); });
+  if (ids.isEmpty()) {
+    auditProvision(d, "skipped", dec.rule.name, dec.label, "a job is already queued or running");
+    return;
+  }
+  autoJobs_.insert(ids.first(), AutoJob{d, dec.rule.name, dec.label});
+}
+
+JobQueue::Task MainWindow::provisionTask(const AutoProvision::Rule& rule, const QString& label, const Target& t) {
+  const QString block = t.blockObject;
+  const WipeCheckpoint::Drive drive{t.serial, t.sizeBytes, false};
+  const bool tearDown = tearDownCheck_->isChecked();
+  const FormatProfile* found = FormatProfile::find(rule.profile);
+  const FormatProfile profile = found ? *found : FormatProfile{};
+  return [this, block, rule, label, drive, tearDown, profile]() {
+    QFuture<OpResult> wiped;
+    switch (rule.wipe) {
+      case AutoProvision::Wipe::None:
+        break;
+      case AutoProvision::Wipe::Quick:
+        wiped = udisks_->wipeBlockAsync(block, /*eraseMode*/ QString(), tearDown);
+        break;
+      case AutoProvision::Wipe::Full:
+        wiped = udisks_->wipeBlockAsync(block, /*eraseMode*/ QStringLiteral("zero"), tearDown);
+        break;
+      case AutoProvision::Wipe::Native: {
+        ZeroFill::Options opts;
+        opts.cancel = &cancelAll_;
+        // Checkpointed like a manual native wipe, so an interrupted one can be resumed by hand.
+        wiped = udisks_->zeroFillBlockAsync(block, opts, jobs_->threadPool(), progressReporter(block), checkpoints_, drive);
+        break;
+      }
+      case AutoProvision::Wipe::Instant: {
+        FastWipe::Options opts;
+        opts.cancel = &cancelAll_;
+        wiped = udisks_->instantWipeBlockAsync(block, opts, jobs_->threadPool(), progressReporter(block));
+        break;
+      }
+    }
+    auto format = [this, block, rule, label, tearDown, profile]() {
+      return udisks_->formatBlockAsync(block, rule.fsType, label, /*eraseMode*/ QString(), tearDown, profile);
+    };
+    if (rule.wipe == AutoProvision::Wipe::None) return format();
+    wiped = withVerify(block, wiped, rule.verify);
+    return rule.fsType.isEmpty() ? wiped : udisks_->thenVerify(wiped, format);
+  };
+}
+
+void MainWindow::auditProvision(const UsbDevice& d, const QString& event, const QString& rule, const QString& label, const QString& detail) {
+  QString err;
+  if (!provision_.audit(d, event, rule, label, detail, &err)) appendLog(LogEntry::Level::Warning, d.deviceNode, "Auto-provision audit log: " + err);
+}
+
 void MainWindow::doFormat() {
-  const QString block = selectedBlockObject();
-  const QString dev = selectedDeviceNode();
-  if (block.isEmpty() || dev.isEmpty()) return;
+  const QList<Target> targets = selectedTargets();
+  if (targets.isEmpty()) return;
 
   const QString fsType = fsCombo_->currentData().toString();
   const QString label = labelEdit_->text().trimmed();
   const bool tearDown = tearDownCheck_->isChecked();
+  const QString devs = selectedDeviceNodes().join(", ");
+  const bool native = formatEngineCombo_->currentData().toString() == "native";
+
+  FatFormat::Options nativeOpts;
+  if (native && !FatFormat::typeFromName(fsType, &nativeOpts.type)) {
+    QMessageBox::warning(this, "Native format", "The native engine formats FAT32 and exFAT only.");
+    return;
+  }
+  const FormatProfile* found = FormatProfile::find(profileCombo_->currentData().toString());
+  const FormatProfile profile = found ? *found : FormatProfile{};
+  nativeOpts.label = label;
+  nativeOpts.clusterBytes = profile.clusterBytes(fsType);
+  nativeOpts.cancel = &cancelAll_;
+
+  PartitionLayout::Table table = PartitionLayout::Table::Mbr;
+  const bool newTable = PartitionLayout::tableFromName(tableCombo_->currentData().toString(), &table);
+  if (native && newTable) {
+    QMessageBox::warning(this, "Native format", "The native engine formats the whole disk without a partition table.");
+    return;
+  }
 
   const auto choice = QMessageBox::warning(
       this,
       "Confirm format",
-      QString("You are about to FORMAT %1 as '%2'.\n\nThis will ERASE EVERYTHING on this device.")
-          .arg(dev)
-          .arg(fsType),
+      QString("You are about to FORMAT %1 device(s) as '%2':\n%3\n\nThis will ERASE EVERYTHING on them.")
+          .arg(targets.size())
+          .arg(fsType)
+          .arg(devs),
       QMessageBox::Cancel | QMessageBox::Ok,
       QMessageBox::Cancel);
 
   if (choice != QMessageBox::Ok) return;
 
-  runOp(
-      QString("Formatting %1 (%2)...").arg(dev).arg(fsType),
-      QStringLiteral("OK: format complete."),
-      QStringLiteral("ERROR: "),
-      [block, fsType, label, tearDown]() -> OpResult {
-        UDisks2 u;
-        QString err;
-        const bool ok = u.formatBlock(block, fsType, label, /*eraseMode*/ QString(), tearDown, &err);
-        return {ok, err};
-      });
+  if (native) {
+    runBatch(QString("format (%1, native, %2)").arg(fsType, profile.name), targets, [this, nativeOpts](const Target& t) -> JobQueue::Task {
+      const QString block = t.blockObject;
+      return [this, block, nativeOpts]() {
+        return udisks_->nativeFormatBlockAsync(block, nativeOpts, jobs_->threadPool(), progressReporter(block));
+      };
+    });
+    return;
+  }
+
+  const bool mkfsArgs = udisks_->supportsMkfsArgs();
+  if (!mkfsArgs && profile.hasMkfsArgs(fsType)) {
+    appendLog(LogEntry::Level::Warning, {},
+              QString("udisks %1 ignores mkfs-args (2.10 or newer needed): profile %2 formats with mkfs defaults.")
+                  .arg(udisks_->version(), profile.name));
+  }
+  if (newTable) {
+    runBatch(QString("format (%1, new %2 table, %3)").arg(fsType, PartitionLayout::tableName(table), profile.describe(fsType, mkfsArgs)), targets,
+             [this, table, fsType, label, tearDown, profile](const Target& t) -> JobQueue::Task {
+      const QString block = t.blockObject;
+      return [this, block, table, fsType, label, tearDown, profile]() {
+        return udisks_->partitionAndFormatBlockAsync(block, table, fsType, label, /*eraseMode*/ QString(), tearDown, profile);
+      };
+    });
+    return;
+  }
+
+  runBatch(QString("format (%1, %2)").arg(fsType, profile.describe(fsType, mkfsArgs)), targets,
+           [this, fsType, label, tearDown, profile](const Target& t) -> JobQueue::Task {
+    const QString block = t.blockObject;
+    return [this, block, fsType, label, tearDown, profile]() {
+      return udisks_->formatBlockAsync(block, fsType, label, /*eraseMode*/ QString(), tearDown, profile);
+    };
+  });
 }
 
 void MainWindow::doWipeQuick() {
-  const QString block = selectedBlockObject();
-  const QString dev = selectedDeviceNode();
-  if (block.isEmpty() || dev.isEmpty()) return;
+  const QList<Target> targets = selectedTargets();
+  if (targets.isEmpty()) return;
 
   const bool tearDown = tearDownCheck_->isChecked();
+  const QString devs = selectedDeviceNodes().join(", ");
   const auto choice = QMessageBox::warning(
       this,
       "Confirm quick wipe",
-      QString("You are about to WIPE SIGNATURES (empty format) on %1.\n\nThis removes filesystem/partition signatures.")
-          .arg(dev),
+      QString("You are about to WIPE SIGNATURES (empty format) on %1 device(s):\n%2\n\nThis removes filesystem/partition signatures.")
+          .arg(targets.size())
+          .arg(devs),
       QMessageBox::Cancel | QMessageBox::Ok,
       QMessageBox::Cancel);
 
   if (choice != QMessageBox::Ok) return;
 
-  runOp(
-      QString("Wiping signatures on %1...").arg(dev),
-      QStringLiteral("OK: signatures wiped."),
-      QStringLiteral("ERROR: "),
-      [block, tearDown]() -> OpResult {
-        UDisks2 u;
-        QString err;
-        const bool ok = u.wipeBlock(block, /*eraseMode*/ QString(), tearDown, &err);
-        return {ok, err};
-      });
+  runBatch(QStringLiteral("quick wipe"), targets, [this, tearDown](const Target& t) -> JobQueue::Task {
+    const QString block = t.blockObject;
+    return [this, block, tearDown]() { return udisks_->wipeBlockAsync(block, /*eraseMode*/ QString(), tearDown); };
+  });
 }
 
 void MainWindow::doWipeFull() {
-  const QString block = selectedBlockObject();
-  const QString dev = selectedDeviceNode();
-  if (block.isEmpty() || dev.isEmpty()) return;
+  const QList<Target> targets = selectedTargets();
+  if (targets.isEmpty()) return;
 
   const bool tearDown = tearDownCheck_->isChecked();
+  const QString devs = selectedDeviceNodes().join(", ");
   const auto choice = QMessageBox::warning(
       this,
       "Confirm full wipe",
-      QString("You are about to ZERO-FILL the entire device %1 (this may take a LONG time).\n\nThis writes zeros over everything before leaving it 'empty'.")
-          .arg(dev),
+      QString("You are about to ZERO-FILL %1 entire device(s) (this may take a LONG time):\n%2\n\nThis writes zeros over everything before leaving it 'empty'.")
+          .arg(targets.size())
+          .arg(devs),
       QMessageBox::Cancel | QMessageBox::Ok,
       QMessageBox::Cancel);
 
   if (choice != QMessageBox::Ok) return;
 
-  runOp(
-      QString("Zero-filling %1 (erase=zero)...").arg(dev),
-      QStringLiteral("OK: full wipe complete."),
-      QStringLiteral("ERROR: "),
-      [block, tearDown]() -> OpResult {
-        UDisks2 u;
-        QString err;
-        const bool ok = u.wipeBlock(block, /*eraseMode*/ QStringLiteral("zero"), tearDown, &err);
-        return {ok, err};
+  const bool verify = verifyCheck_->isChecked();
+  const QString suffix = verify ? QStringLiteral(" + verify") : QString();
+
+  if (wipeEngineCombo_->currentData().toString() == "native") {
+    WipePasses plan;
+    WipePasses::parse(wipePassesCombo_->currentData().toString(), &plan);
+    if (!plan.isSingleZero()) {
+      // "verify after wipe" checks the last write pass as a pass of the plan (random-aware).
+      if (verify) plan.addFinalVerify();
+      ZeroFill::Options fill;
+      fill.cancel = &cancelAll_;
+      ZeroVerify::Options check;
+      check.cancel = &cancelAll_;
+      runBatch(QString("full wipe (native, %1)").arg(plan.spec()), targets, [this, plan, fill, check](const Target& t) -> JobQueue::Task {
+        WipePasses own = plan;
+        own.seed = RandomFill::newSeed();
+        if (own.hasRandom()) appendLog(LogEntry::Level::Info, t.deviceNode, QString("Random pass seed for %1: %2").arg(t.deviceNode, RandomFill::seedName(own.seed)));
+        const QString block = t.blockObject;
+        return [this, block, own, fill, check]() {
+          auto progressFor = [this, block](const QString& label) { return progressReporter(block, label); };
+          return udisks_->multiPassWipeBlockAsync(block, own, fill, check, jobs_->threadPool(), progressFor);
+        };
       });
+      return;
+    }
+
+    // Interrupted earlier fills of these drives can continue from their checkpoint.
+    QStringList resumable;
+    for (const Target& t : targets) {
+      WipeCheckpoint::Entry entry;
+      if (checkpoints_->find(t.serial, t.sizeBytes, &entry)) resumable << QString("%1: %2").arg(t.deviceNode, entry.describe());
+    }
+    bool resume = false;
+    if (!resumable.isEmpty()) {
+      const auto answer = QMessageBox::question(
+          this,
+          "Resume full wipe",
+          QString("An earlier zero-fill of these drive(s) was interrupted:\n%1\n\nResume from the last checkpoint "
+                  "(the last %2 MiB before it are re-checked first)? No starts over from the beginning.")
+              .arg(resumable.join('\n'))
+              .arg(WipeCheckpoint::kOverlapBytes >> 20),
+          QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel,
+          QMessageBox::Yes);
+      if (answer == QMessageBox::Cancel) return;
+      resume = answer == QMessageBox::Yes;
+    }
+
+    ZeroFill::Options opts;
+    opts.cancel = &cancelAll_;
+    runBatch("full wipe (native zero-fill)" + suffix, targets, [this, opts, verify, resume](const Target& t) -> JobQueue::Task {
+      const QString block = t.blockObject;
+      const WipeCheckpoint::Drive drive{t.serial, t.sizeBytes, resume};
+      return [this, block, opts, verify, drive]() {
+        return withVerify(block, udisks_->zeroFillBlockAsync(block, opts, jobs_->threadPool(), progressReporter(block), checkpoints_, drive),
+                          verify);
+      };
+    });
+    return;
+  }
+
+  runBatch("full wipe (erase=zero)" + suffix, targets, [this, tearDown, verify](const Target& t) -> JobQueue::Task {
+    const QString block = t.blockObject;
+    return [this, block, tearDown, verify]() {
+      return withVerify(block, udisks_->wipeBlockAsync(block, /*eraseMode*/ QStringLiteral("zero"), tearDown), verify);
+    };
+  });
+}
+
+void MainWindow::doWipeInstant() {
+  const QList<Target> targets = selectedTargets();
+  if (targets.isEmpty()) return;
+
+  const QString devs = selectedDeviceNodes().join(", ");
+  const auto choice = QMessageBox::warning(
+      this,
+      "Confirm instant wipe",
+      QString("You are about to ZERO %1 entire device(s) using hardware zeroing/discard where possible:\n%2\n\n"
+              "Ranges the device can't guarantee to read back as zeros are overwritten with zeros.")
+          .arg(targets.size())
+          .arg(devs),
+      QMessageBox::Cancel | QMessageBox::Ok,
+      QMessageBox::Cancel);
+
+  if (choice != QMessageBox::Ok) return;
+
+  const bool verify = verifyCheck_->isChecked();
+  FastWipe::Options opts;
+  opts.cancel = &cancelAll_;
+  runBatch(verify ? QStringLiteral("instant wipe + verify") : QStringLiteral("instant wipe"), targets,
+           [this, opts, verify](const Target& t) -> JobQueue::Task {
+             const QString block = t.blockObject;
+             return [this, block, opts, verify]() {
+               return withVerify(block, udisks_->instantWipeBlockAsync(block, opts, jobs_->threadPool(), progressReporter(block)), verify);
+             };
+           });
+}
+
+void MainWindow::doWriteImage() {
+  const QList<Target> targets = selectedTargets();
+  if (targets.isEmpty()) return;
+
+  const QString image = QFileDialog::getOpenFileName(this, "Choose a disk image", QString(),
+                                                     "Disk images (*.img *.iso *.raw *.bin *.gz);;All files (*)");
+  if (image.isEmpty()) return;
+
+  const QString devs = selectedDeviceNodes().join(", ");
+  const auto choice = QMessageBox::warning(
+      this,
+      "Confirm image write",
+      QString("You are about to WRITE the image\n%1 (%2)\nonto %3 entire device(s):\n%4\n\nEverything on them is overwritten.")
+          .arg(image, humanBytes(static_cast<quint64>(QFileInfo(image).size())))
+          .arg(targets.size())
+          .arg(devs),
+      QMessageBox::Cancel | QMessageBox::Ok,
+      QMessageBox::Cancel);
+
+  if (choice != QMessageBox::Ok) return;
+
+  QString opName = QString(deltaCheck_->isChecked() ? "delta write image (%1)" : "write image (%1)").arg(QFileInfo(image).fileName());
+  std::shared_ptr<ImageVerify::Source> verifySource;
+  if (verifyCheck_->isChecked()) {
+    ImageVerify::Options verifyOpts;
+    verifyOpts.cancel = &cancelAll_;
+    verifySource = std::make_shared<ImageVerify::Source>(image, verifyOpts);
+    opName += " + verify";
+  }
+  // A fan-out writer slot that no job takes holds the shared ring for its grace time, so sticks
+  // that already have a job are left out (and logged, as runBatch() would) before sizing it.
+  QList<Target> writers;
+  QSet<QString> writerBlocks;
+  for (const Target& t : targets) {
+    if (writerBlocks.contains(t.blockObject)) continue;
+    writerBlocks.insert(t.blockObject);
+    if (jobs_->isActive(t.blockObject)) {
+      appendLog(LogEntry::Level::Warning, t.deviceNode, QString("Skipped: %1 already has a job queued or running.").arg(t.deviceNode));
+      continue;
+    }
+    writers << t;
+  }
+  if (writers.isEmpty()) return;
+  if (writers.size() > 1) {
+    // Fan-out: the image is read and inflated once for all the sticks. They must run at once;
+    // writers left queued would fall out of the shared ring and read on their own.
+    if (parallelSpin_->value() < writers.size()) {
+      parallelSpin_->setValue(qMin(parallelSpin_->maximum(), static_cast<int>(writers.size())));
+      appendLog(QString("Parallel jobs raised to %1 so the image writes share one reader.").arg(parallelSpin_->value()));
+    }
+    ImageFanOut::Options opts;
+    opts.delta = deltaCheck_->isChecked();
+    opts.cancel = &cancelAll_;
+    auto fanOut = std::make_shared<ImageFanOut>(image, static_cast<int>(writers.size()), opts);
+    auto nextIndex = std::make_shared<int>(0);
+    runBatch(opName + " [fan-out]", writers, [this, fanOut, nextIndex, verifySource](const Target& t) -> JobQueue::Task {
+      const QString block = t.blockObject;
+      const int index = (*nextIndex)++;
+      return [this, block, fanOut, index, verifySource]() {
+        return withImageVerify(block, udisks_->writeImageFanOutBlockAsync(block, fanOut, index, jobs_->threadPool(), progressReporter(block)),
+                               verifySource);
+      };
+    }, false);
+    return;
+  }
+
+  ImageWriter::Options opts;
+  opts.delta = deltaCheck_->isChecked();
+  opts.cancel = &cancelAll_;
+  runBatch(opName, writers, [this, image, opts, verifySource](const Target& t) -> JobQueue::Task {
+    const QString block = t.blockObject;
+    return [this, block, image, opts, verifySource]() {
+      return withImageVerify(block, udisks_->writeImageBlockAsync(block, image, opts, jobs_->threadPool(), progressReporter(block)),
+                             verifySource);
+    };
+  });
 }
@@ -1,73 +1,158 @@
 #pragma once
 
 #include <QMainWindow>
+#include <QHash>
 #include <QString>
-#include <functional>
-
-#include <QDBusObjectPath>
-#include <QVariantMap>
 #include <QStringList>
 
-class QListWidget;
+#include "AutoProvision.h"
+#include "DeviceModel.h"
+#include "ImageVerify.h"
+#include "IoProgress.h"
+#include "JobQueue.h"
+#include "LogModel.h"
+#include "WipeCheckpoint.h"
+
+#include <atomic>
+#include <memory>
+
 class QComboBox;
 class QLineEdit;
 class QCheckBox;
 class QPushButton;
-class QTextEdit;
+class QSpinBox;
+class QTableView;
+class QTableWidget;
 class QTimer;
-class QProgressDialog;
 
+class DeviceBackend;
 class UDisks2;
 
 class MainWindow final : public QMainWindow {
   Q_OBJECT
 public:
   explicit MainWindow(QWidget* parent = nullptr);
+  ~MainWindow() override;
 
 private Q_SLOTS:
   void refreshDevices();        // manual (button)
-  void refreshDevicesSilent();  // auto (timer / udisks signals)
-  void onUDisksInterfacesAdded(const QDBusObjectPath&, const QVariantMap&);
-  void onUDisksInterfacesRemoved(const QDBusObjectPath&, const QStringList&);
+  void refreshDevicesSilent();  // auto (udisks device cache changed)
+  void checkConsistency();      // rare full resync of the udisks device cache
   void onSelectionChanged();
   void onConfirmChanged(const QString&);
+  void onJobStarted(int id, const QString& key);
+  void onJobFinished(int id, const QString& key, const OpResult& result);
+  void onQueueIdle();
   void doFormat();
   void doWipeQuick();
   void doWipeFull();
+  void doWipeInstant();
+  void doWriteImage();
+  void onAutoProvisionModeChanged();
 
 private:
-  struct OpResult { bool ok = false; QString error; };
+  // One selected target of a (batch) operation.
+  struct Target {
+    QString blockObject;
+    QString deviceNode;
+    bool readOnly = false;
+    QString serial;
+    quint64 sizeBytes = 0;
+  };
+
+  // Builds the operation for one device; called once per selected device.
+  using TaskFactory = std::function<JobQueue::Task(const Target&)>;
+
+  // `linkLimits`: queue each job behind its USB hub/bus/controller (see JobQueue); off for jobs
+  // that must all run at once. Returns the ids of the jobs queued.
+  QList<int> runBatch(const QString& opName, const QList<Target>& targets, const TaskFactory& makeTask, bool linkLimits = true);
+
+  // Thread-safe: forwards progress of the job on `key` to the GUI thread.
+  IoProgressFn progressReporter(const QString& key, const QString& operation = {});
+  QFuture<OpResult> withVerify(const QString& blockObject, QFuture<OpResult> wipe, bool verify);
+  // Chains the image read-back check after a write when `source` is set (verify checked).
+  QFuture<OpResult> withImageVerify(const QString& blockObject, QFuture<OpResult> write, std::shared_ptr<ImageVerify::Source> source);
+  void onJobProgress(const QString& key, const IoProgress& p, const QString& operation = {});
 
-  void setBusy(bool busy, const QString& statusLine = {});
-  void runOp(const QString& startLine, const QString& okLine, const QString& failPrefix, std::function<OpResult()> fn);
+  // Auto-provisioning of a device that just appeared: the first matching rule decides, and its
+  // wipe and format run as one job.
+  void autoProvision(const UsbDevice& d);
+  JobQueue::Task provisionTask(const AutoProvision::Rule& rule, const QString& label, const Target& t);
+  // Audit record; a write failure goes to the log.
+  void auditProvision(const UsbDevice& d, const QString& event, const QString& rule, const QString& label, const QString& detail = {});
 
-  void appendLog(const QString& line);
+  // To the log view and the log file. `device` is the node the line is about, if any.
+  void appendLog(LogEntry::Level level, const QString& device, const QString& message);
+  void appendLog(const QString& message) { appendLog(LogEntry::Level::Info, {}, message); }
   void updateActionEnablement();
   void refreshDevicesImpl(bool verbose);
-  QString selectedBlockObject() const;
-  QString selectedDeviceNode() const;
-  bool selectedReadOnly() const;
+  QList<Target> selectedTargets() const;
+  QStringList selectedDeviceNodes() const;
+  bool confirmationMatches() const;
 
-  UDisks2* udisks_;
+  UDisks2* udisks_;        // device operations (and discovery, by default)
+  DeviceBackend* devices_; // device discovery and hotplug
+  JobQueue* jobs_;
 
-  QListWidget* list_;
+  DeviceModel* deviceModel_;
+  QTableView* deviceView_;
   QComboBox* fsCombo_;
+  QComboBox* profileCombo_;
+  QComboBox* formatEngineCombo_;
+  QComboBox* tableCombo_;
   QLineEdit* labelEdit_;
   QCheckBox* tearDownCheck_;
+  QCheckBox* verifyCheck_;
+  QCheckBox* deltaCheck_;
+  QSpinBox* parallelSpin_;
   QLineEdit* confirmEdit_;
 
   QPushButton* refreshBtn_;
+  QComboBox* autoProvisionCombo_;
   QPushButton* formatBtn_;
   QPushButton* wipeQuickBtn_;
   QPushButton* wipeFullBtn_;
+  QPushButton* wipeInstantBtn_;
+  QPushButton* writeImageBtn_;
+  QComboBox* wipeEngineCombo_;
+  QComboBox* wipePassesCombo_;
 
-  QTextEdit* log_;
+  QTableWidget* jobTable_;
+  LogModel* logModel_;
+  LogFilter* logFilter_;
+  QTableView* logView_;
+  QComboBox* logLevelCombo_;
+  QComboBox* logDeviceCombo_;
+  RotatingLog logFile_;
+  std::shared_ptr<WipeCheckpoint> checkpoints_ = std::make_shared<WipeCheckpoint>();
+  AutoProvision provision_;
 
-  bool busy_ = false;
-  QProgressDialog* progress_ = nullptr;
+  // Per-job bookkeeping for the job table and the batch summary.
+  struct JobRow {
+    int row = -1;
+    QString deviceNode;
+    QString opName;
+    qint64 lastRateLogMs = 0; // last rate sample written to the log
+  };
+  QHash<int, JobRow> jobRows_;
+  QHash<QString, int> runningJobByKey_;
+  // Auto-provisioning jobs, for their result's audit record.
+  struct AutoJob {
+    UsbDevice device;
+    QString rule;
+    QString label;
+  };
+  QHash<int, AutoJob> autoJobs_;
+  // Devices (block object -> size) as of the last refresh that listed without error; a device
+  // not in it, or whose medium just came in, is new for auto-provisioning.
+  QHash<QString, quint64> autoSeen_;
+  std::atomic_bool cancelAll_{false}; // set on shutdown; stops in-process I/O engines
+  int batchOk_ = 0;
+  int batchFailed_ = 0;
+  int batchAuto_ = 0; // of those, auto-provisioning jobs
 
   QTimer* pollTimer_ = nullptr;
-  QTimer* debounceTimer_ = nullptr;
+  bool manualRefreshPending_ = false;
   QStringList lastDeviceNodes_;
   QString lastAutoError_;
 };
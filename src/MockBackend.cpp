@@ -0,0 +1,64 @@
+#include "MockBackend.h"
+#include "OpFuture.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+UsbDevice MockBackend::fromJson(const QJsonObject& o) {
+  UsbDevice d;
+  d.deviceNode = o.value("device").toString();
+  d.blockObject = o.value("blockObject").toString();
+  if (d.blockObject.isEmpty()) d.blockObject = udisksBlockObject(d.deviceNode.section('/', -1));
+  d.driveObject = o.value("driveObject").toString();
+  d.vendor = o.value("vendor").toString();
+  d.model = o.value("model").toString();
+  d.serial = o.value("serial").toString();
+  d.sizeBytes = static_cast<quint64>(o.value("sizeBytes").toInteger());
+  d.readOnly = o.value("readOnly").toBool();
+  return d;
+}
+
+void MockBackend::setDevices(QVector<UsbDevice> devices) {
+  // The same guarantees as the real backends: whole disks only, sorted by node.
+  devices.removeIf([](const UsbDevice& d) { return !isWholeDiskName(d.deviceNode.section('/', -1)); });
+  std::sort(devices.begin(), devices.end(), [](const UsbDevice& a, const UsbDevice& b) { return a.deviceNode < b.deviceNode; });
+  devices_ = std::move(devices);
+  error_.clear();
+  Q_EMIT devicesChanged();
+}
+
+bool MockBackend::resync(QString* error) {
+  if (source_.isEmpty()) {
+    Q_EMIT devicesChanged();
+    return true;
+  }
+  QFile f(source_);
+  QJsonParseError parseError;
+  const QJsonDocument doc = f.open(QIODevice::ReadOnly) ? QJsonDocument::fromJson(f.readAll(), &parseError) : QJsonDocument();
+  if (!doc.isObject()) {
+    error_ = QString("Can't read mock device list %1: %2")
+                 .arg(source_, f.isOpen() ? parseError.errorString() : f.errorString());
+    if (error) *error = error_;
+    Q_EMIT devicesChanged();
+    return false;
+  }
+  QVector<UsbDevice> devices;
+  for (const QJsonValue& v : doc.object().value("devices").toArray()) devices.push_back(fromJson(v.toObject()));
+  setDevices(std::move(devices));
+  return true;
+}
+
+QFuture<OpResult> MockBackend::resyncAsync() {
+  QString error;
+  const bool ok = resync(&error);
+  return readyFuture(OpResult{ok, error});
+}
+
+QVector<UsbDevice> MockBackend::devices(QString* error) const {
+  if (!error_.isEmpty() && error) *error = error_;
+  return devices_;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "DeviceBackend.h"
+
+#include <QString>
+#include <QVector>
+
+class QJsonObject;
+
+// A fixed device list for tests, demos and benchmarks. Devices are set in code, or read from a
+// JSON file in the shape of `ffrog-cli list --json` ({"devices": [{"device": "/dev/sdb", ...}]}),
+// re-read on every resync(). No hotplug, and read-only: nothing checks that its entries are USB
+// sticks.
+class MockBackend final : public DeviceBackend {
+  Q_OBJECT
+public:
+  using DeviceBackend::DeviceBackend;
+
+  QString name() const override { return QStringLiteral("mock"); }
+  bool isReadOnly() const override { return true; }
+
+  void setSource(const QString& jsonPath) { source_ = jsonPath; }
+  void setDevices(QVector<UsbDevice> devices);
+
+  bool startWatching(QString* error = nullptr) override { return resync(error); }
+  bool resync(QString* error = nullptr) override;
+  QFuture<OpResult> resyncAsync() override;
+  QVector<UsbDevice> devices(QString* error = nullptr) const override;
+
+  static UsbDevice fromJson(const QJsonObject& o);
+
+private:
+  QString source_;
+  QString error_;
+  QVector<UsbDevice> devices_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "OpResult.h"
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QObject>
+#include <QPromise>
+
+#include <memory>
+#include <utility>
+
+// Helpers for chaining asynchronous steps that end in an OpResult.
+
+template <typename T>
+QFuture<T> readyFuture(T value) {
+  QPromise<T> promise;
+  promise.start();
+  promise.addResult(std::move(value));
+  promise.finish();
+  return promise.future();
+}
+
+// Once `f` is ready, runs `next(result)` on ctx's thread and forwards the OpResult of the future
+// it returns. This is how the async steps chain without QFuture::unwrap() (Qt >= 6.4).
+template <typename T, typename Next>
+QFuture<OpResult> andThen(QObject* ctx, QFuture<T> f, Next next) {
+  auto promise = std::make_shared<QPromise<OpResult>>();
+  promise->start();
+  QFuture<OpResult> out = promise->future();
+  f.then(ctx, [ctx, promise, next = std::move(next)](T value) mutable {
+    next(std::move(value)).then(ctx, [promise](OpResult r) {
+      promise->addResult(std::move(r));
+      promise->finish();
+    });
+  });
+  return out;
+}
+
+// Records the wall time from now until `f` is ready as step `name` of its result.
+inline QFuture<OpResult> timedStep(QObject* ctx, const QString& name, QFuture<OpResult> f) {
+  QElapsedTimer timer;
+  timer.start();
+  return andThen(ctx, std::move(f), [name, timer](OpResult r) {
+    r.steps.append(OpStep{name, timer.elapsed()});
+    return readyFuture(std::move(r));
+  });
+}
+
+// Runs `next()` only if `f` succeeded; otherwise forwards f's result. The steps recorded by `f`
+// come first in the final result.
+template <typename Next>
+QFuture<OpResult> andThenIfOk(QObject* ctx, QFuture<OpResult> f, Next next) {
+  return andThen(ctx, std::move(f), [ctx, next = std::move(next)](OpResult done) mutable -> QFuture<OpResult> {
+    if (!done.ok) return readyFuture(std::move(done));
+    return andThen(ctx, next(), [earlier = std::move(done.steps)](OpResult r) {
+      r.steps = earlier + r.steps;
+      return readyFuture(std::move(r));
+    });
+  });
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+// Wall time of one step of an operation (unmount, format, zero-fill, rescan, ...).
+struct OpStep {
+  QString name;
+  qint64 ms = 0;
+};
+
+// Outcome of one device operation (format, wipe, ...).
+struct OpResult {
+  bool ok = false;
+  QString error;
+  QString detail; // optional extra line for the log (method used, throughput...)
+  QVector<OpStep> steps; // in execution order
+};
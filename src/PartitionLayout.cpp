@@ -0,0 +1,96 @@
+#include "PartitionLayout.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <numeric>
+
+namespace {
+
+// Room at the end of the disk for the GPT backup header and entries (33 sectors), kept whole MiB.
+constexpr quint64 kGptTailBytes = 1ull << 20;
+
+quint64 readSysfsU64(const QString& path) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return 0;
+  return f.readAll().trimmed().toULongLong();
+}
+
+} // namespace
+
+quint64 PartitionLayout::probeAlignment(const QString& devicePath, QString* source) {
+  // /dev/sdb (or a /dev/disk/by-* symlink) -> /sys/class/block/sdb/queue, as FastWipe::Caps.
+  const QString name = QFileInfo(QFileInfo(devicePath).canonicalFilePath()).fileName();
+  QString queue = "/sys/class/block/" + name + "/queue/";
+  if (!QDir(queue).exists()) queue = "/sys/class/block/" + name + "/../queue/";
+
+  quint64 alignment = kDefaultAlignment;
+  QStringList used;
+  for (const char* hint : {"optimal_io_size", "discard_granularity"}) {
+    const quint64 v = readSysfsU64(queue + hint);
+    if (v < 512 || v % 512 != 0) continue;
+    const quint64 combined = std::lcm(alignment, v);
+    if (combined > kMaxAlignment) continue;
+    if (combined != alignment) used << QString("%1=%2").arg(QString::fromLatin1(hint)).arg(v);
+    alignment = combined;
+  }
+  if (source) *source = used.isEmpty() ? QStringLiteral("default") : used.join(' ');
+  return alignment;
+}
+
+bool PartitionLayout::compute(quint64 diskBytes, quint64 alignment, Table table, PartitionLayout* out, QString* error) {
+  if (alignment == 0) alignment = kDefaultAlignment;
+  const quint64 tail = table == Table::Gpt ? kGptTailBytes : 0;
+  // The start: the first boundary, which also leaves the MBR/GPT header its space.
+  const quint64 offset = alignment;
+  const quint64 end = diskBytes > tail ? (diskBytes - tail) / alignment * alignment : 0;
+  if (end <= offset) {
+    if (error) *error = QString("The disk (%1 bytes) is too small for a %2-aligned partition.").arg(diskBytes).arg(alignment);
+    return false;
+  }
+  out->table = table;
+  out->alignment = alignment;
+  out->offset = offset;
+  out->size = end - offset;
+  return true;
+}
+
+bool PartitionLayout::tableFromName(const QString& name, Table* out) {
+  const QString n = name.toLower();
+  if (n == "dos" || n == "mbr") {
+    *out = Table::Mbr;
+    return true;
+  }
+  if (n == "gpt") {
+    *out = Table::Gpt;
+    return true;
+  }
+  return false;
+}
+
+QString PartitionLayout::tableName(Table table) {
+  return table == Table::Gpt ? QStringLiteral("gpt") : QStringLiteral("dos");
+}
+
+QString PartitionLayout::partitionType(Table table, const QString& fsType) {
+  const bool linuxFs = fsType == "ext4" || fsType == "ext3" || fsType == "ext2" || fsType == "xfs" || fsType == "btrfs";
+  if (table == Table::Gpt) {
+    // Linux filesystem data / Microsoft basic data.
+    return linuxFs ? QStringLiteral("0fc63daf-8483-4772-8e79-3d69d8477de4") : QStringLiteral("ebd0a0a2-b9e5-4433-87c0-68b6b72699c7");
+  }
+  if (linuxFs) return QStringLiteral("0x83");
+  if (fsType == "vfat") return QStringLiteral("0x0c"); // FAT32 (LBA)
+  if (fsType == "exfat" || fsType == "ntfs") return QStringLiteral("0x07");
+  return {};
+}
+
+QString PartitionLayout::summary() const {
+  return QString("%1, partition at %2 MiB, %3 MB, %4 MiB aligned (%5)")
+      .arg(tableName(table))
+      .arg(offset >> 20)
+      .arg(static_cast<double>(size) / 1e6, 0, 'f', 1)
+      .arg(static_cast<double>(alignment) / (1 << 20), 0, 'g', 4)
+      .arg(alignmentSource);
+}
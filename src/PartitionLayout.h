@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QString>
+
+// Where the single partition of a freshly created table goes, so that it starts and ends on the
+// flash's erase-block (allocation-unit) boundaries: a misaligned partition turns every cluster
+// write that straddles two erase blocks into two read-modify-write cycles on cheap sticks.
+struct PartitionLayout {
+  enum class Table { Mbr, Gpt };
+
+  static constexpr quint64 kDefaultAlignment = 4ull << 20; // covers the common 1/2/4 MiB erase blocks
+  static constexpr quint64 kMaxAlignment = 64ull << 20;     // larger sysfs hints are ignored
+
+  Table table = Table::Mbr;
+  quint64 alignment = kDefaultAlignment;
+  QString alignmentSource = QStringLiteral("default"); // e.g. "discard_granularity=8388608"
+  quint64 offset = 0; // partition start, bytes
+  quint64 size = 0;   // partition length, bytes
+
+  // The alignment for `devicePath` from /sys/class/block/<name>/queue (optimal_io_size,
+  // discard_granularity): their least common multiple with kDefaultAlignment, so a small or
+  // missing hint (most USB sticks report 0 or 512) still gets 4 MiB.
+  static quint64 probeAlignment(const QString& devicePath, QString* source = nullptr);
+
+  // One partition from the first aligned boundary to the last one that leaves room for the GPT
+  // backup header. Returns false if the disk is too small for that.
+  static bool compute(quint64 diskBytes, quint64 alignment, Table table, PartitionLayout* out, QString* error = nullptr);
+
+  static bool tableFromName(const QString& name, Table* out); // "dos"/"mbr" or "gpt"
+  static QString tableName(Table table);                      // UDisks' name: "dos" or "gpt"
+
+  // MBR type byte ("0x0c") or GPT type GUID for a filesystem; empty lets UDisks choose.
+  static QString partitionType(Table table, const QString& fsType);
+
+  // e.g. "gpt, partition at 4 MiB, 7.9 GB, 4 MiB aligned (default)"
+  QString summary() const;
+};
@@ -0,0 +1,246 @@
+#include "RandomFill.h"
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FFROG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Philox4x32 multipliers and Weyl key increments.
+constexpr std::uint32_t kM0 = 0xD2511F53;
+constexpr std::uint32_t kM1 = 0xCD9E8D57;
+constexpr std::uint32_t kW0 = 0x9E3779B9;
+constexpr std::uint32_t kW1 = 0xBB67AE85;
+constexpr int kRounds = 10;
+
+// Counter of block n: {lo32(n), hi32(n), 0, 0}; key: the two halves of the seed.
+using FillFn = void (*)(char* out, quint64 firstBlock, std::size_t blocks, std::uint32_t k0, std::uint32_t k1);
+
+void philoxBlock(quint64 block, std::uint32_t k0, std::uint32_t k1, std::uint32_t out[4]) {
+  std::uint32_t c0 = static_cast<std::uint32_t>(block), c1 = static_cast<std::uint32_t>(block >> 32), c2 = 0, c3 = 0;
+  for (int r = 0; r < kRounds; ++r) {
+    const std::uint64_t p0 = static_cast<std::uint64_t>(kM0) * c0;
+    const std::uint64_t p1 = static_cast<std::uint64_t>(kM1) * c2;
+    const std::uint32_t n0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    const std::uint32_t n2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c0 = n0;
+    c1 = static_cast<std::uint32_t>(p1);
+    c2 = n2;
+    c3 = static_cast<std::uint32_t>(p0);
+    k0 += kW0;
+    k1 += kW1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// Little-endian words, so the stream is the same on every host.
+void storeBlock(char* out, const std::uint32_t w[4]) {
+  for (int i = 0; i < 4; ++i) {
+    out[4 * i + 0] = static_cast<char>(w[i]);
+    out[4 * i + 1] = static_cast<char>(w[i] >> 8);
+    out[4 * i + 2] = static_cast<char>(w[i] >> 16);
+    out[4 * i + 3] = static_cast<char>(w[i] >> 24);
+  }
+}
+
+void fillScalar(char* out, quint64 firstBlock, std::size_t blocks, std::uint32_t k0, std::uint32_t k1) {
+  std::uint32_t w[4];
+  for (std::size_t i = 0; i < blocks; ++i) {
+    philoxBlock(firstBlock + i, k0, k1, w);
+    storeBlock(out + 16 * i, w);
+  }
+}
+
+#ifdef FFROG_X86
+// Four blocks per step, one per 32-bit lane of c0..c3 (structure of arrays).
+__attribute__((target("sse2"))) inline void mulhilo4(__m128i a, __m128i m, __m128i* hi, __m128i* lo) {
+  // _mm_mul_epu32 multiplies lanes 0 and 2; the odd lanes go through a shifted copy.
+  const __m128i even = _mm_shuffle_epi32(_mm_mul_epu32(a, m), _MM_SHUFFLE(3, 1, 2, 0));                     // lo0 lo2 hi0 hi2
+  const __m128i odd = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), m), _MM_SHUFFLE(3, 1, 2, 0)); // lo1 lo3 hi1 hi3
+  *lo = _mm_unpacklo_epi32(even, odd);
+  *hi = _mm_unpackhi_epi32(even, odd);
+}
+
+__attribute__((target("sse2"))) void fillSse2(char* out, quint64 firstBlock, std::size_t blocks, std::uint32_t k0, std::uint32_t k1) {
+  const __m128i m0 = _mm_set1_epi32(static_cast<int>(kM0));
+  const __m128i m1 = _mm_set1_epi32(static_cast<int>(kM1));
+  std::size_t i = 0;
+  for (; i + 4 <= blocks; i += 4) {
+    const quint64 b = firstBlock + i;
+    // The low counter word wraps inside this step: rare (every 64 GiB), done by the scalar path.
+    if (static_cast<std::uint32_t>(b) > 0xFFFFFFFFu - 3) {
+      fillScalar(out + 16 * i, b, 4, k0, k1);
+      continue;
+    }
+    __m128i c0 = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(b))), _mm_setr_epi32(0, 1, 2, 3));
+    __m128i c1 = _mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(b >> 32)));
+    __m128i c2 = _mm_setzero_si128(), c3 = _mm_setzero_si128();
+    std::uint32_t r0 = k0, r1 = k1;
+    for (int r = 0; r < kRounds; ++r) {
+      __m128i hi0, lo0, hi1, lo1;
+      mulhilo4(c0, m0, &hi0, &lo0);
+      mulhilo4(c2, m1, &hi1, &lo1);
+      c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(static_cast<int>(r0)));
+      c1 = lo1;
+      c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(static_cast<int>(r1)));
+      c3 = lo0;
+      r0 += kW0;
+      r1 += kW1;
+    }
+    // Transpose to block order: block j is c0[j] c1[j] c2[j] c3[j].
+    const __m128i t0 = _mm_unpacklo_epi32(c0, c1), t1 = _mm_unpackhi_epi32(c0, c1);
+    const __m128i t2 = _mm_unpacklo_epi32(c2, c3), t3 = _mm_unpackhi_epi32(c2, c3);
+    char* p = out + 16 * i;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 32), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 48), _mm_unpackhi_epi64(t1, t3));
+  }
+  fillScalar(out + 16 * i, firstBlock + i, blocks - i, k0, k1);
+}
+
+__attribute__((target("avx2"))) inline void mulhilo8(__m256i a, __m256i m, __m256i* hi, __m256i* lo) {
+  const __m256i even = _mm256_mul_epu32(a, m);
+  const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+  *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+  *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+__attribute__((target("avx2"))) void fillAvx2(char* out, quint64 firstBlock, std::size_t blocks, std::uint32_t k0, std::uint32_t k1) {
+  const __m256i m0 = _mm256_set1_epi32(static_cast<int>(kM0));
+  const __m256i m1 = _mm256_set1_epi32(static_cast<int>(kM1));
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  std::size_t i = 0;
+  for (; i + 8 <= blocks; i += 8) {
+    const quint64 b = firstBlock + i;
+    if (static_cast<std::uint32_t>(b) > 0xFFFFFFFFu - 7) {
+      fillScalar(out + 16 * i, b, 8, k0, k1);
+      continue;
+    }
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(b))), lanes);
+    __m256i c1 = _mm256_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(b >> 32)));
+    __m256i c2 = _mm256_setzero_si256(), c3 = _mm256_setzero_si256();
+    std::uint32_t r0 = k0, r1 = k1;
+    for (int r = 0; r < kRounds; ++r) {
+      __m256i hi0, lo0, hi1, lo1;
+      mulhilo8(c0, m0, &hi0, &lo0);
+      mulhilo8(c2, m1, &hi1, &lo1);
+      c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(r0)));
+      c1 = lo1;
+      c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(r1)));
+      c3 = lo0;
+      r0 += kW0;
+      r1 += kW1;
+    }
+    // Within each 128-bit half as in the SSE2 kernel (blocks 0-3 low, 4-7 high), then the halves.
+    const __m256i t0 = _mm256_unpacklo_epi32(c0, c1), t1 = _mm256_unpackhi_epi32(c0, c1);
+    const __m256i t2 = _mm256_unpacklo_epi32(c2, c3), t3 = _mm256_unpackhi_epi32(c2, c3);
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2); // blocks 0 | 4
+    const __m256i u1 = _mm256_unpackhi_epi64(t0, t2); // blocks 1 | 5
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3); // blocks 2 | 6
+    const __m256i u3 = _mm256_unpackhi_epi64(t1, t3); // blocks 3 | 7
+    char* p = out + 16 * i;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_permute2x128_si256(u0, u1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 32), _mm256_permute2x128_si256(u2, u3, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 64), _mm256_permute2x128_si256(u0, u1, 0x31));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 96), _mm256_permute2x128_si256(u2, u3, 0x31));
+  }
+  fillScalar(out + 16 * i, firstBlock + i, blocks - i, k0, k1);
+}
+#endif
+
+FillFn kernelFn(RandomFill::Kernel k) {
+  switch (k) {
+#ifdef FFROG_X86
+    case RandomFill::Kernel::Avx2: return fillAvx2;
+    case RandomFill::Kernel::Sse2: return fillSse2;
+#endif
+    default: return fillScalar;
+  }
+}
+
+} // namespace
+
+bool RandomFill::isSupported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Auto:
+    case Kernel::Scalar:
+      return true;
+#ifdef FFROG_X86
+    case Kernel::Avx2:
+      return __builtin_cpu_supports("avx2");
+    case Kernel::Sse2:
+      return __builtin_cpu_supports("sse2");
+#endif
+    default:
+      return false;
+  }
+}
+
+RandomFill::Kernel RandomFill::best() {
+  static const Kernel k = isSupported(Kernel::Avx2)   ? Kernel::Avx2
+                          : isSupported(Kernel::Sse2) ? Kernel::Sse2
+                                                      : Kernel::Scalar;
+  return k;
+}
+
+QString RandomFill::name(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Auto: return name(best());
+    case Kernel::Avx2: return QStringLiteral("avx2");
+    case Kernel::Sse2: return QStringLiteral("sse2");
+    case Kernel::Scalar: return QStringLiteral("scalar");
+  }
+  return {};
+}
+
+void RandomFill::fill(char* buf, std::size_t len, quint64 seed, quint64 offset, Kernel kernel) {
+  if (kernel == Kernel::Auto || !isSupported(kernel)) kernel = best();
+  const auto k0 = static_cast<std::uint32_t>(seed);
+  const auto k1 = static_cast<std::uint32_t>(seed >> 32);
+
+  // Partial blocks at either end go through a scratch block.
+  auto partial = [&](quint64 block, std::size_t skip, std::size_t n, char* dst) {
+    std::uint32_t w[4];
+    char tmp[16];
+    philoxBlock(block, k0, k1, w);
+    storeBlock(tmp, w);
+    std::memcpy(dst, tmp + skip, n);
+  };
+
+  std::size_t pos = 0;
+  if (const std::size_t skip = offset % 16; skip && len) {
+    pos = std::min<std::size_t>(16 - skip, len);
+    partial(offset / 16, skip, pos, buf);
+  }
+  const std::size_t blocks = (len - pos) / 16;
+  kernelFn(kernel)(buf + pos, (offset + pos) / 16, blocks, k0, k1);
+  pos += blocks * 16;
+  if (pos < len) partial((offset + pos) / 16, 0, len - pos, buf + pos);
+}
+
+quint64 RandomFill::newSeed() {
+  return QRandomGenerator::system()->generate64();
+}
+
+QString RandomFill::seedName(quint64 seed) {
+  return QString("0x%1").arg(seed, 16, 16, QLatin1Char('0'));
+}
+
+bool RandomFill::parseSeed(const QString& text, quint64* out) {
+  bool ok = false;
+  const QString t = text.trimmed();
+  const quint64 v = t.startsWith("0x", Qt::CaseInsensitive) ? t.mid(2).toULongLong(&ok, 16) : t.toULongLong(&ok, 10);
+  if (ok) *out = v;
+  return ok;
+}
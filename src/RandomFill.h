@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QString>
+
+#include <cstddef>
+
+// Seeded random data for overwrite passes: Philox4x32-10 (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3"), a counter-based generator whose 16-byte block n depends only
+// on (seed, n). Any range of the stream can be produced on its own, so the write workers fill
+// their chunks in parallel and a verify pass regenerates exactly what was written. The widest
+// kernel the CPU supports (AVX2: 8 blocks per step, SSE2: 4, scalar) is picked at runtime; all
+// of them produce the same stream.
+class RandomFill final {
+public:
+  enum class Kernel { Auto, Avx2, Sse2, Scalar };
+
+  // Writes bytes [offset, offset + len) of the stream for `seed` into `buf`.
+  static void fill(char* buf, std::size_t len, quint64 seed, quint64 offset, Kernel kernel = Kernel::Auto);
+
+  // A fresh seed from the system's CSPRNG.
+  static quint64 newSeed();
+  // e.g. "0x0123456789abcdef", as logged; parseSeed() takes it back (decimal works too).
+  static QString seedName(quint64 seed);
+  static bool parseSeed(const QString& text, quint64* out);
+
+  static bool isSupported(Kernel kernel);
+  static Kernel best();
+  static QString name(Kernel kernel);
+};
@@ -0,0 +1,242 @@
+#include "RawDevice.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr std::size_t kPageAlign = 4096;
+
+namespace {
+
+QMutex leaseMutex;
+
+QHash<QString, int>& leases() {
+  static QHash<QString, int> byPath;
+  return byPath;
+}
+
+// False if `path` has no lease; else true, with a duplicate of its descriptor in `fd` (-1 and
+// errno on failure). Duplicated under the lock so the lease can't close it meanwhile.
+bool dupLeased(const QString& path, int* fd) {
+  const QMutexLocker lock(&leaseMutex);
+  const auto it = leases().constFind(path);
+  if (it == leases().constEnd()) return false;
+  *fd = ::fcntl(*it, F_DUPFD_CLOEXEC, 0);
+  return true;
+}
+
+} // namespace
+
+RawDevice::Lease::Lease(const QString& path, int fd) : path_(path), fd_(fd) {
+  const QMutexLocker lock(&leaseMutex);
+  leases().insert(path_, fd_);
+}
+
+RawDevice::Lease::~Lease() {
+  {
+    const QMutexLocker lock(&leaseMutex);
+    if (leases().value(path_, -1) == fd_) leases().remove(path_);
+  }
+  if (fd_ >= 0) ::close(fd_);
+}
+
+RawDevice::~RawDevice() {
+  close();
+}
+
+QString RawDevice::errnoMessage(const QString& what) {
+  const int e = errno;
+  return what + ": " + QString::fromLocal8Bit(std::strerror(e));
+}
+
+bool RawDevice::open(const QString& path, Mode mode, bool direct, QString* error) {
+  close();
+  path_ = path;
+  int leased = -1;
+  if (dupLeased(path, &leased)) return openLeased(leased, mode, direct, error);
+  const QByteArray p = path.toLocal8Bit();
+
+  struct stat st {};
+  if (::stat(p.constData(), &st) != 0) {
+    if (error) *error = errnoMessage("stat(" + path + ")");
+    return false;
+  }
+  isBlock_ = S_ISBLK(st.st_mode);
+  if (!isBlock_ && !S_ISREG(st.st_mode)) {
+    if (error) *error = path + " is neither a block device nor a regular file.";
+    return false;
+  }
+
+  int flags = O_CLOEXEC;
+  switch (mode) {
+    case Mode::Read: flags |= O_RDONLY; break;
+    case Mode::Write: flags |= O_WRONLY; break;
+    case Mode::ReadWrite: flags |= O_RDWR; break;
+  }
+  // On block devices O_EXCL (without O_CREAT) means "fail if mounted or otherwise claimed".
+  if (isBlock_) flags |= O_EXCL;
+
+  fd_ = -1;
+  if (direct) fd_ = ::open(p.constData(), flags | O_DIRECT);
+  direct_ = fd_ >= 0;
+  if (fd_ < 0 && (!direct || errno == EINVAL)) fd_ = ::open(p.constData(), flags);
+  if (fd_ < 0) {
+    if (error) *error = errnoMessage("open(" + path + ")");
+    return false;
+  }
+  return probeSize(static_cast<quint64>(st.st_size), error);
+}
+
+bool RawDevice::openLeased(int leased, Mode mode, bool direct, QString* error) {
+  if (leased < 0) {
+    if (error) *error = errnoMessage("dup of the descriptor leased for " + path_);
+    return false;
+  }
+  fd_ = leased;
+  const int fl = ::fcntl(fd_, F_GETFL);
+  const int access = fl & O_ACCMODE;
+  const bool fits = mode == Mode::Read ? access != O_WRONLY : mode == Mode::Write ? access != O_RDONLY : access == O_RDWR;
+  if (fl < 0 || !fits) {
+    if (error) *error = path_ + " was leased for a different access mode.";
+    close();
+    return false;
+  }
+  struct stat st {};
+  if (::fstat(fd_, &st) != 0) {
+    if (error) *error = errnoMessage("fstat(" + path_ + ")");
+    close();
+    return false;
+  }
+  isBlock_ = S_ISBLK(st.st_mode);
+  if (!isBlock_ && !S_ISREG(st.st_mode)) {
+    if (error) *error = path_ + " is neither a block device nor a regular file.";
+    close();
+    return false;
+  }
+  // The lease decided O_EXCL; O_DIRECT can still be switched (buffered I/O if it is refused).
+  direct_ = (fl & O_DIRECT) != 0;
+  setDirect(direct);
+  return probeSize(static_cast<quint64>(st.st_size), error);
+}
+
+bool RawDevice::probeSize(quint64 fileSize, QString* error) {
+  alignment_ = kPageAlign;
+  sectorSize_ = 512;
+  if (isBlock_) {
+    unsigned long long bytes = 0;
+    if (::ioctl(fd_, BLKGETSIZE64, &bytes) != 0) {
+      if (error) *error = errnoMessage("BLKGETSIZE64(" + path_ + ")");
+      close();
+      return false;
+    }
+    size_ = bytes;
+    int lbs = 0;
+    if (::ioctl(fd_, BLKSSZGET, &lbs) == 0 && lbs > 0) {
+      sectorSize_ = static_cast<quint32>(lbs);
+      alignment_ = std::max<quint64>(kPageAlign, lbs);
+    }
+  } else {
+    size_ = fileSize;
+  }
+  return true;
+}
+
+void RawDevice::close() {
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+  size_ = 0;
+  direct_ = false;
+}
+
+bool RawDevice::setDirect(bool on) {
+  if (fd_ < 0) return false;
+  if (on == direct_) return true;
+  int fl = ::fcntl(fd_, F_GETFL);
+  if (fl < 0) return false;
+  fl = on ? (fl | O_DIRECT) : (fl & ~O_DIRECT);
+  if (::fcntl(fd_, F_SETFL, fl) != 0) return false;
+  direct_ = on;
+  return true;
+}
+
+bool RawDevice::writeAt(const char* data, quint64 len, quint64 offset, QString* error) {
+  while (len > 0) {
+    const ssize_t n = ::pwrite(fd_, data, static_cast<std::size_t>(len), static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (error) {
+        *error = n < 0 ? errnoMessage(QString("pwrite at offset %1").arg(offset))
+                       : QString("pwrite at offset %1 wrote nothing (device full?)").arg(offset);
+      }
+      return false;
+    }
+    data += n;
+    offset += static_cast<quint64>(n);
+    len -= static_cast<quint64>(n);
+  }
+  return true;
+}
+
+bool RawDevice::readAt(char* data, quint64 len, quint64 offset, QString* error) {
+  while (len > 0) {
+    const ssize_t n = ::pread(fd_, data, static_cast<std::size_t>(len), static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (error) {
+        *error = n < 0 ? errnoMessage(QString("pread at offset %1").arg(offset))
+                       : QString("pread at offset %1: unexpected end of %2").arg(offset).arg(path_);
+      }
+      return false;
+    }
+    data += n;
+    offset += static_cast<quint64>(n);
+    len -= static_cast<quint64>(n);
+  }
+  return true;
+}
+
+bool RawDevice::sync(QString* error) {
+  if (fd_ >= 0 && ::fsync(fd_) != 0) {
+    if (error) *error = errnoMessage("fsync(" + path_ + ")");
+    return false;
+  }
+  return true;
+}
+
+AlignedBuffer::AlignedBuffer(std::size_t size) {
+  const std::size_t rounded = (size + kPageAlign - 1) / kPageAlign * kPageAlign;
+  void* p = nullptr;
+  if (rounded > 0 && ::posix_memalign(&p, kPageAlign, rounded) == 0) {
+    std::memset(p, 0, rounded);
+    data_ = static_cast<char*>(p);
+    size_ = size;
+  }
+}
+
+AlignedBuffer::~AlignedBuffer() {
+  std::free(data_);
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) noexcept {
+  if (this != &other) {
+    std::free(data_);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QString>
+
+#include <cstddef>
+
+// A block device (or a regular file, for tests and benchmarks) opened for raw I/O.
+// Closing is done by the destructor.
+class RawDevice final {
+public:
+  enum class Mode { Read, Write, ReadWrite };
+
+  RawDevice() = default;
+  ~RawDevice();
+  RawDevice(const RawDevice&) = delete;
+  RawDevice& operator=(const RawDevice&) = delete;
+
+  // A descriptor for `path` opened by someone allowed to (UDisks Block.OpenDevice, which checks
+  // polkit), for a process that may not open the node itself. While the lease lives, open(path)
+  // duplicates it instead of opening the node; the duplicates share its file status flags
+  // (O_DIRECT). Takes ownership of `fd`.
+  class Lease final {
+  public:
+    Lease(const QString& path, int fd);
+    ~Lease();
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+  private:
+    QString path_;
+    int fd_;
+  };
+
+  // Block devices are opened O_EXCL, so this fails while anything has them mounted.
+  // With `direct`, O_DIRECT is tried first; filesystems that refuse it (tmpfs) get buffered I/O.
+  // A leased path is not opened again: its descriptor is duplicated (see Lease).
+  bool open(const QString& path, Mode mode, bool direct, QString* error = nullptr);
+  void close();
+
+  int fd() const { return fd_; }
+  const QString& path() const { return path_; }
+  quint64 size() const { return size_; }
+  bool isBlockDevice() const { return isBlock_; }
+  bool isDirect() const { return direct_; }
+
+  // Offsets and lengths of O_DIRECT I/O must be multiples of this (>= 4096).
+  quint64 alignment() const { return alignment_; }
+
+  // Logical sector size (BLKSSZGET); 512 for regular files.
+  quint32 sectorSize() const { return sectorSize_; }
+
+  // Toggles O_DIRECT on the open descriptor (e.g. for an unaligned tail of a regular file).
+  bool setDirect(bool on);
+
+  // pwrite() of all `len` bytes at `offset`, retrying short writes and EINTR.
+  bool writeAt(const char* data, quint64 len, quint64 offset, QString* error = nullptr);
+  // pread() of all `len` bytes at `offset`; reading past the end is an error.
+  bool readAt(char* data, quint64 len, quint64 offset, QString* error = nullptr);
+
+  bool sync(QString* error = nullptr);
+
+  static QString errnoMessage(const QString& what);
+
+private:
+  bool openLeased(int leased, Mode mode, bool direct, QString* error);
+  // Size, sector size and alignment of the open descriptor (`fileSize` for regular files).
+  bool probeSize(quint64 fileSize, QString* error);
+
+  int fd_ = -1;
+  QString path_;
+  quint64 size_ = 0;
+  quint64 alignment_ = 4096;
+  quint32 sectorSize_ = 512;
+  bool isBlock_ = false;
+  bool direct_ = false;
+};
+
+// Zero-initialized, page-aligned heap buffer, suitable for O_DIRECT.
+class AlignedBuffer final {
+public:
+  AlignedBuffer() = default;
+  explicit AlignedBuffer(std::size_t size);
+  ~AlignedBuffer();
+  AlignedBuffer(AlignedBuffer&& other) noexcept;
+  AlignedBuffer& operator=(AlignedBuffer&& other) noexcept;
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  char* data() { return data_; }
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool isNull() const { return data_ == nullptr; }
+
+private:
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+inline quint64 alignUp(quint64 v, quint64 a) { return (v + a - 1) / a * a; }
+inline quint64 alignDown(quint64 v, quint64 a) { return v / a * a; }
@@ -0,0 +1,143 @@
+#include "SysfsBackend.h"
+#include "OpFuture.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Multicast groups of NETLINK_KOBJECT_UEVENT: raw kernel events, and udev's re-broadcast once
+// its database entry is written (that one is the trigger for the serial/hints).
+static constexpr unsigned kKernelGroup = 1;
+static constexpr unsigned kUdevGroup = 2;
+
+static QString readAttr(const QString& path) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return {};
+  return QString::fromUtf8(f.readAll()).trimmed();
+}
+
+SysfsBackend::SysfsBackend(QObject* parent, const QString& sysRoot, const QString& udevDataDir)
+    : DeviceBackend(parent), sysRoot_(sysRoot), udevDataDir_(udevDataDir) {}
+
+SysfsBackend::~SysfsBackend() {
+  if (fd_ >= 0) ::close(fd_);
+}
+
+QHash<QString, QString> SysfsBackend::udevProperties(const QString& udevDataDir, const QString& majorMinor) {
+  QHash<QString, QString> props;
+  QFile f(udevDataDir + "/b" + majorMinor);
+  if (!f.open(QIODevice::ReadOnly)) return props;
+  for (const QByteArray& line : f.readAll().split('\n')) {
+    if (!line.startsWith("E:")) continue;
+    const int eq = line.indexOf('=');
+    if (eq > 2) props.insert(QString::fromUtf8(line.mid(2, eq - 2)), QString::fromUtf8(line.mid(eq + 1)));
+  }
+  return props;
+}
+
+QVector<UsbDevice> SysfsBackend::scan(const QString& sysRoot, const QString& udevDataDir) {
+  QVector<UsbDevice> out;
+  const QDir blockDir(sysRoot + "/block");
+  // Entries are symlinks into /sys/devices; sorted by name like the UDisks2 list.
+  for (const QString& name : blockDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System, QDir::Name)) {
+    if (!isWholeDiskName(name)) continue;
+    const QString dev = blockDir.filePath(name);
+
+    // USB only (UDisks2's ConnectionBus == "usb"): the device sits below a USB host controller.
+    const QString devicePath = QFileInfo(dev + "/device").canonicalFilePath();
+    if (!devicePath.contains("/usb")) continue;
+
+    // Same extra safety as the UDisks2 backend: respect udev's system/ignore hints.
+    const QHash<QString, QString> udev = udevProperties(udevDataDir, readAttr(dev + "/dev"));
+    if (udev.value("UDISKS_SYSTEM") == "1" || udev.value("UDISKS_IGNORE") == "1") continue;
+
+    UsbDevice d;
+    d.deviceNode = "/dev/" + name;
+    d.blockObject = udisksBlockObject(name);
+    d.sizeBytes = readAttr(dev + "/size").toULongLong() * 512; // always 512-byte units
+    d.readOnly = readAttr(dev + "/ro") == "1";
+    d.vendor = readAttr(dev + "/device/vendor");
+    d.model = readAttr(dev + "/device/model");
+    if (d.vendor.isEmpty()) d.vendor = udev.value("ID_VENDOR").replace('_', ' ');
+    if (d.model.isEmpty()) d.model = udev.value("ID_MODEL").replace('_', ' ');
+    d.serial = udev.value("ID_SERIAL_SHORT");
+    if (d.serial.isEmpty()) {
+      // The USB device (the ancestor with idVendor) carries the serial descriptor.
+      for (QDir up(devicePath); !up.isRoot(); up.cdUp()) {
+        if (QFileInfo::exists(up.filePath("idVendor"))) {
+          d.serial = readAttr(up.filePath("serial"));
+          break;
+        }
+      }
+    }
+    out.push_back(d);
+  }
+  return out;
+}
+
+bool SysfsBackend::startWatching(QString* error) {
+  bool ok = true;
+  if (fd_ < 0) {
+    fd_ = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = kKernelGroup | kUdevGroup;
+    if (fd_ < 0 || ::bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+      if (error) *error = QString("Can't listen for uevents (hotplug): %1").arg(QString::fromLocal8Bit(std::strerror(errno)));
+      if (fd_ >= 0) ::close(fd_);
+      fd_ = -1;
+      ok = false;
+    } else {
+      notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+      connect(notifier_, &QSocketNotifier::activated, this, &SysfsBackend::onUevent);
+    }
+  }
+  resync();
+  return ok;
+}
+
+bool SysfsBackend::resync(QString*) {
+  devices_ = scan(sysRoot_, udevDataDir_);
+  Q_EMIT devicesChanged();
+  return true;
+}
+
+QFuture<OpResult> SysfsBackend::resyncAsync() {
+  resync();
+  return readyFuture(OpResult{true, {}});
+}
+
+QVector<UsbDevice> SysfsBackend::devices(QString*) const {
+  return devices_;
+}
+
+void SysfsBackend::onUevent() {
+  // Drain the socket; any block event (disk or partition, add/remove/change) triggers one
+  // rescan per burst.
+  bool relevant = false;
+  char buf[8192];
+  for (;;) {
+    const ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    relevant = relevant || QByteArray::fromRawData(buf, static_cast<int>(n)).contains("SUBSYSTEM=block");
+  }
+  if (!relevant || rescanPending_) return;
+  rescanPending_ = true;
+  QTimer::singleShot(0, this, [this]() {
+    rescanPending_ = false;
+    QVector<UsbDevice> now = scan(sysRoot_, udevDataDir_);
+    if (now == devices_) return;
+    devices_ = std::move(now);
+    Q_EMIT devicesChanged();
+  });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "DeviceBackend.h"
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class QSocketNotifier;
+
+// Device discovery without udisksd: reads /sys/block directly (size, ro, the device's USB
+// ancestry, vendor/model) plus udev's database for the serial and the UDISKS_SYSTEM /
+// UDISKS_IGNORE hints, and rescans on kernel/udev uevents from a netlink socket. A full scan
+// is a few dozen small file reads, so startup and refresh cost microseconds, not round trips.
+class SysfsBackend final : public DeviceBackend {
+  Q_OBJECT
+public:
+  explicit SysfsBackend(QObject* parent = nullptr,
+                        const QString& sysRoot = QStringLiteral("/sys"),
+                        const QString& udevDataDir = QStringLiteral("/run/udev/data"));
+  ~SysfsBackend() override;
+
+  QString name() const override { return QStringLiteral("sysfs"); }
+
+  // Opens the uevent socket (hotplug); a failure there is reported, but the inventory still
+  // works and refreshes on resync().
+  bool startWatching(QString* error = nullptr) override;
+  bool resync(QString* error = nullptr) override;
+  QFuture<OpResult> resyncAsync() override;
+  QVector<UsbDevice> devices(QString* error = nullptr) const override;
+
+  // One pass over <sysRoot>/block with the listUsbRemovable() filters.
+  static QVector<UsbDevice> scan(const QString& sysRoot, const QString& udevDataDir);
+
+  // KEY=VALUE properties of a udev database entry ("E:" lines of <udevDataDir>/b<major>:<minor>).
+  static QHash<QString, QString> udevProperties(const QString& udevDataDir, const QString& majorMinor);
+
+private:
+  void onUevent();
+
+  QString sysRoot_;
+  QString udevDataDir_;
+  QVector<UsbDevice> devices_;
+  int fd_ = -1;
+  QSocketNotifier* notifier_ = nullptr;
+  bool rescanPending_ = false;
+};
@@ -1,23 +1,90 @@
 #include "UDisks2.h"
+#include "OpFuture.h"
+#include "RawDevice.h"
 
+#include <QDBusArgument>
 #include <QDBusConnection>
 #include <QDBusInterface>
+#include <QDBusMessage>
+#include <QDBusMetaType>
 #include <QDBusReply>
 #include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QDBusUnixFileDescriptor>
 #include <QVariantMap>
 #include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QPromise>
 #include <QRegularExpression>
+#include <QSet>
+#include <QTimer>
+#include <QVersionNumber>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
 #include <limits>
+#include <memory>
+
+#include <fcntl.h>
 
 static constexpr const char* kService = "org.freedesktop.UDisks2";
+static constexpr const char* kRootPath = "/org/freedesktop/UDisks2";
+static constexpr const char* kPropsIface = "org.freedesktop.DBus.Properties";
+static constexpr const char* kObjectManagerIface = "org.freedesktop.DBus.ObjectManager";
+
+static constexpr const char* kBlockIface = "org.freedesktop.UDisks2.Block";
+static constexpr const char* kDriveIface = "org.freedesktop.UDisks2.Drive";
+static constexpr const char* kPartitionIface = "org.freedesktop.UDisks2.Partition";
+static constexpr const char* kPartitionTableIface = "org.freedesktop.UDisks2.PartitionTable";
+static constexpr const char* kFilesystemIface = "org.freedesktop.UDisks2.Filesystem";
+static constexpr const char* kJobIface = "org.freedesktop.UDisks2.Job";
 static constexpr const char* kManagerPath = "/org/freedesktop/UDisks2/Manager";
 static constexpr const char* kManagerIface = "org.freedesktop.UDisks2.Manager";
-static constexpr const char* kPropsIface = "org.freedesktop.DBus.Properties";
+static constexpr const char* kPhysicalVolumeIface = "org.freedesktop.UDisks2.PhysicalVolume";
+
+// Reply timeout for Format: a full zero-fill runs for hours, far beyond the 25 s D-Bus default.
+// INT_MAX is libdbus' "no timeout".
+static constexpr int kLongCallTimeoutMs = std::numeric_limits<int>::max();
+
+// Wire type of GetManagedObjects: a{oa{sa{sv}}}.
+using ManagedObjects = QMap<QDBusObjectPath, UDisks2::InterfaceMap>;
+
+static void registerDBusTypes() {
+  static const bool registered = [] {
+    qDBusRegisterMetaType<UDisks2::InterfaceMap>();
+    qDBusRegisterMetaType<ManagedObjects>();
+    return true;
+  }();
+  (void)registered;
+}
+
+// Sends `call` without blocking; resolves with the reply, which may be an error reply.
+static QFuture<QDBusMessage> asyncCall(const QDBusMessage& call, int timeoutMs = -1) {
+  auto promise = std::make_shared<QPromise<QDBusMessage>>();
+  promise->start();
+  QFuture<QDBusMessage> future = promise->future();
+  auto* watcher = new QDBusPendingCallWatcher(UDisks2::bus().asyncCall(call, timeoutMs));
+  QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher, [promise](QDBusPendingCallWatcher* w) {
+    promise->addResult(w->reply());
+    promise->finish();
+    w->deleteLater();
+  });
+  return future;
+}
 
-UDisks2::UDisks2(QObject* parent) : QObject(parent) {}
+UDisks2::UDisks2(QObject* parent) : DeviceBackend(parent) {
+  registerDBusTypes();
+}
+
+QDBusConnection UDisks2::bus() {
+  static const QByteArray which = qgetenv("FFROG_UDISKS_BUS");
+  if (which.isEmpty() || which == "system") return QDBusConnection::systemBus();
+  if (which == "session") return QDBusConnection::sessionBus();
+  return QDBusConnection::connectToBus(QString::fromLocal8Bit(which), QStringLiteral("ffrog-udisks"));
+}
 
 QVariant UDisks2::getProp(const QString& objPath, const QString& iface, const QString& prop, bool* ok) const {
-  QDBusInterface props(kService, objPath, kPropsIface, QDBusConnection::systemBus());
+  QDBusInterface props(kService, objPath, kPropsIface, bus());
   if (!props.isValid()) {
     if (ok) *ok = false;
     return {};
@@ -41,7 +108,84 @@ QString UDisks2::bytesToString(const QVariant& v) {
   return QString::fromLocal8Bit(tmp.constData());
 }
 
+QString UDisks2::objectPath(const QVariant& v) {
+  return qvariant_cast<QDBusObjectPath>(v).path();
+}
+
+bool UDisks2::Snapshot::has(const QString& objPath, const QString& iface) const {
+  const auto it = objects.constFind(objPath);
+  return it != objects.constEnd() && it->contains(iface);
+}
+
+QVariant UDisks2::Snapshot::prop(const QString& objPath, const QString& iface, const QString& prop) const {
+  const auto it = objects.constFind(objPath);
+  if (it == objects.constEnd()) return {};
+  const auto ifIt = it->constFind(iface);
+  if (ifIt == it->constEnd()) return {};
+  return ifIt->value(prop);
+}
+
+bool UDisks2::parseSnapshot(const QDBusMessage& msg, Snapshot* out, QString* error) {
+  const QDBusReply<ManagedObjects> reply(msg);
+  if (!reply.isValid()) {
+    if (error) {
+      *error = reply.error().type() == QDBusError::ServiceUnknown
+                   ? QStringLiteral("Can't talk to udisksd on the system D-Bus. Is the udisks2 service running?")
+                   : "GetManagedObjects failed: " + reply.error().message();
+    }
+    return false;
+  }
+
+  const ManagedObjects objs = reply.value();
+  out->objects.clear();
+  out->objects.reserve(objs.size());
+  for (auto it = objs.cbegin(); it != objs.cend(); ++it) out->objects.insert(it.key().path(), it.value());
+  return true;
+}
+
+bool UDisks2::fetchSnapshot(Snapshot* out, QString* error) const {
+  const QDBusMessage call = QDBusMessage::createMethodCall(kService, kRootPath, kObjectManagerIface, "GetManagedObjects");
+  return parseSnapshot(bus().call(call), out, error);
+}
+
+QStringList UDisks2::mountPoints(const QVariant& v) {
+  // MountPoints is 'aay' (NUL-terminated byte strings); complex types arrive as QDBusArgument.
+  QList<QByteArray> raw;
+  if (v.userType() == qMetaTypeId<QDBusArgument>()) {
+    v.value<QDBusArgument>() >> raw;
+  } else {
+    raw = qvariant_cast<QList<QByteArray>>(v);
+  }
+  QStringList out;
+  for (const QByteArray& mp : raw) out.push_back(bytesToString(mp));
+  return out;
+}
+
+QStringList UDisks2::objectPaths(const QVariant& v) {
+  // 'ao' inside a variant arrives as a QDBusArgument.
+  QStringList out;
+  for (const QDBusObjectPath& p : qdbus_cast<QList<QDBusObjectPath>>(v)) out.push_back(p.path());
+  return out;
+}
+
+QString UDisks2::deviceNodeOf(const Snapshot& snap, const QString& blockObject) {
+  QString node = bytesToString(snap.prop(blockObject, kBlockIface, "PreferredDevice"));
+  if (node.isEmpty()) node = bytesToString(snap.prop(blockObject, kBlockIface, "Device"));
+  if (node.isEmpty()) {
+    // Fallback: derive from the block object basename, e.g. .../block_devices/sdb -> /dev/sdb
+    const QString base = blockObject.section('/', -1);
+    if (!base.isEmpty()) node = "/dev/" + base;
+  }
+  return node;
+}
+
 QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
+  Snapshot snap;
+  if (!fetchSnapshot(&snap, error)) return {};
+  return listUsbRemovable(snap, error);
+}
+
+QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(const Snapshot& snap, QString* error) {
   QVector<UsbDevice> out;
 
   // Debug counters (useful when UDisks2 is reachable but our filters yield 0).
@@ -53,44 +197,21 @@ QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
   int noDev = 0;
   int notWholeDisk = 0;
 
-  QDBusInterface mgr(kService, kManagerPath, kManagerIface, QDBusConnection::systemBus());
-  if (!mgr.isValid()) {
-    if (error) *error = "Can't talk to udisksd on the system D-Bus. Is the udisks2 service running?";
-    return out;
-  }
-
-  // Get all Block objects.
-  QDBusReply<QList<QDBusObjectPath>> blocksReply = mgr.call("GetBlockDevices", QVariantMap{});
-  if (!blocksReply.isValid()) {
-    if (error) *error = "GetBlockDevices failed: " + blocksReply.error().message();
-    return out;
-  }
-
-  for (const QDBusObjectPath& bop : blocksReply.value()) {
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    const InterfaceMap& ifaces = it.value();
+    const auto blkIt = ifaces.constFind(kBlockIface);
+    if (blkIt == ifaces.constEnd()) continue; // drives, jobs, the manager...
     ++blocks;
-    const QString blockPath = bop.path();
-
-    // IMPORTANT: Do NOT use QDBusInterface::isValid() to test if an interface exists.
-    // Many object paths are valid while a specific interface may not be present.
-    // Instead, try reading a property from that interface.
-    {
-      bool okPart = false;
-      (void)getProp(blockPath, "org.freedesktop.UDisks2.Partition", "Number", &okPart);
-      if (okPart) {
-        ++partitions;
-        continue; // it's a partition like /dev/sdX1
-      }
-    }
+    const QString blockPath = it.key();
+    const QVariantMap& blk = *blkIt;
 
-    bool okDrive = false;
-    const QVariant driveVar = getProp(blockPath, "org.freedesktop.UDisks2.Block", "Drive", &okDrive);
-    if (!okDrive) {
-      ++noDrive;
-      continue;
+    if (ifaces.contains(kPartitionIface)) {
+      ++partitions;
+      continue; // it's a partition like /dev/sdX1
     }
-    const QDBusObjectPath driveObj = qvariant_cast<QDBusObjectPath>(driveVar);
-    const QString drivePath = driveObj.path();
-    if (drivePath.isEmpty() || drivePath == "/") {
+
+    const QString drivePath = objectPath(blk.value("Drive"));
+    if (drivePath.isEmpty() || drivePath == "/" || !snap.has(drivePath, kDriveIface)) {
       ++noDrive;
       continue;
     }
@@ -98,16 +219,14 @@ QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
     // Filter to USB devices.
     // NOTE: Some USB pendrives report Removable/MediaRemovable = false in practice, so we rely
     // primarily on ConnectionBus containing "usb".
-    const QString conn = getProp(drivePath, "org.freedesktop.UDisks2.Drive", "ConnectionBus").toString();
+    const QString conn = snap.prop(drivePath, kDriveIface, "ConnectionBus").toString();
     if (!conn.contains("usb", Qt::CaseInsensitive)) {
       ++nonUsb;
       continue;
     }
 
     // Skip devices udisks marks as system/ignore (extra safety).
-    const bool hintSystem = getProp(blockPath, "org.freedesktop.UDisks2.Block", "HintSystem").toBool();
-    const bool hintIgnore = getProp(blockPath, "org.freedesktop.UDisks2.Block", "HintIgnore").toBool();
-    if (hintSystem || hintIgnore) {
+    if (blk.value("HintSystem").toBool() || blk.value("HintIgnore").toBool()) {
       ++hinted;
       continue;
     }
@@ -115,30 +234,18 @@ QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
     UsbDevice dev;
     dev.blockObject = blockPath;
     dev.driveObject = drivePath;
-    dev.deviceNode = bytesToString(getProp(blockPath, "org.freedesktop.UDisks2.Block", "PreferredDevice"));
-    if (dev.deviceNode.isEmpty()) dev.deviceNode = bytesToString(getProp(blockPath, "org.freedesktop.UDisks2.Block", "Device"));
-    if (dev.deviceNode.isEmpty()) {
-      // Fallback: derive from the block object basename, e.g. .../block_devices/sdb -> /dev/sdb
-      const QString base = blockPath.section('/', -1);
-      if (!base.isEmpty()) dev.deviceNode = "/dev/" + base;
-    }
+    dev.deviceNode = deviceNodeOf(snap, blockPath);
 
-    // Safety: only accept whole-disk nodes. We intentionally avoid partitions like /dev/sdb1.
-    // This is the "format the whole stick" use-case.
-    // Accept sdX (letters only) and nvmeXnY (whole namespace).
-    const QString bn = dev.deviceNode.section('/', -1);
-    const bool isWholeDisk = bn.contains(QRegularExpression("^sd[a-z]+$")) ||
-                             bn.contains(QRegularExpression("^nvme\\d+n\\d+$")) ||
-                             bn.contains(QRegularExpression("^mmcblk\\d+$"));
-    if (!isWholeDisk) {
+    // Safety: whole disks only ("format the whole stick"), see isWholeDiskName().
+    if (!isWholeDiskName(dev.deviceNode.section('/', -1))) {
       ++notWholeDisk;
       continue;
     }
-    dev.sizeBytes = getProp(blockPath, "org.freedesktop.UDisks2.Block", "Size").toULongLong();
-    dev.readOnly = getProp(blockPath, "org.freedesktop.UDisks2.Block", "ReadOnly").toBool();
-    dev.vendor = getProp(drivePath, "org.freedesktop.UDisks2.Drive", "Vendor").toString();
-    dev.model = getProp(drivePath, "org.freedesktop.UDisks2.Drive", "Model").toString();
-    dev.serial = getProp(drivePath, "org.freedesktop.UDisks2.Drive", "Serial").toString();
+    dev.sizeBytes = blk.value("Size").toULongLong();
+    dev.readOnly = blk.value("ReadOnly").toBool();
+    dev.vendor = snap.prop(drivePath, kDriveIface, "Vendor").toString();
+    dev.model = snap.prop(drivePath, kDriveIface, "Model").toString();
+    dev.serial = snap.prop(drivePath, kDriveIface, "Serial").toString();
 
     // Extra safety: only show /dev/* nodes (ignore weird backends)
     if (dev.deviceNode.startsWith("/dev/")) {
@@ -148,6 +255,9 @@ QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
     }
   }
 
+  // QHash order is arbitrary; keep the list stable for the UI.
+  std::sort(out.begin(), out.end(), [](const UsbDevice& a, const UsbDevice& b) { return a.deviceNode < b.deviceNode; });
+
   if (out.isEmpty() && error) {
     *error = QString("UDisks2 reachable, but filter returned 0 USB whole-disk devices. "
                      "blocks=%1 partitions=%2 noDrive=%3 nonUsb=%4 hinted=%5 notWholeDisk=%6 noDev=%7")
@@ -162,6 +272,134 @@ QVector<UDisks2::UsbDevice> UDisks2::listUsbRemovable(QString* error) const {
   return out;
 }
 
+bool UDisks2::startWatching(QString* error) {
+  if (!watching_) {
+    // Subscribe before the initial snapshot so nothing that happens in between is lost;
+    // deltas for objects the snapshot already has are simply applied twice.
+    QDBusConnection conn = bus();
+    const bool okAdded = conn.connect(kService, kRootPath, kObjectManagerIface, "InterfacesAdded",
+                                      this, SLOT(onInterfacesAdded(QDBusMessage)));
+    const bool okRemoved = conn.connect(kService, kRootPath, kObjectManagerIface, "InterfacesRemoved",
+                                        this, SLOT(onInterfacesRemoved(QDBusMessage)));
+    // Empty path = every object exported by udisksd.
+    const bool okProps = conn.connect(kService, QString(), kPropsIface, "PropertiesChanged",
+                                      this, SLOT(onPropertiesChanged(QDBusMessage)));
+    watching_ = okAdded && okRemoved && okProps;
+  }
+  return resync(error);
+}
+
+bool UDisks2::resync(QString* error) {
+  SnapshotResult r;
+  r.ok = fetchSnapshot(&r.snapshot, &r.error);
+  if (!r.ok && error) *error = r.error;
+  const bool ok = r.ok;
+  applySnapshot(std::move(r));
+  return ok;
+}
+
+void UDisks2::applySnapshot(SnapshotResult r) {
+  cache_ = std::move(r.snapshot);
+  cacheError_ = r.ok ? QString() : r.error;
+  Q_EMIT devicesChanged();
+}
+
+QVector<UDisks2::UsbDevice> UDisks2::cachedUsbRemovable(QString* error) const {
+  if (!cacheError_.isEmpty()) {
+    if (error) *error = cacheError_;
+    return {};
+  }
+  return listUsbRemovable(cache_, error);
+}
+
+void UDisks2::scheduleDevicesChanged(const QString& iface) {
+  // Jobs, the Manager, loop/mdraid objects etc. don't affect the device list.
+  if (iface != kBlockIface && iface != kDriveIface && iface != kPartitionIface && iface != kFilesystemIface) return;
+  if (changePending_) return;
+  changePending_ = true;
+  // A hotplug arrives as a burst of signals (drive, block, partitions...): emit once per burst.
+  QTimer::singleShot(0, this, [this]() {
+    changePending_ = false;
+    Q_EMIT devicesChanged();
+  });
+}
+
+void UDisks2::onInterfacesAdded(const QDBusMessage& msg) {
+  const QList<QVariant> args = msg.arguments();
+  if (args.size() < 2) return;
+  const QString path = qvariant_cast<QDBusObjectPath>(args.at(0)).path();
+  const InterfaceMap added = qdbus_cast<InterfaceMap>(args.at(1));
+
+  InterfaceMap& ifaces = cache_.objects[path];
+  for (auto it = added.cbegin(); it != added.cend(); ++it) {
+    ifaces.insert(it.key(), it.value());
+    scheduleDevicesChanged(it.key());
+  }
+  if (added.contains(kJobIface)) reportJob(path);
+}
+
+void UDisks2::onInterfacesRemoved(const QDBusMessage& msg) {
+  const QList<QVariant> args = msg.arguments();
+  if (args.size() < 2) return;
+  const QString path = qvariant_cast<QDBusObjectPath>(args.at(0)).path();
+  const QStringList removed = qdbus_cast<QStringList>(args.at(1));
+
+  auto objIt = cache_.objects.find(path);
+  if (objIt == cache_.objects.end()) return;
+  for (const QString& iface : removed) {
+    objIt->remove(iface);
+    scheduleDevicesChanged(iface);
+  }
+  if (objIt->isEmpty()) cache_.objects.erase(objIt);
+}
+
+void UDisks2::onPropertiesChanged(const QDBusMessage& msg) {
+  // Signature: s a{sv} as
+  const QList<QVariant> args = msg.arguments();
+  if (args.size() < 2) return;
+  const QString iface = args.at(0).toString();
+  const QVariantMap changed = qdbus_cast<QVariantMap>(args.at(1));
+  const QStringList invalidated = args.size() > 2 ? qdbus_cast<QStringList>(args.at(2)) : QStringList();
+
+  auto objIt = cache_.objects.find(msg.path());
+  if (objIt == cache_.objects.end()) return; // InterfacesAdded will bring the full object.
+  auto ifIt = objIt->find(iface);
+  if (ifIt == objIt->end()) return;
+  for (auto it = changed.cbegin(); it != changed.cend(); ++it) ifIt->insert(it.key(), it.value());
+  for (const QString& name : invalidated) ifIt->remove(name);
+  scheduleDevicesChanged(iface);
+  if (iface == kJobIface) reportJob(msg.path());
+}
+
+void UDisks2::reportJob(const QString& jobPath) {
+  const QVariantMap job = cache_.objects.value(jobPath).value(kJobIface);
+  if (job.isEmpty()) return;
+
+  const QString operation = job.value("Operation").toString();
+  const bool valid = job.value("ProgressValid").toBool();
+  const double fraction = std::clamp(job.value("Progress").toDouble(), 0.0, 1.0);
+  const quint64 bytesTotal = job.value("BytesTotal").toULongLong();
+  const quint64 rate = job.value("Rate").toULongLong();
+  const quint64 endUsec = job.value("ExpectedEndTime").toULongLong();
+  const qint64 nowUsec = QDateTime::currentMSecsSinceEpoch() * 1000;
+
+  for (const QString& obj : objectPaths(job.value("Objects"))) {
+    // Jobs on a partition (format-mkfs on /dev/sdb1) are reported against the whole disk.
+    const QString table = objectPath(cache_.prop(obj, kPartitionIface, "Table"));
+    const QString disk = table.isEmpty() || table == "/" ? obj : table;
+
+    IoProgress p;
+    if (valid) {
+      // Not every job knows its byte count; the erase runs over the whole block anyway.
+      p.bytesTotal = bytesTotal ? bytesTotal : cache_.prop(obj, kBlockIface, "Size").toULongLong();
+      p.bytesDone = static_cast<quint64>(fraction * static_cast<double>(p.bytesTotal));
+    }
+    p.bytesPerSec = static_cast<double>(rate);
+    if (endUsec > static_cast<quint64>(nowUsec)) p.etaSeconds = static_cast<qint64>((endUsec - nowUsec) / 1000000);
+    Q_EMIT jobProgress(disk, p, operation);
+  }
+}
+
 bool UDisks2::unmountIfMounted(const QString& blockObject, QString* error) const {
   // Do NOT use QDBusInterface::isValid() to test for interface presence.
   // Instead, try to read a property from that interface.
@@ -171,87 +409,38 @@ bool UDisks2::unmountIfMounted(const QString& blockObject, QString* error) const
     // Not a filesystem (or interface not present). That's fine.
     return true;
   }
+  return unmountBlocks({blockObject}, error);
+}
 
-  QDBusInterface fs(kService, blockObject, "org.freedesktop.UDisks2.Filesystem", QDBusConnection::systemBus());
-  QDBusReply<void> reply = fs.call("Unmount", QVariantMap{});
-  if (!reply.isValid()) {
-    // If already unmounted, udisks may complain; treat common cases as non-fatal.
-    const QString msg = reply.error().message();
-    if (msg.contains("Not mounted", Qt::CaseInsensitive) || msg.contains("not mounted", Qt::CaseInsensitive)) {
-      return true;
+bool UDisks2::unmountBlocks(const QStringList& blocks, QString* error) const {
+  for (const QString& block : blocks) {
+    // A plain method call: QDBusInterface would Introspect each block first.
+    QDBusMessage call = QDBusMessage::createMethodCall(kService, block, kFilesystemIface, "Unmount");
+    call << QVariantMap{};
+    const QDBusMessage reply = bus().call(call);
+    if (reply.type() == QDBusMessage::ErrorMessage) {
+      // If already unmounted, udisks may complain; treat that as non-fatal.
+      const QString msg = reply.errorMessage();
+      if (msg.contains("not mounted", Qt::CaseInsensitive)) continue;
+      if (error) *error = "Unmount failed: " + msg;
+      return false;
     }
-    if (error) *error = "Unmount failed: " + msg;
-    return false;
   }
   return true;
 }
 
 bool UDisks2::unmountAllOnSameDrive(const QString& blockObject, QString* error) const {
-  // Always try unmount on the block itself first (covers "superfloppy" USB sticks).
-  if (!unmountIfMounted(blockObject, error)) return false;
-
-  bool okDrive = false;
-  const QVariant driveVar = getProp(blockObject, "org.freedesktop.UDisks2.Block", "Drive", &okDrive);
-  if (!okDrive) return true;
-  const QString drivePath = qvariant_cast<QDBusObjectPath>(driveVar).path();
-  if (drivePath.isEmpty() || drivePath == "/") return true;
-
-  QDBusInterface mgr(kService, kManagerPath, kManagerIface, QDBusConnection::systemBus());
-  if (!mgr.isValid()) return true; // already checked in other calls; best-effort.
-  QDBusReply<QList<QDBusObjectPath>> blocksReply = mgr.call("GetBlockDevices", QVariantMap{});
-  if (!blocksReply.isValid()) return true;
-
-  for (const QDBusObjectPath& bop : blocksReply.value()) {
-    const QString p = bop.path();
-    bool okDrv2 = false;
-    const QVariant drv2 = getProp(p, "org.freedesktop.UDisks2.Block", "Drive", &okDrv2);
-    if (!okDrv2) continue;
-    const QString drv2Path = qvariant_cast<QDBusObjectPath>(drv2).path();
-    if (drv2Path != drivePath) continue;
-
-    // Unmount any filesystem present on that block (partitions, etc.).
-    if (!unmountIfMounted(p, error)) return false;
-  }
-
-  return true;
+  // One GetManagedObjects instead of a Drive lookup per block in the system; only what is
+  // mounted gets an Unmount call.
+  Snapshot snap;
+  if (!fetchSnapshot(&snap, error)) return false;
+  return unmountBlocks(Topology::build(snap).mountedBlocksOnSameDrive(blockObject), error);
 }
 
 QString UDisks2::pickPrimaryPartitionBlock(const QString& blockObject) const {
-  bool okDrive = false;
-  const QVariant driveVar = getProp(blockObject, "org.freedesktop.UDisks2.Block", "Drive", &okDrive);
-  if (!okDrive) return {};
-  const QString drivePath = qvariant_cast<QDBusObjectPath>(driveVar).path();
-  if (drivePath.isEmpty() || drivePath == "/") return {};
-
-  QDBusInterface mgr(kService, kManagerPath, kManagerIface, QDBusConnection::systemBus());
-  if (!mgr.isValid()) return {};
-  QDBusReply<QList<QDBusObjectPath>> blocksReply = mgr.call("GetBlockDevices", QVariantMap{});
-  if (!blocksReply.isValid()) return {};
-
-  int bestNum = std::numeric_limits<int>::max();
-  QString bestPath;
-
-  for (const QDBusObjectPath& bop : blocksReply.value()) {
-    const QString p = bop.path();
-
-    bool okDrv2 = false;
-    const QVariant drv2 = getProp(p, "org.freedesktop.UDisks2.Block", "Drive", &okDrv2);
-    if (!okDrv2) continue;
-    const QString drv2Path = qvariant_cast<QDBusObjectPath>(drv2).path();
-    if (drv2Path != drivePath) continue;
-
-    bool okPart = false;
-    const QVariant numVar = getProp(p, "org.freedesktop.UDisks2.Partition", "Number", &okPart);
-    if (!okPart) continue;
-    const int num = numVar.toInt();
-    if (num <= 0) continue;
-    if (num < bestNum) {
-      bestNum = num;
-      bestPath = p;
-    }
-  }
-
-  return bestPath;
+  Snapshot snap;
+  if (!fetchSnapshot(&snap)) return {};
+  return Topology::build(snap).primaryPartitionBlock(blockObject);
 }
 
 bool UDisks2::formatBlock(const QString& blockObject,
@@ -260,14 +449,18 @@ bool UDisks2::formatBlock(const QString& blockObject,
                           const QString& eraseMode,
                           bool tearDown,
                           QString* error) const {
+  Snapshot snap;
+  if (!fetchSnapshot(&snap, error)) return false;
+  const Topology topo = Topology::build(snap);
+
   // If the disk has partitions (common), format the primary partition instead of the whole disk.
   // This behaves more like "normal" desktop format tools.
-  const QString primaryPart = pickPrimaryPartitionBlock(blockObject);
+  const QString primaryPart = topo.primaryPartitionBlock(blockObject);
   const QString fmtTarget = primaryPart.isEmpty() ? blockObject : primaryPart;
 
-  if (!unmountAllOnSameDrive(blockObject, error)) return false;
+  if (!unmountBlocks(topo.mountedBlocksOnSameDrive(blockObject), error)) return false;
 
-  QDBusInterface blk(kService, fmtTarget, "org.freedesktop.UDisks2.Block", QDBusConnection::systemBus());
+  QDBusInterface blk(kService, fmtTarget, "org.freedesktop.UDisks2.Block", bus());
   if (!blk.isValid()) {
     if (error) *error = "org.freedesktop.UDisks2.Block interface not available for: " + fmtTarget;
     return false;
@@ -280,6 +473,7 @@ bool UDisks2::formatBlock(const QString& blockObject,
   opts.insert("update-partition-type", true);
   if (tearDown) opts.insert("tear-down", true);
 
+  blk.setTimeout(kLongCallTimeoutMs);
   QDBusReply<void> reply = blk.call("Format", fsType, opts);
   if (!reply.isValid()) {
     if (error) *error = "Format failed: " + reply.error().message();
@@ -294,7 +488,7 @@ bool UDisks2::formatBlock(const QString& blockObject,
 bool UDisks2::wipeBlock(const QString& blockObject, const QString& eraseMode, bool tearDown, QString* error) const {
   if (!unmountAllOnSameDrive(blockObject, error)) return false;
 
-  QDBusInterface blk(kService, blockObject, "org.freedesktop.UDisks2.Block", QDBusConnection::systemBus());
+  QDBusInterface blk(kService, blockObject, "org.freedesktop.UDisks2.Block", bus());
   if (!blk.isValid()) {
     if (error) *error = "org.freedesktop.UDisks2.Block interface not available for: " + blockObject;
     return false;
@@ -304,6 +498,7 @@ bool UDisks2::wipeBlock(const QString& blockObject, const QString& eraseMode, bo
   if (!eraseMode.isEmpty()) opts.insert("erase", eraseMode);
   if (tearDown) opts.insert("tear-down", true);
 
+  blk.setTimeout(kLongCallTimeoutMs);
   QDBusReply<void> reply = blk.call("Format", QStringLiteral("empty"), opts);
   if (!reply.isValid()) {
     if (error) *error = "Wipe (empty) failed: " + reply.error().message();
@@ -313,3 +508,536 @@ bool UDisks2::wipeBlock(const QString& blockObject, const QString& eraseMode, bo
   blk.call("Rescan", QVariantMap{});
   return true;
 }
+
+// ---- Asynchronous API ---------------------------------------------------
+
+QFuture<UDisks2::SnapshotResult> UDisks2::fetchSnapshotAsync() {
+  const QDBusMessage call = QDBusMessage::createMethodCall(kService, kRootPath, kObjectManagerIface, "GetManagedObjects");
+  return asyncCall(call).then([](QDBusMessage reply) {
+    SnapshotResult r;
+    r.ok = parseSnapshot(reply, &r.snapshot, &r.error);
+    return r;
+  });
+}
+
+QFuture<UDisks2::DeviceList> UDisks2::listUsbRemovableAsync() {
+  return fetchSnapshotAsync().then([](SnapshotResult r) {
+    DeviceList out;
+    if (!r.ok) {
+      out.error = r.error;
+      return out;
+    }
+    out.devices = listUsbRemovable(r.snapshot, &out.error);
+    return out;
+  });
+}
+
+QFuture<OpResult> UDisks2::resyncAsync() {
+  return fetchSnapshotAsync().then(this, [this](SnapshotResult r) {
+    const OpResult result{r.ok, r.error};
+    applySnapshot(std::move(r));
+    return result;
+  });
+}
+
+UDisks2::Topology UDisks2::Topology::build(const Snapshot& snap) {
+  Topology topo;
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    const auto blkIt = it->constFind(kBlockIface);
+    if (blkIt == it->constEnd()) continue;
+
+    Block b;
+    b.object = it.key();
+    const auto partIt = it->constFind(kPartitionIface);
+    if (partIt != it->constEnd()) b.partitionNumber = partIt->value("Number").toInt();
+    const auto fsIt = it->constFind(kFilesystemIface);
+    if (fsIt != it->constEnd()) {
+      b.hasFilesystem = true;
+      b.mountPoints = mountPoints(fsIt->value("MountPoints"));
+    }
+
+    const QString drive = objectPath(blkIt->value("Drive"));
+    if (drive.isEmpty() || drive == "/") {
+      topo.unattached.insert(b.object, b);
+      continue;
+    }
+    topo.driveOf.insert(b.object, drive);
+    topo.blocksOnDrive[drive].push_back(b);
+  }
+  // QHash order is arbitrary; keep the unmount order reproducible.
+  for (auto& blocks : topo.blocksOnDrive) {
+    std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.object < b.object; });
+  }
+  return topo;
+}
+
+QVector<UDisks2::Topology::Block> UDisks2::Topology::sameDrive(const QString& blockObject) const {
+  const auto driveIt = driveOf.constFind(blockObject);
+  if (driveIt != driveOf.constEnd()) return blocksOnDrive.value(*driveIt);
+  const auto it = unattached.constFind(blockObject);
+  return it != unattached.constEnd() ? QVector<Block>{*it} : QVector<Block>{};
+}
+
+QStringList UDisks2::Topology::mountedBlocksOnSameDrive(const QString& blockObject) const {
+  QStringList out;
+  QStringList others;
+  for (const Block& b : sameDrive(blockObject)) {
+    if (b.mountPoints.isEmpty()) continue;
+    if (b.object == blockObject) out.push_back(b.object);
+    else others.push_back(b.object);
+  }
+  return out + others;
+}
+
+QString UDisks2::Topology::primaryPartitionBlock(const QString& blockObject) const {
+  // A block without a drive has no partitions to pick from.
+  if (!driveOf.contains(blockObject)) return {};
+  int bestNum = std::numeric_limits<int>::max();
+  QString bestPath;
+  for (const Block& b : sameDrive(blockObject)) {
+    if (b.partitionNumber <= 0) continue;
+    if (b.partitionNumber < bestNum) {
+      bestNum = b.partitionNumber;
+      bestPath = b.object;
+    }
+  }
+  return bestPath;
+}
+
+QFuture<OpResult> UDisks2::unmountSequentially(QStringList blocks) {
+  if (blocks.isEmpty()) return readyFuture(OpResult{true, {}});
+
+  const QString block = blocks.takeFirst();
+  QDBusMessage call = QDBusMessage::createMethodCall(kService, block, kFilesystemIface, "Unmount");
+  call << QVariantMap{};
+  return andThen(this, asyncCall(call), [this, blocks](const QDBusMessage& reply) {
+    if (reply.type() == QDBusMessage::ErrorMessage) {
+      // If already unmounted, udisks may complain; treat that as non-fatal.
+      const QString msg = reply.errorMessage();
+      if (!msg.contains("not mounted", Qt::CaseInsensitive)) return readyFuture(OpResult{false, "Unmount failed: " + msg});
+    }
+    return unmountSequentially(blocks);
+  });
+}
+
+QFuture<OpResult> UDisks2::unmountAllOnSameDriveAsync(const QString& blockObject) {
+  return andThen(this, fetchSnapshotAsync(), [this, blockObject](const SnapshotResult& r) {
+    if (!r.ok) return readyFuture(OpResult{false, r.error});
+    return timedStep(this, QStringLiteral("unmount"), unmountSequentially(Topology::build(r.snapshot).mountedBlocksOnSameDrive(blockObject)));
+  });
+}
+
+QFuture<OpResult> UDisks2::callForResult(const QDBusMessage& call, const QString& failPrefix) {
+  return andThen(this, asyncCall(call, kLongCallTimeoutMs), [failPrefix](const QDBusMessage& reply) {
+    if (reply.type() == QDBusMessage::ErrorMessage) return readyFuture(OpResult{false, failPrefix + reply.errorMessage()});
+    return readyFuture(OpResult{true, {}});
+  });
+}
+
+QFuture<OpResult> UDisks2::callBlockFormat(const QString& target,
+                                           const QString& fsType,
+                                           const QVariantMap& opts,
+                                           const QString& failPrefix) {
+  QDBusMessage call = QDBusMessage::createMethodCall(kService, target, kBlockIface, "Format");
+  call << fsType << opts;
+  return andThenIfOk(this, timedStep(this, QStringLiteral("format"), callForResult(call, failPrefix)), [this, target]() {
+    return rescanThen(target, OpResult{true, {}});
+  });
+}
+
+QFuture<OpResult> UDisks2::rescanThen(const QString& blockObject, OpResult result) {
+  // Optional rescan; its outcome doesn't change the result.
+  QDBusMessage rescan = QDBusMessage::createMethodCall(kService, blockObject, kBlockIface, "Rescan");
+  rescan << QVariantMap{};
+  QElapsedTimer timer;
+  timer.start();
+  return asyncCall(rescan).then([result, timer](QDBusMessage) mutable {
+    result.steps.append(OpStep{QStringLiteral("rescan"), timer.elapsed()});
+    return result;
+  });
+}
+
+QFuture<OpResult> UDisks2::formatBlockAsync(const QString& blockObject,
+                                            const QString& fsType,
+                                            const QString& label,
+                                            const QString& eraseMode,
+                                            bool tearDown,
+                                            const FormatProfile& profile) {
+  QVariantMap opts;
+  if (!label.isEmpty()) opts.insert("label", label);
+  if (!eraseMode.isEmpty()) opts.insert("erase", eraseMode);
+  opts.insert("take-ownership", true);
+  opts.insert("update-partition-type", true);
+  if (tearDown) opts.insert("tear-down", true);
+
+  return andThen(this, fetchSnapshotAsync(), [this, blockObject, fsType, opts, profile](const SnapshotResult& r) {
+    if (!r.ok) return readyFuture(OpResult{false, r.error});
+    // mkfs.fat's cluster size is in sectors of this device.
+    QVariantMap fmtOpts = opts;
+    profile.addFormatOptions(fsType, FormatProfile::probeSectorBytes(deviceNodeOf(r.snapshot, blockObject)), supportsMkfsArgs(), &fmtOpts);
+
+    const Topology topo = Topology::build(r.snapshot);
+
+    // If the disk has partitions (common), format the primary partition instead of the whole disk.
+    const QString primaryPart = topo.primaryPartitionBlock(blockObject);
+    const QString fmtTarget = primaryPart.isEmpty() ? blockObject : primaryPart;
+
+    QFuture<OpResult> unmounted =
+        timedStep(this, QStringLiteral("unmount"), unmountSequentially(topo.mountedBlocksOnSameDrive(blockObject)));
+    return andThenIfOk(this, unmounted, [this, fmtTarget, fsType, fmtOpts]() {
+      return callBlockFormat(fmtTarget, fsType, fmtOpts, QStringLiteral("Format failed: "));
+    });
+  });
+}
+
+QFuture<OpResult> UDisks2::partitionAndFormatBlockAsync(const QString& blockObject,
+                                                        PartitionLayout::Table table,
+                                                        const QString& fsType,
+                                                        const QString& label,
+                                                        const QString& eraseMode,
+                                                        bool tearDown,
+                                                        const FormatProfile& profile) {
+  QVariantMap tableOpts;
+  if (!eraseMode.isEmpty()) tableOpts.insert("erase", eraseMode);
+  if (tearDown) tableOpts.insert("tear-down", true);
+  QVariantMap partOpts;
+  if (table == PartitionLayout::Table::Mbr) partOpts.insert("partition-type", QStringLiteral("primary"));
+  QVariantMap fsBase;
+  if (!label.isEmpty()) fsBase.insert("label", label);
+  fsBase.insert("take-ownership", true);
+
+  return andThen(this, fetchSnapshotAsync(), [=, this](const SnapshotResult& r) {
+    if (!r.ok) return readyFuture(OpResult{false, r.error});
+    QVariantMap fsOpts = fsBase;
+    profile.addFormatOptions(fsType, FormatProfile::probeSectorBytes(deviceNodeOf(r.snapshot, blockObject)), supportsMkfsArgs(), &fsOpts);
+
+    // Erase-block alignment from the disk's queue limits; the layout is fixed before anything is
+    // written, so a disk too small for it is refused untouched.
+    PartitionLayout layout;
+    const quint64 alignment = PartitionLayout::probeAlignment(deviceNodeOf(r.snapshot, blockObject), &layout.alignmentSource);
+    const quint64 diskBytes = r.snapshot.prop(blockObject, kBlockIface, "Size").toULongLong();
+    QString err;
+    if (!PartitionLayout::compute(diskBytes, alignment, table, &layout, &err)) {
+      return readyFuture(OpResult{false, "Partitioning failed: " + err});
+    }
+
+    QFuture<OpResult> unmounted =
+        timedStep(this, QStringLiteral("unmount"), unmountSequentially(Topology::build(r.snapshot).mountedBlocksOnSameDrive(blockObject)));
+    QFuture<OpResult> tabled = andThenIfOk(this, unmounted, [=, this]() {
+      QDBusMessage call = QDBusMessage::createMethodCall(kService, blockObject, kBlockIface, "Format");
+      call << PartitionLayout::tableName(table) << tableOpts;
+      return timedStep(this, QStringLiteral("partition-table"), callForResult(call, QStringLiteral("Creating the partition table failed: ")));
+    });
+    return andThenIfOk(this, tabled, [=, this]() {
+      // Partition and filesystem in one call: udisksd creates, waits for and formats the partition.
+      QDBusMessage call = QDBusMessage::createMethodCall(kService, blockObject, kPartitionTableIface, "CreatePartitionAndFormat");
+      call << layout.offset << layout.size << PartitionLayout::partitionType(table, fsType) << QString() << partOpts << fsType
+           << fsOpts;
+      QFuture<OpResult> created = timedStep(this, QStringLiteral("format"), callForResult(call, QStringLiteral("Format failed: ")));
+      return andThenIfOk(this, created, [this, blockObject, layout]() {
+        OpResult res{true, {}};
+        res.detail = layout.summary();
+        return rescanThen(blockObject, std::move(res));
+      });
+    });
+  });
+}
+
+QFuture<OpResult> UDisks2::wipeBlockAsync(const QString& blockObject, const QString& eraseMode, bool tearDown) {
+  QVariantMap opts;
+  if (!eraseMode.isEmpty()) opts.insert("erase", eraseMode);
+  if (tearDown) opts.insert("tear-down", true);
+
+  return andThenIfOk(this, unmountAllOnSameDriveAsync(blockObject), [this, blockObject, opts]() {
+    return callBlockFormat(blockObject, QStringLiteral("empty"), opts, QStringLiteral("Wipe (empty) failed: "));
+  });
+}
+
+QString UDisks2::version() const {
+  if (!versionRead_) {
+    version_ = getProp(kManagerPath, kManagerIface, "Version").toString();
+    versionRead_ = true;
+  }
+  return version_;
+}
+
+bool UDisks2::supportsMkfsArgs() const {
+  const QString v = version();
+  return v.isEmpty() || QVersionNumber::fromString(v) >= QVersionNumber(2, 10);
+}
+
+QString UDisks2::stackedUse(const Snapshot& snap, const QVector<Topology::Block>& blocks) {
+  QSet<QString> objects;
+  for (const Topology::Block& b : blocks) objects.insert(b.object);
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    if (objects.contains(objectPath(snap.prop(it.key(), kBlockIface, "CryptoBackingDevice")))) {
+      return "the unlocked encrypted volume " + deviceNodeOf(snap, it.key());
+    }
+  }
+  for (const QString& block : objects) {
+    const QString raid = objectPath(snap.prop(block, kBlockIface, "MDRaidMember"));
+    if (!raid.isEmpty() && raid != "/") return QStringLiteral("a RAID array");
+    if (snap.has(block, kPhysicalVolumeIface)) return QStringLiteral("an LVM volume group");
+  }
+  return {};
+}
+
+QFuture<OpResult> UDisks2::runOnUnmountedNodeAsync(const QString& blockObject,
+                                                   QThreadPool* pool,
+                                                   const QString& stepName,
+                                                   bool writable,
+                                                   std::function<OpResult(const QString&)> work) {
+  return andThen(this, fetchSnapshotAsync(), [=, this](const SnapshotResult& r) {
+    if (!r.ok) return readyFuture(OpResult{false, r.error});
+    const QString node = deviceNodeOf(r.snapshot, blockObject);
+    const Topology topo = Topology::build(r.snapshot);
+    const QString stacked = stackedUse(r.snapshot, topo.sameDrive(blockObject));
+    if (!stacked.isEmpty()) {
+      return readyFuture(OpResult{false, QString("%1 is in use by %2: lock or stop it first, or use the udisks engine "
+                                                 "(it tears such devices down).")
+                                             .arg(node, stacked)});
+    }
+
+    QFuture<OpResult> unmounted = timedStep(this, QStringLiteral("unmount"), unmountSequentially(topo.mountedBlocksOnSameDrive(blockObject)));
+    auto fd = std::make_shared<QDBusUnixFileDescriptor>();
+    QFuture<OpResult> opened = andThenIfOk(this, unmounted, [=, this]() {
+      // Exclusive like RawDevice's own open; udisks before 2.7.3 ignores "flags" (RawDevice then
+      // sets O_DIRECT itself).
+      QDBusMessage call = QDBusMessage::createMethodCall(kService, blockObject, kBlockIface, "OpenDevice");
+      call << (writable ? QStringLiteral("rw") : QStringLiteral("r")) << QVariantMap{{"flags", O_EXCL | O_DIRECT}};
+      return andThen(this, asyncCall(call, kLongCallTimeoutMs), [fd, node](const QDBusMessage& reply) {
+        if (reply.type() == QDBusMessage::ErrorMessage) {
+          return readyFuture(OpResult{false, QString("Opening %1 failed: %2").arg(node, reply.errorMessage())});
+        }
+        *fd = qdbus_cast<QDBusUnixFileDescriptor>(reply.arguments().value(0));
+        if (!fd->isValid()) return readyFuture(OpResult{false, QString("Opening %1 failed: no descriptor in the reply.").arg(node)});
+        return readyFuture(OpResult{true, {}});
+      });
+    });
+    return andThenIfOk(this, opened, [=, this]() {
+      QFuture<OpResult> done = timedStep(this, stepName, QtConcurrent::run(pool, [node, work, fd]() {
+        const int leased = ::fcntl(fd->fileDescriptor(), F_DUPFD_CLOEXEC, 0);
+        if (leased < 0) return OpResult{false, RawDevice::errnoMessage("dup of the UDisks OpenDevice descriptor")};
+        const RawDevice::Lease lease(node, leased);
+        return work(node);
+      }));
+      return andThen(this, done, [this, blockObject](OpResult res) { return rescanThen(blockObject, std::move(res)); });
+    });
+  });
+}
+
+QFuture<OpResult> UDisks2::zeroFillBlockAsync(const QString& blockObject,
+                                              const ZeroFill::Options& opts,
+                                              QThreadPool* pool,
+                                              IoProgressFn progress,
+                                              std::shared_ptr<WipeCheckpoint> checkpoints,
+                                              const WipeCheckpoint::Drive& drive) {
+  const QString step = opts.random ? QStringLiteral("random-fill") : QStringLiteral("zero-fill");
+  return runOnUnmountedNodeAsync(blockObject, pool, step, /*writable*/ true, [opts, progress, checkpoints, drive](const QString& node) {
+    OpResult res;
+    ZeroFill::Options fill = opts;
+    QString resumeNote;
+    const bool tracked = checkpoints && !drive.serial.isEmpty();
+    if (tracked && drive.resume) {
+      WipeCheckpoint::Entry entry;
+      if (checkpoints->find(drive.serial, drive.sizeBytes, &entry)) {
+        QString why;
+        if (WipeCheckpoint::recheck(node, entry.offset, opts.cancel, &why)) {
+          fill.offset = entry.offset;
+          resumeNote = QString("resumed at %1 (overlap re-checked)").arg(humanBytes(entry.offset));
+        } else {
+          resumeNote = QString("checkpoint at %1 not used (%2), started from the beginning").arg(humanBytes(entry.offset), why);
+        }
+      }
+    }
+    if (tracked) {
+      // A checkpoint that can't be saved only costs the resume; the wipe itself goes on.
+      fill.checkpoint = [checkpoints, drive, node](quint64 offset) {
+        WipeCheckpoint::Entry entry;
+        entry.serial = drive.serial;
+        entry.sizeBytes = drive.sizeBytes;
+        entry.offset = offset;
+        entry.deviceNode = node;
+        checkpoints->save(entry);
+      };
+    }
+
+    ZeroFill::Stats stats;
+    res.ok = ZeroFill::run(node, fill, progress, &stats, &res.error);
+    if (!res.ok) res.error = (opts.random ? "Random fill failed: " : "Zero-fill failed: ") + res.error;
+    if (res.ok && tracked) checkpoints->remove(drive.serial, drive.sizeBytes);
+    res.detail = stats.summary(fill);
+    if (!resumeNote.isEmpty()) res.detail += "; " + resumeNote;
+    if (!res.ok && tracked && stats.completeTo > 0) res.detail += QString("; checkpoint at %1").arg(humanBytes(stats.completeTo));
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::multiPassWipeBlockAsync(const QString& blockObject,
+                                                   const WipePasses& plan,
+                                                   const ZeroFill::Options& fill,
+                                                   const ZeroVerify::Options& verify,
+                                                   QThreadPool* pool,
+                                                   const std::function<IoProgressFn(const QString& label)>& progressFor) {
+  QFuture<OpResult> done = readyFuture(OpResult{true});
+  bool lastRandom = false;
+  for (int i = 0; i < plan.passes.size(); ++i) {
+    const WipePasses::Pass pass = plan.passes[i];
+    const QString label = QString("pass %1/%2: %3").arg(i + 1).arg(plan.passes.size()).arg(WipePasses::passName(pass));
+    const IoProgressFn progress = progressFor ? progressFor(label) : IoProgressFn();
+    if (pass == WipePasses::Pass::Verify) {
+      ZeroVerify::Options opts = verify;
+      opts.random = lastRandom;
+      opts.seed = plan.seed;
+      done = thenVerify(done, [=, this]() { return verifyZerosBlockAsync(blockObject, opts, pool, progress); });
+      continue;
+    }
+    ZeroFill::Options opts = fill;
+    opts.random = pass == WipePasses::Pass::Random;
+    opts.seed = plan.seed;
+    lastRandom = opts.random;
+    done = thenVerify(done, [=, this]() { return zeroFillBlockAsync(blockObject, opts, pool, progress); });
+  }
+  return done;
+}
+
+QFuture<OpResult> UDisks2::instantWipeBlockAsync(const QString& blockObject,
+                                                 const FastWipe::Options& opts,
+                                                 QThreadPool* pool,
+                                                 IoProgressFn progress) {
+  return runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("instant-wipe"), /*writable*/ true, [opts, progress](const QString& node) {
+    OpResult res;
+    FastWipe::Stats stats;
+    res.ok = FastWipe::run(node, opts, progress, &stats, &res.error);
+    if (!res.ok) res.error = "Instant wipe failed: " + res.error;
+    res.detail = stats.summary();
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::nativeFormatBlockAsync(const QString& blockObject,
+                                                  const FatFormat::Options& opts,
+                                                  QThreadPool* pool,
+                                                  IoProgressFn progress) {
+  return runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("format"), /*writable*/ true, [opts, progress](const QString& node) {
+    OpResult res;
+    FatFormat::Stats stats;
+    res.ok = FatFormat::run(node, opts, progress, &stats, &res.error);
+    if (!res.ok) res.error = "Format failed: " + res.error;
+    res.detail = stats.summary();
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::writeImageBlockAsync(const QString& blockObject,
+                                                const QString& imagePath,
+                                                const ImageWriter::Options& opts,
+                                                QThreadPool* pool,
+                                                IoProgressFn progress) {
+  return runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("write-image"), /*writable*/ true, [imagePath, opts, progress](const QString& node) {
+    OpResult res;
+    ImageWriter::Stats stats;
+    res.ok = ImageWriter::run(imagePath, node, opts, progress, &stats, &res.error);
+    if (!res.ok) res.error = "Image write failed: " + res.error;
+    res.detail = stats.summary(opts);
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::writeImageFanOutBlockAsync(const QString& blockObject,
+                                                      std::shared_ptr<ImageFanOut> fanOut,
+                                                      int index,
+                                                      QThreadPool* pool,
+                                                      IoProgressFn progress) {
+  QFuture<OpResult> written =
+      runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("write-image"), /*writable*/ true, [fanOut, index, progress](const QString& node) {
+        OpResult res;
+        ImageFanOut::Stats stats;
+        res.ok = fanOut->write(index, node, progress, &stats, &res.error);
+        if (!res.ok) res.error = "Image write failed: " + res.error;
+        res.detail = stats.summary(fanOut->options());
+        return res;
+      });
+  return andThen(this, written, [fanOut, index](OpResult res) {
+    fanOut->withdraw(index);
+    return readyFuture(std::move(res));
+  });
+}
+
+QFuture<OpResult> UDisks2::verifyZerosBlockAsync(const QString& blockObject,
+                                                 const ZeroVerify::Options& opts,
+                                                 QThreadPool* pool,
+                                                 IoProgressFn progress) {
+  return runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("verify"), /*writable*/ false, [opts, progress](const QString& node) {
+    OpResult res;
+    ZeroVerify::Report report;
+    res.ok = ZeroVerify::run(node, opts, progress, &report, &res.error);
+    if (!res.ok) {
+      res.error = "Verify failed: " + res.error;
+    } else if (!report.clean()) {
+      res.ok = false;
+      res.error = QString("Verify failed: %1 %2, first at offset %3")
+                      .arg(report.nonZeroSectors)
+                      .arg(opts.random ? QStringLiteral("sectors differ from the random stream") : QStringLiteral("non-zero sectors"))
+                      .arg(report.firstBadOffset);
+    }
+    res.detail = report.summary();
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::verifyAfter(const QString& blockObject,
+                                       QFuture<OpResult> wipe,
+                                       const ZeroVerify::Options& opts,
+                                       QThreadPool* pool,
+                                       IoProgressFn progress) {
+  return thenVerify(wipe, [=, this]() { return verifyZerosBlockAsync(blockObject, opts, pool, progress); });
+}
+
+QFuture<OpResult> UDisks2::verifyImageBlockAsync(const QString& blockObject,
+                                                 std::shared_ptr<ImageVerify::Source> source,
+                                                 QThreadPool* pool,
+                                                 IoProgressFn progress) {
+  return runOnUnmountedNodeAsync(blockObject, pool, QStringLiteral("verify"), /*writable*/ false, [source, progress](const QString& node) {
+    OpResult res;
+    const ImageVerify::Digest* digest = source->digest(&res.error);
+    if (!digest) {
+      res.error = "Verify failed: can't hash the image: " + res.error;
+      return res;
+    }
+    ImageVerify::Report report;
+    res.ok = ImageVerify::run(node, *digest, source->options(), progress, &report, &res.error);
+    if (!res.ok) {
+      res.error = "Verify failed: " + res.error;
+    } else if (report.badChunks > 0) {
+      res.ok = false;
+      res.error = QString("Verify failed: %1 chunk(s) differ from the image, first at offset %2")
+                      .arg(report.badChunks)
+                      .arg(report.badOffsets.value(0));
+    } else if (!report.clean()) {
+      res.ok = false;
+      res.error = QStringLiteral("Verify failed: the SHA-256 of the device differs from the image's");
+    }
+    res.detail = report.summary(*digest, source->options());
+    return res;
+  });
+}
+
+QFuture<OpResult> UDisks2::verifyImageAfter(const QString& blockObject,
+                                            QFuture<OpResult> write,
+                                            std::shared_ptr<ImageVerify::Source> source,
+                                            QThreadPool* pool,
+                                            IoProgressFn progress) {
+  return thenVerify(write, [=, this]() { return verifyImageBlockAsync(blockObject, source, pool, progress); });
+}
+
+QFuture<OpResult> UDisks2::thenVerify(QFuture<OpResult> done, std::function<QFuture<OpResult>()> verify) {
+  return andThen(this, done, [this, verify](OpResult first) -> QFuture<OpResult> {
+    if (!first.ok) return readyFuture(first);
+    return andThen(this, verify(), [first](OpResult verified) {
+      if (!first.detail.isEmpty()) verified.detail = first.detail + "; " + verified.detail;
+      verified.steps = first.steps + verified.steps;
+      return readyFuture(verified);
+    });
+  });
+}
@@ -1,29 +1,134 @@
 #pragma once
 
+#include "DeviceBackend.h"
+#include "FastWipe.h"
+#include "FatFormat.h"
+#include "FormatProfile.h"
+#include "ImageFanOut.h"
+#include "ImageVerify.h"
+#include "ImageWriter.h"
+#include "IoProgress.h"
+#include "OpResult.h"
+#include "PartitionLayout.h"
+#include "WipeCheckpoint.h"
+#include "WipePasses.h"
+#include "ZeroFill.h"
+#include "ZeroVerify.h"
+
+#include <QFuture>
+#include <QHash>
+#include <QMap>
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QVariantMap>
 #include <QVector>
 
-class UDisks2 final : public QObject {
+#include <functional>
+#include <memory>
+
+class QDBusConnection;
+class QDBusMessage;
+class QThreadPool;
+
+// The UDisks2 device backend (discovery through udisksd), and the client for every device
+// operation, whichever backend lists the devices.
+class UDisks2 final : public DeviceBackend {
   Q_OBJECT
 public:
-  struct UsbDevice {
-    QString blockObject;   // D-Bus object path for org.freedesktop.UDisks2.Block
-    QString driveObject;   // D-Bus object path for org.freedesktop.UDisks2.Drive
-    QString deviceNode;    // e.g. /dev/sdb
-    QString vendor;
-    QString model;
-    QString serial;
-    quint64 sizeBytes = 0;
-    bool readOnly = false;
+  using UsbDevice = ::UsbDevice;
+
+  // Interfaces and properties of one UDisks2 object, keyed by interface name.
+  using InterfaceMap = QMap<QString, QVariantMap>;
+
+  // Every UDisks2 object (blocks, drives, partitions, filesystems, jobs...) at one point in time,
+  // keyed by object path. Filled by a single ObjectManager.GetManagedObjects round trip, so
+  // looking things up here never touches the bus.
+  struct Snapshot {
+    QHash<QString, InterfaceMap> objects;
+
+    bool has(const QString& objPath, const QString& iface) const;
+    QVariant prop(const QString& objPath, const QString& iface, const QString& prop) const;
+  };
+
+  // Drive -> blocks -> partitions/filesystems/mount points, indexed from one snapshot in a single
+  // pass. Built once per operation, so the per-drive helpers (what to unmount, which partition to
+  // format) look their drive up instead of each rescanning every object in the system.
+  struct Topology {
+    struct Block {
+      QString object;
+      int partitionNumber = 0; // 0: not a partition (whole disk, or a superfloppy filesystem)
+      bool hasFilesystem = false;
+      QStringList mountPoints;
+    };
+
+    QHash<QString, QString> driveOf;              // block object -> drive object
+    QHash<QString, QVector<Block>> blocksOnDrive; // drive object -> its blocks, by object path
+    QHash<QString, Block> unattached;             // blocks without a drive (loop devices...)
+
+    static Topology build(const Snapshot& snap);
+
+    // `blockObject` and every other block of its drive.
+    QVector<Block> sameDrive(const QString& blockObject) const;
+    // Mounted filesystems on the drive of `blockObject`: the block itself first (superfloppy
+    // sticks), then the others.
+    QStringList mountedBlocksOnSameDrive(const QString& blockObject) const;
+    // The lowest-numbered partition on the drive of `blockObject`, or empty.
+    QString primaryPartitionBlock(const QString& blockObject) const;
+  };
+
+  // Result of the asynchronous enumeration calls.
+  struct SnapshotResult {
+    bool ok = false;
+    Snapshot snapshot;
+    QString error;
+  };
+  struct DeviceList {
+    QVector<UsbDevice> devices;
+    QString error; // same meaning as listUsbRemovable()'s `error`
   };
 
   explicit UDisks2(QObject* parent = nullptr);
 
+  // The bus udisksd is expected on: the system bus, unless FFROG_UDISKS_BUS says "session" or
+  // gives a D-Bus address (e.g. a private bus running the mock service from bench/).
+  static QDBusConnection bus();
+
+  // One GetManagedObjects call on the UDisks2 ObjectManager.
+  bool fetchSnapshot(Snapshot* out, QString* error = nullptr) const;
+
   // Lists *top-level* USB removable devices (pendrives/SD readers) only.
   // This intentionally filters out internal disks.
   QVector<UsbDevice> listUsbRemovable(QString* error = nullptr) const;
 
+  // Same filter as above, applied to an already fetched snapshot (no D-Bus traffic).
+  static QVector<UsbDevice> listUsbRemovable(const Snapshot& snap, QString* error = nullptr);
+
+  // Long-lived device cache. startWatching() subscribes to the ObjectManager
+  // InterfacesAdded/InterfacesRemoved and Properties.PropertiesChanged signals, then takes one
+  // snapshot; from there on the deltas are applied to the cache directly and devicesChanged()
+  // is emitted (coalesced) whenever a Block/Drive/Partition/Filesystem object changes.
+  bool startWatching(QString* error = nullptr) override;
+  bool isWatching() const { return watching_; }
+
+  // Replaces the cache with a fresh snapshot. Only needed as a rare consistency check
+  // (missed signals, udisksd restart); always emits devicesChanged().
+  bool resync(QString* error = nullptr) override;
+
+  const Snapshot& cache() const { return cache_; }
+
+  // listUsbRemovable() on the cache. No D-Bus traffic.
+  QVector<UsbDevice> cachedUsbRemovable(QString* error = nullptr) const;
+
+  QString name() const override { return QStringLiteral("udisks"); }
+
+  // Manager.Version, e.g. "2.10.1": read once (blocking) and cached; empty if it can't be read.
+  QString version() const;
+  // Format's `mkfs-args` option needs udisks 2.10; older versions silently ignore it. True when
+  // the version is unknown.
+  bool supportsMkfsArgs() const;
+  QVector<UsbDevice> devices(QString* error = nullptr) const override { return cachedUsbRemovable(error); }
+
   // Best-effort unmount for any mounted filesystem on the block.
   bool unmountIfMounted(const QString& blockObject, QString* error = nullptr) const;
 
@@ -51,7 +156,183 @@ public:
                  bool tearDown,
                  QString* error = nullptr) const;
 
+  // Asynchronous API: same semantics as the blocking calls above, built on QDBusPendingCall, so
+  // no thread waits for udisksd. Must be called on this object's thread (it needs the event
+  // loop); continuations run there too. Steps chain on the reply of the previous one:
+  // GetManagedObjects -> unmount -> Format -> Rescan.
+  QFuture<SnapshotResult> fetchSnapshotAsync();
+  QFuture<DeviceList> listUsbRemovableAsync();
+  QFuture<OpResult> resyncAsync() override;
+  QFuture<OpResult> unmountAllOnSameDriveAsync(const QString& blockObject);
+  // `profile` adds its mkfs tuning (FormatProfile) to the Format call.
+  QFuture<OpResult> formatBlockAsync(const QString& blockObject,
+                                     const QString& fsType,
+                                     const QString& label,
+                                     const QString& eraseMode,
+                                     bool tearDown,
+                                     const FormatProfile& profile = {});
+  // Format on a fresh layout instead of whatever the stick came with: unmounts the drive, creates
+  // a new MBR/GPT partition table (Block.Format, with `eraseMode` if set), then one partition
+  // aligned to the erase block (PartitionLayout, from sysfs or 4 MiB) with its filesystem in a
+  // single PartitionTable.CreatePartitionAndFormat call, then Rescans. The result's detail
+  // records the layout.
+  QFuture<OpResult> partitionAndFormatBlockAsync(const QString& blockObject,
+                                                 PartitionLayout::Table table,
+                                                 const QString& fsType,
+                                                 const QString& label,
+                                                 const QString& eraseMode,
+                                                 bool tearDown,
+                                                 const FormatProfile& profile = {});
+  QFuture<OpResult> wipeBlockAsync(const QString& blockObject, const QString& eraseMode, bool tearDown);
+
+  // Native full wipe: unmounts everything on the drive, zero-fills the whole-disk node in-process
+  // with ZeroFill on `pool` (instead of Format erase=zero), then Rescans. `progress` is called on
+  // the pool thread. The result's detail names the engine and the throughput.
+  // With `checkpoints`, progress is checkpointed under `drive` (removed once the fill completes);
+  // `drive.resume` continues from its checkpoint if the overlap re-check passes, and otherwise
+  // starts from byte zero, saying why in the detail.
+  QFuture<OpResult> zeroFillBlockAsync(const QString& blockObject,
+                                       const ZeroFill::Options& opts,
+                                       QThreadPool* pool,
+                                       IoProgressFn progress = {},
+                                       std::shared_ptr<WipeCheckpoint> checkpoints = {},
+                                       const WipeCheckpoint::Drive& drive = {});
+
+  // Multi-pass native wipe: one zeroFillBlockAsync() per write pass (random passes with
+  // `plan.seed`) and one verifyZerosBlockAsync() per verify pass, which checks the data of the
+  // write pass before it. Stops at the first failing pass; the result collects every pass's
+  // detail and steps. `progressFor(label)` gives each pass its reporter ("pass 1/3: random").
+  QFuture<OpResult> multiPassWipeBlockAsync(const QString& blockObject,
+                                            const WipePasses& plan,
+                                            const ZeroFill::Options& fill,
+                                            const ZeroVerify::Options& verify,
+                                            QThreadPool* pool,
+                                            const std::function<IoProgressFn(const QString& label)>& progressFor = {});
+
+  // Instant wipe: like zeroFillBlockAsync(), but with FastWipe, which picks the fastest method
+  // that still guarantees zeros (BLKZEROOUT, BLKDISCARD + read-check, written zeros). The
+  // result's detail records the method and the device's discard/write-zeroes limits.
+  QFuture<OpResult> instantWipeBlockAsync(const QString& blockObject,
+                                          const FastWipe::Options& opts,
+                                          QThreadPool* pool,
+                                          IoProgressFn progress = {});
+
+  // Native format: unmounts everything on the drive, writes a FAT32/exFAT filesystem over the
+  // whole-disk node in-process with FatFormat on `pool` (no mkfs, no partition table), then
+  // Rescans. The result's detail records the layout and the write count.
+  QFuture<OpResult> nativeFormatBlockAsync(const QString& blockObject,
+                                           const FatFormat::Options& opts,
+                                           QThreadPool* pool,
+                                           IoProgressFn progress = {});
+
+  // Image flash: unmounts everything on the drive, streams `imagePath` (.img/.iso, optionally
+  // gzip-compressed) onto the whole-disk node with ImageWriter on `pool`, then Rescans so the
+  // image's partitions show up. The result's detail records the size and the throughput.
+  QFuture<OpResult> writeImageBlockAsync(const QString& blockObject,
+                                         const QString& imagePath,
+                                         const ImageWriter::Options& opts,
+                                         QThreadPool* pool,
+                                         IoProgressFn progress = {});
+
+  // Fan-out image flash: like writeImageBlockAsync(), but the device is writer `index` of
+  // `fanOut`, which reads and inflates the image once for all the devices of the batch. The
+  // writer is withdrawn when the operation ends, also if it failed before writing.
+  QFuture<OpResult> writeImageFanOutBlockAsync(const QString& blockObject,
+                                               std::shared_ptr<ImageFanOut> fanOut,
+                                               int index,
+                                               QThreadPool* pool,
+                                               IoProgressFn progress = {});
+
+  // Read-back check after a wipe: reads the whole-disk node with ZeroVerify on `pool` and fails
+  // if any sector is not zero (not the random stream, with opts.random). The result's detail
+  // carries the verify summary.
+  QFuture<OpResult> verifyZerosBlockAsync(const QString& blockObject,
+                                          const ZeroVerify::Options& opts,
+                                          QThreadPool* pool,
+                                          IoProgressFn progress = {});
+
+  // Runs `verify()` (or any next step: a format after a wipe) once `done` succeeded; the result
+  // keeps done's detail and steps in front.
+  QFuture<OpResult> thenVerify(QFuture<OpResult> done, std::function<QFuture<OpResult>()> verify);
+
+  // Runs verifyZerosBlockAsync() once `wipe` succeeded. The result keeps the wipe's detail and
+  // steps in front of the verify's.
+  QFuture<OpResult> verifyAfter(const QString& blockObject,
+                                QFuture<OpResult> wipe,
+                                const ZeroVerify::Options& opts,
+                                QThreadPool* pool,
+                                IoProgressFn progress = {});
+
+  // Read-back check after an image write: reads the first image-size bytes of the whole-disk node
+  // with ImageVerify on `pool` and fails if any chunk differs from the image. `source` holds the
+  // image's hashes, computed by the first device of the batch that needs them. The result's detail
+  // is the verification record (hashes, duration, MB/s, mismatching offsets).
+  QFuture<OpResult> verifyImageBlockAsync(const QString& blockObject,
+                                          std::shared_ptr<ImageVerify::Source> source,
+                                          QThreadPool* pool,
+                                          IoProgressFn progress = {});
+
+  // Runs verifyImageBlockAsync() once `write` succeeded, like verifyAfter().
+  QFuture<OpResult> verifyImageAfter(const QString& blockObject,
+                                     QFuture<OpResult> write,
+                                     std::shared_ptr<ImageVerify::Source> source,
+                                     QThreadPool* pool,
+                                     IoProgressFn progress = {});
+
+Q_SIGNALS:
+  // A UDisks Job (format-erase, format-mkfs, ...) on `blockObject` reported progress. Emitted for
+  // watched caches only (startWatching()), from the Job's Progress/Rate/BytesTotal/
+  // ExpectedEndTime properties. `blockObject` is the whole-disk block, also when the job runs
+  // on one of its partitions.
+  void jobProgress(const QString& blockObject, const IoProgress& progress, const QString& operation);
+
+private Q_SLOTS:
+  void onInterfacesAdded(const QDBusMessage& msg);
+  void onInterfacesRemoved(const QDBusMessage& msg);
+  void onPropertiesChanged(const QDBusMessage& msg);
+
 private:
+  void scheduleDevicesChanged(const QString& iface);
+  void reportJob(const QString& jobPath);
+  void applySnapshot(SnapshotResult r);
+
+  // Async building blocks (see the public *Async() calls).
+  QFuture<OpResult> unmountSequentially(QStringList blocks);
+  // Sends `call` (no reply timeout) and turns an error reply into a failed result.
+  QFuture<OpResult> callForResult(const QDBusMessage& call, const QString& failPrefix);
+  QFuture<OpResult> callBlockFormat(const QString& target, const QString& fsType, const QVariantMap& opts,
+                                    const QString& failPrefix);
+
+  // Resolves the drive's whole-disk node, unmounts the drive, opens the node through
+  // Block.OpenDevice (polkit decides, as for the udisks engine; "rw" when `writable`, else "r"),
+  // runs `work(node)` on `pool` (timed as step `stepName`) with RawDevice opens of the node
+  // served by that descriptor, Rescans. Refuses drives that something is stacked on (see
+  // stackedUse()): the native engines have no tear-down.
+  QFuture<OpResult> runOnUnmountedNodeAsync(const QString& blockObject,
+                                            QThreadPool* pool,
+                                            const QString& stepName,
+                                            bool writable,
+                                            std::function<OpResult(const QString&)> work);
+  // "the unlocked encrypted volume /dev/dm-0", "a RAID array", "an LVM volume group": what uses
+  // one of `blocks` besides a mount; empty if nothing does.
+  static QString stackedUse(const Snapshot& snap, const QVector<Topology::Block>& blocks);
+  QFuture<OpResult> rescanThen(const QString& blockObject, OpResult result);
+
+  static bool parseSnapshot(const QDBusMessage& reply, Snapshot* out, QString* error);
+  // Blocking: Filesystem.Unmount on each of `blocks`, in order; "not mounted" is not an error.
+  bool unmountBlocks(const QStringList& blocks, QString* error) const;
+  static QStringList mountPoints(const QVariant& v);
+  static QStringList objectPaths(const QVariant& v);
+  static QString deviceNodeOf(const Snapshot& snap, const QString& blockObject);
+
   QVariant getProp(const QString& objPath, const QString& iface, const QString& prop, bool* ok = nullptr) const;
   static QString bytesToString(const QVariant& v);
+  static QString objectPath(const QVariant& v);
+
+  Snapshot cache_;
+  mutable QString version_;
+  mutable bool versionRead_ = false;
+  QString cacheError_;
+  bool watching_ = false;
+  bool changePending_ = false;
 };
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QRegularExpression>
+#include <QString>
+
+// One USB whole-disk device as listed to the user, whichever backend found it.
+struct UsbDevice {
+  QString blockObject;   // D-Bus object path for org.freedesktop.UDisks2.Block
+  QString driveObject;   // D-Bus object path for org.freedesktop.UDisks2.Drive (may be empty)
+  QString deviceNode;    // e.g. /dev/sdb
+  QString vendor;
+  QString model;
+  QString serial;
+  quint64 sizeBytes = 0;
+  bool readOnly = false;
+
+  friend bool operator==(const UsbDevice&, const UsbDevice&) = default;
+};
+
+// Safety: only whole-disk kernel names are ever offered, never partitions like sdb1.
+// Accepts sdX (letters only), nvmeXnY (whole namespace) and mmcblkX.
+inline bool isWholeDiskName(const QString& name) {
+  static const QRegularExpression kWholeDisk("^(sd[a-z]+|nvme\\d+n\\d+|mmcblk\\d+)$");
+  return kWholeDisk.match(name).hasMatch();
+}
+
+// UDisks2 object path of the Block for a kernel disk name (udisksd's naming for plain names).
+inline QString udisksBlockObject(const QString& name) {
+  return QStringLiteral("/org/freedesktop/UDisks2/block_devices/") + name;
+}
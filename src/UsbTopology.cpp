@@ -0,0 +1,61 @@
+#include "UsbTopology.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+namespace {
+
+QString readAttr(const QString& path) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return {};
+  return QString::fromUtf8(f.readAll()).trimmed();
+}
+
+// `speed` is in Mb/s, "1.5" for low-speed devices.
+int readSpeedMbps(const QString& dir) {
+  return static_cast<int>(readAttr(dir + "/speed").toDouble());
+}
+
+} // namespace
+
+UsbTopology UsbTopology::probe(const QString& deviceNode, const QString& sysRoot) {
+  UsbTopology t;
+  const QString name = QFileInfo(QFileInfo(deviceNode).canonicalFilePath()).fileName();
+  if (name.isEmpty()) return t;
+  // e.g. /sys/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1.3/2-1.3:1.0/host6/.../block/sdb
+  const QString path = QFileInfo(sysRoot + "/class/block/" + name).canonicalFilePath();
+  if (path.isEmpty()) return t;
+
+  bool rootHubSeen = false;
+  for (QDir up(path); !up.isRoot() && up.absolutePath() != sysRoot; up.cdUp()) {
+    const QString dir = up.absolutePath();
+    const QString entry = up.dirName();
+    if (rootHubSeen) {
+      // The root hub's parent is the host controller (a PCI function or a platform device);
+      // an xHCI controller carries both its USB 2 and its USB 3 bus.
+      t.links.push_back({"controller " + entry, 0, false});
+      break;
+    }
+    // Interfaces (2-1.3:1.0) have no busnum/speed; USB devices and hubs do.
+    if (!QFileInfo::exists(dir + "/busnum") || !QFileInfo::exists(dir + "/speed")) continue;
+    const int speed = readSpeedMbps(dir);
+    if (t.device.isEmpty()) {
+      t.device = entry;
+      t.speedMbps = speed;
+    } else if (entry.startsWith("usb")) {
+      t.links.push_back({"bus " + entry, speed, false});
+      rootHubSeen = true;
+    } else {
+      t.links.push_back({"hub " + entry, speed, true});
+    }
+  }
+  return t;
+}
+
+QString UsbTopology::describe() const {
+  if (!isUsb()) return QStringLiteral("not USB");
+  QStringList via;
+  for (const Link& l : links) via << (l.speedMbps ? QString("%1 (%2 Mb/s)").arg(l.id).arg(l.speedMbps) : l.id);
+  return QString("%1 @ %2 Mb/s via %3").arg(device).arg(speedMbps).arg(via.join(", "));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Where a USB disk hangs in the USB tree, read from its sysfs ancestry: the hubs between the
+// stick and the host, the root hub (bus) and the host controller. Sticks behind the same external
+// hub share its one upstream port (480 Mb/s for USB 2, 5/10 Gb/s for USB 3), so JobQueue limits
+// the concurrent jobs per link instead of only globally. Root hub ports have their own bandwidth
+// on xHCI, so buses and controllers only get a limit once throughput measurements call for one.
+struct UsbTopology {
+  struct Link {
+    QString id;         // "hub 2-1", "bus usb2", "controller 0000:00:14.0"
+    int speedMbps = 0;  // negotiated speed of the link; 0 = unknown (controllers)
+    bool hub = false;   // an external hub: everything behind it shares its upstream port
+  };
+
+  QString device;          // the stick's own USB device, e.g. "2-1.3"
+  int speedMbps = 0;       // the stick's negotiated speed
+  QVector<Link> links;     // shared links: nearest hub first, then the bus, then the controller
+
+  bool isUsb() const { return !device.isEmpty(); }
+
+  // Topology of a block device node (/dev/sdb or a /dev/disk/by-* symlink), from the USB devices
+  // (directories with `busnum` and `speed`) above <sysRoot>/class/block/<name>. Not a USB
+  // device: an empty topology.
+  static UsbTopology probe(const QString& deviceNode, const QString& sysRoot = QStringLiteral("/sys"));
+
+  // e.g. "2-1.3 @ 480 Mb/s via hub 2-1 (480 Mb/s), bus usb2 (480 Mb/s), controller 0000:00:14.0"
+  QString describe() const;
+};
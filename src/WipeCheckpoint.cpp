@@ -0,0 +1,135 @@
+#include "WipeCheckpoint.h"
+#include "IoProgress.h"
+#include "ZeroVerify.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QLockFile>
+#include <QMutex>
+#include <QSaveFile>
+
+#include <algorithm>
+
+namespace {
+
+// Jobs on the pool checkpoint concurrently; the lock file only serialises processes.
+QMutex gMutex;
+
+} // namespace
+
+QString WipeCheckpoint::Entry::describe() const {
+  QString s = humanBytes(offset) + " of " + humanBytes(sizeBytes);
+  if (sizeBytes) s += QString(" (%1%)").arg(100.0 * static_cast<double>(offset) / static_cast<double>(sizeBytes), 0, 'f', 1);
+  if (updated.isValid()) s += ", " + updated.toLocalTime().toString("yyyy-MM-dd HH:mm");
+  return s;
+}
+
+QString WipeCheckpoint::defaultPath() {
+  const QString env = qEnvironmentVariable("FFROG_WIPE_STATE");
+  if (!env.isEmpty()) return env;
+  QString state = qEnvironmentVariable("XDG_STATE_HOME");
+  if (state.isEmpty()) state = QDir::homePath() + "/.local/state";
+  return state + "/ffrog/wipe-checkpoints.json";
+}
+
+WipeCheckpoint::WipeCheckpoint(const QString& path) : path_(path) {}
+
+QString WipeCheckpoint::key(const QString& serial, quint64 sizeBytes) {
+  return serial + '/' + QString::number(sizeBytes);
+}
+
+QJsonObject WipeCheckpoint::load() const {
+  QFile f(path_);
+  if (!f.open(QIODevice::ReadOnly)) return {};
+  return QJsonDocument::fromJson(f.readAll()).object();
+}
+
+bool WipeCheckpoint::store(const QJsonObject& root, QString* error) {
+  QSaveFile f(path_);
+  if (!f.open(QIODevice::WriteOnly)) {
+    if (error) *error = QString("Cannot write %1: %2").arg(path_, f.errorString());
+    return false;
+  }
+  f.write(QJsonDocument(root).toJson());
+  if (!f.commit()) {
+    if (error) *error = QString("Cannot write %1: %2").arg(path_, f.errorString());
+    return false;
+  }
+  return true;
+}
+
+bool WipeCheckpoint::find(const QString& serial, quint64 sizeBytes, Entry* out) const {
+  if (serial.isEmpty()) return false;
+  QMutexLocker locker(&gMutex);
+  const QJsonObject o = load().value(key(serial, sizeBytes)).toObject();
+  if (o.isEmpty()) return false;
+  out->serial = serial;
+  out->sizeBytes = sizeBytes;
+  out->offset = static_cast<quint64>(o.value("offset").toInteger());
+  out->deviceNode = o.value("device").toString();
+  out->updated = QDateTime::fromString(o.value("updated").toString(), Qt::ISODate);
+  return out->offset > 0 && out->offset < sizeBytes;
+}
+
+bool WipeCheckpoint::save(const Entry& entry, QString* error) {
+  if (entry.serial.isEmpty()) return false;
+  QMutexLocker locker(&gMutex);
+  if (!QDir().mkpath(QFileInfo(path_).absolutePath())) {
+    if (error) *error = QString("Cannot create the directory of %1.").arg(path_);
+    return false;
+  }
+  QLockFile lock(path_ + ".lock");
+  if (!lock.tryLock(5000)) {
+    if (error) *error = QString("Cannot lock %1.").arg(path_);
+    return false;
+  }
+  QJsonObject root = load();
+  root.insert(key(entry.serial, entry.sizeBytes),
+              QJsonObject{{"serial", entry.serial},
+                          {"sizeBytes", static_cast<qint64>(entry.sizeBytes)},
+                          {"offset", static_cast<qint64>(entry.offset)},
+                          {"device", entry.deviceNode},
+                          {"updated", (entry.updated.isValid() ? entry.updated : QDateTime::currentDateTimeUtc()).toString(Qt::ISODate)}});
+  return store(root, error);
+}
+
+bool WipeCheckpoint::remove(const QString& serial, quint64 sizeBytes, QString* error) {
+  if (serial.isEmpty()) return true;
+  QMutexLocker locker(&gMutex);
+  if (!QFileInfo::exists(path_)) return true;
+  QLockFile lock(path_ + ".lock");
+  if (!lock.tryLock(5000)) {
+    if (error) *error = QString("Cannot lock %1.").arg(path_);
+    return false;
+  }
+  QJsonObject root = load();
+  if (!root.contains(key(serial, sizeBytes))) return true;
+  root.remove(key(serial, sizeBytes));
+  return store(root, error);
+}
+
+bool WipeCheckpoint::recheck(const QString& devicePath, quint64 offset, const std::atomic_bool* cancel, QString* why) {
+  ZeroVerify::Options opts;
+  opts.cancel = cancel;
+  const quint64 head = std::min<quint64>(1ull << 20, offset);
+  const quint64 windowStart = offset > kOverlapBytes ? offset - kOverlapBytes : 0;
+  const QList<QPair<quint64, quint64>> ranges{{0, head}, {windowStart, offset - windowStart}};
+  for (const auto& [from, length] : ranges) {
+    if (length == 0) continue;
+    opts.offset = from;
+    opts.length = length;
+    ZeroVerify::Report report;
+    QString error;
+    if (!ZeroVerify::run(devicePath, opts, {}, &report, &error)) {
+      if (why) *why = "re-check failed: " + error;
+      return false;
+    }
+    if (!report.clean()) {
+      if (why) *why = QString("non-zero data at offset %1").arg(report.firstBadOffset);
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QDateTime>
+#include <QJsonObject>
+#include <QString>
+
+#include <atomic>
+
+// Progress checkpoints of native zero-fills, so that the next full wipe of the same drive can
+// continue where an interrupted one stopped (stick pulled, ffrog closed, reboot) instead of
+// from byte zero. One small JSON file under the user's state directory, keyed by drive serial
+// and size; updates are atomic (QSaveFile) and serialised across processes with a lock file.
+// Drives without a serial are never checkpointed: nothing identifies them safely.
+class WipeCheckpoint final {
+public:
+  struct Entry {
+    QString serial;
+    quint64 sizeBytes = 0;
+    quint64 offset = 0;  // every byte below is zeroed and was flushed to the drive
+    QString deviceNode;  // informational: where it was last seen
+    QDateTime updated;
+
+    // e.g. "112.4 GB of 256.0 GB (43.9%), 2026-10-15 14:02"
+    QString describe() const;
+  };
+
+  // What a zero-fill job checkpoints under, and whether it continues from the saved entry.
+  struct Drive {
+    QString serial;
+    quint64 sizeBytes = 0;
+    bool resume = false;
+  };
+
+  // Bytes re-checked below a checkpoint before resuming from it.
+  static constexpr quint64 kOverlapBytes = 64ull << 20;
+
+  // $FFROG_WIPE_STATE, else $XDG_STATE_HOME/ffrog/wipe-checkpoints.json (~/.local/state/...).
+  static QString defaultPath();
+
+  explicit WipeCheckpoint(const QString& path = defaultPath());
+  const QString& path() const { return path_; }
+
+  // False if the drive has no checkpoint (or no serial).
+  bool find(const QString& serial, quint64 sizeBytes, Entry* out) const;
+  bool save(const Entry& entry, QString* error = nullptr);
+  bool remove(const QString& serial, quint64 sizeBytes, QString* error = nullptr);
+
+  // Reads back the kOverlapBytes below `offset` and the drive's first MiB (where a partition
+  // table written since would be) and checks they are zeros. Blocking. False with `why` (e.g.
+  // "non-zero data at offset 1048576") if the checkpoint can't be trusted.
+  static bool recheck(const QString& devicePath, quint64 offset, const std::atomic_bool* cancel, QString* why);
+
+private:
+  static QString key(const QString& serial, quint64 sizeBytes);
+  QJsonObject load() const;
+  bool store(const QJsonObject& root, QString* error);
+
+  QString path_;
+};
@@ -0,0 +1,45 @@
+#include "WipePasses.h"
+
+#include <QStringList>
+
+bool WipePasses::parse(const QString& spec, WipePasses* out, QString* error) {
+  QVector<Pass> passes;
+  for (const QString& part : spec.split(',', Qt::SkipEmptyParts)) {
+    const QString name = part.trimmed().toLower();
+    if (name == "random") {
+      passes << Pass::Random;
+    } else if (name == "zero" || name == "zeros") {
+      passes << Pass::Zero;
+    } else if (name == "verify") {
+      if (passes.isEmpty()) {
+        if (error) *error = QStringLiteral("A verify pass needs a write pass before it.");
+        return false;
+      }
+      passes << Pass::Verify;
+    } else {
+      if (error) *error = QString("Unknown wipe pass \"%1\" (random, zero or verify).").arg(part.trimmed());
+      return false;
+    }
+  }
+  if (passes.isEmpty()) {
+    if (error) *error = QStringLiteral("No wipe passes given.");
+    return false;
+  }
+  out->passes = passes;
+  return true;
+}
+
+QString WipePasses::passName(Pass pass) {
+  switch (pass) {
+    case Pass::Random: return QStringLiteral("random");
+    case Pass::Zero: return QStringLiteral("zero");
+    case Pass::Verify: return QStringLiteral("verify");
+  }
+  return {};
+}
+
+QString WipePasses::spec() const {
+  QStringList names;
+  for (Pass p : passes) names << passName(p);
+  return names.join(',');
+}
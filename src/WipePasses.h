@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+// A multi-pass overwrite for the native wipe engine, e.g. "random,zero,verify": write passes
+// (RandomFill data or zeros) and read-back checks of the pass before them. A random pass is
+// reproducible from its seed, which goes into the job's log and result, so it can be
+// verified (here, or later by regenerating the stream).
+struct WipePasses {
+  enum class Pass { Random, Zero, Verify };
+
+  QVector<Pass> passes{Pass::Zero};
+  quint64 seed = 0;
+
+  // Comma separated pass names; the first pass can't be a verify.
+  static bool parse(const QString& spec, WipePasses* out, QString* error = nullptr);
+  static QString passName(Pass pass);
+
+  bool hasRandom() const { return passes.contains(Pass::Random); }
+  // Just one zero pass: the plain zero-fill, which can be checkpointed and resumed.
+  bool isSingleZero() const { return passes == QVector<Pass>{Pass::Zero}; }
+
+  // e.g. "random,zero,verify"
+  QString spec() const;
+
+  // A read-back check of the final write pass (--verify, "verify after wipe"): appends a verify
+  // pass, unless the plan already ends with one. It expects the random stream when the last
+  // write was random, which a plain zero check after the wipe would report as bad sectors.
+  void addFinalVerify() {
+    if (passes.isEmpty() || passes.constLast() != Pass::Verify) passes << Pass::Verify;
+  }
+};
@@ -0,0 +1,130 @@
+#include "ZeroCheck.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FFROG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using ScanFn = void (*)(const char*, std::size_t, std::size_t, ZeroCheck::Result*);
+
+inline void account(ZeroCheck::Result* r, std::size_t offset) {
+  if (r->firstNonZero < 0) r->firstNonZero = static_cast<qint64>(offset);
+  ++r->nonZeroSectors;
+}
+
+bool sectorIsZeroScalar(const char* p, std::size_t n) {
+  std::size_t i = 0;
+  std::uint64_t acc = 0;
+  for (; i + 8 <= n; i += 8) {
+    std::uint64_t v;
+    std::memcpy(&v, p + i, 8);
+    acc |= v;
+  }
+  for (; i < n; ++i) acc |= static_cast<unsigned char>(p[i]);
+  return acc == 0;
+}
+
+void scanScalar(const char* buf, std::size_t len, std::size_t sector, ZeroCheck::Result* r) {
+  for (std::size_t off = 0; off < len; off += sector) {
+    const std::size_t n = len - off < sector ? len - off : sector;
+    if (!sectorIsZeroScalar(buf + off, n)) account(r, off);
+  }
+}
+
+#ifdef FFROG_X86
+__attribute__((target("sse2"))) void scanSse2(const char* buf, std::size_t len, std::size_t sector, ZeroCheck::Result* r) {
+  const std::size_t full = len - len % sector;
+  for (std::size_t off = 0; off < full; off += sector) {
+    const char* p = buf + off;
+    // Four independent accumulators keep the loads pipelined.
+    __m128i a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+    for (std::size_t i = 0; i < sector; i += 64) {
+      a0 = _mm_or_si128(a0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+      a1 = _mm_or_si128(a1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16)));
+      a2 = _mm_or_si128(a2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 32)));
+      a3 = _mm_or_si128(a3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 48)));
+    }
+    const __m128i acc = _mm_or_si128(_mm_or_si128(a0, a1), _mm_or_si128(a2, a3));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) account(r, off);
+  }
+  if (full < len && !sectorIsZeroScalar(buf + full, len - full)) account(r, full);
+}
+
+__attribute__((target("avx2"))) void scanAvx2(const char* buf, std::size_t len, std::size_t sector, ZeroCheck::Result* r) {
+  const std::size_t full = len - len % sector;
+  for (std::size_t off = 0; off < full; off += sector) {
+    const char* p = buf + off;
+    __m256i a0 = _mm256_setzero_si256(), a1 = a0;
+    for (std::size_t i = 0; i < sector; i += 64) {
+      a0 = _mm256_or_si256(a0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+      a1 = _mm256_or_si256(a1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32)));
+    }
+    const __m256i acc = _mm256_or_si256(a0, a1);
+    if (!_mm256_testz_si256(acc, acc)) account(r, off);
+  }
+  if (full < len && !sectorIsZeroScalar(buf + full, len - full)) account(r, full);
+}
+#endif
+
+ScanFn kernelFn(ZeroCheck::Kernel k) {
+  switch (k) {
+#ifdef FFROG_X86
+    case ZeroCheck::Kernel::Avx2: return scanAvx2;
+    case ZeroCheck::Kernel::Sse2: return scanSse2;
+#endif
+    default: return scanScalar;
+  }
+}
+
+} // namespace
+
+bool ZeroCheck::isSupported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Auto:
+    case Kernel::Scalar:
+      return true;
+#ifdef FFROG_X86
+    case Kernel::Avx2:
+      return __builtin_cpu_supports("avx2");
+    case Kernel::Sse2:
+      return __builtin_cpu_supports("sse2");
+#endif
+    default:
+      return false;
+  }
+}
+
+ZeroCheck::Kernel ZeroCheck::best() {
+  static const Kernel k = isSupported(Kernel::Avx2)   ? Kernel::Avx2
+                          : isSupported(Kernel::Sse2) ? Kernel::Sse2
+                                                      : Kernel::Scalar;
+  return k;
+}
+
+QString ZeroCheck::name(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Auto: return name(best());
+    case Kernel::Avx2: return QStringLiteral("avx2");
+    case Kernel::Sse2: return QStringLiteral("sse2");
+    case Kernel::Scalar: return QStringLiteral("scalar");
+  }
+  return {};
+}
+
+ZeroCheck::Kernel ZeroCheck::resolve(Kernel kernel, std::size_t sectorSize) {
+  // The vector kernels read whole 64-byte blocks up to the end of each sector.
+  if (sectorSize % 64 != 0) return Kernel::Scalar;
+  return kernel == Kernel::Auto || !isSupported(kernel) ? best() : kernel;
+}
+
+ZeroCheck::Result ZeroCheck::scan(const char* buf, std::size_t len, std::size_t sectorSize, Kernel kernel) {
+  Result r;
+  if (sectorSize == 0) return r;
+  kernelFn(resolve(kernel, sectorSize))(buf, len, sectorSize, &r);
+  return r;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QString>
+
+#include <cstddef>
+
+// Zero-detection kernels for read-back verification. The widest kernel the CPU supports
+// (AVX2, SSE2, scalar) is picked at runtime; the others stay callable for benchmarking.
+class ZeroCheck final {
+public:
+  enum class Kernel { Auto, Avx2, Sse2, Scalar };
+
+  struct Result {
+    quint64 nonZeroSectors = 0;
+    qint64 firstNonZero = -1; // byte offset (within the buffer) of the first non-zero sector
+  };
+
+  // Scans `len` bytes as `sectorSize`-byte sectors (a short last sector counts as one). The
+  // vector kernels step 64 bytes at a time; other sector sizes use the scalar kernel.
+  static Result scan(const char* buf, std::size_t len, std::size_t sectorSize, Kernel kernel = Kernel::Auto);
+
+  // A sector size callers accept: a power of two, >= 64.
+  static bool isValidSectorSize(quint64 sectorSize) { return sectorSize >= 64 && (sectorSize & (sectorSize - 1)) == 0; }
+
+  // The kernel scan() runs for `kernel` and `sectorSize`: Auto or an unsupported kernel gives
+  // best(), a sector size that isn't a multiple of 64 the scalar kernel.
+  static Kernel resolve(Kernel kernel, std::size_t sectorSize);
+
+  static bool isSupported(Kernel kernel);
+  static Kernel best();
+  static QString name(Kernel kernel);
+};
@@ -0,0 +1,347 @@
+#include "ZeroFill.h"
+#include "RandomFill.h"
+#include "RawDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef FFROG_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+// State shared by both write engines.
+struct FillJob {
+  int fd = -1;
+  const char* zeros = nullptr;
+  bool random = false; // each pwrite worker fills its own buffer with RandomFill(seed)
+  quint64 seed = 0;
+  quint64 chunk = 0;
+  quint64 start = 0;
+  quint64 end = 0;
+  int depth = 1;
+  const std::atomic_bool* cancel = nullptr;
+  std::atomic<quint64> done{0};
+  // Set by the engines when they return: every write below it completed.
+  quint64 complete = 0;
+
+  const std::function<void(quint64)>* checkpoint = nullptr;
+  std::chrono::milliseconds checkpointEvery{0};
+  std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+
+  bool cancelled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+
+  // `completeBelow` must be computed before the call: the flush then covers those writes.
+  void maybeCheckpoint(quint64 completeBelow) {
+    if (!checkpoint || !*checkpoint) return;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastCheckpoint < checkpointEvery) return;
+    lastCheckpoint = now;
+    // Only what is on the device counts, past the page cache and the stick's write cache.
+    if (::fdatasync(fd) == 0) (*checkpoint)(completeBelow);
+  }
+};
+
+constexpr quint64 kIdle = ~0ull;
+
+bool fillWithPwrite(FillJob& job, IoProgressMeter& meter, QString* error) {
+  std::atomic<quint64> next{job.start};
+  std::atomic_bool failed{false};
+  std::mutex mu;
+  std::condition_variable cv;
+  int running = job.depth;
+  QString firstError;
+
+  // Per worker, a lower bound of the chunk it is writing (kIdle when it has none). A worker
+  // publishes next's value before taking a chunk, so reading `next` first and then these never
+  // misses a write in flight. A failed chunk keeps its bound.
+  std::vector<std::atomic<quint64>> busy(static_cast<std::size_t>(job.depth));
+  for (auto& b : busy) b.store(kIdle);
+  auto completeBelow = [&]() {
+    quint64 below = std::min(next.load(), job.end);
+    for (const auto& b : busy) below = std::min(below, b.load());
+    return below;
+  };
+
+  auto worker = [&](std::atomic<quint64>& bound) {
+    AlignedBuffer own;
+    if (job.random) {
+      own = AlignedBuffer(job.chunk);
+      if (own.isNull()) {
+        std::lock_guard<std::mutex> lock(mu);
+        if (!failed.exchange(true)) firstError = QString("Can't allocate a %1-byte I/O buffer.").arg(job.chunk);
+      }
+    }
+    bool ok = true;
+    while (ok && !failed.load(std::memory_order_relaxed) && !job.cancelled()) {
+      bound.store(next.load());
+      quint64 off = next.fetch_add(job.chunk);
+      if (off >= job.end) break;
+      quint64 len = std::min(job.chunk, job.end - off);
+      const char* src = job.zeros;
+      if (job.random) {
+        RandomFill::fill(own.data(), len, job.seed, off);
+        src = own.data();
+      }
+      while (len > 0) {
+        const ssize_t n = ::pwrite(job.fd, src, len, static_cast<off_t>(off));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          const QString msg = n < 0 ? RawDevice::errnoMessage(QString("pwrite at offset %1").arg(off))
+                                    : QString("pwrite at offset %1 wrote nothing (device full?)").arg(off);
+          std::lock_guard<std::mutex> lock(mu);
+          if (!failed.exchange(true)) firstError = msg;
+          ok = false;
+          break;
+        }
+        job.done.fetch_add(static_cast<quint64>(n), std::memory_order_relaxed);
+        off += static_cast<quint64>(n);
+        len -= static_cast<quint64>(n);
+        // Zeros are zeros at any position; random data continues where the write stopped.
+        if (job.random) src += n;
+      }
+    }
+    if (ok) bound.store(kIdle);
+    std::lock_guard<std::mutex> lock(mu);
+    --running;
+    cv.notify_all();
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(job.depth);
+  for (auto& b : busy) threads.emplace_back(worker, std::ref(b));
+
+  // The calling thread only reports progress.
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    while (running > 0) {
+      cv.wait_for(lock, std::chrono::milliseconds(200));
+      lock.unlock();
+      meter.update(job.done.load(std::memory_order_relaxed));
+      job.maybeCheckpoint(completeBelow());
+      lock.lock();
+    }
+  }
+  for (auto& t : threads) t.join();
+  job.complete = completeBelow();
+
+  if (failed) {
+    if (error) *error = firstError;
+    return false;
+  }
+  return true;
+}
+
+#ifdef FFROG_HAVE_LIBURING
+// Returns 1 on success, 0 on an I/O error, -1 if io_uring is unavailable (caller falls back).
+int fillWithIoUring(FillJob& job, IoProgressMeter& meter, QString* error) {
+  io_uring ring;
+  if (io_uring_queue_init(static_cast<unsigned>(job.depth), &ring, 0) < 0) return -1;
+
+  struct Slot {
+    quint64 off = 0;
+    quint64 len = 0;
+    quint64 written = 0;
+    bool busy = false; // in flight, or failed
+  };
+  std::vector<Slot> slots(job.depth);
+  std::vector<int> freeSlots;
+  for (int i = job.depth - 1; i >= 0; --i) freeSlots.push_back(i);
+
+  auto queueWrite = [&](int i) {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    const Slot& s = slots[i];
+    // Every write uses the same zero buffer, so a resubmitted partial write needs no offset into it.
+    io_uring_prep_write(sqe, job.fd, job.zeros, static_cast<unsigned>(s.len - s.written), s.off + s.written);
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<std::uintptr_t>(i)));
+  };
+
+  quint64 next = job.start;
+  int inflight = 0;
+  bool failed = false;
+  QString firstError;
+
+  auto completeBelow = [&]() {
+    quint64 below = std::min(next, job.end);
+    for (const Slot& s : slots) {
+      if (s.busy) below = std::min(below, s.off + s.written);
+    }
+    return below;
+  };
+
+  for (;;) {
+    while (!failed && !job.cancelled() && !freeSlots.empty() && next < job.end) {
+      const int i = freeSlots.back();
+      freeSlots.pop_back();
+      slots[i] = Slot{next, std::min(job.chunk, job.end - next), 0, true};
+      next += slots[i].len;
+      queueWrite(i);
+      ++inflight;
+    }
+    if (inflight == 0) break;
+    io_uring_submit(&ring);
+
+    io_uring_cqe* cqe = nullptr;
+    const int rc = io_uring_wait_cqe(&ring, &cqe);
+    if (rc == -EINTR) continue;
+    if (rc < 0) {
+      // Can't reap anything anymore; the in-flight writes die with the ring.
+      errno = -rc;
+      firstError = RawDevice::errnoMessage("io_uring_wait_cqe");
+      failed = true;
+      break;
+    }
+    const int i = static_cast<int>(reinterpret_cast<std::uintptr_t>(io_uring_cqe_get_data(cqe)));
+    const int res = cqe->res;
+    io_uring_cqe_seen(&ring, cqe);
+
+    Slot& s = slots[i];
+    if (res == -EINTR || res == -EAGAIN) {
+      if (!failed) {
+        queueWrite(i);
+        continue;
+      }
+    } else if (res <= 0) {
+      if (!failed) {
+        errno = -res;
+        firstError = res < 0 ? RawDevice::errnoMessage(QString("write at offset %1").arg(s.off + s.written))
+                             : QString("write at offset %1 wrote nothing (device full?)").arg(s.off + s.written);
+      }
+      failed = true;
+    } else {
+      s.written += static_cast<quint64>(res);
+      job.done.fetch_add(static_cast<quint64>(res), std::memory_order_relaxed);
+      if (s.written < s.len && !failed) {
+        queueWrite(i);
+        continue;
+      }
+      if (s.written == s.len) s.busy = false;
+    }
+    freeSlots.push_back(i);
+    --inflight;
+    meter.update(job.done.load(std::memory_order_relaxed));
+    job.maybeCheckpoint(completeBelow());
+  }
+
+  io_uring_queue_exit(&ring);
+  job.complete = completeBelow();
+  if (failed) {
+    if (error) *error = firstError;
+    return 0;
+  }
+  return 1;
+}
+#endif
+
+} // namespace
+
+QString ZeroFill::Stats::summary(const Options& opts) const {
+  const double mb = static_cast<double>(bytesWritten) / 1e6;
+  return QString("%1, %2, %3 MiB x %4, %5 MB in %6 s (%7 MB/s)")
+      .arg(engine)
+      .arg(direct ? QStringLiteral("O_DIRECT") : QStringLiteral("buffered"))
+      .arg(static_cast<double>(opts.chunkBytes) / (1 << 20), 0, 'f', 1)
+      .arg(opts.queueDepth)
+      .arg(mb, 0, 'f', 1)
+      .arg(seconds, 0, 'f', 1)
+      .arg(seconds > 0 ? mb / seconds : 0.0, 0, 'f', 1);
+}
+
+bool ZeroFill::run(const QString& path,
+                   const Options& opts,
+                   const IoProgressFn& progress,
+                   Stats* stats,
+                   QString* error) {
+  RawDevice dev;
+  if (!dev.open(path, RawDevice::Mode::Write, opts.direct, error)) return false;
+
+  const quint64 align = dev.alignment();
+  quint64 end = opts.length ? opts.offset + opts.length : dev.size();
+  if (dev.isBlockDevice()) end = std::min(end, dev.size());
+  // Starting a little early is harmless for a wipe and keeps O_DIRECT offsets aligned.
+  const quint64 start = alignDown(opts.offset, align);
+  if (start >= end) {
+    if (error) *error = QString("Nothing to write on %1 (size %2 bytes).").arg(path).arg(dev.size());
+    return false;
+  }
+
+  const quint64 chunk = alignUp(std::max<quint64>(opts.chunkBytes, align), align);
+  AlignedBuffer zeros(chunk);
+  if (zeros.isNull()) {
+    if (error) *error = QString("Can't allocate a %1-byte I/O buffer.").arg(chunk);
+    return false;
+  }
+
+  FillJob job;
+  job.fd = dev.fd();
+  job.zeros = zeros.data();
+  job.random = opts.random;
+  job.seed = opts.seed;
+  job.chunk = chunk;
+  job.start = start;
+  // O_DIRECT needs aligned lengths: the aligned body goes through the fast engines, an odd
+  // tail (regular files only; block devices are sector-sized) is written buffered below.
+  job.end = dev.isDirect() ? alignDown(end, align) : end;
+  job.depth = std::max(1, opts.queueDepth);
+  job.cancel = opts.cancel;
+  job.complete = start;
+  job.checkpoint = &opts.checkpoint;
+  job.checkpointEvery = std::chrono::milliseconds(opts.checkpointMs);
+
+  const bool direct = dev.isDirect();
+  IoProgressMeter meter(end - start, progress);
+  QString engine = QStringLiteral("pwrite");
+  bool ok = true;
+  if (job.end > job.start) {
+    int rc = -1;
+#ifdef FFROG_HAVE_LIBURING
+    if (opts.useIoUring && !opts.random) {
+      rc = fillWithIoUring(job, meter, error);
+      if (rc >= 0) engine = QStringLiteral("io_uring");
+    }
+#endif
+    if (rc < 0) rc = fillWithPwrite(job, meter, error) ? 1 : 0;
+    ok = rc == 1;
+  }
+  if (opts.random) engine += QString(", random %1 seed %2").arg(RandomFill::name(RandomFill::Kernel::Auto), RandomFill::seedName(opts.seed));
+
+  if (ok && !job.cancelled() && job.end < end) {
+    const quint64 tail = end - job.end;
+    if (opts.random) RandomFill::fill(zeros.data(), tail, opts.seed, job.end);
+    ok = dev.setDirect(false) && ::pwrite(dev.fd(), zeros.data(), tail, static_cast<off_t>(job.end)) == static_cast<ssize_t>(tail);
+    if (!ok && error) *error = RawDevice::errnoMessage(QString("pwrite of the %1-byte tail").arg(tail));
+    if (ok) {
+      job.done.fetch_add(tail);
+      job.complete = end;
+    }
+  }
+
+  if (ok && job.cancelled()) {
+    if (error) *error = QStringLiteral("Zero-fill cancelled.");
+    ok = false;
+  }
+  // Flush even after a failure/cancel so the bytes counted as written really are on the device.
+  const bool synced = dev.sync(ok ? error : nullptr);
+  if (!synced) ok = false;
+  if (synced && opts.checkpoint) opts.checkpoint(job.complete);
+  meter.update(job.done.load(), /*force*/ true);
+
+  if (stats) {
+    stats->engine = engine;
+    stats->direct = direct;
+    stats->bytesWritten = job.done.load();
+    stats->completeTo = job.complete;
+    stats->seconds = meter.elapsedSeconds();
+  }
+  return ok;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "IoProgress.h"
+
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+// In-process zero-fill of a whole block device (or a regular file / loop device, for testing
+// and benchmarking). Writes one shared, page-aligned zero buffer with O_DIRECT, keeping
+// `queueDepth` writes in flight through io_uring when ffrog was built with liburing and the
+// kernel allows it, otherwise through `queueDepth` pwrite() worker threads.
+// With `random`, it writes RandomFill's stream for `seed` instead (a random overwrite pass):
+// always on the pwrite workers, each generating its own chunk, so generation runs on
+// `queueDepth` cores.
+// Blocking: run it on a worker thread.
+class ZeroFill final {
+public:
+  struct Options {
+    quint64 chunkBytes = 4ull << 20; // bytes per write (rounded up to the device alignment)
+    int queueDepth = 8;              // writes in flight
+    bool direct = true;              // O_DIRECT (silently buffered where unsupported)
+    bool useIoUring = true;          // false = always use the pwrite thread pool
+    quint64 offset = 0;              // first byte to write (rounded down to the alignment)
+    quint64 length = 0;              // 0 = up to the end of the device/file
+    bool random = false;             // RandomFill data instead of zeros
+    quint64 seed = 0;                // the random stream's seed (log it to verify the pass)
+    const std::atomic_bool* cancel = nullptr;
+    // Resume support: every `checkpointMs` the device is flushed and `checkpoint` is called (on
+    // the filling thread) with an offset below which every byte is written and on the device;
+    // once more at the end, also after a failure or cancel.
+    std::function<void(quint64 offset)> checkpoint;
+    int checkpointMs = 10000;
+  };
+
+  struct Stats {
+    QString engine; // "io_uring" or "pwrite" ("pwrite, random avx2 seed 0x..." for a random pass)
+    bool direct = false;
+    quint64 bytesWritten = 0;
+    quint64 completeTo = 0; // everything below this offset was written (the resume point)
+    double seconds = 0;
+
+    // e.g. "io_uring, O_DIRECT, 4.0 MiB x 8, 16008.1 MB in 412.3 s (38.8 MB/s)"
+    QString summary(const Options& opts) const;
+  };
+
+  static bool run(const QString& path,
+                  const Options& opts,
+                  const IoProgressFn& progress = {},
+                  Stats* stats = nullptr,
+                  QString* error = nullptr);
+};
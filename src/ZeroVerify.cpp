@@ -0,0 +1,153 @@
+#include "ZeroVerify.h"
+#include "RandomFill.h"
+#include "RawDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// The sectors of `buf` (read at device offset `off`) that differ from the random stream.
+ZeroCheck::Result diffRandom(const char* buf, char* expected, std::size_t len, std::size_t sector, quint64 seed, quint64 off) {
+  RandomFill::fill(expected, len, seed, off);
+  ZeroCheck::Result r;
+  for (std::size_t pos = 0; pos < len; pos += sector) {
+    const std::size_t n = std::min(sector, len - pos);
+    if (std::memcmp(buf + pos, expected + pos, n) == 0) continue;
+    if (r.firstNonZero < 0) r.firstNonZero = static_cast<qint64>(pos);
+    ++r.nonZeroSectors;
+  }
+  return r;
+}
+
+} // namespace
+
+QString ZeroVerify::Report::summary() const {
+  const double mb = static_cast<double>(bytesChecked) / 1e6;
+  QString s = QString("verify: %1 MB read back in %2 s (%3 MB/s, %4), %5 %6")
+                  .arg(mb, 0, 'f', 1)
+                  .arg(seconds, 0, 'f', 1)
+                  .arg(seconds > 0 ? mb / seconds : 0.0, 0, 'f', 1)
+                  .arg(kernel)
+                  .arg(nonZeroSectors)
+                  .arg(random ? QStringLiteral("sectors differ from the random stream") : QStringLiteral("non-zero sectors"));
+  if (firstBadOffset >= 0) s += QString(", first at offset %1").arg(firstBadOffset);
+  return s;
+}
+
+bool ZeroVerify::run(const QString& path,
+                     const Options& opts,
+                     const IoProgressFn& progress,
+                     Report* report,
+                     QString* error) {
+  if (!ZeroCheck::isValidSectorSize(opts.sectorSize)) {
+    if (error) *error = QString("Invalid sector size %1 (a power of two, at least 64).").arg(opts.sectorSize);
+    return false;
+  }
+  RawDevice dev;
+  if (!dev.open(path, RawDevice::Mode::Read, /*direct*/ true, error)) return false;
+
+  const quint64 size = opts.length ? std::min(dev.size(), opts.offset + opts.length) : dev.size();
+  const quint64 start = std::min(alignDown(opts.offset, dev.alignment()), size);
+  const quint64 chunk = alignUp(std::max(opts.chunkBytes, dev.alignment()), dev.alignment());
+  const std::size_t sector = static_cast<std::size_t>(opts.sectorSize);
+  const int depth = std::max(1, opts.queueDepth);
+
+  std::atomic<quint64> next{start};
+  std::atomic<quint64> done{0};
+  std::atomic<quint64> nonZero{0};
+  std::atomic_bool failed{false};
+  std::mutex mu;
+  std::condition_variable cv;
+  int running = depth;
+  qint64 firstBad = -1;
+  QString firstError;
+
+  auto cancelled = [&opts]() { return opts.cancel && opts.cancel->load(std::memory_order_relaxed); };
+
+  auto worker = [&]() {
+    AlignedBuffer buf(chunk);
+    AlignedBuffer expected(opts.random ? chunk : 0);
+    if (buf.isNull() || (opts.random && expected.isNull())) {
+      std::lock_guard<std::mutex> lock(mu);
+      if (!failed.exchange(true)) firstError = QString("Can't allocate a %1-byte read buffer.").arg(chunk);
+    }
+    while (!failed.load(std::memory_order_relaxed) && !cancelled()) {
+      const quint64 off = next.fetch_add(chunk);
+      if (off >= size) break;
+      const std::size_t len = static_cast<std::size_t>(std::min(chunk, size - off));
+      // O_DIRECT only does whole aligned blocks: a regular file's odd tail is read as one
+      // rounded-up direct read into the (chunk-sized, aligned) buffer, which stops at EOF.
+      const bool tail = dev.isDirect() && len % dev.alignment() != 0;
+      std::size_t got = 0;
+      while (got < len) {
+        const std::size_t want = tail ? alignUp(len, dev.alignment()) - got : len - got;
+        const ssize_t n = ::pread(dev.fd(), buf.data() + got, want, static_cast<off_t>(off + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += static_cast<std::size_t>(n);
+      }
+      if (got < len) {
+        std::lock_guard<std::mutex> lock(mu);
+        if (!failed.exchange(true)) firstError = RawDevice::errnoMessage(QString("read at offset %1").arg(off));
+        break;
+      }
+
+      const ZeroCheck::Result r = opts.random ? diffRandom(buf.data(), expected.data(), len, sector, opts.seed, off)
+                                              : ZeroCheck::scan(buf.data(), len, sector, opts.kernel);
+      if (r.nonZeroSectors) {
+        nonZero.fetch_add(r.nonZeroSectors, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mu);
+        const qint64 at = static_cast<qint64>(off) + r.firstNonZero;
+        if (firstBad < 0 || at < firstBad) firstBad = at;
+      }
+      done.fetch_add(len, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(mu);
+    --running;
+    cv.notify_all();
+  };
+
+  IoProgressMeter meter(size - start, progress);
+  std::vector<std::thread> threads;
+  threads.reserve(depth);
+  for (int i = 0; i < depth; ++i) threads.emplace_back(worker);
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    while (running > 0) {
+      cv.wait_for(lock, std::chrono::milliseconds(200));
+      lock.unlock();
+      meter.update(done.load(std::memory_order_relaxed));
+      lock.lock();
+    }
+  }
+  for (auto& t : threads) t.join();
+  meter.update(done.load(), /*force*/ true);
+
+  if (report) {
+    report->bytesChecked = done.load();
+    report->nonZeroSectors = nonZero.load();
+    report->firstBadOffset = firstBad;
+    report->seconds = meter.elapsedSeconds();
+    report->kernel = opts.random ? "random " + RandomFill::name(RandomFill::Kernel::Auto) : ZeroCheck::name(ZeroCheck::resolve(opts.kernel, sector));
+    report->random = opts.random;
+  }
+  if (failed) {
+    if (error) *error = firstError;
+    return false;
+  }
+  if (cancelled()) {
+    if (error) *error = QStringLiteral("Verify cancelled.");
+    return false;
+  }
+  return true;
+}
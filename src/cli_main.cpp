@@ -0,0 +1,11 @@
+#include "Cli.h"
+
+#include <QCoreApplication>
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("ffrog-cli");
+  QCoreApplication::setApplicationVersion("1.7");
+  Cli cli;
+  return cli.run(app.arguments());
+}
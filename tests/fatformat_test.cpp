@@ -0,0 +1,105 @@
+// The native FAT32/exFAT formatter (src/FatFormat.*) checked by the filesystem tools: formats
+// sparse image files on both sides of every default cluster-size boundary (and with explicit
+// cluster sizes) and fails if `fsck.vfat -n` / `fsck.exfat -n` reports anything. Skipped when
+// the fsck tool for a type is not installed.
+
+#include "FatFormat.h"
+
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+constexpr quint64 MiB = 1ull << 20;
+constexpr quint64 GiB = 1ull << 30;
+
+QString findTool(const QStringList& names) {
+  for (const QString& n : names) {
+    QString path = QStandardPaths::findExecutable(n);
+    if (path.isEmpty()) path = QStandardPaths::findExecutable(n, {"/usr/sbin", "/sbin"});
+    if (!path.isEmpty()) return path;
+  }
+  return {};
+}
+
+QString fsckFor(FatFormat::Type type) {
+  return type == FatFormat::Type::Fat32 ? findTool({"fsck.vfat", "fsck.fat", "dosfsck"}) : findTool({"fsck.exfat", "exfatfsck"});
+}
+
+} // namespace
+
+Q_DECLARE_METATYPE(FatFormat::Type)
+
+class FatFormatTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void fsckClean_data() {
+    QTest::addColumn<FatFormat::Type>("type");
+    QTest::addColumn<quint64>("size");
+    QTest::addColumn<quint32>("cluster"); // 0: the default for the size
+
+    const auto fat32 = FatFormat::Type::Fat32;
+    const auto exfat = FatFormat::Type::ExFat;
+    // FAT32 defaults change at 260 MiB, 8, 16 and 32 GiB; exFAT's at 256 MiB and 32 GiB.
+    for (quint64 edge : {260 * MiB, 8 * GiB, 16 * GiB, 32 * GiB}) {
+      QTest::addRow("vfat %llu MiB", edge / MiB) << fat32 << edge << 0u;
+      QTest::addRow("vfat %llu MiB", edge / MiB + 1) << fat32 << edge + MiB << 0u;
+    }
+    for (quint64 edge : {256 * MiB, 32 * GiB}) {
+      QTest::addRow("exfat %llu MiB", edge / MiB) << exfat << edge << 0u;
+      QTest::addRow("exfat %llu MiB", edge / MiB + 1) << exfat << edge + MiB << 0u;
+    }
+    QTest::newRow("vfat 64 MiB") << fat32 << 64 * MiB << 0u;
+    QTest::newRow("vfat 128 GiB") << fat32 << 128 * GiB << 0u;
+    QTest::newRow("exfat 64 MiB") << exfat << 64 * MiB << 0u;
+    QTest::newRow("exfat 128 GiB") << exfat << 128 * GiB << 0u;
+    // Explicit cluster sizes at the ends of each type's range.
+    QTest::newRow("vfat 1 GiB, 64 KiB clusters") << fat32 << 1 * GiB << (64u << 10);
+    QTest::newRow("vfat 1 GiB, 512 B clusters") << fat32 << 1 * GiB << 512u;
+    QTest::newRow("exfat 8 GiB, 4 KiB clusters") << exfat << 8 * GiB << (4u << 10);
+    QTest::newRow("exfat 8 GiB, 1 MiB clusters") << exfat << 8 * GiB << (1u << 20);
+  }
+
+  void fsckClean() {
+    QFETCH(FatFormat::Type, type);
+    QFETCH(quint64, size);
+    QFETCH(quint32, cluster);
+
+    const QString fsck = fsckFor(type);
+    if (fsck.isEmpty()) QSKIP("no fsck tool for this filesystem");
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("volume.img");
+    {
+      QFile f(path);
+      QVERIFY(f.open(QIODevice::WriteOnly));
+      QVERIFY2(f.resize(static_cast<qint64>(size)), qPrintable(f.errorString())); // sparse
+    }
+
+    FatFormat::Options opts;
+    opts.type = type;
+    opts.label = "FFROG TEST";
+    opts.clusterBytes = cluster;
+    FatFormat::Stats stats;
+    QString err;
+    QVERIFY2(FatFormat::run(path, opts, {}, &stats, &err), qPrintable(err));
+    if (cluster) QCOMPARE(stats.layout.clusterBytes, cluster);
+    else QCOMPARE(stats.layout.clusterBytes, FatFormat::defaultClusterBytes(type, size));
+
+    QProcess proc;
+    proc.setProcessChannelMode(QProcess::MergedChannels);
+    proc.start(fsck, {"-n", path});
+    QVERIFY(proc.waitForFinished(-1));
+    const QByteArray log = proc.readAll();
+    QVERIFY2(proc.exitStatus() == QProcess::NormalExit && proc.exitCode() == 0,
+             qPrintable(QString("%1 (%2): %3").arg(stats.layout.describe(), fsck, QString::fromLocal8Bit(log))));
+  }
+};
+
+QTEST_GUILESS_MAIN(FatFormatTest)
+#include "fatformat_test.moc"
@@ -0,0 +1,173 @@
+// UDisks2::Topology checked against the old per-call mountedBlocksOnSameDrive/
+// primaryPartitionBlock/sameDrive logic (a scan of every object per call), on synthetic
+// GetManagedObjects snapshots: a partitioned stick with mounted partitions, a superfloppy stick
+// (filesystem on the whole disk) and a block without a drive.
+
+#include "UDisks2.h"
+
+#include <QDBusObjectPath>
+#include <QSet>
+#include <QTest>
+
+#include <limits>
+
+namespace {
+
+constexpr const char* kBlock = "org.freedesktop.UDisks2.Block";
+constexpr const char* kPartition = "org.freedesktop.UDisks2.Partition";
+constexpr const char* kFilesystem = "org.freedesktop.UDisks2.Filesystem";
+const QString kBlocks = QStringLiteral("/org/freedesktop/UDisks2/block_devices/");
+const QString kDrives = QStringLiteral("/org/freedesktop/UDisks2/drives/");
+
+// One Block object; `partition` > 0 adds a Partition interface, `mounts` (empty list allowed) a
+// Filesystem interface.
+void addBlock(UDisks2::Snapshot* snap, const QString& name, const QString& drive, int partition = 0,
+              const QStringList* mounts = nullptr) {
+  UDisks2::InterfaceMap ifaces;
+  ifaces.insert(kBlock, QVariantMap{{"Drive", QVariant::fromValue(QDBusObjectPath(drive.isEmpty() ? "/" : kDrives + drive))},
+                                    {"Device", QByteArray("/dev/" + name.toLatin1())}});
+  if (partition > 0) ifaces.insert(kPartition, QVariantMap{{"Number", partition}});
+  if (mounts) {
+    QList<QByteArray> raw;
+    for (const QString& m : *mounts) raw << m.toUtf8();
+    ifaces.insert(kFilesystem, QVariantMap{{"MountPoints", QVariant::fromValue(raw)}});
+  }
+  snap->objects.insert(kBlocks + name, ifaces);
+}
+
+QString driveOf(const UDisks2::Snapshot& snap, const QString& block) {
+  return qvariant_cast<QDBusObjectPath>(snap.prop(block, kBlock, "Drive")).path();
+}
+
+bool mounted(const UDisks2::Snapshot& snap, const QString& block) {
+  return !qvariant_cast<QList<QByteArray>>(snap.prop(block, kFilesystem, "MountPoints")).isEmpty();
+}
+
+// The helpers as they were before Topology: a scan of every object per call.
+QStringList oldMountedBlocksOnSameDrive(const UDisks2::Snapshot& snap, const QString& blockObject) {
+  QStringList out;
+  if (mounted(snap, blockObject)) out.push_back(blockObject);
+  const QString drivePath = driveOf(snap, blockObject);
+  if (drivePath.isEmpty() || drivePath == "/") return out;
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    const QString& p = it.key();
+    if (p == blockObject) continue;
+    if (driveOf(snap, p) != drivePath) continue;
+    if (mounted(snap, p)) out.push_back(p);
+  }
+  return out;
+}
+
+QString oldPrimaryPartitionBlock(const UDisks2::Snapshot& snap, const QString& blockObject) {
+  const QString drivePath = driveOf(snap, blockObject);
+  if (drivePath.isEmpty() || drivePath == "/") return {};
+  int bestNum = std::numeric_limits<int>::max();
+  QString bestPath;
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    const QString& p = it.key();
+    if (!snap.has(p, kPartition)) continue;
+    if (driveOf(snap, p) != drivePath) continue;
+    const int num = snap.prop(p, kPartition, "Number").toInt();
+    if (num > 0 && num < bestNum) {
+      bestNum = num;
+      bestPath = p;
+    }
+  }
+  return bestPath;
+}
+
+QSet<QString> oldSameDrive(const UDisks2::Snapshot& snap, const QString& blockObject) {
+  const QString drivePath = driveOf(snap, blockObject);
+  if (drivePath.isEmpty() || drivePath == "/") return snap.objects.contains(blockObject) ? QSet<QString>{blockObject} : QSet<QString>{};
+  QSet<QString> out;
+  for (auto it = snap.objects.cbegin(); it != snap.objects.cend(); ++it) {
+    if (driveOf(snap, it.key()) == drivePath) out.insert(it.key());
+  }
+  return out;
+}
+
+// sdb: MBR stick, sdb2 and sdb5 mounted, sdb1 not. sdc: superfloppy, mounted. sdd: a second
+// stick with its own partition. loop0: no drive, mounted.
+UDisks2::Snapshot sampleSnapshot() {
+  UDisks2::Snapshot snap;
+  const QStringList none;
+  const QStringList media{"/media/a"};
+  const QStringList two{"/media/b", "/mnt/b"};
+  addBlock(&snap, "sdb", "Stick_B");
+  addBlock(&snap, "sdb1", "Stick_B", 1, &none);
+  addBlock(&snap, "sdb2", "Stick_B", 2, &media);
+  addBlock(&snap, "sdb5", "Stick_B", 5, &two);
+  addBlock(&snap, "sdc", "Stick_C", 0, &media);
+  addBlock(&snap, "sdd", "Stick_D");
+  addBlock(&snap, "sdd1", "Stick_D", 1, &media);
+  addBlock(&snap, "loop0", QString(), 0, &media);
+  return snap;
+}
+
+QSet<QString> objects(const QVector<UDisks2::Topology::Block>& blocks) {
+  QSet<QString> out;
+  for (const auto& b : blocks) out.insert(b.object);
+  return out;
+}
+
+} // namespace
+
+class TopologyTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void matchesOldHelpers_data() {
+    QTest::addColumn<QString>("block");
+    QTest::newRow("partitioned whole disk") << kBlocks + "sdb";
+    QTest::newRow("partition of it") << kBlocks + "sdb5";
+    QTest::newRow("superfloppy") << kBlocks + "sdc";
+    QTest::newRow("other stick") << kBlocks + "sdd";
+    QTest::newRow("no drive") << kBlocks + "loop0";
+    QTest::newRow("unknown block") << kBlocks + "sdz";
+  }
+
+  void matchesOldHelpers() {
+    QFETCH(QString, block);
+    const UDisks2::Snapshot snap = sampleSnapshot();
+    const UDisks2::Topology topo = UDisks2::Topology::build(snap);
+
+    // The block itself first, then the others (their order was the hash order before).
+    const QStringList got = topo.mountedBlocksOnSameDrive(block);
+    const QStringList want = oldMountedBlocksOnSameDrive(snap, block);
+    QCOMPARE(QSet<QString>(got.cbegin(), got.cend()), QSet<QString>(want.cbegin(), want.cend()));
+    QCOMPARE(got.size(), want.size());
+    if (!want.isEmpty() && want.first() == block) QCOMPARE(got.first(), block);
+
+    QCOMPARE(topo.primaryPartitionBlock(block), oldPrimaryPartitionBlock(snap, block));
+    QCOMPARE(objects(topo.sameDrive(block)), oldSameDrive(snap, block));
+  }
+
+  void partitionedStick() {
+    const UDisks2::Topology topo = UDisks2::Topology::build(sampleSnapshot());
+    QCOMPARE(topo.mountedBlocksOnSameDrive(kBlocks + "sdb"), (QStringList{kBlocks + "sdb2", kBlocks + "sdb5"}));
+    QCOMPARE(topo.mountedBlocksOnSameDrive(kBlocks + "sdb5"), (QStringList{kBlocks + "sdb5", kBlocks + "sdb2"}));
+    QCOMPARE(topo.primaryPartitionBlock(kBlocks + "sdb"), kBlocks + "sdb1");
+    QCOMPARE(topo.sameDrive(kBlocks + "sdb").size(), 4);
+  }
+
+  void superfloppy() {
+    const UDisks2::Topology topo = UDisks2::Topology::build(sampleSnapshot());
+    QCOMPARE(topo.mountedBlocksOnSameDrive(kBlocks + "sdc"), QStringList{kBlocks + "sdc"});
+    QVERIFY(topo.primaryPartitionBlock(kBlocks + "sdc").isEmpty());
+    const auto blocks = topo.sameDrive(kBlocks + "sdc");
+    QCOMPARE(blocks.size(), 1);
+    QVERIFY(blocks.first().hasFilesystem);
+    QCOMPARE(blocks.first().partitionNumber, 0);
+  }
+
+  void blockWithoutDrive() {
+    const UDisks2::Topology topo = UDisks2::Topology::build(sampleSnapshot());
+    QCOMPARE(topo.mountedBlocksOnSameDrive(kBlocks + "loop0"), QStringList{kBlocks + "loop0"});
+    QVERIFY(topo.primaryPartitionBlock(kBlocks + "loop0").isEmpty());
+    QCOMPARE(topo.sameDrive(kBlocks + "loop0").size(), 1);
+    QVERIFY(!topo.driveOf.contains(kBlocks + "loop0"));
+  }
+};
+
+QTEST_GUILESS_MAIN(TopologyTest)
+#include "topology_test.moc"